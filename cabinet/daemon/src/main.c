@@ -0,0 +1,243 @@
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cabinet-shm.h"
+#include "cabinet-usb.h"
+#include "time_.h"
+
+#include "options.h"
+
+/* Delay before retrying a failed cycle, e.g. while a device reconnects */
+#define ERROR_RETRY_DELAY_MS 10
+
+/* Max. number of events read per monitor update */
+#define MONITOR_EVENTS_MAX 64
+
+static volatile bool interrupted = false;
+
+// -----------------------------------------------------------------------------------------
+
+static void sig_handler(int sig)
+{
+  interrupted = true;
+}
+
+static void sleep_ms(int32_t time_ms)
+{
+  usleep(time_ms * 1000);
+}
+
+static bool setup_sched(uint8_t priority)
+{
+  struct sched_param param;
+
+  if (priority == 0) {
+    return true;
+  }
+
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+
+  if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+    perror("Setting SCHED_FIFO failed");
+    return false;
+  }
+
+  // Avoid page faults on the polling loop
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    perror("Locking memory failed");
+    return false;
+  }
+
+  return true;
+}
+
+// -----------------------------------------------------------------------------------------
+
+static void proc_run(const struct options *options)
+{
+  void *usb;
+  void *shm;
+  result_t result;
+  struct cabinet_output output;
+  struct cabinet_state state;
+  struct cabinet_shm_state shm_state;
+  uint64_t errors;
+
+  memset(&output, 0, sizeof(output));
+  memset(&state, 0, sizeof(state));
+  memset(&shm_state, 0, sizeof(shm_state));
+
+  result = cabinet_usb_open(&usb, options->piuio_id, options->piubtn_id);
+
+  if (RESULT_IS_ERROR(result)) {
+    errno = result;
+    perror("Opening cabinet failed");
+    exit(EXIT_FAILURE);
+  }
+
+  result = cabinet_shm_create(&shm, options->shm_name);
+
+  if (RESULT_IS_ERROR(result)) {
+    errno = result;
+    perror("Creating shared memory failed");
+    cabinet_usb_close(usb);
+    exit(EXIT_FAILURE);
+  }
+
+  if (!setup_sched(options->sched_priority)) {
+    cabinet_shm_destroy(shm);
+    cabinet_usb_close(usb);
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(
+      stderr, "Publishing to %s, CTRL + C to stop\n", options->shm_name);
+
+  errors = 0;
+
+  while (!interrupted) {
+    result = cabinet_usb_poll(usb, &output, &state);
+
+    if (RESULT_IS_ERROR(result)) {
+      // Report once per error streak, keep polling until the device is back
+      if (errors++ == 0) {
+        errno = result;
+        perror("Running update cycle for cabinet failed");
+      }
+
+      cabinet_shm_publish_error(shm, pumpio_time_now_ns(), result);
+      sleep_ms(ERROR_RETRY_DELAY_MS);
+      continue;
+    }
+
+    if (errors > 0) {
+      fprintf(stderr, "Recovered after %lu failed cycles\n", errors);
+      errors = 0;
+    }
+
+    shm_state.time_ns = pumpio_time_now_ns();
+    shm_state.piuio_state = state.piuio_state;
+    shm_state.piuio = state.piuio;
+    shm_state.piubtn = state.piubtn;
+
+    cabinet_shm_publish(shm, &shm_state);
+
+    if (options->delay_ms > 0) {
+      sleep_ms(options->delay_ms);
+    }
+  }
+
+  cabinet_shm_destroy(shm);
+  cabinet_usb_close(usb);
+}
+
+static const char *device_name(enum cabinet_shm_device device)
+{
+  return device == CABINET_SHM_DEVICE_PIUBTN ? "piubtn" : "piuio";
+}
+
+static void proc_monitor(const struct options *options)
+{
+  void *shm;
+  result_t result;
+  struct cabinet_shm_state state;
+  struct cabinet_shm_status status;
+  struct cabinet_shm_event events[MONITOR_EVENTS_MAX];
+  uint64_t start_ns;
+  uint64_t read_ns;
+  uint64_t lost;
+  uint32_t count;
+
+  result = cabinet_shm_open(&shm, options->shm_name);
+
+  if (RESULT_IS_ERROR(result)) {
+    errno = result;
+    perror("Attaching to shared memory failed");
+    exit(EXIT_FAILURE);
+  }
+
+  while (!interrupted) {
+    do {
+      count = cabinet_shm_read_events(shm, events, MONITOR_EVENTS_MAX, &lost);
+
+      if (lost > 0) {
+        printf("lost %lu events\n", lost);
+      }
+
+      for (uint32_t i = 0; i < count; i++) {
+        printf(
+            "event %lu cycle %lu %-6s pressed %016lX released %016lX\n",
+            events[i].seq,
+            events[i].cycle,
+            device_name(events[i].device),
+            events[i].pressed,
+            events[i].released);
+      }
+    } while (count == MONITOR_EVENTS_MAX);
+
+    start_ns = pumpio_time_now_ns();
+    result = cabinet_shm_read_state(shm, &state);
+    read_ns = pumpio_time_now_ns() - start_ns;
+
+    if (RESULT_IS_ERROR(result)) {
+      errno = result;
+      perror("Reading state failed");
+      sleep_ms(options->delay_ms);
+      continue;
+    }
+
+    cabinet_shm_status(shm, &status);
+
+    printf(
+        "state cycle %lu age %.3f ms piuio %016lX piubtn %02X | daemon %u "
+        "readers %u errors %lu lost %lu read %lu ns\n",
+        state.cycle,
+        state.cycle > 0 ? (pumpio_time_now_ns() - state.time_ns) / 1e6 : 0.0,
+        state.piuio_state,
+        state.piubtn.raw[0],
+        status.daemon_pid,
+        status.readers,
+        status.errors,
+        status.lost,
+        read_ns);
+
+    sleep_ms(options->delay_ms);
+  }
+
+  cabinet_shm_close(shm);
+}
+
+// -----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+  struct options options;
+
+  signal(SIGINT, sig_handler);
+  signal(SIGTERM, sig_handler);
+
+  if (!parse_args(&options, argc, argv)) {
+    print_usage(argv);
+    return EXIT_FAILURE;
+  }
+
+  if (options.mode == MODE_RUN) {
+    proc_run(&options);
+  } else if (options.mode == MODE_MONITOR) {
+    proc_monitor(&options);
+  } else {
+    fprintf(stderr, "Invalid parameters selected\n");
+    print_usage(argv);
+  }
+
+  return EXIT_SUCCESS;
+}
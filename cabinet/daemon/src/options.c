@@ -0,0 +1,152 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cabinet-shm.h"
+
+#include "options.h"
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+static void options_init_defaults(struct options *options)
+{
+  assert(options != NULL);
+
+  options->mode = MODE_RUN;
+  options->shm_name = CABINET_SHM_NAME_DEFAULT;
+  options->delay_ms = 0;
+  options->sched_priority = 0;
+  options->piuio_id = NULL;
+  options->piubtn_id = NULL;
+}
+
+void print_usage(char **argv)
+{
+  printf(
+      "cabinet-daemon tool, build " __DATE__ " " __TIME__ " gitrev %s\n",
+      STRINGIFY(GITREV));
+  printf("Usage: %s [OPTION] ...\n", argv[0]);
+  printf(
+      "  -h  Print this help/usage message\n"
+      "  -m  Mode (default: run)\n"
+      "        run: Poll the devices of the cabinet and publish their state "
+      "to shared memory\n"
+      "        monitor: Attach to the shared memory of a running daemon as a "
+      "reader and print its state, events and status\n"
+      "  -s  Name of the shared memory segment (default: "
+      CABINET_SHM_NAME_DEFAULT ")\n"
+      "  -d  Delay between two cycles in ms, 0 to poll at full rate (default: "
+      "0), print interval in monitor mode (default: 100)\n"
+      "  -r  Run the polling loop with SCHED_FIFO at the given priority, 1 "
+      "to 99, requires root or CAP_SYS_NICE (default: off)\n"
+      "  -p  Path or serial number of the PIUIO device to open\n"
+      "  -b  Path or serial number of the PIUBTN device to open\n");
+}
+
+bool parse_args(struct options *options, int argc, char **argv)
+{
+  bool delay_set;
+
+  assert(options != NULL);
+  assert(argv != NULL);
+
+  options_init_defaults(options);
+  delay_set = false;
+
+  for (int32_t i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-h")) {
+      return false;
+    } else if (!strcmp(argv[i], "-m")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -m argument\n");
+        return false;
+      }
+
+      i++;
+
+      if (!strcmp(argv[i], "run")) {
+        options->mode = MODE_RUN;
+      } else if (!strcmp(argv[i], "monitor")) {
+        options->mode = MODE_MONITOR;
+      } else {
+        fprintf(stderr, "Invalid parameter for -m argument\n");
+        return false;
+      }
+    } else if (!strcmp(argv[i], "-s")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -s argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->shm_name = argv[i];
+    } else if (!strcmp(argv[i], "-d")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -d argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 0) {
+        fprintf(stderr, "Invalid value for -d argument, must be >= 0\n");
+        return false;
+      }
+
+      options->delay_ms = tmp;
+      delay_set = true;
+    } else if (!strcmp(argv[i], "-r")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -r argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 1 || tmp > 99) {
+        fprintf(stderr, "Invalid value for -r argument, must be 1-99\n");
+        return false;
+      }
+
+      options->sched_priority = tmp;
+    } else if (!strcmp(argv[i], "-p")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -p argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->piuio_id = argv[i];
+    } else if (!strcmp(argv[i], "-b")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -b argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->piubtn_id = argv[i];
+    } else {
+      fprintf(stderr, "Invalid argument %s\n", argv[i]);
+      return false;
+    }
+  }
+
+  // Printing at full rate floods the terminal
+  if (options->mode == MODE_MONITOR && !delay_set) {
+    options->delay_ms = 100;
+  }
+
+  return true;
+}
@@ -0,0 +1,25 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+enum mode {
+  MODE_RUN = 0,
+  MODE_MONITOR = 1,
+};
+
+struct options {
+  enum mode mode;
+  const char *shm_name;
+  uint32_t delay_ms;
+  uint8_t sched_priority;
+  const char *piuio_id;
+  const char *piubtn_id;
+};
+
+void print_usage(char **argv);
+bool parse_args(struct options *options, int argc, char **argv);
+
+#endif
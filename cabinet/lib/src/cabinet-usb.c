@@ -0,0 +1,197 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cabinet-usb.h"
+#include "piubtn-usb.h"
+#include "piuio-state.h"
+#include "piuio-usb.h"
+
+struct cabinet_usb_ctx {
+  void *piuio;
+  void *piubtn;
+  pthread_t piubtn_thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  /* Protected by lock, incremented by the caller to request a poll */
+  uint64_t request;
+  /* Protected by lock, set to request once the poll completed */
+  uint64_t done;
+  bool stop;
+  /* Exchanged with the PIUBTN thread, owned by it between request and done */
+  union piubtn_output_paket piubtn_output;
+  union piubtn_input_paket piubtn_input;
+  result_t piubtn_result;
+};
+
+static void *cabinet_usb_piubtn_thread(void *arg)
+{
+  struct cabinet_usb_ctx *cabinet;
+  uint64_t request;
+
+  cabinet = (struct cabinet_usb_ctx *) arg;
+
+  pthread_mutex_lock(&cabinet->lock);
+
+  while (true) {
+    while (!cabinet->stop && cabinet->request == cabinet->done) {
+      pthread_cond_wait(&cabinet->cond, &cabinet->lock);
+    }
+
+    if (cabinet->stop) {
+      break;
+    }
+
+    request = cabinet->request;
+
+    pthread_mutex_unlock(&cabinet->lock);
+
+    cabinet->piubtn_result = piubtn_usb_poll(
+        cabinet->piubtn, &cabinet->piubtn_output, &cabinet->piubtn_input);
+
+    pthread_mutex_lock(&cabinet->lock);
+
+    cabinet->done = request;
+    pthread_cond_broadcast(&cabinet->cond);
+  }
+
+  pthread_mutex_unlock(&cabinet->lock);
+
+  return NULL;
+}
+
+result_t
+cabinet_usb_open(void **handle, const char *piuio_id, const char *piubtn_id)
+{
+  struct cabinet_usb_ctx *cabinet;
+  result_t result;
+
+  assert(handle != NULL);
+
+  cabinet = (struct cabinet_usb_ctx *) malloc(sizeof(struct cabinet_usb_ctx));
+
+  if (cabinet == NULL) {
+    return ENOMEM;
+  }
+
+  if (piuio_id != NULL) {
+    result = piuio_usb_open_id(&cabinet->piuio, piuio_id);
+  } else {
+    result = piuio_usb_open(&cabinet->piuio);
+  }
+
+  if (RESULT_IS_ERROR(result)) {
+    free(cabinet);
+    return result;
+  }
+
+  if (piubtn_id != NULL) {
+    result = piubtn_usb_open_id(&cabinet->piubtn, piubtn_id);
+  } else {
+    result = piubtn_usb_open(&cabinet->piubtn);
+  }
+
+  if (RESULT_IS_ERROR(result)) {
+    piuio_usb_close(cabinet->piuio);
+    free(cabinet);
+    return result;
+  }
+
+  pthread_mutex_init(&cabinet->lock, NULL);
+  pthread_cond_init(&cabinet->cond, NULL);
+  cabinet->request = 0;
+  cabinet->done = 0;
+  cabinet->stop = false;
+
+  result = pthread_create(
+      &cabinet->piubtn_thread, NULL, cabinet_usb_piubtn_thread, cabinet);
+
+  if (result != 0) {
+    pthread_cond_destroy(&cabinet->cond);
+    pthread_mutex_destroy(&cabinet->lock);
+    piubtn_usb_close(cabinet->piubtn);
+    piuio_usb_close(cabinet->piuio);
+    free(cabinet);
+    return result;
+  }
+
+  *handle = (void *) cabinet;
+
+  return RESULT_SUCCESS;
+}
+
+result_t cabinet_usb_poll(
+    void *handle,
+    const struct cabinet_output *output,
+    struct cabinet_state *state)
+{
+  struct cabinet_usb_ctx *cabinet;
+  union piuio_output_paket piuio_output;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(output != NULL);
+  assert(state != NULL);
+
+  cabinet = (struct cabinet_usb_ctx *) handle;
+
+  // Kick off the PIUBTN poll first, it runs while polling the PIUIO
+  pthread_mutex_lock(&cabinet->lock);
+  cabinet->piubtn_output = output->piubtn;
+  cabinet->request++;
+  pthread_cond_broadcast(&cabinet->cond);
+  pthread_mutex_unlock(&cabinet->lock);
+
+  // Full cycle modifies the sensor mask of the output
+  piuio_output = output->piuio;
+
+  result = piuio_usb_poll_full_cycle(
+      cabinet->piuio, &piuio_output, &state->piuio);
+
+  pthread_mutex_lock(&cabinet->lock);
+
+  while (cabinet->done != cabinet->request) {
+    pthread_cond_wait(&cabinet->cond, &cabinet->lock);
+  }
+
+  pthread_mutex_unlock(&cabinet->lock);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  if (RESULT_IS_ERROR(cabinet->piubtn_result)) {
+    return cabinet->piubtn_result;
+  }
+
+  state->piuio_state = piuio_state_decode(&state->piuio);
+  state->piubtn = cabinet->piubtn_input;
+
+  return RESULT_SUCCESS;
+}
+
+void cabinet_usb_close(void *handle)
+{
+  struct cabinet_usb_ctx *cabinet;
+
+  assert(handle != NULL);
+
+  cabinet = (struct cabinet_usb_ctx *) handle;
+
+  pthread_mutex_lock(&cabinet->lock);
+  cabinet->stop = true;
+  pthread_cond_broadcast(&cabinet->cond);
+  pthread_mutex_unlock(&cabinet->lock);
+
+  pthread_join(cabinet->piubtn_thread, NULL);
+
+  pthread_cond_destroy(&cabinet->cond);
+  pthread_mutex_destroy(&cabinet->lock);
+
+  piubtn_usb_close(cabinet->piubtn);
+  piuio_usb_close(cabinet->piuio);
+
+  free(cabinet);
+}
@@ -0,0 +1,82 @@
+/**
+ * Cabinet level abstraction for polling a PIUIO and a PIUBTN device of a Pump
+ * It Up Pro cabinet together, both backed by libusb.
+ *
+ * Polling the devices one after another adds up their latencies. Instead, the
+ * PIUBTN device is polled on a dedicated thread while the calling thread runs
+ * the full PIUIO cycle. A cabinet poll therefore takes roughly as long as the
+ * slower of the two devices.
+ */
+#ifndef CABINET_USB_H_
+#define CABINET_USB_H_
+
+#include <stdint.h>
+
+#include "piubtn.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Output data for all devices of the cabinet
+ */
+struct cabinet_output {
+  union piuio_output_paket piuio;
+  union piubtn_output_paket piubtn;
+};
+
+/**
+ * Merged input state of all devices of the cabinet polled in a single cycle
+ */
+struct cabinet_state {
+  /* Packed PIUIO state of the cycle, see piuio-state.h */
+  uint64_t piuio_state;
+  /* Batch of input pakets with inverted pull ups of the PIUIO cycle */
+  struct piuio_usb_input_batch_paket piuio;
+  /* Input paket with inverted pull ups of the PIUBTN poll */
+  union piubtn_input_paket piubtn;
+};
+
+/**
+ * Open the PIUIO and PIUBTN devices of a cabinet.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               cabinet_usb_close.
+ * @param piuio_id Identifier of the PIUIO device, see piuio_usb_open_id. NULL
+ *                 to open the first one found
+ * @param piubtn_id Identifier of the PIUBTN device, see piubtn_usb_open_id.
+ *                  NULL to open the first one found
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
+ *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
+ */
+result_t cabinet_usb_open(
+    void **handle, const char *piuio_id, const char *piubtn_id);
+
+/**
+ * Poll all devices of the cabinet concurrently: a full PIUIO cycle (see
+ * piuio_usb_poll_full_cycle) and a PIUBTN poll (see piubtn_usb_poll).
+ *
+ * @param handle Valid handle of an opened cabinet
+ * @param output Pointer to an allocated buffer with the output data to send.
+ * @param state Pointer to an allocated buffer for the merged input state to
+ *              receive
+ * @return Success or an error code as defined by result_t. If both devices
+ *         fail, the error of the PIUIO device is returned. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
+ *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
+ */
+result_t cabinet_usb_poll(
+    void *handle,
+    const struct cabinet_output *output,
+    struct cabinet_state *state);
+
+/**
+ * Close the devices of an opened cabinet.
+ *
+ * @param handle Valid handle of the opened cabinet to close
+ */
+void cabinet_usb_close(void *handle);
+
+#endif
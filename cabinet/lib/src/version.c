@@ -0,0 +1,13 @@
+#include "version.h"
+
+#ifndef CABINET_GITREV
+#define CABINET_GITREV "UNKNOWN"
+#endif
+
+#ifndef CABINET_VERSION
+#define CABINET_VERSION "UNKNOWN"
+#endif
+
+const char *cabinet_build_date = __DATE__ " " __TIME__;
+const char *cabinet_gitrev = CABINET_GITREV;
+const char *cabinet_version = CABINET_VERSION;
\ No newline at end of file
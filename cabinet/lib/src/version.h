@@ -0,0 +1,19 @@
+#ifndef CABINET_VERSION_H
+#define CABINET_VERSION_H
+
+/**
+ * The build time and date of the library as defined by the build system.
+ */
+extern const char *cabinet_build_date;
+
+/**
+ * The git revision hash the build is based on.
+ */
+extern const char *cabinet_gitrev;
+
+/**
+ * Semantic version following MAJOR.MINOR.PATCH
+ */
+extern const char *cabinet_version;
+
+#endif
\ No newline at end of file
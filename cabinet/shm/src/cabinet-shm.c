@@ -0,0 +1,543 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cabinet-shm.h"
+
+/* "CBNT" */
+#define CABINET_SHM_MAGIC 0x43424E54
+
+#define CABINET_SHM_EVENTS_MASK (CABINET_SHM_EVENTS - 1)
+
+/* Number of times a reader yields while the state is being written before
+   giving up. Writing takes well below a us unless the publisher got
+   preempted or died while writing */
+#define CABINET_SHM_STATE_RETRIES 1000
+
+_Static_assert(
+    (CABINET_SHM_EVENTS & CABINET_SHM_EVENTS_MASK) == 0,
+    "Number of events must be a power of two");
+_Static_assert(
+    ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+    "Atomics shared between processes must be lock-free");
+
+/**
+ * Cursor of a reader, aligned to avoid false sharing of different readers
+ */
+struct cabinet_shm_reader_slot {
+  /* Process id of the reader owning the slot, 0 if free */
+  _Atomic uint32_t pid;
+  /* Sequence number of the last event consumed */
+  _Atomic uint64_t cursor;
+  _Atomic uint64_t lost;
+} __attribute__((aligned(64)));
+
+/**
+ * Entry of the event ring, seq is 0 while the entry is being written
+ */
+struct cabinet_shm_event_slot {
+  _Atomic uint64_t seq;
+  struct cabinet_shm_event event;
+};
+
+/**
+ * Layout of the shared memory segment
+ */
+struct cabinet_shm_segment {
+  /* Written last on initialization */
+  _Atomic uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+  _Atomic uint32_t daemon_pid;
+  _Atomic uint64_t cycles;
+  _Atomic uint64_t errors;
+  _Atomic uint32_t last_error;
+  _Atomic uint64_t heartbeat_ns;
+  /* Seqlock of the state, odd while the state is being written */
+  _Atomic uint64_t state_seq __attribute__((aligned(64)));
+  struct cabinet_shm_state state;
+  /* Sequence number of the last event published */
+  _Atomic uint64_t events_head __attribute__((aligned(64)));
+  struct cabinet_shm_reader_slot readers[CABINET_SHM_READERS_MAX];
+  struct cabinet_shm_event_slot events[CABINET_SHM_EVENTS];
+};
+
+struct cabinet_shm_publisher_ctx {
+  struct cabinet_shm_segment *segment;
+  uint64_t cycle;
+  uint64_t events_head;
+  bool has_prev;
+  uint64_t prev_piuio;
+  uint64_t prev_piubtn;
+};
+
+struct cabinet_shm_reader_ctx {
+  struct cabinet_shm_segment *segment;
+  struct cabinet_shm_reader_slot *slot;
+};
+
+static bool cabinet_shm_pid_alive(uint32_t pid)
+{
+  // EPERM: Exists, but owned by another user
+  return pid != 0 && (kill((pid_t) pid, 0) == 0 || errno != ESRCH);
+}
+
+static result_t cabinet_shm_map(
+    const char *name,
+    int flags,
+    bool *initialized,
+    struct cabinet_shm_segment **segment)
+{
+  struct stat st;
+  void *addr;
+  int fd;
+  result_t result;
+
+  fd = shm_open(name, flags, 0666);
+
+  if (fd < 0) {
+    return errno;
+  }
+
+  result = RESULT_SUCCESS;
+
+  if (fstat(fd, &st) != 0) {
+    result = errno;
+  } else if (st.st_size != sizeof(struct cabinet_shm_segment)) {
+    // Readers must not resize a segment of a different layout
+    if (!(flags & O_CREAT)) {
+      result = EPROTO;
+    } else if (ftruncate(fd, sizeof(struct cabinet_shm_segment)) != 0) {
+      result = errno;
+    }
+  }
+
+  if (RESULT_IS_ERROR(result)) {
+    close(fd);
+    return result;
+  }
+
+  // The mapping keeps the segment open
+  addr = mmap(
+      NULL,
+      sizeof(struct cabinet_shm_segment),
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED,
+      fd,
+      0);
+  close(fd);
+
+  if (addr == MAP_FAILED) {
+    return errno;
+  }
+
+  *segment = (struct cabinet_shm_segment *) addr;
+  *initialized =
+      atomic_load_explicit(&(*segment)->magic, memory_order_acquire) ==
+          CABINET_SHM_MAGIC &&
+      (*segment)->version == CABINET_SHM_VERSION &&
+      (*segment)->size == sizeof(struct cabinet_shm_segment);
+
+  return RESULT_SUCCESS;
+}
+
+static void cabinet_shm_push_event(
+    struct cabinet_shm_publisher_ctx *ctx,
+    const struct cabinet_shm_state *state,
+    enum cabinet_shm_device device,
+    uint64_t prev,
+    uint64_t cur)
+{
+  struct cabinet_shm_event_slot *slot;
+  uint64_t seq;
+
+  seq = ++ctx->events_head;
+  slot = &ctx->segment->events[(seq - 1) & CABINET_SHM_EVENTS_MASK];
+
+  atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  slot->event.seq = seq;
+  slot->event.cycle = ctx->cycle;
+  slot->event.time_ns = state->time_ns;
+  slot->event.device = device;
+  slot->event.pressed = cur & ~prev;
+  slot->event.released = prev & ~cur;
+
+  atomic_store_explicit(&slot->seq, seq, memory_order_release);
+  atomic_store_explicit(
+      &ctx->segment->events_head, seq, memory_order_release);
+}
+
+result_t cabinet_shm_create(void **handle, const char *name)
+{
+  struct cabinet_shm_publisher_ctx *ctx;
+  struct cabinet_shm_segment *segment;
+  bool initialized;
+  uint32_t pid;
+  uint64_t seq;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(name != NULL);
+
+  result = cabinet_shm_map(name, O_RDWR | O_CREAT, &initialized, &segment);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  pid = atomic_load_explicit(&segment->daemon_pid, memory_order_acquire);
+
+  if (initialized && pid != (uint32_t) getpid() &&
+      cabinet_shm_pid_alive(pid)) {
+    munmap(segment, sizeof(struct cabinet_shm_segment));
+    return EBUSY;
+  }
+
+  ctx = (struct cabinet_shm_publisher_ctx *) calloc(
+      1, sizeof(struct cabinet_shm_publisher_ctx));
+
+  if (ctx == NULL) {
+    munmap(segment, sizeof(struct cabinet_shm_segment));
+    return ENOMEM;
+  }
+
+  // Continue the cycles and events of the previous publisher to keep attached
+  // readers working
+  if (!initialized) {
+    memset(segment, 0, sizeof(struct cabinet_shm_segment));
+    segment->version = CABINET_SHM_VERSION;
+    segment->size = sizeof(struct cabinet_shm_segment);
+    atomic_store_explicit(
+        &segment->magic, CABINET_SHM_MAGIC, memory_order_release);
+  }
+
+  // A publisher killed while writing the state leaves the seqlock odd, which
+  // inverts it for all further writes. The torn state is replaced with the
+  // next publish
+  seq = atomic_load_explicit(&segment->state_seq, memory_order_relaxed);
+
+  if (seq & 1) {
+    atomic_store_explicit(&segment->state_seq, seq + 1, memory_order_release);
+  }
+
+  ctx->segment = segment;
+  ctx->cycle = atomic_load_explicit(&segment->cycles, memory_order_relaxed);
+  ctx->events_head =
+      atomic_load_explicit(&segment->events_head, memory_order_relaxed);
+
+  atomic_store_explicit(
+      &segment->daemon_pid, (uint32_t) getpid(), memory_order_release);
+
+  *handle = ctx;
+
+  return RESULT_SUCCESS;
+}
+
+void cabinet_shm_publish(void *handle, const struct cabinet_shm_state *state)
+{
+  struct cabinet_shm_publisher_ctx *ctx;
+  struct cabinet_shm_segment *segment;
+  uint64_t seq;
+  uint64_t piubtn;
+
+  assert(handle != NULL);
+  assert(state != NULL);
+
+  ctx = (struct cabinet_shm_publisher_ctx *) handle;
+  segment = ctx->segment;
+
+  ctx->cycle++;
+
+  seq = atomic_load_explicit(&segment->state_seq, memory_order_relaxed);
+  atomic_store_explicit(&segment->state_seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  segment->state = *state;
+  segment->state.cycle = ctx->cycle;
+
+  atomic_store_explicit(&segment->state_seq, seq + 2, memory_order_release);
+
+  memcpy(&piubtn, state->piubtn.raw, sizeof(piubtn));
+
+  if (ctx->has_prev && state->piuio_state != ctx->prev_piuio) {
+    cabinet_shm_push_event(
+        ctx,
+        state,
+        CABINET_SHM_DEVICE_PIUIO,
+        ctx->prev_piuio,
+        state->piuio_state);
+  }
+
+  if (ctx->has_prev && piubtn != ctx->prev_piubtn) {
+    cabinet_shm_push_event(
+        ctx, state, CABINET_SHM_DEVICE_PIUBTN, ctx->prev_piubtn, piubtn);
+  }
+
+  ctx->has_prev = true;
+  ctx->prev_piuio = state->piuio_state;
+  ctx->prev_piubtn = piubtn;
+
+  atomic_store_explicit(&segment->cycles, ctx->cycle, memory_order_relaxed);
+  atomic_store_explicit(
+      &segment->heartbeat_ns, state->time_ns, memory_order_relaxed);
+}
+
+void cabinet_shm_publish_error(void *handle, uint64_t time_ns, result_t error)
+{
+  struct cabinet_shm_publisher_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct cabinet_shm_publisher_ctx *) handle;
+
+  atomic_fetch_add_explicit(&ctx->segment->errors, 1, memory_order_relaxed);
+  atomic_store_explicit(
+      &ctx->segment->last_error, error, memory_order_relaxed);
+  atomic_store_explicit(
+      &ctx->segment->heartbeat_ns, time_ns, memory_order_relaxed);
+}
+
+void cabinet_shm_destroy(void *handle)
+{
+  struct cabinet_shm_publisher_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct cabinet_shm_publisher_ctx *) handle;
+
+  atomic_store_explicit(&ctx->segment->daemon_pid, 0, memory_order_release);
+  munmap(ctx->segment, sizeof(struct cabinet_shm_segment));
+  free(ctx);
+}
+
+result_t cabinet_shm_open(void **handle, const char *name)
+{
+  struct cabinet_shm_reader_ctx *ctx;
+  struct cabinet_shm_segment *segment;
+  struct cabinet_shm_reader_slot *slot;
+  bool initialized;
+  uint32_t pid;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(name != NULL);
+
+  result = cabinet_shm_map(name, O_RDWR, &initialized, &segment);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  if (!initialized) {
+    munmap(segment, sizeof(struct cabinet_shm_segment));
+    return EPROTO;
+  }
+
+  slot = NULL;
+
+  // Claim a free slot or one of a reader that exited without detaching
+  for (uint8_t i = 0; i < CABINET_SHM_READERS_MAX && slot == NULL; i++) {
+    pid = atomic_load_explicit(&segment->readers[i].pid, memory_order_relaxed);
+
+    if ((pid == 0 || !cabinet_shm_pid_alive(pid)) &&
+        atomic_compare_exchange_strong_explicit(
+            &segment->readers[i].pid,
+            &pid,
+            (uint32_t) getpid(),
+            memory_order_acquire,
+            memory_order_relaxed)) {
+      slot = &segment->readers[i];
+    }
+  }
+
+  if (slot == NULL) {
+    munmap(segment, sizeof(struct cabinet_shm_segment));
+    return EBUSY;
+  }
+
+  ctx = (struct cabinet_shm_reader_ctx *) malloc(
+      sizeof(struct cabinet_shm_reader_ctx));
+
+  if (ctx == NULL) {
+    atomic_store_explicit(&slot->pid, 0, memory_order_release);
+    munmap(segment, sizeof(struct cabinet_shm_segment));
+    return ENOMEM;
+  }
+
+  atomic_store_explicit(
+      &slot->cursor,
+      atomic_load_explicit(&segment->events_head, memory_order_acquire),
+      memory_order_relaxed);
+  atomic_store_explicit(&slot->lost, 0, memory_order_relaxed);
+
+  ctx->segment = segment;
+  ctx->slot = slot;
+
+  *handle = ctx;
+
+  return RESULT_SUCCESS;
+}
+
+result_t
+cabinet_shm_read_state(void *handle, struct cabinet_shm_state *state)
+{
+  struct cabinet_shm_segment *segment;
+  uint64_t seq;
+  uint32_t pid;
+
+  assert(handle != NULL);
+  assert(state != NULL);
+
+  segment = ((struct cabinet_shm_reader_ctx *) handle)->segment;
+
+  for (uint32_t i = 0; i < CABINET_SHM_STATE_RETRIES; i++) {
+    seq = atomic_load_explicit(&segment->state_seq, memory_order_acquire);
+
+    // Let a preempted publisher finish writing
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+
+    *state = segment->state;
+    atomic_thread_fence(memory_order_acquire);
+
+    if (atomic_load_explicit(&segment->state_seq, memory_order_relaxed) ==
+        seq) {
+      return RESULT_SUCCESS;
+    }
+  }
+
+  // A publisher that died while writing never finishes
+  pid = atomic_load_explicit(&segment->daemon_pid, memory_order_acquire);
+
+  return cabinet_shm_pid_alive(pid) ? EAGAIN : ENODEV;
+}
+
+uint32_t cabinet_shm_read_events(
+    void *handle,
+    struct cabinet_shm_event *events,
+    uint32_t max,
+    uint64_t *lost)
+{
+  struct cabinet_shm_reader_ctx *ctx;
+  struct cabinet_shm_event_slot *slot;
+  uint64_t head;
+  uint64_t cursor;
+  uint64_t lost_events;
+  uint64_t seq;
+  uint32_t count;
+
+  assert(handle != NULL);
+  assert(events != NULL);
+
+  ctx = (struct cabinet_shm_reader_ctx *) handle;
+
+  cursor = atomic_load_explicit(&ctx->slot->cursor, memory_order_relaxed);
+  head = atomic_load_explicit(
+      &ctx->segment->events_head, memory_order_acquire);
+  lost_events = 0;
+  count = 0;
+
+  while (count < max && cursor < head) {
+    // Events older than the ring were overwritten already
+    if (head - cursor > CABINET_SHM_EVENTS) {
+      lost_events += head - cursor - CABINET_SHM_EVENTS;
+      cursor = head - CABINET_SHM_EVENTS;
+    }
+
+    slot = &ctx->segment->events[cursor & CABINET_SHM_EVENTS_MASK];
+    seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if (seq == cursor + 1) {
+      events[count] = slot->event;
+      atomic_thread_fence(memory_order_acquire);
+    }
+
+    // Overwritten while reading, the publisher lapped the reader
+    if (seq != cursor + 1 ||
+        atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+      lost_events++;
+      cursor++;
+      head = atomic_load_explicit(
+          &ctx->segment->events_head, memory_order_acquire);
+      continue;
+    }
+
+    count++;
+    cursor++;
+  }
+
+  atomic_store_explicit(&ctx->slot->cursor, cursor, memory_order_relaxed);
+
+  if (lost_events > 0) {
+    atomic_fetch_add_explicit(
+        &ctx->slot->lost, lost_events, memory_order_relaxed);
+  }
+
+  if (lost != NULL) {
+    *lost = lost_events;
+  }
+
+  return count;
+}
+
+void cabinet_shm_status(void *handle, struct cabinet_shm_status *status)
+{
+  struct cabinet_shm_reader_ctx *ctx;
+  struct cabinet_shm_segment *segment;
+
+  assert(handle != NULL);
+  assert(status != NULL);
+
+  ctx = (struct cabinet_shm_reader_ctx *) handle;
+  segment = ctx->segment;
+
+  status->daemon_pid =
+      atomic_load_explicit(&segment->daemon_pid, memory_order_acquire);
+  status->cycles = atomic_load_explicit(&segment->cycles, memory_order_relaxed);
+  status->errors = atomic_load_explicit(&segment->errors, memory_order_relaxed);
+  status->last_error =
+      atomic_load_explicit(&segment->last_error, memory_order_relaxed);
+  status->heartbeat_ns =
+      atomic_load_explicit(&segment->heartbeat_ns, memory_order_relaxed);
+  status->events =
+      atomic_load_explicit(&segment->events_head, memory_order_relaxed);
+  status->lost = atomic_load_explicit(&ctx->slot->lost, memory_order_relaxed);
+  status->readers = 0;
+
+  for (uint8_t i = 0; i < CABINET_SHM_READERS_MAX; i++) {
+    if (atomic_load_explicit(&segment->readers[i].pid, memory_order_relaxed) !=
+        0) {
+      status->readers++;
+    }
+  }
+
+  // Daemon killed without stopping
+  if (!cabinet_shm_pid_alive(status->daemon_pid)) {
+    status->daemon_pid = 0;
+  }
+}
+
+void cabinet_shm_close(void *handle)
+{
+  struct cabinet_shm_reader_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct cabinet_shm_reader_ctx *) handle;
+
+  atomic_store_explicit(&ctx->slot->pid, 0, memory_order_release);
+  munmap(ctx->segment, sizeof(struct cabinet_shm_segment));
+  free(ctx);
+}
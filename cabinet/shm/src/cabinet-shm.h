@@ -0,0 +1,223 @@
+/**
+ * Shared memory segment publishing the cabinet's input state to any number of
+ * local processes, e.g. the game, a lights/attract process and a health
+ * monitor, while only a single process (the daemon) owns the devices.
+ *
+ * The daemon polls the devices at full rate and publishes every cycle:
+ *
+ * - The latest state, protected by a seqlock. Readers never block the daemon
+ *   and retry in the rare case of reading while it is being updated.
+ * - Edge events, i.e. the inputs pressed and released in a cycle, in a ring
+ *   buffer. Every reader has its own cursor into the ring stored in the
+ *   segment, so each one consumes the events at its own rate. The daemon never
+ *   waits for readers: a reader falling behind by more than the size of the
+ *   ring loses the oldest events and is told how many.
+ *
+ * Reading is a copy from shared memory without any system calls, i.e. no
+ * additional USB traffic and far below a microsecond per read. The segment is
+ * kept when the daemon exits and re-used on restart, readers stay attached.
+ *
+ * All timestamps are based on CLOCK_MONOTONIC.
+ */
+#ifndef CABINET_SHM_H_
+#define CABINET_SHM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "piubtn.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Default name of the segment, located under /dev/shm
+ */
+#define CABINET_SHM_NAME_DEFAULT "/pumpio-cabinet"
+
+/**
+ * Layout version, incremented on every incompatible change
+ */
+#define CABINET_SHM_VERSION 1
+
+/**
+ * Max. number of readers attached at the same time
+ */
+#define CABINET_SHM_READERS_MAX 16
+
+/**
+ * Number of events kept in the ring buffer, power of two
+ */
+#define CABINET_SHM_EVENTS 1024
+
+/**
+ * Device an event originates from
+ */
+enum cabinet_shm_device {
+  CABINET_SHM_DEVICE_PIUIO = 0,
+  CABINET_SHM_DEVICE_PIUBTN = 1,
+};
+
+/**
+ * State of the cabinet published every cycle
+ */
+struct cabinet_shm_state {
+  /* Number of the cycle, starting with 1, 0 if none was published, yet */
+  uint64_t cycle;
+  /* Completion time of the cycle */
+  uint64_t time_ns;
+  /* Packed PIUIO state of the cycle, see piuio-state.h */
+  uint64_t piuio_state;
+  /* Batch of input pakets with inverted pull ups of the PIUIO cycle */
+  struct piuio_usb_input_batch_paket piuio;
+  /* Input paket with inverted pull ups of the PIUBTN poll */
+  union piubtn_input_paket piubtn;
+};
+
+/**
+ * Inputs of a device that changed in a cycle
+ */
+struct cabinet_shm_event {
+  /* Sequence number of the event, starting with 1 */
+  uint64_t seq;
+  /* Cycle and completion time of the cycle the change was detected in */
+  uint64_t cycle;
+  uint64_t time_ns;
+  enum cabinet_shm_device device;
+  /* Bits that went from 0 to 1, the packed state for PIUIO, the raw paket
+     for PIUBTN */
+  uint64_t pressed;
+  /* Bits that went from 1 to 0 */
+  uint64_t released;
+};
+
+/**
+ * Status of the daemon and a reader
+ */
+struct cabinet_shm_status {
+  /* Process id of the publishing daemon, 0 if not running */
+  uint32_t daemon_pid;
+  /* Number of cycles published */
+  uint64_t cycles;
+  /* Number of failed cycles and the error of the last one */
+  uint64_t errors;
+  result_t last_error;
+  /* Time of the last published cycle or error */
+  uint64_t heartbeat_ns;
+  /* Number of events published */
+  uint64_t events;
+  /* Number of readers attached */
+  uint32_t readers;
+  /* Number of events the reader lost by falling behind */
+  uint64_t lost;
+};
+
+/**
+ * Create the segment, or re-use an existing one of the same layout, to
+ * publish to. Only a single publisher per segment must exist.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               cabinet_shm_destroy.
+ * @param name Name of the segment, e.g. CABINET_SHM_NAME_DEFAULT
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EBUSY if another publisher is running on the
+ *         segment, ENOMEM, any error of shm_open, ftruncate or mmap
+ */
+result_t cabinet_shm_create(void **handle, const char *name);
+
+/**
+ * Publish the state of a cycle. Events are generated for all inputs that
+ * changed since the previous cycle.
+ *
+ * @param handle Valid handle of a created segment
+ * @param state State of the cycle, the cycle number is assigned by the call
+ */
+void cabinet_shm_publish(void *handle, const struct cabinet_shm_state *state);
+
+/**
+ * Publish a failed cycle, the last state stays published.
+ *
+ * @param handle Valid handle of a created segment
+ * @param time_ns Time of the failure
+ * @param error Error of the failed cycle
+ */
+void cabinet_shm_publish_error(void *handle, uint64_t time_ns, result_t error);
+
+/**
+ * Stop publishing. The segment is kept for the next publisher, attached
+ * readers see the daemon as not running.
+ *
+ * @param handle Valid handle of a created segment
+ */
+void cabinet_shm_destroy(void *handle);
+
+/**
+ * Attach to a segment as a reader. The reader receives all events published
+ * after attaching.
+ *
+ * Slots of readers that exited without detaching are reclaimed.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               cabinet_shm_close.
+ * @param name Name of the segment, e.g. CABINET_SHM_NAME_DEFAULT
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOENT if no daemon created the segment,
+ *         EPROTO if the layout of the segment differs, EBUSY if
+ *         CABINET_SHM_READERS_MAX readers are attached, ENOMEM, any error of
+ *         shm_open or mmap
+ */
+result_t cabinet_shm_open(void **handle, const char *name);
+
+/**
+ * Read the latest state.
+ *
+ * Retries a bounded number of times while the publisher is writing the state
+ * instead of spinning until it is done.
+ *
+ * @param handle Valid handle of an attached reader
+ * @param state Pointer to an allocated buffer to return the state in, contents
+ *              are undefined on error
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EAGAIN if the publisher did not finish
+ *         writing the state in time, ENODEV if the publisher died while
+ *         writing it
+ */
+result_t
+cabinet_shm_read_state(void *handle, struct cabinet_shm_state *state);
+
+/**
+ * Read the events published since the last call and advance the reader's
+ * cursor.
+ *
+ * @param handle Valid handle of an attached reader
+ * @param events Pointer to an allocated buffer for max events
+ * @param max Max. number of events to read
+ * @param lost Optional pointer to return the number of events lost since the
+ *             last call in, NULL if not used
+ * @return Number of events read, 0 if none are available
+ */
+uint32_t cabinet_shm_read_events(
+    void *handle,
+    struct cabinet_shm_event *events,
+    uint32_t max,
+    uint64_t *lost);
+
+/**
+ * Get the status of the daemon and the reader.
+ *
+ * @param handle Valid handle of an attached reader
+ * @param status Pointer to an allocated buffer to return the status in
+ */
+void cabinet_shm_status(void *handle, struct cabinet_shm_status *status);
+
+/**
+ * Detach a reader.
+ *
+ * @param handle Valid handle of an attached reader
+ */
+void cabinet_shm_close(void *handle);
+
+#endif
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cabinet-usb.h"
+
+#include "options.h"
+
+typedef bool (*func_render_data_t)(
+    struct cabinet_output *output,
+    const struct cabinet_state *state,
+    double io_time_sec);
+
+static bool interrupted = false;
+
+// -----------------------------------------------------------------------------------------
+
+static void sig_handler(int sig)
+{
+  interrupted = true;
+}
+
+static void sleep_ms(int32_t time_ms)
+{
+  usleep(time_ms * 1000);
+}
+
+// -----------------------------------------------------------------------------------------
+
+static bool render_raw(
+    struct cabinet_output *output,
+    const struct cabinet_state *state,
+    double io_time_sec)
+{
+  assert(output != NULL);
+  assert(state != NULL);
+
+  printf("%016lX ", state->piuio_state);
+
+  for (size_t i = 0; i < sizeof(state->piubtn.raw); i++) {
+    printf("%02X ", state->piubtn.raw[i]);
+  }
+
+  printf("%.5f\n", io_time_sec);
+
+  return !interrupted;
+}
+
+static bool render_benchmark(
+    struct cabinet_output *output,
+    const struct cabinet_state *state,
+    double io_time_sec)
+{
+  static uint64_t counter = 0;
+  static double accu = 0;
+  static double min = 0;
+  static double max = 0;
+
+  assert(output != NULL);
+  assert(state != NULL);
+
+  counter++;
+  accu += io_time_sec;
+
+  if (counter == 1 || io_time_sec < min) {
+    min = io_time_sec;
+  }
+
+  if (io_time_sec > max) {
+    max = io_time_sec;
+  }
+
+  if (interrupted) {
+    printf("Samples: %ld\n", counter);
+    printf("Min time: %.5f secs\n", min);
+    printf("Max time: %.5f secs\n", max);
+    printf("Average time: %.5f secs\n", accu / counter);
+  }
+
+  return !interrupted;
+}
+
+// -----------------------------------------------------------------------------------------
+
+static void proc_usb(
+    const char *piuio_id,
+    const char *piubtn_id,
+    int32_t delay_ms,
+    func_render_data_t render)
+{
+  void *handle;
+  int32_t result;
+  struct cabinet_output output;
+  struct cabinet_state state;
+  struct timespec tstart;
+  struct timespec tend;
+  double io_time_sec;
+  bool loop;
+
+  assert(render);
+
+  memset(&output, 0, sizeof(output));
+  memset(&state, 0, sizeof(state));
+
+  result = cabinet_usb_open(&handle, piuio_id, piubtn_id);
+
+  if (result) {
+    errno = result;
+    perror("Opening cabinet failed");
+    exit(EXIT_FAILURE);
+  }
+
+  loop = true;
+
+  while (loop) {
+    clock_gettime(CLOCK_MONOTONIC, &tstart);
+
+    result = cabinet_usb_poll(handle, &output, &state);
+
+    clock_gettime(CLOCK_MONOTONIC, &tend);
+
+    io_time_sec = ((double) tend.tv_sec + 1.0e-9 * tend.tv_nsec) -
+        ((double) tstart.tv_sec + 1.0e-9 * tstart.tv_nsec);
+
+    if (result) {
+      errno = result;
+      perror("Running update cycle for cabinet failed");
+      exit(EXIT_FAILURE);
+    }
+
+    loop = render(&output, &state, io_time_sec);
+
+    if (delay_ms > 0) {
+      sleep_ms(delay_ms);
+    }
+  }
+
+  cabinet_usb_close(handle);
+}
+
+// -----------------------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+  struct options options;
+
+  signal(SIGINT, sig_handler);
+
+  if (!parse_args(&options, argc, argv)) {
+    print_usage(argv);
+    return EXIT_FAILURE;
+  }
+
+  if (options.mode == MODE_RAW) {
+    proc_usb(
+        options.piuio_id, options.piubtn_id, options.delay_ms, render_raw);
+  } else if (options.mode == MODE_BENCHMARK) {
+    proc_usb(
+        options.piuio_id,
+        options.piubtn_id,
+        options.delay_ms,
+        render_benchmark);
+  } else {
+    fprintf(stderr, "Invalid parameters selected\n");
+    print_usage(argv);
+  }
+
+  return EXIT_SUCCESS;
+}
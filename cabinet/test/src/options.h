@@ -0,0 +1,23 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+enum mode {
+  MODE_RAW = 0,
+  MODE_BENCHMARK = 1,
+};
+
+struct options {
+  enum mode mode;
+  uint32_t delay_ms;
+  const char *piuio_id;
+  const char *piubtn_id;
+};
+
+void print_usage(char **argv);
+bool parse_args(struct options *options, int argc, char **argv);
+
+#endif
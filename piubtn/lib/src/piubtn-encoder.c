@@ -0,0 +1,55 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include "piubtn-encoder.h"
+
+/**
+ * Bit of the raw output word for a bit of a byte of the output paket
+ */
+#define PIUBTN_ENCODER_RAW_BIT(byte, bit) (UINT64_C(1) << ((byte) * 8 + (bit)))
+
+/* See struct piubtn_piu_output_paket */
+static const uint64_t piubtn_encoder_outputs[] = {
+    [PIUBTN_ENCODER_P1_BACK] = PIUBTN_ENCODER_RAW_BIT(0, 7),
+    [PIUBTN_ENCODER_P1_LEFT] = PIUBTN_ENCODER_RAW_BIT(0, 6),
+    [PIUBTN_ENCODER_P1_RIGHT] = PIUBTN_ENCODER_RAW_BIT(0, 5),
+    [PIUBTN_ENCODER_P1_START] = PIUBTN_ENCODER_RAW_BIT(0, 4),
+    [PIUBTN_ENCODER_P2_BACK] = PIUBTN_ENCODER_RAW_BIT(0, 3),
+    [PIUBTN_ENCODER_P2_LEFT] = PIUBTN_ENCODER_RAW_BIT(0, 2),
+    [PIUBTN_ENCODER_P2_RIGHT] = PIUBTN_ENCODER_RAW_BIT(0, 1),
+    [PIUBTN_ENCODER_P2_START] = PIUBTN_ENCODER_RAW_BIT(0, 0),
+};
+
+static_assert(
+    sizeof(piubtn_encoder_outputs) / sizeof(uint64_t) ==
+        PIUBTN_ENCODER_OUTPUT_COUNT,
+    "Output table incomplete");
+static_assert(
+    PIUBTN_OUTPUT_PAKET_SIZE == PUMPIO_ENCODER_RAW_SIZE,
+    "Output paket not covered by the raw output word");
+
+void piubtn_encoder_init(struct pumpio_encoder *encoder)
+{
+  pumpio_encoder_init(
+      encoder, piubtn_encoder_outputs, PIUBTN_ENCODER_OUTPUT_COUNT);
+}
+
+uint8_t piubtn_encoder_apply(
+    const struct pumpio_encoder *encoder,
+    uint64_t mask,
+    uint64_t value,
+    union piubtn_output_paket *paket)
+{
+  uint64_t prev;
+  uint64_t next;
+
+  assert(encoder != NULL);
+  assert(paket != NULL);
+
+  prev = pumpio_encoder_from_raw(paket->raw);
+  next = pumpio_encoder_replace(encoder, prev, mask, value);
+
+  pumpio_encoder_to_raw(next, paket->raw);
+
+  return pumpio_encoder_diff(prev, next);
+}
@@ -0,0 +1,64 @@
+/**
+ * Logical outputs of the PIUBTN device and their encoder to raw output
+ * pakets.
+ *
+ * The button lights are numbered densely, see piubtn_encoder_output, and set
+ * as a single logical mask instead of the bitfields of
+ * piubtn_piu_output_paket.
+ */
+#ifndef PIUBTN_ENCODER_H
+#define PIUBTN_ENCODER_H
+
+#include <stdint.h>
+
+#include "encoder.h"
+#include "piubtn.h"
+
+/**
+ * Logical outputs of Pump It Up (Pro)
+ */
+enum piubtn_encoder_output {
+  PIUBTN_ENCODER_P1_BACK = 0,
+  PIUBTN_ENCODER_P1_LEFT = 1,
+  PIUBTN_ENCODER_P1_RIGHT = 2,
+  PIUBTN_ENCODER_P1_START = 3,
+  PIUBTN_ENCODER_P2_BACK = 4,
+  PIUBTN_ENCODER_P2_LEFT = 5,
+  PIUBTN_ENCODER_P2_RIGHT = 6,
+  PIUBTN_ENCODER_P2_START = 7,
+  PIUBTN_ENCODER_OUTPUT_COUNT = 8,
+};
+
+/**
+ * Logical masks of groups of outputs
+ */
+#define PIUBTN_ENCODER_P1 UINT64_C(0x000000000000000F)
+#define PIUBTN_ENCODER_P2 UINT64_C(0x00000000000000F0)
+#define PIUBTN_ENCODER_ALL UINT64_C(0x00000000000000FF)
+
+/**
+ * Initialize an encoder for the outputs of the device.
+ *
+ * @param encoder Pointer to the encoder to initialize
+ */
+void piubtn_encoder_init(struct pumpio_encoder *encoder);
+
+/**
+ * Replace a group of logical outputs of an output paket, e.g. all button
+ * lights of a player. Outputs not in the mask are kept.
+ *
+ * @param encoder Pointer to an encoder initialized with piubtn_encoder_init
+ * @param mask Logical outputs to replace
+ * @param value New values of the logical outputs in the mask
+ * @param paket Output paket to update
+ * @return Mask with bit n set if byte n of the paket changed, 0 if it is
+ *         unchanged. The usb backend (piubtn-usb.h) skips writing unchanged
+ *         outputs based on the same diff, callers don't need to track it
+ */
+uint8_t piubtn_encoder_apply(
+    const struct pumpio_encoder *encoder,
+    uint64_t mask,
+    uint64_t value,
+    union piubtn_output_paket *paket);
+
+#endif
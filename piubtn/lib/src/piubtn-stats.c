@@ -0,0 +1,23 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include "piubtn-stats.h"
+
+static struct pumpio_stats piubtn_stats_global;
+
+void piubtn_stats_snapshot(struct pumpio_stats_snapshot *snapshot)
+{
+  assert(snapshot != NULL);
+
+  pumpio_stats_snapshot(&piubtn_stats_global, snapshot);
+}
+
+void piubtn_stats_reset()
+{
+  pumpio_stats_reset(&piubtn_stats_global);
+}
+
+struct pumpio_stats *piubtn_stats()
+{
+  return &piubtn_stats_global;
+}
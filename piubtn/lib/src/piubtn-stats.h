@@ -0,0 +1,33 @@
+/**
+ * Process-wide statistics of all PIUBTN devices driven by this library.
+ *
+ * piubtn-usb records every transfer, every poll as a cycle (see
+ * PUMPIO_STATS_HIST_CYCLE) and the time it takes for changed button lights to
+ * be transferred. See stats.h and hist.h for evaluating the snapshot. Use
+ * piubtn_usb_set_stats to record a device in its own statistics instead.
+ */
+#ifndef PIUBTN_STATS_H
+#define PIUBTN_STATS_H
+
+#include "stats.h"
+
+/**
+ * Take a snapshot of the statistics of all PIUBTN devices.
+ *
+ * @param snapshot Pointer to the snapshot to fill
+ */
+void piubtn_stats_snapshot(struct pumpio_stats_snapshot *snapshot);
+
+/**
+ * Reset the statistics of all PIUBTN devices.
+ */
+void piubtn_stats_reset();
+
+/**
+ * Get the statistics instance the backends record in.
+ *
+ * @return Pointer to the process-wide statistics
+ */
+struct pumpio_stats *piubtn_stats();
+
+#endif
@@ -1,35 +1,116 @@
 #include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "devices.h"
+#include "encoder.h"
+#include "piubtn-stats.h"
 #include "piubtn-usb.h"
+#include "time_.h"
 #include "usb_.h"
 
-#define PIUBTN_USB_VID 0x0D2F
-#define PIUBTN_USB_PID 0x1010
+struct piubtn_usb_ctx {
+  void *usb;
+  /* Outputs last sent as raw output word, see encoder.h */
+  uint64_t output;
+  /* Device latched the outputs with the last poll, unknown if it failed as
+     the device might have been reset since */
+  bool latched;
+  /* Statistics to record in and start of the last cycle for its interval */
+  struct pumpio_stats *stats;
+  uint64_t last_cycle_ns;
+};
 
-#define PIUBTN_USB_CONFIG 0x01
-#define PIUBTN_USB_IFACE 0x00
+static result_t piubtn_usb_open_ctx(void **handle, const char *id)
+{
+  struct piubtn_usb_ctx *ctx;
+  result_t result;
+
+  ctx = (struct piubtn_usb_ctx *) malloc(sizeof(struct piubtn_usb_ctx));
+
+  if (ctx == NULL) {
+    return ENOMEM;
+  }
+
+  result = pumpio_usb_open_id(
+      &ctx->usb,
+      PUMPIO_PIUBTN_VID,
+      PUMPIO_PIUBTN_PID,
+      id,
+      PUMPIO_DEVICE_CONFIG,
+      PUMPIO_DEVICE_IFACE);
+
+  if (RESULT_IS_ERROR(result)) {
+    free(ctx);
+    return result;
+  }
+
+  ctx->stats = piubtn_stats();
+  ctx->last_cycle_ns = 0;
+  pumpio_usb_set_stats(ctx->usb, ctx->stats);
+  ctx->output = 0;
+  ctx->latched = false;
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Get the bytes of the outputs which differ from the ones sent last
+ */
+static uint8_t piubtn_usb_output_diff(
+    const struct piubtn_usb_ctx *ctx, const union piubtn_output_paket *output)
+{
+  return pumpio_encoder_diff(ctx->output, pumpio_encoder_from_raw(output->raw));
+}
+
+/**
+ * Remember the outputs just transferred and record the output latency if
+ * they changed
+ */
+static void piubtn_usb_record_output(
+    struct piubtn_usb_ctx *ctx,
+    const union piubtn_output_paket *output,
+    uint64_t start_ns)
+{
+  if (piubtn_usb_output_diff(ctx, output) == 0) {
+    return;
+  }
+
+  ctx->output = pumpio_encoder_from_raw(output->raw);
 
-#define PIUBTN_USB_CTRL_TYPE_IN 0xC0
-#define PIUBTN_USB_CTRL_TYPE_OUT 0x40
-#define PIUBTN_USB_CTRL_REQUEST 0xAE
-#define PIUBTN_USB_REQ_TIMEOUT 10000
+  pumpio_stats_record_output(ctx->stats, pumpio_time_now_ns() - start_ns);
+}
 
 bool piubtn_usb_available()
 {
-  return pumpio_usb_available(PIUBTN_USB_VID, PIUBTN_USB_PID);
+  return pumpio_usb_available(PUMPIO_PIUBTN_VID, PUMPIO_PIUBTN_PID);
+}
+
+result_t piubtn_usb_enumerate(
+    struct pumpio_usb_device_info *infos, size_t max_count, size_t *count)
+{
+  assert(count != NULL);
+
+  return pumpio_usb_enumerate(
+      PUMPIO_PIUBTN_VID, PUMPIO_PIUBTN_PID, infos, max_count, count);
 }
 
 result_t piubtn_usb_open(void **handle)
 {
   assert(handle != NULL);
 
-  return pumpio_usb_open(
-      handle,
-      PIUBTN_USB_VID,
-      PIUBTN_USB_PID,
-      PIUBTN_USB_CONFIG,
-      PIUBTN_USB_IFACE);
+  return piubtn_usb_open_ctx(handle, NULL);
+}
+
+result_t piubtn_usb_open_id(void **handle, const char *id)
+{
+  assert(handle != NULL);
+  assert(id != NULL);
+
+  return piubtn_usb_open_ctx(handle, id);
 }
 
 result_t piubtn_usb_poll(
@@ -37,64 +118,189 @@ result_t piubtn_usb_poll(
     const union piubtn_output_paket *output,
     union piubtn_input_paket *input)
 {
+  struct piubtn_usb_ctx *ctx;
   result_t result;
   uint16_t res_len;
+  uint64_t start_ns;
+  bool output_latched;
 
   assert(handle != NULL);
   assert(output != NULL);
   assert(input != NULL);
 
-  // Write outputs
+  ctx = (struct piubtn_usb_ctx *) handle;
+  start_ns = pumpio_time_now_ns();
+
+  // Until this poll succeeds, it is unknown what the device latched, e.g. it
+  // might get reset and reconnected on errors
+  output_latched = ctx->latched && piubtn_usb_output_diff(ctx, output) == 0;
+  ctx->latched = false;
+
+  // Write outputs, skipped if unchanged since the last poll
+  if (!output_latched) {
+    result = pumpio_usb_control_transfer(
+        ctx->usb,
+        PUMPIO_CTRL_TYPE_OUT,
+        PUMPIO_CTRL_REQUEST,
+        0,
+        0,
+        (uint8_t *) output->raw,
+        sizeof(output->raw),
+        PIUBTN_USB_REQ_TIMEOUT_MS,
+        &res_len);
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    if (res_len != sizeof(output->raw)) {
+      return EIO;
+    }
+
+    piubtn_usb_record_output(ctx, output, start_ns);
+  }
+
+  // Read inputs
   result = pumpio_usb_control_transfer(
-      handle,
-      PIUBTN_USB_CTRL_TYPE_OUT,
-      PIUBTN_USB_CTRL_REQUEST,
+      ctx->usb,
+      PUMPIO_CTRL_TYPE_IN,
+      PUMPIO_CTRL_REQUEST,
       0,
       0,
-      (uint8_t *) output->raw,
-      sizeof(output->raw),
-      PIUBTN_USB_REQ_TIMEOUT,
+      (uint8_t *) input->raw,
+      sizeof(input->raw),
+      PIUBTN_USB_REQ_TIMEOUT_MS,
       &res_len);
 
   if (RESULT_IS_ERROR(result)) {
     return result;
   }
 
-  if (res_len != sizeof(output->raw)) {
+  if (res_len != sizeof(input->raw)) {
     return EIO;
   }
 
-  // Read inputs
-  result = pumpio_usb_control_transfer(
-      handle,
-      PIUBTN_USB_CTRL_TYPE_IN,
-      PIUBTN_USB_CTRL_REQUEST,
+  // Invert pull ups
+  for (uint8_t j = 0; j < sizeof(input->raw); j++) {
+    input->raw[j] ^= 0xFF;
+  }
+
+  ctx->latched = true;
+
+  pumpio_stats_record_cycle(
+      ctx->stats, &ctx->last_cycle_ns, start_ns, pumpio_time_now_ns());
+
+  return RESULT_SUCCESS;
+}
+
+result_t piubtn_usb_poll_deadline(
+    void *handle,
+    const struct piubtn_usb_poll_config *config,
+    const union piubtn_output_paket *output,
+    union piubtn_input_paket *input)
+{
+  struct piubtn_usb_ctx *ctx;
+  struct pumpio_usb_deadline deadline;
+  union piubtn_input_paket paket;
+  result_t result;
+  uint16_t res_len;
+  uint64_t start_ns;
+  bool output_latched;
+
+  assert(handle != NULL);
+  assert(config != NULL);
+  assert(output != NULL);
+  assert(input != NULL);
+
+  ctx = (struct piubtn_usb_ctx *) handle;
+  start_ns = pumpio_time_now_ns();
+
+  deadline.deadline_ns = start_ns + (uint64_t) config->deadline_us * 1000;
+  deadline.timeout_ms = config->transfer_timeout_ms;
+  deadline.backoff_us = config->backoff_us;
+  deadline.backoff_max_us = config->backoff_max_us;
+
+  output_latched = ctx->latched && piubtn_usb_output_diff(ctx, output) == 0;
+  ctx->latched = false;
+
+  // Write outputs, skipped if unchanged since the last poll
+  if (!output_latched) {
+    result = pumpio_usb_control_transfer_deadline(
+        ctx->usb,
+        PUMPIO_CTRL_TYPE_OUT,
+        PUMPIO_CTRL_REQUEST,
+        0,
+        0,
+        (uint8_t *) output->raw,
+        sizeof(output->raw),
+        &deadline,
+        &res_len);
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    if (res_len != sizeof(output->raw)) {
+      return EIO;
+    }
+
+    piubtn_usb_record_output(ctx, output, start_ns);
+  }
+
+  // Read inputs into a temporary buffer to keep the previous data on failure
+  result = pumpio_usb_control_transfer_deadline(
+      ctx->usb,
+      PUMPIO_CTRL_TYPE_IN,
+      PUMPIO_CTRL_REQUEST,
       0,
       0,
-      (uint8_t *) input->raw,
-      sizeof(input->raw),
-      PIUBTN_USB_REQ_TIMEOUT,
+      (uint8_t *) paket.raw,
+      sizeof(paket.raw),
+      &deadline,
       &res_len);
 
   if (RESULT_IS_ERROR(result)) {
     return result;
   }
 
-  if (res_len != sizeof(input->raw)) {
+  if (res_len != sizeof(paket.raw)) {
     return EIO;
   }
 
   // Invert pull ups
-  for (uint8_t j = 0; j < sizeof(input->raw); j++) {
-    input->raw[j] ^= 0xFF;
+  for (uint8_t j = 0; j < sizeof(paket.raw); j++) {
+    input->raw[j] = paket.raw[j] ^ 0xFF;
   }
 
+  ctx->latched = true;
+
+  pumpio_stats_record_cycle(
+      ctx->stats, &ctx->last_cycle_ns, start_ns, pumpio_time_now_ns());
+
   return RESULT_SUCCESS;
 }
 
+void piubtn_usb_set_stats(void *handle, struct pumpio_stats *stats)
+{
+  struct piubtn_usb_ctx *ctx;
+
+  assert(handle != NULL);
+  assert(stats != NULL);
+
+  ctx = (struct piubtn_usb_ctx *) handle;
+
+  ctx->stats = stats;
+  pumpio_usb_set_stats(ctx->usb, stats);
+}
+
 void piubtn_usb_close(void *handle)
 {
+  struct piubtn_usb_ctx *ctx;
+
   assert(handle != NULL);
 
-  pumpio_usb_close(handle);
+  ctx = (struct piubtn_usb_ctx *) handle;
+
+  pumpio_usb_close(ctx->usb);
+  free(ctx);
 }
\ No newline at end of file
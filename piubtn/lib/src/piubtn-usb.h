@@ -10,14 +10,51 @@
 
 #include "piubtn.h"
 #include "result.h"
+#include "usb_.h"
 
 /**
- * Check if a PIUBTN device is connected via USB and available to be opened.
+ * Default timeout of a single transfer in ms used by the polling calls without
+ * explicit timeouts
+ */
+#define PIUBTN_USB_REQ_TIMEOUT_MS 10000
+
+/**
+ * Time bounds of a poll, see piubtn_usb_poll_deadline
+ */
+struct piubtn_usb_poll_config {
+  /* Max. duration of the whole poll in us, measured from the call */
+  uint32_t deadline_us;
+  /* Max. timeout of a single transfer in ms, 0 to use the time left until the
+     deadline only */
+  uint32_t transfer_timeout_ms;
+  /* Time to wait before retrying a failed transfer in us, doubled with every
+     retry up to backoff_max_us */
+  uint32_t backoff_us;
+  uint32_t backoff_max_us;
+};
+
+/**
+ * Check if a PIUBTN device is connected via USB. The device is not opened, see
+ * pumpio_usb_available.
  *
  * @return True if device is connected, false otherwise.
  */
 bool piubtn_usb_available();
 
+/**
+ * Enumerate all PIUBTN devices connected via USB.
+ *
+ * @param infos Pointer to an allocated array to return information about the
+ *              devices found in
+ * @param max_count Number of elements of the infos array
+ * @param count Pointer to a variable to return the total number of devices
+ *              found in, can be larger than max_count
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENOMEM, ENOTSUP
+ */
+result_t piubtn_usb_enumerate(
+    struct pumpio_usb_device_info *infos, size_t max_count, size_t *count);
+
 /**
  * Open a connected PIUBTN device using a user space usb library.
  *
@@ -31,9 +68,28 @@ bool piubtn_usb_available();
  */
 result_t piubtn_usb_open(void **handle);
 
+/**
+ * Open a specific PIUBTN device using a user space usb library. Use this if
+ * multiple PIUBTN devices are connected to the same host.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piubtn_usb_close.
+ * @param id Identifier of the device, either its path (e.g. "1-2.4") or its
+ *           serial number as returned by piubtn_usb_enumerate
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
+ *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
+ */
+result_t piubtn_usb_open_id(void **handle, const char *id);
+
 /**
  * Run a one synchronous polling call setting outputs and getting inputs.
  *
+ * The output transfer is skipped if the outputs did not change since the
+ * previous successful poll, i.e. the device latched them already.
+ *
  * @param handle Valid handle of an opened PIUBTN usb device
  * @param output Pointer to an allocated buffer with the output data to send.
  * @param input Pointer to an allocated buffer for the input data to receive.
@@ -46,6 +102,43 @@ result_t piubtn_usb_poll(
     const union piubtn_output_paket *output,
     union piubtn_input_paket *input);
 
+/**
+ * Run a synchronous polling call (see piubtn_usb_poll) which is bounded by a
+ * deadline. Failed transfers are retried with bounded backoff until the
+ * deadline is reached.
+ *
+ * The device has a single input paket, i.e. the poll either completes or
+ * fails. This matches piuio_usb_poll_full_cycle_deadline which fails if none
+ * of its sub-polls completed.
+ *
+ * @param handle Valid handle of an opened PIUBTN usb device
+ * @param config Time bounds of the poll
+ * @param output Pointer to an allocated buffer with the output data to send.
+ * @param input Pointer to an allocated buffer for the input data to receive.
+ *              Left untouched if the poll does not complete, i.e. it keeps the
+ *              data of a previous poll if the same buffer is reused.
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ETIMEDOUT if the poll did not complete
+ *         before the deadline, EIO if incomplete data was transferred,
+ *         EINVAL, EACCES, ENODEV, ENOENT, EBUSY, ENOMEM, ENOTSUP
+ */
+result_t piubtn_usb_poll_deadline(
+    void *handle,
+    const struct piubtn_usb_poll_config *config,
+    const union piubtn_output_paket *output,
+    union piubtn_input_paket *input);
+
+/**
+ * Record the cycles, transfers and errors of an opened PIUBTN usb device in the
+ * given statistics instead of the process-wide ones (see piubtn-stats.h), e.g.
+ * to evaluate multiple devices individually.
+ *
+ * @param handle Valid handle of an opened PIUBTN usb device
+ * @param stats Pointer to the statistics to record in, must stay valid until
+ *              the device is closed
+ */
+void piubtn_usb_set_stats(void *handle, struct pumpio_stats *stats);
+
 /**
  * Close an opened PIUBTN usb device.
  *
@@ -7,6 +7,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "bench.h"
+#include "piubtn-encoder.h"
 #include "piubtn-usb.h"
 #include "piubtn.h"
 
@@ -48,10 +50,17 @@ static void handle_button_lights_on_input(
   output->btn_light_p2_back = input->btn_p2_back;
 }
 
-static bool draw_menu_tui(struct piubtn_piu_output_paket *output)
+static bool draw_menu_tui(union piubtn_output_paket *output)
 {
+  static struct pumpio_encoder encoder;
+  static bool encoder_initialized = false;
   int state;
 
+  if (!encoder_initialized) {
+    piubtn_encoder_init(&encoder);
+    encoder_initialized = true;
+  }
+
   system("clear");
   printf(
       "Menu options:\n"
@@ -74,29 +83,12 @@ static bool draw_menu_tui(struct piubtn_piu_output_paket *output)
       return false;
 
     case 2:
-      output->btn_light_p1_start = 1;
-      output->btn_light_p1_right = 1;
-      output->btn_light_p1_left = 1;
-      output->btn_light_p1_back = 1;
-
-      output->btn_light_p2_start = 1;
-      output->btn_light_p2_right = 1;
-      output->btn_light_p2_left = 1;
-      output->btn_light_p2_back = 1;
-
+      piubtn_encoder_apply(
+          &encoder, PIUBTN_ENCODER_ALL, PIUBTN_ENCODER_ALL, output);
       break;
 
     case 3:
-      output->btn_light_p1_start = 0;
-      output->btn_light_p1_right = 0;
-      output->btn_light_p1_left = 0;
-      output->btn_light_p1_back = 0;
-
-      output->btn_light_p2_start = 0;
-      output->btn_light_p2_right = 0;
-      output->btn_light_p2_left = 0;
-      output->btn_light_p2_back = 0;
-
+      piubtn_encoder_apply(&encoder, PIUBTN_ENCODER_ALL, 0, output);
       break;
   }
 
@@ -215,7 +207,7 @@ static bool render_tui(
   assert(input != NULL);
 
   if (interrupted) {
-    if (draw_menu_tui(&output->piu)) {
+    if (draw_menu_tui(output)) {
       interrupted = false;
     } else {
       return false;
@@ -229,31 +221,36 @@ static bool render_tui(
   return true;
 }
 
-static bool render_benchmark(
-    union piubtn_output_paket *output,
-    const union piubtn_input_paket *input,
-    double io_time_sec)
+// -----------------------------------------------------------------------------------------
+
+static void proc_list()
 {
-  assert(output);
-  assert(input);
+  struct pumpio_usb_device_info infos[16];
+  size_t count;
+  result_t result;
 
-  static uint64_t counter = 0;
-  static double accu = 0;
+  result = piubtn_usb_enumerate(infos, 16, &count);
 
-  counter++;
-  accu += io_time_sec;
+  if (result) {
+    errno = result;
+    perror("Enumerating PIUBTN devices failed");
+    exit(EXIT_FAILURE);
+  }
 
-  system("clear");
-  printf("Samples: %ld\n", counter);
-  printf("Latest time: %.5f secs\n", io_time_sec);
-  printf("Average time: %.5f secs\n", accu / counter);
+  printf("Found %zu PIUBTN device(s)\n", count);
 
-  return !interrupted;
+  for (size_t i = 0; i < count && i < 16; i++) {
+    printf(
+        "  path %s, bus %d, address %d, serial %s\n",
+        infos[i].path,
+        infos[i].bus,
+        infos[i].address,
+        infos[i].serial[0] ? infos[i].serial : "n/a");
+  }
 }
 
-// -----------------------------------------------------------------------------------------
-
-static void proc_usb(int32_t delay_ms, func_render_data_t render)
+static void
+proc_usb(const char *device_id, int32_t delay_ms, func_render_data_t render)
 {
   void *handle;
   int32_t result;
@@ -272,7 +269,11 @@ static void proc_usb(int32_t delay_ms, func_render_data_t render)
   memset(&output, 0, sizeof(output.raw));
   memset(&input, 0, sizeof(input.raw));
 
-  result = piubtn_usb_open(&handle);
+  if (device_id) {
+    result = piubtn_usb_open_id(&handle, device_id);
+  } else {
+    result = piubtn_usb_open(&handle);
+  }
 
   if (result) {
     errno = result;
@@ -306,6 +307,77 @@ static void proc_usb(int32_t delay_ms, func_render_data_t render)
   piubtn_usb_close(handle);
 }
 
+struct bench_ctx {
+  void *handle;
+  union piubtn_output_paket output;
+  union piubtn_input_paket input;
+};
+
+static result_t bench_poll(void *ctx)
+{
+  struct bench_ctx *bench;
+
+  bench = (struct bench_ctx *) ctx;
+
+  return piubtn_usb_poll(bench->handle, &bench->output, &bench->input);
+}
+
+static void proc_bench(
+    const char *device_id,
+    uint32_t delay_ms,
+    const struct bench_options *bench_options)
+{
+  struct pumpio_bench_config config;
+  struct pumpio_bench_result bench_result;
+  struct bench_ctx bench;
+  result_t result;
+
+  memset(&config, 0, sizeof(config));
+  memset(&bench, 0, sizeof(bench));
+
+  if (device_id) {
+    result = piubtn_usb_open_id(&bench.handle, device_id);
+  } else {
+    result = piubtn_usb_open(&bench.handle);
+  }
+
+  if (result) {
+    errno = result;
+    perror("Opening PIUBTN failed");
+    exit(EXIT_FAILURE);
+  }
+
+  config.warmup = bench_options->warmup;
+  config.samples = bench_options->samples;
+  config.duration_ms = bench_options->duration_s * 1000;
+  config.delay_us = delay_ms * 1000;
+
+  // Status to stderr, keeps stdout clean for the csv/json results
+  fprintf(
+      stderr,
+      "Running %u warmup iterations, then measuring, press CTRL + C to "
+      "stop early\n",
+      config.warmup);
+
+  result = pumpio_bench_run(
+      &config, bench_poll, &bench, &interrupted, &bench_result);
+
+  if (result) {
+    errno = result;
+    perror("Running benchmark for PIUBTN failed");
+    exit(EXIT_FAILURE);
+  }
+
+  pumpio_bench_print(
+      stdout,
+      "piubtn-usb",
+      &config,
+      &bench_result,
+      (enum pumpio_bench_format) bench_options->format);
+
+  piubtn_usb_close(bench.handle);
+}
+
 // -----------------------------------------------------------------------------------------
 
 int main(int argc, char *argv[])
@@ -320,13 +392,15 @@ int main(int argc, char *argv[])
   }
 
   if (options.mode == MODE_RAW) {
-    proc_usb(options.delay_ms, render_raw);
+    proc_usb(options.device_id, options.delay_ms, render_raw);
   } else if (options.mode == MODE_TEXT) {
-    proc_usb(options.delay_ms, render_text);
+    proc_usb(options.device_id, options.delay_ms, render_text);
   } else if (options.mode == MODE_TUI) {
-    proc_usb(options.delay_ms, render_tui);
+    proc_usb(options.device_id, options.delay_ms, render_tui);
   } else if (options.mode == MODE_BENCHMARK) {
-    proc_usb(options.delay_ms, render_benchmark);
+    proc_bench(options.device_id, options.delay_ms, &options.bench);
+  } else if (options.mode == MODE_LIST) {
+    proc_list();
   } else {
     fprintf(stderr, "Invalid parameters selected\n");
     print_usage(argv);
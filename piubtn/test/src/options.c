@@ -13,6 +13,11 @@ static void options_init_defaults(struct options *options)
 
   options->mode = MODE_RAW;
   options->delay_ms = 100;
+  options->device_id = NULL;
+  options->bench.warmup = 100;
+  options->bench.samples = 0;
+  options->bench.duration_s = 0;
+  options->bench.format = BENCH_FORMAT_TEXT;
 }
 
 void print_usage(char **argv)
@@ -31,15 +36,32 @@ void print_usage(char **argv)
       "outputs\n"
       "        bench: Benchmark the update call driving IO. Useful to debug "
       "performance/hardware issues\n"
-      "  -d  Update loop delay in ms, use to reduce CPU load (default: 100)\n");
+      "        list: List all connected devices and exit\n"
+      "  -d  Update loop delay in ms, use to reduce CPU load (default: 100, "
+      "bench: 0)\n"
+      "  -i  Path (e.g. 1-2.4) or serial number of the device to open if "
+      "multiple are connected, see list mode\n"
+      "Benchmark options:\n"
+      "  -w  Number of warmup iterations not measured (default: 100)\n"
+      "  -n  Number of samples to measure (default: 10000, unlimited if -T "
+      "is set)\n"
+      "  -T  Max. time to measure in seconds, stops on -n or -T, whichever "
+      "comes first\n"
+      "  -o  Output format of the results (default: text)\n"
+      "        text: Human readable\n"
+      "        csv: Header and a line of values per backend\n"
+      "        json: Single object\n");
 }
 
 bool parse_args(struct options *options, int argc, char **argv)
 {
+  bool delay_set;
+
   assert(options != NULL);
   assert(argv != NULL);
 
   options_init_defaults(options);
+  delay_set = false;
 
   for (int32_t i = 1; i < argc; i++) {
     if (!strcmp(argv[i], "-h")) {
@@ -60,6 +82,8 @@ bool parse_args(struct options *options, int argc, char **argv)
         options->mode = MODE_TEXT;
       } else if (!strcmp(argv[i], "bench")) {
         options->mode = MODE_BENCHMARK;
+      } else if (!strcmp(argv[i], "list")) {
+        options->mode = MODE_LIST;
       } else {
         fprintf(stderr, "Invalid parameter for -m argument\n");
         return false;
@@ -82,8 +106,100 @@ bool parse_args(struct options *options, int argc, char **argv)
       }
 
       options->delay_ms = tmp;
+      delay_set = true;
+    } else if (!strcmp(argv[i], "-i")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -i argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->device_id = argv[i];
+    } else if (!strcmp(argv[i], "-w")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -w argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 0) {
+        fprintf(stderr, "Invalid value for for -w argument, must be >= 0\n");
+        return false;
+      }
+
+      options->bench.warmup = tmp;
+    } else if (!strcmp(argv[i], "-n")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -n argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for for -n argument, must be > 0\n");
+        return false;
+      }
+
+      options->bench.samples = tmp;
+    } else if (!strcmp(argv[i], "-T")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -T argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for for -T argument, must be > 0\n");
+        return false;
+      }
+
+      options->bench.duration_s = tmp;
+    } else if (!strcmp(argv[i], "-o")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -o argument\n");
+        return false;
+      }
+
+      i++;
+
+      if (!strcmp(argv[i], "text")) {
+        options->bench.format = BENCH_FORMAT_TEXT;
+      } else if (!strcmp(argv[i], "csv")) {
+        options->bench.format = BENCH_FORMAT_CSV;
+      } else if (!strcmp(argv[i], "json")) {
+        options->bench.format = BENCH_FORMAT_JSON;
+      } else {
+        fprintf(stderr, "Invalid parameter for -o argument\n");
+        return false;
+      }
     }
   }
 
+  // Benchmark back to back unless a delay is requested explicitly
+  if (options->mode == MODE_BENCHMARK && !delay_set) {
+    options->delay_ms = 0;
+  }
+
+  // Without any limit, measure a fixed number of samples
+  if (options->bench.samples == 0 && options->bench.duration_s == 0) {
+    options->bench.samples = 10000;
+  }
+
   return true;
-}
\ No newline at end of file
+}
@@ -10,11 +10,27 @@ enum mode {
   MODE_TEXT = 1,
   MODE_TUI = 2,
   MODE_BENCHMARK = 3,
+  MODE_LIST = 4,
+};
+
+enum bench_format {
+  BENCH_FORMAT_TEXT = 0,
+  BENCH_FORMAT_CSV = 1,
+  BENCH_FORMAT_JSON = 2,
+};
+
+struct bench_options {
+  uint32_t warmup;
+  uint32_t samples;
+  uint32_t duration_s;
+  enum bench_format format;
 };
 
 struct options {
   enum mode mode;
   uint32_t delay_ms;
+  const char *device_id;
+  struct bench_options bench;
 };
 
 void print_usage(char **argv);
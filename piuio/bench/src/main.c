@@ -0,0 +1,565 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "devices.h"
+#include "piuio-debounce.h"
+#include "piuio-encoder.h"
+#include "piuio-history.h"
+#include "piuio-latch.h"
+#include "piuio-sim.h"
+#include "piuio-state.h"
+#include "piuio-usb.h"
+#include "piuio.h"
+#include "stats.h"
+#include "time_.h"
+#include "usb_.h"
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+/* Number of cycles of the synthetic trace, power of two */
+#define TRACE_SIZE 4096
+#define TRACE_MASK (TRACE_SIZE - 1)
+
+/* Min. duration of a single measuring round */
+#define ROUND_MIN_NS 20000000
+
+#define ROUNDS_DEFAULT 11
+#define ROUNDS_MAX 101
+
+#define LATCH_READERS 4
+
+typedef uint64_t (*func_bench_t)(uint64_t iterations);
+
+struct bench {
+  const char *name;
+  func_bench_t func;
+};
+
+enum format {
+  FORMAT_TEXT = 0,
+  FORMAT_CSV = 1,
+};
+
+struct options {
+  uint32_t rounds;
+  enum format format;
+  const char *filter;
+};
+
+/* Results are written here to keep the compiler from dropping the work */
+static volatile uint64_t sink;
+
+static uint64_t trace[TRACE_SIZE];
+static struct piuio_usb_input_batch_paket trace_batches[TRACE_SIZE];
+
+static struct piuio_debounce debounce;
+static struct pumpio_encoder encoder;
+static struct piuio_latch latch;
+static struct piuio_latch_reader latch_readers[LATCH_READERS];
+static struct piuio_history history;
+static struct pumpio_stats transport_stats;
+static struct piuio_sim sim;
+static void *transport_handle;
+static void *sim_handle;
+
+// -----------------------------------------------------------------------------------------
+
+static uint64_t xorshift64(uint64_t *seed)
+{
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+
+  return *seed;
+}
+
+/**
+ * Generate a synthetic trace of a session: panels are stepped on and off at
+ * random with a few cycles of contact bounce on every transition, operator
+ * inputs are rarely active. Fixed seed, identical for every run.
+ */
+static void trace_generate()
+{
+  uint64_t seed;
+  uint64_t state;
+  uint64_t bounce;
+  uint64_t panel;
+
+  seed = UINT64_C(0x9E3779B97F4A7C15);
+  state = 0;
+  bounce = 0;
+
+  for (uint32_t i = 0; i < TRACE_SIZE; i++) {
+    for (uint8_t player = 0; player < PIUIO_STATE_PLAYER_COUNT; player++) {
+      for (uint8_t j = 0; j < PIUIO_STATE_PANEL_COUNT; j++) {
+        // Change a panel about every 100 cycles, bouncing for a few cycles
+        if (xorshift64(&seed) % 100 == 0) {
+          panel = PIUIO_STATE_PANEL_MASK(player, j);
+          state ^= panel;
+          bounce |= panel;
+        }
+      }
+    }
+
+    if (bounce != 0 && xorshift64(&seed) % 4 == 0) {
+      bounce = 0;
+    }
+
+    if (xorshift64(&seed) % 1000 == 0) {
+      state ^= UINT64_C(1) << PIUIO_STATE_OPERATOR_1_SHIFT;
+    }
+
+    trace[i] = state ^ (bounce & xorshift64(&seed));
+
+    // Batch as received from the device, i.e. with pull ups
+    piuio_sim_set_state(&sim, trace[i]);
+
+    for (uint8_t j = 0; j < PIUIO_SENSOR_MASK_TOTAL_COUNT; j++) {
+      trace_batches[i].pakets[j] = sim.inputs[j];
+      piuio_state_invert_pull_ups(&trace_batches[i].pakets[j]);
+    }
+  }
+}
+
+static result_t transport_noop(
+    void *ctx,
+    uint8_t request_type,
+    uint8_t request,
+    uint16_t value,
+    uint16_t index,
+    uint8_t *data,
+    uint16_t len,
+    uint32_t timeout_ms,
+    uint16_t *len_res)
+{
+  *len_res = len;
+
+  return RESULT_SUCCESS;
+}
+
+static void setup()
+{
+  result_t result;
+
+  piuio_sim_init(&sim);
+  trace_generate();
+  piuio_sim_init(&sim);
+
+  piuio_debounce_init(&debounce, 3, 3);
+
+  piuio_encoder_init_piu(&encoder);
+
+  piuio_latch_init(&latch);
+
+  for (uint8_t i = 0; i < LATCH_READERS; i++) {
+    piuio_latch_reader_open(&latch, &latch_readers[i]);
+  }
+
+  piuio_history_init(&history);
+
+  result = pumpio_usb_open_transport(&transport_handle, transport_noop, NULL);
+
+  if (RESULT_IS_SUCCESS(result)) {
+    result = piuio_sim_open(&sim, &sim_handle);
+  }
+
+  if (RESULT_IS_ERROR(result)) {
+    errno = result;
+    perror("Opening transports failed");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void teardown()
+{
+  piuio_usb_close(sim_handle);
+  pumpio_usb_close(transport_handle);
+
+  for (uint8_t i = 0; i < LATCH_READERS; i++) {
+    piuio_latch_reader_close(&latch_readers[i]);
+  }
+}
+
+// -----------------------------------------------------------------------------------------
+
+static uint64_t bench_pull_up_inversion(uint64_t iterations)
+{
+  struct piuio_usb_input_batch_paket batch;
+  uint64_t accu;
+
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    // Work on a copy, the trace is shared with the other benchmarks
+    batch = trace_batches[i & TRACE_MASK];
+
+    for (uint8_t j = 0; j < PIUIO_SENSOR_MASK_TOTAL_COUNT; j++) {
+      piuio_state_invert_pull_ups(&batch.pakets[j]);
+    }
+
+    accu += batch.pakets[0].raw[0];
+  }
+
+  return accu;
+}
+
+static uint64_t bench_state_decode(uint64_t iterations)
+{
+  uint64_t accu;
+
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    accu ^= piuio_state_decode(&trace_batches[i & TRACE_MASK]);
+  }
+
+  return accu;
+}
+
+static uint64_t bench_debounce(uint64_t iterations)
+{
+  uint64_t accu;
+
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    accu ^= piuio_debounce_update(&debounce, trace[i & TRACE_MASK]);
+  }
+
+  return accu;
+}
+
+static uint64_t bench_latch_publish(uint64_t iterations)
+{
+  struct piuio_latch_result result;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    piuio_latch_publish(&latch, trace[i & TRACE_MASK]);
+  }
+
+  piuio_latch_reader_read(&latch_readers[0], &result);
+
+  return result.pressed;
+}
+
+static uint64_t bench_latch_read(uint64_t iterations)
+{
+  struct piuio_latch_result result;
+  uint64_t accu;
+
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    piuio_latch_publish(&latch, trace[i & TRACE_MASK]);
+    piuio_latch_reader_read(&latch_readers[i % LATCH_READERS], &result);
+    accu ^= result.pressed;
+  }
+
+  return accu;
+}
+
+static uint64_t bench_history_push(uint64_t iterations)
+{
+  static uint64_t time_ns = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    time_ns += 1000;
+    piuio_history_push(&history, time_ns, trace[i & TRACE_MASK], 0);
+  }
+
+  return time_ns;
+}
+
+static uint64_t bench_output_bitfields(uint64_t iterations)
+{
+  union piuio_output_paket paket;
+  uint64_t accu;
+  uint64_t mask;
+
+  memset(&paket, 0, sizeof(paket));
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    // Outputs of a cycle derived from the trace, same as bench_output_encode
+    mask = trace[i & TRACE_MASK];
+
+    paket.piu.pad_light_p1_lu = (mask >> PIUIO_ENCODER_PIU_PAD_P1_LU) & 1;
+    paket.piu.pad_light_p1_ru = (mask >> PIUIO_ENCODER_PIU_PAD_P1_RU) & 1;
+    paket.piu.pad_light_p1_cn = (mask >> PIUIO_ENCODER_PIU_PAD_P1_CN) & 1;
+    paket.piu.pad_light_p1_ld = (mask >> PIUIO_ENCODER_PIU_PAD_P1_LD) & 1;
+    paket.piu.pad_light_p1_rd = (mask >> PIUIO_ENCODER_PIU_PAD_P1_RD) & 1;
+    paket.piu.pad_light_p2_lu = (mask >> PIUIO_ENCODER_PIU_PAD_P2_LU) & 1;
+    paket.piu.pad_light_p2_ru = (mask >> PIUIO_ENCODER_PIU_PAD_P2_RU) & 1;
+    paket.piu.pad_light_p2_cn = (mask >> PIUIO_ENCODER_PIU_PAD_P2_CN) & 1;
+    paket.piu.pad_light_p2_ld = (mask >> PIUIO_ENCODER_PIU_PAD_P2_LD) & 1;
+    paket.piu.pad_light_p2_rd = (mask >> PIUIO_ENCODER_PIU_PAD_P2_RD) & 1;
+    paket.piu.light_bass = (mask >> PIUIO_ENCODER_PIU_BASS) & 1;
+    paket.piu.top_lamp_l1 = (mask >> PIUIO_ENCODER_PIU_TOP_LAMP_L1) & 1;
+    paket.piu.top_lamp_l2 = (mask >> PIUIO_ENCODER_PIU_TOP_LAMP_L2) & 1;
+    paket.piu.top_lamp_r1 = (mask >> PIUIO_ENCODER_PIU_TOP_LAMP_R1) & 1;
+    paket.piu.top_lamp_r2 = (mask >> PIUIO_ENCODER_PIU_TOP_LAMP_R2) & 1;
+    paket.piu.coin_counter_1 = (mask >> PIUIO_ENCODER_PIU_COIN_COUNTER_1) & 1;
+    paket.piu.coin_counter_2 = (mask >> PIUIO_ENCODER_PIU_COIN_COUNTER_2) & 1;
+
+    accu += paket.raw[i & (PIUIO_OUTPUT_PAKET_SIZE - 1)];
+  }
+
+  return accu;
+}
+
+static uint64_t bench_output_encode(uint64_t iterations)
+{
+  union piuio_output_paket paket;
+  uint64_t accu;
+
+  memset(&paket, 0, sizeof(paket));
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    accu += piuio_encoder_apply(
+        &encoder, PIUIO_ENCODER_PIU_ALL, trace[i & TRACE_MASK], &paket);
+  }
+
+  return accu + paket.raw[0];
+}
+
+static uint64_t bench_transfer(uint64_t iterations)
+{
+  union piuio_input_paket paket;
+  uint64_t accu;
+  uint16_t len;
+
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    pumpio_usb_control_transfer(
+        transport_handle,
+        PUMPIO_CTRL_TYPE_IN,
+        PUMPIO_CTRL_REQUEST,
+        0,
+        0,
+        paket.raw,
+        sizeof(paket),
+        0,
+        &len);
+    accu += len;
+  }
+
+  return accu;
+}
+
+static uint64_t bench_transfer_stats(uint64_t iterations)
+{
+  uint64_t accu;
+
+  pumpio_usb_set_stats(transport_handle, &transport_stats);
+  accu = bench_transfer(iterations);
+  pumpio_usb_set_stats(transport_handle, NULL);
+
+  return accu;
+}
+
+static uint64_t bench_sim_full_cycle(uint64_t iterations)
+{
+  union piuio_output_paket output;
+  struct piuio_usb_input_batch_paket input;
+  uint64_t accu;
+
+  memset(&output, 0, sizeof(output));
+  accu = 0;
+
+  for (uint64_t i = 0; i < iterations; i++) {
+    piuio_sim_set_state(&sim, trace[i & TRACE_MASK]);
+    piuio_usb_poll_full_cycle(sim_handle, &output, &input);
+    accu ^= piuio_state_decode(&input);
+  }
+
+  return accu;
+}
+
+static const struct bench benches[] = {
+    {"pull-up-inversion", bench_pull_up_inversion},
+    {"state-decode", bench_state_decode},
+    {"debounce", bench_debounce},
+    {"latch-publish", bench_latch_publish},
+    {"latch-publish-read", bench_latch_read},
+    {"history-push", bench_history_push},
+    {"output-bitfields", bench_output_bitfields},
+    {"output-encode", bench_output_encode},
+    {"usb-transfer", bench_transfer},
+    {"usb-transfer-stats", bench_transfer_stats},
+    {"sim-full-cycle", bench_sim_full_cycle},
+};
+
+// -----------------------------------------------------------------------------------------
+
+static int compare_double(const void *a, const void *b)
+{
+  double va;
+  double vb;
+
+  va = *((const double *) a);
+  vb = *((const double *) b);
+
+  return (va > vb) - (va < vb);
+}
+
+/**
+ * Find a number of iterations running for at least ROUND_MIN_NS
+ */
+static uint64_t calibrate(func_bench_t func)
+{
+  uint64_t iterations;
+  uint64_t start_ns;
+  uint64_t elapsed_ns;
+
+  iterations = 1;
+
+  while (true) {
+    start_ns = pumpio_time_now_ns();
+    sink = func(iterations);
+    elapsed_ns = pumpio_time_now_ns() - start_ns;
+
+    if (elapsed_ns >= ROUND_MIN_NS) {
+      return iterations;
+    }
+
+    iterations *= 2;
+  }
+}
+
+static void run(const struct bench *bench, const struct options *options)
+{
+  double ns_per_op[ROUNDS_MAX];
+  uint64_t iterations;
+  uint64_t start_ns;
+  uint64_t elapsed_ns;
+
+  // Calibration doubles as warmup
+  iterations = calibrate(bench->func);
+
+  for (uint32_t i = 0; i < options->rounds; i++) {
+    start_ns = pumpio_time_now_ns();
+    sink = bench->func(iterations);
+    elapsed_ns = pumpio_time_now_ns() - start_ns;
+
+    ns_per_op[i] = (double) elapsed_ns / iterations;
+  }
+
+  qsort(ns_per_op, options->rounds, sizeof(double), compare_double);
+
+  // Median is robust against rounds disturbed by the system
+  if (options->format == FORMAT_CSV) {
+    printf(
+        "%s,%.3f,%.3f,%.3f,%lu,%u\n",
+        bench->name,
+        ns_per_op[options->rounds / 2],
+        ns_per_op[0],
+        ns_per_op[options->rounds - 1],
+        iterations,
+        options->rounds);
+  } else {
+    printf(
+        "%-20s %10.2f ns/op  (min %.2f, max %.2f, %lu iterations x %u "
+        "rounds)\n",
+        bench->name,
+        ns_per_op[options->rounds / 2],
+        ns_per_op[0],
+        ns_per_op[options->rounds - 1],
+        iterations,
+        options->rounds);
+  }
+}
+
+// -----------------------------------------------------------------------------------------
+
+static void print_usage(char **argv)
+{
+  printf(
+      "piuio-bench tool, build " __DATE__ " " __TIME__ " gitrev %s\n",
+      STRINGIFY(GITREV));
+  printf("Usage: %s [OPTION] ...\n", argv[0]);
+  printf(
+      "Hardware-free microbenchmarks of the CPU-side hot paths of a polling "
+      "cycle, run against a simulated device and a synthetic trace\n"
+      "  -h  Print this help/usage message\n"
+      "  -r  Number of measuring rounds, the median is reported (default: "
+      "11)\n"
+      "  -f  Only run benchmarks containing the given string in their name\n"
+      "  -o  Output format (default: text)\n"
+      "        text: Human readable\n"
+      "        csv: Header and a line per benchmark, times in ns/op\n");
+}
+
+static bool parse_args(struct options *options, int argc, char **argv)
+{
+  options->rounds = ROUNDS_DEFAULT;
+  options->format = FORMAT_TEXT;
+  options->filter = NULL;
+
+  for (int32_t i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-h")) {
+      return false;
+    } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      i++;
+      options->rounds = atoi(argv[i]);
+
+      if (options->rounds < 1 || options->rounds > ROUNDS_MAX) {
+        fprintf(stderr, "Invalid value for -r argument, must be 1-101\n");
+        return false;
+      }
+    } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+      i++;
+      options->filter = argv[i];
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      i++;
+
+      if (!strcmp(argv[i], "text")) {
+        options->format = FORMAT_TEXT;
+      } else if (!strcmp(argv[i], "csv")) {
+        options->format = FORMAT_CSV;
+      } else {
+        fprintf(stderr, "Invalid parameter for -o argument\n");
+        return false;
+      }
+    } else {
+      fprintf(stderr, "Invalid argument %s\n", argv[i]);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  struct options options;
+
+  if (!parse_args(&options, argc, argv)) {
+    print_usage(argv);
+    return EXIT_FAILURE;
+  }
+
+  setup();
+
+  if (options.format == FORMAT_CSV) {
+    printf("name,ns_per_op,min_ns_per_op,max_ns_per_op,iterations,rounds\n");
+  }
+
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    if (options.filter != NULL && !strstr(benches[i].name, options.filter)) {
+      continue;
+    }
+
+    run(&benches[i], &options);
+  }
+
+  teardown();
+
+  return EXIT_SUCCESS;
+}
@@ -18,9 +18,13 @@
 #include <linux/kref.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/uaccess.h>
 #include <linux/usb.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 // -------------------------------------------------------------------------
 
@@ -42,6 +46,9 @@ MODULE_PARM_DESC(
 static int piuio_open(struct inode *inode, struct file *filp);
 static ssize_t
 piuio_read(struct file *filp, char __user *ubuf, size_t sz, loff_t *pofs);
+static ssize_t piuio_write(
+    struct file *filp, const char __user *ubuf, size_t sz, loff_t *pofs);
+static __poll_t piuio_poll(struct file *filp, poll_table *wait);
 static int piuio_release(struct inode *inode, struct file *filp);
 
 /* File operations for /dev/piuioN */
@@ -49,6 +56,8 @@ static const struct file_operations piuio_fops = {
     .owner = THIS_MODULE,
     .open = piuio_open,
     .read = piuio_read,
+    .write = piuio_write,
+    .poll = piuio_poll,
     .release = piuio_release,
 };
 
@@ -82,6 +91,9 @@ static struct usb_driver piuio_driver = {
 
 static struct usb_driver piuio_driver;
 
+/* Runs the cycles started by write, drained on module unload */
+static struct workqueue_struct *piuio_wq;
+
 // -------------------------------------------------------------------------
 
 /* Protocol-specific parameters */
@@ -101,7 +113,7 @@ struct piuio_state {
   /* USB device and interface */
   struct usb_device *dev;
   struct usb_interface *intf;
-  /* Concurrency control */
+  /* Concurrency control, held for the transfers of a cycle */
   struct mutex lock;
   struct kref kref;
   // Native data buffers for reading/writing device
@@ -110,6 +122,20 @@ struct piuio_state {
   // (EAGAIN)
   unsigned char outputs[PIUIO_OUTPUT_PACKET_SIZE];
   unsigned char inputs[PIUIO_INPUT_PACKET_SIZE * PIUIO_INPUT_MULTIPLEX_NUM];
+  /* Asynchronous cycle started by write, see piuio_write. The cycle state
+     is guarded by cycle_lock, never held while transferring, to not block
+     poll and non-blocking calls */
+  struct work_struct cycle_work;
+  wait_queue_head_t cycle_wait;
+  spinlock_t cycle_lock;
+  /* File which started the cycle, NULL if closed before it completed */
+  struct file *cycle_owner;
+  bool cycle_pending;
+  bool cycle_done;
+  int cycle_result;
+  unsigned char cycle_outputs[PIUIO_OUTPUT_PACKET_SIZE];
+  unsigned char
+      cycle_inputs[PIUIO_INPUT_PACKET_SIZE * PIUIO_INPUT_MULTIPLEX_NUM];
 };
 
 // -------------------------------------------------------------------------
@@ -167,35 +193,13 @@ static int piuio_open(struct inode *inode, struct file *filp)
 }
 
 /**
- * Single read call to write the current output state (lights) as well as
- * fetch a full input update cycle of all sensores. This call expects the
- * output lights data to be in the first 8 bytes of the buffer.
- * The buffer is fully populated with 4x input data (multiplexed sensores).
+ * Run a full update cycle with the outputs of the state, lock held
  */
-static ssize_t
-piuio_read(struct file *filp, char __user *ubuf, size_t sz, loff_t *pofs)
+static int piuio_cycle(struct piuio_state *st)
 {
-  struct piuio_state *st;
   int i;
   int result = 0;
 
-  st = filp->private_data;
-
-  mutex_lock(&st->lock);
-
-  /* Device closed */
-  if (!st->intf) {
-    result = -ENODEV;
-    goto out;
-  }
-
-  /* Transfer user space buffered outputs to kernel buffer, required */
-  if (copy_from_user(st->outputs, ubuf, sizeof(st->outputs))) {
-    result = -EFAULT;
-    goto out;
-  }
-
-  /* Run a full update cycle */
   for (i = 0; i < PIUIO_INPUT_MULTIPLEX_NUM; i++) {
     /* Select set of sensores for next inputs to fetch */
     st->outputs[0] = (st->outputs[0] & ~0x03) | i;
@@ -214,7 +218,7 @@ piuio_read(struct file *filp, char __user *ubuf, size_t sz, loff_t *pofs)
         timeout_ms);
 
     if (result < 0) {
-      goto out;
+      return result;
     }
 
     /* Get inputs selected by sensor mask */
@@ -230,8 +234,146 @@ piuio_read(struct file *filp, char __user *ubuf, size_t sz, loff_t *pofs)
         timeout_ms);
 
     if (result < 0) {
-      goto out;
+      return result;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Run a cycle started by write on the work queue
+ */
+static void piuio_cycle_work(struct work_struct *work)
+{
+  struct piuio_state *st = container_of(work, struct piuio_state, cycle_work);
+  int result;
+
+  mutex_lock(&st->lock);
+
+  if (st->intf) {
+    /* Not changed by write while the cycle is pending */
+    memcpy(st->outputs, st->cycle_outputs, sizeof(st->outputs));
+    result = piuio_cycle(st);
+    memcpy(st->cycle_inputs, st->inputs, sizeof(st->cycle_inputs));
+  } else {
+    result = -ENODEV;
+  }
+
+  mutex_unlock(&st->lock);
+
+  spin_lock(&st->cycle_lock);
+  st->cycle_result = result;
+  st->cycle_pending = false;
+  /* Dropped if its file was closed meanwhile */
+  st->cycle_done = st->cycle_owner != NULL;
+  spin_unlock(&st->cycle_lock);
+
+  wake_up_interruptible(&st->cycle_wait);
+
+  /* Drop the reference taken by piuio_write */
+  kref_put(&st->kref, piuio_free);
+}
+
+/**
+ * Check if the cycle started by the file is still in flight
+ */
+static bool piuio_cycle_in_flight(struct piuio_state *st, struct file *filp)
+{
+  bool in_flight;
+
+  spin_lock(&st->cycle_lock);
+  in_flight = st->cycle_pending && st->cycle_owner == filp;
+  spin_unlock(&st->cycle_lock);
+
+  return in_flight;
+}
+
+/**
+ * Single read call to write the current output state (lights) as well as
+ * fetch a full input update cycle of all sensores. This call expects the
+ * output lights data to be in the first 8 bytes of the buffer.
+ * The buffer is fully populated with 4x input data (multiplexed sensores).
+ *
+ * If the file started a cycle with write, the outputs of the buffer are
+ * ignored and the inputs of that cycle are returned instead. The call blocks
+ * until it completed or fails with EAGAIN if the file is non-blocking.
+ */
+static ssize_t
+piuio_read(struct file *filp, char __user *ubuf, size_t sz, loff_t *pofs)
+{
+  struct piuio_state *st;
+  unsigned char inputs[sizeof(st->cycle_inputs)];
+  bool owner;
+  int result = 0;
+
+  st = filp->private_data;
+
+  /* Collect the cycle started by write */
+  while (piuio_cycle_in_flight(st, filp)) {
+    if (filp->f_flags & O_NONBLOCK) {
+      return -EAGAIN;
+    }
+
+    if (wait_event_interruptible(
+            st->cycle_wait, !piuio_cycle_in_flight(st, filp))) {
+      return -ERESTARTSYS;
+    }
+  }
+
+  spin_lock(&st->cycle_lock);
+
+  owner = st->cycle_done && st->cycle_owner == filp;
+
+  if (owner) {
+    result = st->cycle_result;
+    memcpy(inputs, st->cycle_inputs, sizeof(inputs));
+    st->cycle_done = false;
+    st->cycle_owner = NULL;
+  }
+
+  spin_unlock(&st->cycle_lock);
+
+  if (owner) {
+    wake_up_interruptible(&st->cycle_wait);
+
+    if (result < 0) {
+      return result;
+    }
+
+    if (copy_to_user(ubuf, inputs, sizeof(inputs))) {
+      return -EFAULT;
     }
+
+    return sizeof(inputs);
+  }
+
+  /* Synchronous cycle, don't sleep on a cycle of another file if
+     non-blocking */
+  if (filp->f_flags & O_NONBLOCK) {
+    if (!mutex_trylock(&st->lock)) {
+      return -EAGAIN;
+    }
+  } else {
+    mutex_lock(&st->lock);
+  }
+
+  /* Device closed */
+  if (!st->intf) {
+    result = -ENODEV;
+    goto out;
+  }
+
+  /* Transfer user space buffered outputs to kernel buffer, required */
+  if (copy_from_user(st->outputs, ubuf, sizeof(st->outputs))) {
+    result = -EFAULT;
+    goto out;
+  }
+
+  result = piuio_cycle(st);
+
+  if (result < 0) {
+    goto out;
   }
 
   if (copy_to_user(ubuf, st->inputs, sizeof(st->inputs))) {
@@ -249,12 +391,98 @@ out:
   }
 }
 
+/**
+ * Start a full update cycle with the outputs (lights) of the buffer without
+ * blocking. Completion is signaled as readable by poll, the inputs are
+ * collected with read on the same file. Only a single cycle can be in flight
+ * per device.
+ */
+static ssize_t piuio_write(
+    struct file *filp, const char __user *ubuf, size_t sz, loff_t *pofs)
+{
+  struct piuio_state *st;
+  unsigned char outputs[PIUIO_OUTPUT_PACKET_SIZE];
+  int result = 0;
+
+  st = filp->private_data;
+
+  if (sz != PIUIO_OUTPUT_PACKET_SIZE) {
+    return -EINVAL;
+  }
+
+  if (copy_from_user(outputs, ubuf, sizeof(outputs))) {
+    return -EFAULT;
+  }
+
+  spin_lock(&st->cycle_lock);
+
+  /* Device closed, the cycle checks again with the device lock held */
+  if (!READ_ONCE(st->intf)) {
+    result = -ENODEV;
+    goto out;
+  }
+
+  /* Previous cycle not collected, yet */
+  if (st->cycle_pending || st->cycle_done) {
+    result = -EBUSY;
+    goto out;
+  }
+
+  memcpy(st->cycle_outputs, outputs, sizeof(st->cycle_outputs));
+  st->cycle_owner = filp;
+  st->cycle_pending = true;
+
+  /* The state must outlive the cycle, dropped by piuio_cycle_work */
+  kref_get(&st->kref);
+  queue_work(piuio_wq, &st->cycle_work);
+
+out:
+  spin_unlock(&st->cycle_lock);
+
+  if (result < 0) {
+    return result;
+  } else {
+    return sz;
+  }
+}
+
+/**
+ * Readable once a cycle started by the file completed, writable if no cycle
+ * is in flight or waiting to be collected
+ */
+static __poll_t piuio_poll(struct file *filp, poll_table *wait)
+{
+  struct piuio_state *st;
+  __poll_t mask = 0;
+
+  st = filp->private_data;
+
+  poll_wait(filp, &st->cycle_wait, wait);
+
+  spin_lock(&st->cycle_lock);
+
+  if (st->cycle_done && st->cycle_owner == filp) {
+    mask |= EPOLLIN | EPOLLRDNORM;
+  } else if (!st->cycle_pending && !st->cycle_done) {
+    mask |= EPOLLOUT | EPOLLWRNORM;
+  }
+
+  spin_unlock(&st->cycle_lock);
+
+  if (!READ_ONCE(st->intf)) {
+    mask |= EPOLLHUP | EPOLLERR;
+  }
+
+  return mask;
+}
+
 /**
  * Cleans up after the last close() on a file descriptor
  */
 static int piuio_release(struct inode *inode, struct file *filp)
 {
   struct piuio_state *st;
+  bool dropped;
 
   st = filp->private_data;
 
@@ -262,10 +490,31 @@ static int piuio_release(struct inode *inode, struct file *filp)
     return -ENODEV;
   }
 
+  /* Drop a cycle of this file only, one in flight is dropped on
+     completion */
+  spin_lock(&st->cycle_lock);
+
+  dropped = st->cycle_owner == filp;
+
+  if (dropped) {
+    st->cycle_owner = NULL;
+    st->cycle_done = false;
+  }
+
+  spin_unlock(&st->cycle_lock);
+
+  if (dropped) {
+    wake_up_interruptible(&st->cycle_wait);
+  }
+
+  mutex_lock(&st->lock);
+
   if (st->intf) {
     usb_autopm_put_interface(st->intf);
   }
 
+  mutex_unlock(&st->lock);
+
   /* Drop reference */
   kref_put(&st->kref, piuio_free);
 
@@ -293,6 +542,9 @@ piuio_probe(struct usb_interface *intf, const struct usb_device_id *id)
 
   kref_init(&st->kref);
   mutex_init(&st->lock);
+  spin_lock_init(&st->cycle_lock);
+  INIT_WORK(&st->cycle_work, piuio_cycle_work);
+  init_waitqueue_head(&st->cycle_wait);
 
   st->dev = usb_get_dev(interface_to_usbdev(intf));
   st->intf = intf;
@@ -323,9 +575,12 @@ static void piuio_disconnect(struct usb_interface *intf)
   usb_deregister_dev(intf, &piuio_class);
 
   mutex_lock(&st->lock);
-  st->intf = NULL;
+  WRITE_ONCE(st->intf, NULL);
   mutex_unlock(&st->lock);
 
+  /* Wake up pollers to report the hang up */
+  wake_up_interruptible(&st->cycle_wait);
+
   kref_put(&st->kref, piuio_free);
 }
 
@@ -336,7 +591,22 @@ static void piuio_disconnect(struct usb_interface *intf)
  */
 static int __init piuio_init(void)
 {
-  return usb_register(&piuio_driver);
+  int result;
+
+  /* High priority, cycles are latency sensitive */
+  piuio_wq = alloc_workqueue("piuio", WQ_HIGHPRI, 0);
+
+  if (!piuio_wq) {
+    return -ENOMEM;
+  }
+
+  result = usb_register(&piuio_driver);
+
+  if (result) {
+    destroy_workqueue(piuio_wq);
+  }
+
+  return result;
 }
 
 /**
@@ -345,6 +615,9 @@ static int __init piuio_init(void)
 static void __exit piuio_exit(void)
 {
   usb_deregister(&piuio_driver);
+
+  /* Waits for cycles still in flight */
+  destroy_workqueue(piuio_wq);
 }
 
 module_init(piuio_init);
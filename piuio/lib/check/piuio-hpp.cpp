@@ -0,0 +1,50 @@
+// Compile check of the C++ interface, run with every build. Keep the examples
+// in sync with the header and README.md.
+
+#include "piuio.hpp"
+
+static_assert(
+    (piuio::Itg::Light::PadP1Up | piuio::Itg::Light::Bass).word() ==
+        (PIUIO_LIGHTS_ITG_PAD_P1_UP | PIUIO_LIGHTS_ITG_BASS),
+    "Lights of a game must combine to a set");
+static_assert(
+    (piuio::Piu::Light::Bass | piuio::Piu::Light::TopLampL1 |
+     piuio::Piu::Light::TopLampR1)
+            .word() ==
+        (PIUIO_LIGHTS_PIU_BASS | PIUIO_LIGHTS_PIU_TOP_LAMP_L1 |
+         PIUIO_LIGHTS_PIU_TOP_LAMP_R1),
+    "Lights must combine with a set");
+
+// Example of piuio.hpp
+void check_header_example()
+{
+  using Itg = piuio::Piuio<piuio::Game::Itg>;
+
+  piuio::UsbDevice device;
+  Itg::Poller poller(device);
+
+  Itg::State state = poller.state();
+
+  if (state.panel(piuio::Player::P1, Itg::Panel::Up)) {
+    poller.lights().set(Itg::Light::PadP1Up | Itg::Light::Bass);
+  }
+}
+
+// Examples of README.md
+void check_readme_example(uint64_t last_frame_ns)
+{
+  piuio::UsbDevice device;
+  piuio::Itg::Poller poller(device);
+
+  if (poller.state().button(piuio::Itg::Button::MenuP1Start)) {
+    poller.lights().set(piuio::Itg::Light::Bass | piuio::Itg::Light::TopLampL1);
+  }
+
+  struct piuio_history_sample buffer[256];
+
+  for (const piuio::Itg::Event &event :
+       poller.history().events_after(last_frame_ns, buffer)) {
+    // event.time_ns, event.pressed, event.released
+    (void) event;
+  }
+}
@@ -0,0 +1,122 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "piuio-debounce.h"
+
+static void piuio_debounce_set_threshold(uint64_t *planes, uint8_t cycles)
+{
+  for (uint8_t k = 0; k < PIUIO_DEBOUNCE_COUNTER_BITS; k++) {
+    planes[k] = (cycles >> k) & 1 ? UINT64_MAX : 0;
+  }
+}
+
+result_t piuio_debounce_init(
+    struct piuio_debounce *debounce,
+    uint8_t press_cycles,
+    uint8_t release_cycles)
+{
+  assert(debounce != NULL);
+
+  if (press_cycles < 1 || press_cycles > PIUIO_DEBOUNCE_THRESHOLD_MAX) {
+    return EINVAL;
+  }
+
+  if (release_cycles < 1 || release_cycles > PIUIO_DEBOUNCE_THRESHOLD_MAX) {
+    return EINVAL;
+  }
+
+  piuio_debounce_set_threshold(debounce->press_threshold, press_cycles);
+  piuio_debounce_set_threshold(debounce->release_threshold, release_cycles);
+  piuio_debounce_reset(debounce, 0);
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_debounce_init_us(
+    struct piuio_debounce *debounce,
+    uint32_t press_us,
+    uint32_t release_us,
+    uint32_t cycle_us)
+{
+  uint32_t press_cycles;
+  uint32_t release_cycles;
+
+  assert(debounce != NULL);
+
+  if (cycle_us == 0) {
+    return EINVAL;
+  }
+
+  press_cycles = (press_us + cycle_us - 1) / cycle_us;
+  release_cycles = (release_us + cycle_us - 1) / cycle_us;
+
+  // 0 us means no debouncing which equals a threshold of a single cycle
+  if (press_cycles == 0) {
+    press_cycles = 1;
+  }
+
+  if (release_cycles == 0) {
+    release_cycles = 1;
+  }
+
+  if (press_cycles > PIUIO_DEBOUNCE_THRESHOLD_MAX ||
+      release_cycles > PIUIO_DEBOUNCE_THRESHOLD_MAX) {
+    return EINVAL;
+  }
+
+  return piuio_debounce_init(debounce, press_cycles, release_cycles);
+}
+
+void piuio_debounce_reset(struct piuio_debounce *debounce, uint64_t state)
+{
+  assert(debounce != NULL);
+
+  debounce->state = state;
+  memset(debounce->counter, 0, sizeof(debounce->counter));
+}
+
+uint64_t piuio_debounce_update(struct piuio_debounce *debounce, uint64_t raw)
+{
+  uint64_t diff;
+  uint64_t carry;
+  uint64_t match_press;
+  uint64_t match_release;
+  uint64_t flip;
+
+  assert(debounce != NULL);
+
+  // Bits that differ from the current debounced state are counted up, all
+  // other counters are reset. This requires an input to be stable for the
+  // whole duration of the threshold
+  diff = raw ^ debounce->state;
+  carry = diff;
+
+  for (uint8_t k = 0; k < PIUIO_DEBOUNCE_COUNTER_BITS; k++) {
+    uint64_t plane = debounce->counter[k];
+
+    debounce->counter[k] = (plane ^ carry) & diff;
+    carry &= plane;
+  }
+
+  // Compare all counters against the thresholds. The threshold applied per bit
+  // depends on the current state of the bit
+  match_press = UINT64_MAX;
+  match_release = UINT64_MAX;
+
+  for (uint8_t k = 0; k < PIUIO_DEBOUNCE_COUNTER_BITS; k++) {
+    match_press &= ~(debounce->counter[k] ^ debounce->press_threshold[k]);
+    match_release &= ~(debounce->counter[k] ^ debounce->release_threshold[k]);
+  }
+
+  flip = diff &
+      ((~debounce->state & match_press) | (debounce->state & match_release));
+
+  debounce->state ^= flip;
+
+  for (uint8_t k = 0; k < PIUIO_DEBOUNCE_COUNTER_BITS; k++) {
+    debounce->counter[k] &= ~flip;
+  }
+
+  return debounce->state;
+}
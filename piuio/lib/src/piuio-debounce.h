@@ -0,0 +1,101 @@
+/**
+ * Bit-parallel debouncer for the packed input state (see piuio-state.h).
+ *
+ * Each of the 64 bits of the state has its own integrating counter. The
+ * counters are stored "vertically", i.e. bit plane k of all counters is kept
+ * in a single 64-bit word. An update step therefore filters all pad sensors
+ * and operator inputs with a fixed, small number of word operations
+ * independent of the number of inputs changing.
+ *
+ * A bit of the debounced state flips once the raw input differs from it for
+ * the configured number of consecutive update cycles. Separate thresholds for
+ * press (0 -> 1) and release (1 -> 0) transitions are supported.
+ */
+#ifndef PIUIO_DEBOUNCE_H
+#define PIUIO_DEBOUNCE_H
+
+#include <stdint.h>
+
+#include "result.h"
+
+/**
+ * Number of bit planes of the vertical counters
+ */
+#define PIUIO_DEBOUNCE_COUNTER_BITS 4
+
+/**
+ * Max threshold in cycles supported by the vertical counters
+ */
+#define PIUIO_DEBOUNCE_THRESHOLD_MAX ((1 << PIUIO_DEBOUNCE_COUNTER_BITS) - 1)
+
+/**
+ * State of a debouncer instance. Treat as opaque, use the functions below.
+ */
+struct piuio_debounce {
+  uint64_t state;
+  uint64_t counter[PIUIO_DEBOUNCE_COUNTER_BITS];
+  uint64_t press_threshold[PIUIO_DEBOUNCE_COUNTER_BITS];
+  uint64_t release_threshold[PIUIO_DEBOUNCE_COUNTER_BITS];
+};
+
+/**
+ * Initialize a debouncer with thresholds given in update cycles.
+ *
+ * A threshold of 1 disables debouncing for that transition, i.e. the state
+ * follows the raw input immediately.
+ *
+ * @param debounce Pointer to the debouncer to initialize
+ * @param press_cycles Number of consecutive cycles an input has to be active
+ *                     before it is reported pressed, 1 to
+ *                     PIUIO_DEBOUNCE_THRESHOLD_MAX
+ * @param release_cycles Number of consecutive cycles an input has to be
+ *                       inactive before it is reported released, 1 to
+ *                       PIUIO_DEBOUNCE_THRESHOLD_MAX
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL
+ */
+result_t piuio_debounce_init(
+    struct piuio_debounce *debounce,
+    uint8_t press_cycles,
+    uint8_t release_cycles);
+
+/**
+ * Initialize a debouncer with thresholds given in microseconds.
+ *
+ * The thresholds are converted to update cycles (rounded up) based on the
+ * (expected) duration of a single update cycle.
+ *
+ * @param debounce Pointer to the debouncer to initialize
+ * @param press_us Min. time an input has to be active before it is reported
+ *                 pressed
+ * @param release_us Min. time an input has to be inactive before it is
+ *                   reported released
+ * @param cycle_us Duration of a single update cycle, > 0
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL if a threshold exceeds
+ *         PIUIO_DEBOUNCE_THRESHOLD_MAX cycles
+ */
+result_t piuio_debounce_init_us(
+    struct piuio_debounce *debounce,
+    uint32_t press_us,
+    uint32_t release_us,
+    uint32_t cycle_us);
+
+/**
+ * Reset the debounced state and all counters.
+ *
+ * @param debounce Pointer to an initialized debouncer
+ * @param state State to report until the next transition
+ */
+void piuio_debounce_reset(struct piuio_debounce *debounce, uint64_t state);
+
+/**
+ * Feed the raw state of one update cycle to the debouncer.
+ *
+ * @param debounce Pointer to an initialized debouncer
+ * @param raw Raw packed state of the current update cycle
+ * @return Debounced packed state
+ */
+uint64_t piuio_debounce_update(struct piuio_debounce *debounce, uint64_t raw);
+
+#endif
@@ -0,0 +1,83 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include "piuio-encoder.h"
+#include "piuio-lights.h"
+
+static const uint64_t piuio_encoder_piu_outputs[] = {
+    [PIUIO_ENCODER_PIU_PAD_P1_LU] = PIUIO_LIGHTS_PIU_PAD_P1_LU,
+    [PIUIO_ENCODER_PIU_PAD_P1_RU] = PIUIO_LIGHTS_PIU_PAD_P1_RU,
+    [PIUIO_ENCODER_PIU_PAD_P1_CN] = PIUIO_LIGHTS_PIU_PAD_P1_CN,
+    [PIUIO_ENCODER_PIU_PAD_P1_LD] = PIUIO_LIGHTS_PIU_PAD_P1_LD,
+    [PIUIO_ENCODER_PIU_PAD_P1_RD] = PIUIO_LIGHTS_PIU_PAD_P1_RD,
+    [PIUIO_ENCODER_PIU_PAD_P2_LU] = PIUIO_LIGHTS_PIU_PAD_P2_LU,
+    [PIUIO_ENCODER_PIU_PAD_P2_RU] = PIUIO_LIGHTS_PIU_PAD_P2_RU,
+    [PIUIO_ENCODER_PIU_PAD_P2_CN] = PIUIO_LIGHTS_PIU_PAD_P2_CN,
+    [PIUIO_ENCODER_PIU_PAD_P2_LD] = PIUIO_LIGHTS_PIU_PAD_P2_LD,
+    [PIUIO_ENCODER_PIU_PAD_P2_RD] = PIUIO_LIGHTS_PIU_PAD_P2_RD,
+    [PIUIO_ENCODER_PIU_BASS] = PIUIO_LIGHTS_PIU_BASS,
+    [PIUIO_ENCODER_PIU_TOP_LAMP_L1] = PIUIO_LIGHTS_PIU_TOP_LAMP_L1,
+    [PIUIO_ENCODER_PIU_TOP_LAMP_L2] = PIUIO_LIGHTS_PIU_TOP_LAMP_L2,
+    [PIUIO_ENCODER_PIU_TOP_LAMP_R1] = PIUIO_LIGHTS_PIU_TOP_LAMP_R1,
+    [PIUIO_ENCODER_PIU_TOP_LAMP_R2] = PIUIO_LIGHTS_PIU_TOP_LAMP_R2,
+    [PIUIO_ENCODER_PIU_COIN_COUNTER_1] = PIUIO_LIGHTS_PIU_COIN_COUNTER_1,
+    [PIUIO_ENCODER_PIU_COIN_COUNTER_2] = PIUIO_LIGHTS_PIU_COIN_COUNTER_2,
+};
+
+static const uint64_t piuio_encoder_itg_outputs[] = {
+    [PIUIO_ENCODER_ITG_PAD_P1_UP] = PIUIO_LIGHTS_ITG_PAD_P1_UP,
+    [PIUIO_ENCODER_ITG_PAD_P1_DOWN] = PIUIO_LIGHTS_ITG_PAD_P1_DOWN,
+    [PIUIO_ENCODER_ITG_PAD_P1_LEFT] = PIUIO_LIGHTS_ITG_PAD_P1_LEFT,
+    [PIUIO_ENCODER_ITG_PAD_P1_RIGHT] = PIUIO_LIGHTS_ITG_PAD_P1_RIGHT,
+    [PIUIO_ENCODER_ITG_PAD_P2_UP] = PIUIO_LIGHTS_ITG_PAD_P2_UP,
+    [PIUIO_ENCODER_ITG_PAD_P2_DOWN] = PIUIO_LIGHTS_ITG_PAD_P2_DOWN,
+    [PIUIO_ENCODER_ITG_PAD_P2_LEFT] = PIUIO_LIGHTS_ITG_PAD_P2_LEFT,
+    [PIUIO_ENCODER_ITG_PAD_P2_RIGHT] = PIUIO_LIGHTS_ITG_PAD_P2_RIGHT,
+    [PIUIO_ENCODER_ITG_BASS] = PIUIO_LIGHTS_ITG_BASS,
+    [PIUIO_ENCODER_ITG_TOP_LAMP_L1] = PIUIO_LIGHTS_ITG_TOP_LAMP_L1,
+    [PIUIO_ENCODER_ITG_TOP_LAMP_L2] = PIUIO_LIGHTS_ITG_TOP_LAMP_L2,
+    [PIUIO_ENCODER_ITG_TOP_LAMP_R1] = PIUIO_LIGHTS_ITG_TOP_LAMP_R1,
+    [PIUIO_ENCODER_ITG_TOP_LAMP_R2] = PIUIO_LIGHTS_ITG_TOP_LAMP_R2,
+    [PIUIO_ENCODER_ITG_COIN_COUNTER] = PIUIO_LIGHTS_ITG_COIN_COUNTER,
+};
+
+static_assert(
+    sizeof(piuio_encoder_piu_outputs) / sizeof(uint64_t) ==
+        PIUIO_ENCODER_PIU_OUTPUT_COUNT,
+    "Output table of Pump It Up incomplete");
+static_assert(
+    sizeof(piuio_encoder_itg_outputs) / sizeof(uint64_t) ==
+        PIUIO_ENCODER_ITG_OUTPUT_COUNT,
+    "Output table of In The Groove incomplete");
+
+void piuio_encoder_init_piu(struct pumpio_encoder *encoder)
+{
+  pumpio_encoder_init(
+      encoder, piuio_encoder_piu_outputs, PIUIO_ENCODER_PIU_OUTPUT_COUNT);
+}
+
+void piuio_encoder_init_itg(struct pumpio_encoder *encoder)
+{
+  pumpio_encoder_init(
+      encoder, piuio_encoder_itg_outputs, PIUIO_ENCODER_ITG_OUTPUT_COUNT);
+}
+
+uint8_t piuio_encoder_apply(
+    const struct pumpio_encoder *encoder,
+    uint64_t mask,
+    uint64_t value,
+    union piuio_output_paket *paket)
+{
+  uint64_t prev;
+  uint64_t next;
+
+  assert(encoder != NULL);
+  assert(paket != NULL);
+
+  prev = pumpio_encoder_from_raw(paket->raw);
+  next = pumpio_encoder_replace(encoder, prev, mask, value);
+
+  pumpio_encoder_to_raw(next, paket->raw);
+
+  return pumpio_encoder_diff(prev, next);
+}
@@ -0,0 +1,111 @@
+/**
+ * Logical outputs of both games and their encoders to raw output pakets.
+ *
+ * Lights and coin counters of a game are numbered densely, see
+ * piuio_encoder_piu_output and piuio_encoder_itg_output, and set as a single
+ * logical mask instead of the bitfields of piuio_piu_output_paket or
+ * piuio_itg_output_paket. The raw output word produced by the encoders is the
+ * same as the output word of piuio-lights, i.e. it can be passed directly to
+ * piuio_lights_replace. The sensor mask bits are never set by an encoder.
+ */
+#ifndef PIUIO_ENCODER_H
+#define PIUIO_ENCODER_H
+
+#include <stdint.h>
+
+#include "encoder.h"
+#include "piuio.h"
+
+/**
+ * Logical outputs of Pump It Up
+ */
+enum piuio_encoder_piu_output {
+  PIUIO_ENCODER_PIU_PAD_P1_LU = 0,
+  PIUIO_ENCODER_PIU_PAD_P1_RU = 1,
+  PIUIO_ENCODER_PIU_PAD_P1_CN = 2,
+  PIUIO_ENCODER_PIU_PAD_P1_LD = 3,
+  PIUIO_ENCODER_PIU_PAD_P1_RD = 4,
+  PIUIO_ENCODER_PIU_PAD_P2_LU = 5,
+  PIUIO_ENCODER_PIU_PAD_P2_RU = 6,
+  PIUIO_ENCODER_PIU_PAD_P2_CN = 7,
+  PIUIO_ENCODER_PIU_PAD_P2_LD = 8,
+  PIUIO_ENCODER_PIU_PAD_P2_RD = 9,
+  PIUIO_ENCODER_PIU_BASS = 10,
+  PIUIO_ENCODER_PIU_TOP_LAMP_L1 = 11,
+  PIUIO_ENCODER_PIU_TOP_LAMP_L2 = 12,
+  PIUIO_ENCODER_PIU_TOP_LAMP_R1 = 13,
+  PIUIO_ENCODER_PIU_TOP_LAMP_R2 = 14,
+  PIUIO_ENCODER_PIU_COIN_COUNTER_1 = 15,
+  PIUIO_ENCODER_PIU_COIN_COUNTER_2 = 16,
+  PIUIO_ENCODER_PIU_OUTPUT_COUNT = 17,
+};
+
+/**
+ * Logical outputs of In The Groove
+ */
+enum piuio_encoder_itg_output {
+  PIUIO_ENCODER_ITG_PAD_P1_UP = 0,
+  PIUIO_ENCODER_ITG_PAD_P1_DOWN = 1,
+  PIUIO_ENCODER_ITG_PAD_P1_LEFT = 2,
+  PIUIO_ENCODER_ITG_PAD_P1_RIGHT = 3,
+  PIUIO_ENCODER_ITG_PAD_P2_UP = 4,
+  PIUIO_ENCODER_ITG_PAD_P2_DOWN = 5,
+  PIUIO_ENCODER_ITG_PAD_P2_LEFT = 6,
+  PIUIO_ENCODER_ITG_PAD_P2_RIGHT = 7,
+  PIUIO_ENCODER_ITG_BASS = 8,
+  PIUIO_ENCODER_ITG_TOP_LAMP_L1 = 9,
+  PIUIO_ENCODER_ITG_TOP_LAMP_L2 = 10,
+  PIUIO_ENCODER_ITG_TOP_LAMP_R1 = 11,
+  PIUIO_ENCODER_ITG_TOP_LAMP_R2 = 12,
+  PIUIO_ENCODER_ITG_COIN_COUNTER = 13,
+  PIUIO_ENCODER_ITG_OUTPUT_COUNT = 14,
+};
+
+/**
+ * Logical masks of groups of outputs
+ */
+#define PIUIO_ENCODER_PIU_PADS_P1 UINT64_C(0x000000000000001F)
+#define PIUIO_ENCODER_PIU_PADS_P2 UINT64_C(0x00000000000003E0)
+#define PIUIO_ENCODER_PIU_TOP_LAMPS UINT64_C(0x0000000000007800)
+#define PIUIO_ENCODER_PIU_LIGHTS UINT64_C(0x0000000000007FFF)
+#define PIUIO_ENCODER_PIU_ALL UINT64_C(0x000000000001FFFF)
+
+#define PIUIO_ENCODER_ITG_PADS_P1 UINT64_C(0x000000000000000F)
+#define PIUIO_ENCODER_ITG_PADS_P2 UINT64_C(0x00000000000000F0)
+#define PIUIO_ENCODER_ITG_TOP_LAMPS UINT64_C(0x0000000000001E00)
+#define PIUIO_ENCODER_ITG_LIGHTS UINT64_C(0x0000000000001FFF)
+#define PIUIO_ENCODER_ITG_ALL UINT64_C(0x0000000000003FFF)
+
+/**
+ * Initialize an encoder for the outputs of Pump It Up.
+ *
+ * @param encoder Pointer to the encoder to initialize
+ */
+void piuio_encoder_init_piu(struct pumpio_encoder *encoder);
+
+/**
+ * Initialize an encoder for the outputs of In The Groove.
+ *
+ * @param encoder Pointer to the encoder to initialize
+ */
+void piuio_encoder_init_itg(struct pumpio_encoder *encoder);
+
+/**
+ * Replace a group of logical outputs of an output paket, e.g. all pad lights of
+ * a player. Outputs not in the mask and the sensor mask bits are kept.
+ *
+ * @param encoder Pointer to an encoder of the game
+ * @param mask Logical outputs to replace
+ * @param value New values of the logical outputs in the mask
+ * @param paket Output paket to update
+ * @return Mask with bit n set if byte n of the paket changed, 0 if it is
+ *         unchanged. The usb backend (piuio-usb.h) skips writing unchanged
+ *         outputs based on the same diff, callers don't need to track it
+ */
+uint8_t piuio_encoder_apply(
+    const struct pumpio_encoder *encoder,
+    uint64_t mask,
+    uint64_t value,
+    union piuio_output_paket *paket);
+
+#endif
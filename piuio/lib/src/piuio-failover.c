@@ -0,0 +1,544 @@
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "piuio-failover.h"
+#include "piuio-kmod.h"
+#include "piuio-poller.h"
+#include "piuio-stats.h"
+#include "time_.h"
+
+/* Interval to retry opening the kernel module's device node */
+#define PIUIO_FAILOVER_OPEN_RETRY_US 10000
+
+enum piuio_failover_switch_state {
+  /* Backend open and driven by piuio_failover_poll */
+  PIUIO_FAILOVER_SWITCH_IDLE = 0,
+  /* Switch requested or in progress, the backend is owned by the switcher
+     thread */
+  PIUIO_FAILOVER_SWITCH_PENDING = 1,
+  /* Last switch couldn't open any backend */
+  PIUIO_FAILOVER_SWITCH_FAILED = 2,
+};
+
+struct piuio_failover_ctx {
+  struct piuio_failover_config config;
+  /* Backend driving the device, only valid if open */
+  enum piuio_failover_backend backend;
+  bool open;
+  void *kmod;
+  void *usb;
+  /* Window of recent cycles, ring buffer */
+  uint32_t latency_us[PIUIO_FAILOVER_WINDOW_MAX];
+  bool failed[PIUIO_FAILOVER_WINDOW_MAX];
+  uint32_t window_pos;
+  uint32_t window_count;
+  uint64_t latency_sum_us;
+  uint32_t failed_count;
+  uint32_t error_streak;
+  uint64_t switched_ns;
+  /* Cycles failed in a row including failed switches, not reset by a
+     switch */
+  uint32_t failed_cycles;
+  /* Switcher thread opening backends off the polling thread */
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool stop;
+  enum piuio_failover_reason switch_reason;
+  /* Result of the last switch, valid if the state is FAILED */
+  result_t switch_result;
+  _Atomic uint32_t switch_state;
+  /* Published for piuio_failover_status */
+  _Atomic uint32_t status_backend;
+  _Atomic uint32_t status_reason;
+  _Atomic uint64_t status_switches;
+  _Atomic uint64_t status_latency_ns[PIUIO_FAILOVER_BACKEND_COUNT];
+};
+
+static result_t piuio_failover_open_kmod(struct piuio_failover_ctx *ctx)
+{
+  uint64_t deadline_ns;
+  result_t result;
+
+  deadline_ns = pumpio_time_now_ns() +
+      (uint64_t) ctx->config.open_timeout_ms * 1000000;
+
+  // The device node re-appears with a delay once libusb handed the device
+  // back to the kernel module
+  while (true) {
+    if (ctx->config.path == NULL) {
+      result = piuio_kmod_open(&ctx->kmod);
+    } else {
+      result = piuio_kmod_open_path(&ctx->kmod, ctx->config.path);
+    }
+
+    if (result != ENOENT && result != ENODEV) {
+      return result;
+    }
+
+    if (pumpio_time_now_ns() >= deadline_ns) {
+      return result;
+    }
+
+    usleep(PIUIO_FAILOVER_OPEN_RETRY_US);
+  }
+}
+
+static result_t piuio_failover_open_backend(
+    struct piuio_failover_ctx *ctx, enum piuio_failover_backend backend)
+{
+  result_t result;
+
+  if (backend == PIUIO_FAILOVER_BACKEND_KMOD) {
+    result = piuio_failover_open_kmod(ctx);
+  } else if (ctx->config.path == NULL) {
+    result = piuio_usb_open(&ctx->usb);
+  } else {
+    result = piuio_usb_open_id(&ctx->usb, ctx->config.path);
+  }
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  // Switching back to the kernel module requires its driver bound again
+  if (backend == PIUIO_FAILOVER_BACKEND_USB) {
+    piuio_usb_set_reattach_kernel_driver(ctx->usb, true);
+  }
+
+  ctx->backend = backend;
+  ctx->open = true;
+
+  atomic_store_explicit(&ctx->status_backend, backend, memory_order_relaxed);
+
+  return RESULT_SUCCESS;
+}
+
+static void piuio_failover_close_backend(struct piuio_failover_ctx *ctx)
+{
+  if (!ctx->open) {
+    return;
+  }
+
+  if (ctx->backend == PIUIO_FAILOVER_BACKEND_KMOD) {
+    piuio_kmod_close(ctx->kmod);
+  } else {
+    piuio_usb_close(ctx->usb);
+  }
+
+  ctx->open = false;
+}
+
+static void piuio_failover_reset_window(struct piuio_failover_ctx *ctx)
+{
+  ctx->window_pos = 0;
+  ctx->window_count = 0;
+  ctx->latency_sum_us = 0;
+  ctx->failed_count = 0;
+  ctx->error_streak = 0;
+}
+
+/**
+ * Mean latency of the successful cycles of a full window, 0 if not full or
+ * all failed
+ */
+static uint64_t
+piuio_failover_window_latency_ns(struct piuio_failover_ctx *ctx)
+{
+  uint32_t succeeded;
+
+  if (ctx->window_count < ctx->config.window_cycles) {
+    return 0;
+  }
+
+  succeeded = ctx->window_count - ctx->failed_count;
+
+  if (succeeded == 0) {
+    return 0;
+  }
+
+  return ctx->latency_sum_us * 1000 / succeeded;
+}
+
+static void piuio_failover_record(
+    struct piuio_failover_ctx *ctx, uint64_t latency_ns, bool failed)
+{
+  uint32_t pos;
+
+  pos = ctx->window_pos;
+
+  // Drop the oldest cycle once the window is full
+  if (ctx->window_count == ctx->config.window_cycles) {
+    if (ctx->failed[pos]) {
+      ctx->failed_count--;
+    } else {
+      ctx->latency_sum_us -= ctx->latency_us[pos];
+    }
+  } else {
+    ctx->window_count++;
+  }
+
+  // Latencies of failed cycles, e.g. timeouts, are not comparable
+  ctx->failed[pos] = failed;
+  ctx->latency_us[pos] = failed ? 0 : (uint32_t) (latency_ns / 1000);
+
+  if (failed) {
+    ctx->failed_count++;
+    ctx->error_streak++;
+  } else {
+    ctx->latency_sum_us += ctx->latency_us[pos];
+    ctx->error_streak = 0;
+  }
+
+  ctx->window_pos = (pos + 1) % ctx->config.window_cycles;
+
+  // Publish once per full window
+  if (ctx->window_pos == 0) {
+    atomic_store_explicit(
+        &ctx->status_latency_ns[ctx->backend],
+        piuio_failover_window_latency_ns(ctx),
+        memory_order_relaxed);
+  }
+}
+
+static bool piuio_failover_errors_exceeded(
+    struct piuio_failover_ctx *ctx, result_t result)
+{
+  if (result == ENODEV || ctx->error_streak >= ctx->config.error_streak) {
+    return true;
+  }
+
+  return ctx->config.error_threshold_percent > 0 &&
+      ctx->window_count == ctx->config.window_cycles &&
+      ctx->failed_count * 100 >
+      ctx->window_count * ctx->config.error_threshold_percent;
+}
+
+static bool piuio_failover_latency_exceeded(
+    struct piuio_failover_ctx *ctx, uint64_t now_ns)
+{
+  enum piuio_failover_backend other;
+  uint64_t latency_ns;
+  uint64_t other_ns;
+
+  if (ctx->config.latency_threshold_us == 0 ||
+      now_ns - ctx->switched_ns <
+          (uint64_t) ctx->config.hold_ms * 1000000) {
+    return false;
+  }
+
+  latency_ns = piuio_failover_window_latency_ns(ctx);
+
+  if (latency_ns <= (uint64_t) ctx->config.latency_threshold_us * 1000) {
+    return false;
+  }
+
+  // Don't flip-flop between two degraded backends, stay on the faster one
+  other = (ctx->backend + 1) % PIUIO_FAILOVER_BACKEND_COUNT;
+  other_ns = atomic_load_explicit(
+      &ctx->status_latency_ns[other], memory_order_relaxed);
+
+  return other_ns == 0 || other_ns < latency_ns;
+}
+
+/**
+ * Close the current backend and open the other one. If that fails, reopen the
+ * current one
+ */
+static result_t piuio_failover_switch(
+    struct piuio_failover_ctx *ctx, enum piuio_failover_reason reason)
+{
+  enum piuio_failover_backend from;
+  enum piuio_failover_backend to;
+  result_t result;
+
+  from = ctx->backend;
+  to = (from + 1) % PIUIO_FAILOVER_BACKEND_COUNT;
+
+  // Keep the latency that caused the switch for comparison
+  if (ctx->window_count == ctx->config.window_cycles) {
+    atomic_store_explicit(
+        &ctx->status_latency_ns[from],
+        piuio_failover_window_latency_ns(ctx),
+        memory_order_relaxed);
+  }
+
+  piuio_failover_close_backend(ctx);
+  piuio_failover_reset_window(ctx);
+  ctx->switched_ns = pumpio_time_now_ns();
+
+  result = piuio_failover_open_backend(ctx, to);
+
+  if (RESULT_IS_ERROR(result)) {
+    return piuio_failover_open_backend(ctx, from);
+  }
+
+  pumpio_stats_record_failover(piuio_stats());
+
+  atomic_store_explicit(&ctx->status_reason, reason, memory_order_relaxed);
+  atomic_fetch_add_explicit(&ctx->status_switches, 1, memory_order_relaxed);
+
+  return RESULT_SUCCESS;
+}
+
+static void *piuio_failover_thread(void *arg)
+{
+  struct piuio_failover_ctx *ctx;
+  enum piuio_failover_reason reason;
+  result_t result;
+
+  ctx = (struct piuio_failover_ctx *) arg;
+
+  pthread_mutex_lock(&ctx->mutex);
+
+  while (true) {
+    while (!ctx->stop &&
+           atomic_load_explicit(&ctx->switch_state, memory_order_relaxed) !=
+               PIUIO_FAILOVER_SWITCH_PENDING) {
+      pthread_cond_wait(&ctx->cond, &ctx->mutex);
+    }
+
+    if (ctx->stop) {
+      break;
+    }
+
+    reason = ctx->switch_reason;
+
+    // Opening may wait for the device node for up to open_timeout_ms
+    pthread_mutex_unlock(&ctx->mutex);
+    result = piuio_failover_switch(ctx, reason);
+    pthread_mutex_lock(&ctx->mutex);
+
+    ctx->switch_result = result;
+
+    // Hand the backend back to the polling thread
+    atomic_store_explicit(
+        &ctx->switch_state,
+        RESULT_IS_ERROR(result) ? PIUIO_FAILOVER_SWITCH_FAILED :
+                                  PIUIO_FAILOVER_SWITCH_IDLE,
+        memory_order_release);
+  }
+
+  pthread_mutex_unlock(&ctx->mutex);
+
+  return NULL;
+}
+
+/**
+ * Hand the backend to the switcher thread, called from the polling thread
+ */
+static void piuio_failover_request_switch(
+    struct piuio_failover_ctx *ctx, enum piuio_failover_reason reason)
+{
+  pthread_mutex_lock(&ctx->mutex);
+
+  ctx->switch_reason = reason;
+  atomic_store_explicit(
+      &ctx->switch_state, PIUIO_FAILOVER_SWITCH_PENDING, memory_order_relaxed);
+  pthread_cond_signal(&ctx->cond);
+
+  pthread_mutex_unlock(&ctx->mutex);
+}
+
+/**
+ * Count a failed cycle and pass the error on once every backend had its full
+ * error streak, EAGAIN before
+ */
+static result_t
+piuio_failover_cycle_failed(struct piuio_failover_ctx *ctx, result_t result)
+{
+  ctx->failed_cycles++;
+
+  if (ctx->failed_cycles <
+      ctx->config.error_streak * PIUIO_FAILOVER_BACKEND_COUNT) {
+    return EAGAIN;
+  }
+
+  return result;
+}
+
+static result_t piuio_failover_cycle(
+    struct piuio_failover_ctx *ctx,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  if (ctx->backend == PIUIO_FAILOVER_BACKEND_KMOD) {
+    return piuio_poller_poll_kmod(ctx->kmod, output, input);
+  }
+
+  return piuio_usb_poll_full_cycle(ctx->usb, output, input);
+}
+
+result_t piuio_failover_open(
+    void **handle, const struct piuio_failover_config *config)
+{
+  struct piuio_failover_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(config != NULL);
+
+  if (config->backend >= PIUIO_FAILOVER_BACKEND_COUNT ||
+      config->window_cycles > PIUIO_FAILOVER_WINDOW_MAX) {
+    return EINVAL;
+  }
+
+  ctx = (struct piuio_failover_ctx *) malloc(
+      sizeof(struct piuio_failover_ctx));
+
+  if (ctx == NULL) {
+    return ENOMEM;
+  }
+
+  memset(ctx, 0, sizeof(struct piuio_failover_ctx));
+
+  ctx->config = *config;
+
+  if (ctx->config.window_cycles == 0) {
+    ctx->config.window_cycles = PIUIO_FAILOVER_DEFAULT_WINDOW_CYCLES;
+  }
+
+  if (ctx->config.error_streak == 0) {
+    ctx->config.error_streak = PIUIO_FAILOVER_DEFAULT_ERROR_STREAK;
+  }
+
+  if (ctx->config.hold_ms == 0) {
+    ctx->config.hold_ms = PIUIO_FAILOVER_DEFAULT_HOLD_MS;
+  }
+
+  if (ctx->config.open_timeout_ms == 0) {
+    ctx->config.open_timeout_ms = PIUIO_FAILOVER_DEFAULT_OPEN_TIMEOUT_MS;
+  }
+
+  result = piuio_failover_open_backend(ctx, config->backend);
+
+  if (RESULT_IS_ERROR(result)) {
+    free(ctx);
+    return result;
+  }
+
+  ctx->switched_ns = pumpio_time_now_ns();
+
+  atomic_init(&ctx->switch_state, PIUIO_FAILOVER_SWITCH_IDLE);
+  pthread_mutex_init(&ctx->mutex, NULL);
+  pthread_cond_init(&ctx->cond, NULL);
+
+  result = pthread_create(&ctx->thread, NULL, piuio_failover_thread, ctx);
+
+  if (result != 0) {
+    pthread_cond_destroy(&ctx->cond);
+    pthread_mutex_destroy(&ctx->mutex);
+    piuio_failover_close_backend(ctx);
+    free(ctx);
+    return result;
+  }
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_failover_poll(
+    void *handle,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  struct piuio_failover_ctx *ctx;
+  uint32_t switch_state;
+  result_t result;
+  uint64_t start_ns;
+  uint64_t end_ns;
+
+  assert(handle != NULL);
+  assert(output != NULL);
+  assert(input != NULL);
+
+  ctx = (struct piuio_failover_ctx *) handle;
+
+  switch_state =
+      atomic_load_explicit(&ctx->switch_state, memory_order_acquire);
+
+  // Never wait for a backend to open on the polling thread
+  if (switch_state == PIUIO_FAILOVER_SWITCH_PENDING) {
+    return EAGAIN;
+  }
+
+  if (switch_state == PIUIO_FAILOVER_SWITCH_FAILED) {
+    result = ctx->switch_result;
+    piuio_failover_request_switch(ctx, PIUIO_FAILOVER_REASON_ERRORS);
+
+    return piuio_failover_cycle_failed(ctx, result);
+  }
+
+  start_ns = pumpio_time_now_ns();
+  result = piuio_failover_cycle(ctx, output, input);
+  end_ns = pumpio_time_now_ns();
+
+  piuio_failover_record(ctx, end_ns - start_ns, RESULT_IS_ERROR(result));
+
+  if (RESULT_IS_SUCCESS(result)) {
+    ctx->failed_cycles = 0;
+
+    if (piuio_failover_latency_exceeded(ctx, end_ns)) {
+      piuio_failover_request_switch(ctx, PIUIO_FAILOVER_REASON_LATENCY);
+    }
+
+    return RESULT_SUCCESS;
+  }
+
+  if (piuio_failover_errors_exceeded(ctx, result)) {
+    piuio_failover_request_switch(ctx, PIUIO_FAILOVER_REASON_ERRORS);
+  }
+
+  return piuio_failover_cycle_failed(ctx, result);
+}
+
+void piuio_failover_status(void *handle, struct piuio_failover_status *status)
+{
+  struct piuio_failover_ctx *ctx;
+
+  assert(handle != NULL);
+  assert(status != NULL);
+
+  ctx = (struct piuio_failover_ctx *) handle;
+
+  status->backend = (enum piuio_failover_backend) atomic_load_explicit(
+      &ctx->status_backend, memory_order_relaxed);
+  status->switches =
+      atomic_load_explicit(&ctx->status_switches, memory_order_relaxed);
+  status->last_reason = (enum piuio_failover_reason) atomic_load_explicit(
+      &ctx->status_reason, memory_order_relaxed);
+
+  for (uint32_t i = 0; i < PIUIO_FAILOVER_BACKEND_COUNT; i++) {
+    status->latency_ns[i] = atomic_load_explicit(
+        &ctx->status_latency_ns[i], memory_order_relaxed);
+  }
+}
+
+void piuio_failover_close(void *handle)
+{
+  struct piuio_failover_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_failover_ctx *) handle;
+
+  // Waits for a switch in progress to complete
+  pthread_mutex_lock(&ctx->mutex);
+  ctx->stop = true;
+  pthread_cond_signal(&ctx->cond);
+  pthread_mutex_unlock(&ctx->mutex);
+
+  pthread_join(ctx->thread, NULL);
+
+  pthread_cond_destroy(&ctx->cond);
+  pthread_mutex_destroy(&ctx->mutex);
+  piuio_failover_close_backend(ctx);
+  free(ctx);
+}
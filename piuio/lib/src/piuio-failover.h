@@ -0,0 +1,163 @@
+/**
+ * Supervisor running the polling cycles of a PIUIO device on either the
+ * kernel module or the libusb backend and switching between them live.
+ *
+ * Depending on the port, hub and backend, the latency of a cycle can differ by
+ * an order of magnitude, and a device node of the kernel module can vanish,
+ * e.g. on a reconnect. The supervisor watches the mean cycle latency and the
+ * error rate over a window of recent cycles. If a threshold is crossed, it
+ * closes the current backend and opens the other one. If the other one can't
+ * be opened, the current one is reopened, which also picks up a device node
+ * re-created under another path.
+ *
+ * Switches run on a dedicated thread of the supervisor as opening a backend
+ * can take up to open_timeout_ms, e.g. for the device node of the kernel
+ * module to re-appear after libusb handed the device back. A poll never opens
+ * a backend and never runs more than a single cycle. While a switch is in
+ * progress, polls return EAGAIN right away, i.e. the inputs pause but the
+ * polling thread keeps its timing. Failed cycles are reported as EAGAIN as
+ * well until every backend had its full error streak, the caller only sees
+ * the error if the device can't be driven with any backend.
+ *
+ * Every switch is counted in the process-wide statistics (see
+ * piuio-stats.h). piuio_failover_poll matches piuio_poller_poll_func_t to run
+ * the supervisor on the poller's thread:
+ *
+ *   config.poll = piuio_failover_poll;
+ *   config.ctx = failover;
+ */
+#ifndef PIUIO_FAILOVER_H
+#define PIUIO_FAILOVER_H
+
+#include <stdint.h>
+
+#include "piuio-usb.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Max. number of cycles of the evaluation window
+ */
+#define PIUIO_FAILOVER_WINDOW_MAX 4096
+
+/**
+ * Defaults applied to configuration values set to 0
+ */
+#define PIUIO_FAILOVER_DEFAULT_WINDOW_CYCLES 1000
+#define PIUIO_FAILOVER_DEFAULT_ERROR_STREAK 3
+#define PIUIO_FAILOVER_DEFAULT_HOLD_MS 5000
+#define PIUIO_FAILOVER_DEFAULT_OPEN_TIMEOUT_MS 2000
+
+/**
+ * Backends the supervisor switches between
+ */
+enum piuio_failover_backend {
+  PIUIO_FAILOVER_BACKEND_KMOD = 0,
+  PIUIO_FAILOVER_BACKEND_USB = 1,
+  PIUIO_FAILOVER_BACKEND_COUNT = 2,
+};
+
+/**
+ * Cause of the last switch
+ */
+enum piuio_failover_reason {
+  PIUIO_FAILOVER_REASON_NONE = 0,
+  /* Mean cycle latency of the window exceeded the threshold */
+  PIUIO_FAILOVER_REASON_LATENCY = 1,
+  /* Error rate of the window exceeded the threshold or too many cycles failed
+     in a row */
+  PIUIO_FAILOVER_REASON_ERRORS = 2,
+};
+
+/**
+ * Configuration of the supervisor
+ */
+struct piuio_failover_config {
+  /* Path of the device (e.g. "1-2.4") to open with both backends, NULL to
+     open the first device found */
+  const char *path;
+  /* Backend to start with */
+  enum piuio_failover_backend backend;
+  /* Number of recent cycles the latency and error rate are evaluated over,
+     max. PIUIO_FAILOVER_WINDOW_MAX. A switch resets the window */
+  uint32_t window_cycles;
+  /* Switch if the mean latency of the successful cycles of a full window
+     exceeds this, 0 to never switch on latency. Only switches if the other
+     backend was not measured slower before */
+  uint32_t latency_threshold_us;
+  /* Switch if the share of failed cycles of the window exceeds this in
+     percent, 0 to only switch on error streaks */
+  uint8_t error_threshold_percent;
+  /* Switch if this many cycles failed in a row, ENODEV switches right away */
+  uint32_t error_streak;
+  /* Min. time to stay on a backend before switching on latency again */
+  uint32_t hold_ms;
+  /* Max. time to wait for the device node of the kernel module to re-appear
+     after the libusb backend handed the device back */
+  uint32_t open_timeout_ms;
+};
+
+/**
+ * Current status of the supervisor
+ */
+struct piuio_failover_status {
+  /* Backend currently driving the device */
+  enum piuio_failover_backend backend;
+  /* Number of switches since opened */
+  uint64_t switches;
+  enum piuio_failover_reason last_reason;
+  /* Mean cycle latency of the last full window of each backend, 0 if not
+     measured, yet */
+  uint64_t latency_ns[PIUIO_FAILOVER_BACKEND_COUNT];
+};
+
+/**
+ * Open the device with the configured backend.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_failover_close.
+ * @param config Configuration of the supervisor, copied by the call
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL, ENOMEM, any error of opening the
+ *         backend
+ */
+result_t piuio_failover_open(
+    void **handle, const struct piuio_failover_config *config);
+
+/**
+ * Run a full polling cycle on the current backend, see
+ * piuio_usb_poll_full_cycle, and start a switch of backends if a threshold is
+ * crossed. Never blocks on opening a backend.
+ *
+ * @param handle Valid handle of an opened supervisor
+ * @param output Output data to send with all sub-polls
+ * @param input Batch of input pakets with inverted pull ups to receive
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EAGAIN if no inputs were received as a
+ *         switch is in progress or the cycle failed, any error of the
+ *         backends if the device can't be driven by either of them
+ */
+result_t piuio_failover_poll(
+    void *handle,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Get the current status of the supervisor. Can be called from any thread.
+ *
+ * @param handle Valid handle of an opened supervisor
+ * @param status Pointer to a struct to return the status in
+ */
+void piuio_failover_status(void *handle, struct piuio_failover_status *status);
+
+/**
+ * Close the current backend and free the supervisor. Waits for a switch in
+ * progress to complete.
+ *
+ * @param handle Valid handle of an opened supervisor
+ */
+void piuio_failover_close(void *handle);
+
+#endif
@@ -0,0 +1,305 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "piuio-history.h"
+
+#define PIUIO_HISTORY_INDEX_MASK (PIUIO_HISTORY_SIZE - 1)
+
+/* Retries of a query if the entries were overwritten while searching */
+#define PIUIO_HISTORY_QUERY_RETRIES 4
+
+static_assert(
+    (PIUIO_HISTORY_SIZE & PIUIO_HISTORY_INDEX_MASK) == 0,
+    "PIUIO_HISTORY_SIZE must be a power of two");
+
+/**
+ * Range of entry indices [begin, end) that can be read safely
+ */
+struct piuio_history_range {
+  uint64_t begin;
+  uint64_t end;
+};
+
+static void piuio_history_get_range(
+    struct piuio_history *history, struct piuio_history_range *range)
+{
+  range->end = atomic_load_explicit(&history->head, memory_order_acquire);
+
+  // The slot of the oldest entry is the next one being overwritten by the
+  // writer, exclude it
+  if (range->end >= PIUIO_HISTORY_SIZE) {
+    range->begin = range->end - PIUIO_HISTORY_SIZE + 1;
+  } else {
+    range->begin = 0;
+  }
+}
+
+static bool piuio_history_read(
+    struct piuio_history *history,
+    uint64_t index,
+    uint64_t *time_ns,
+    uint64_t *state,
+    uint8_t *stale_mask)
+{
+  struct piuio_history_entry *entry;
+  uint64_t head;
+
+  entry = &history->entries[index & PIUIO_HISTORY_INDEX_MASK];
+
+  *time_ns = atomic_load_explicit(&entry->time_ns, memory_order_relaxed);
+
+  if (state != NULL) {
+    *state = atomic_load_explicit(&entry->state, memory_order_relaxed);
+  }
+
+  if (stale_mask != NULL) {
+    *stale_mask =
+        atomic_load_explicit(&entry->stale_mask, memory_order_relaxed);
+  }
+
+  // Entry is valid if the writer did not start overwriting it while reading
+  atomic_thread_fence(memory_order_acquire);
+  head = atomic_load_explicit(&history->head, memory_order_relaxed);
+
+  return head - index < PIUIO_HISTORY_SIZE;
+}
+
+/**
+ * Find the index of the first entry in the range with a timestamp newer than
+ * the given time, range->end if there is none.
+ */
+static bool piuio_history_upper_bound(
+    struct piuio_history *history,
+    const struct piuio_history_range *range,
+    uint64_t time_ns,
+    uint64_t *index)
+{
+  uint64_t lo;
+  uint64_t hi;
+
+  lo = range->begin;
+  hi = range->end;
+
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    uint64_t mid_time_ns;
+
+    if (!piuio_history_read(history, mid, &mid_time_ns, NULL, NULL)) {
+      return false;
+    }
+
+    if (mid_time_ns <= time_ns) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  *index = lo;
+
+  return true;
+}
+
+void piuio_history_init(struct piuio_history *history)
+{
+  assert(history != NULL);
+
+  atomic_init(&history->head, 0);
+
+  for (uint32_t i = 0; i < PIUIO_HISTORY_SIZE; i++) {
+    atomic_init(&history->entries[i].time_ns, 0);
+    atomic_init(&history->entries[i].state, 0);
+    atomic_init(&history->entries[i].stale_mask, 0);
+  }
+}
+
+void piuio_history_push(
+    struct piuio_history *history,
+    uint64_t time_ns,
+    uint64_t state,
+    uint8_t stale_mask)
+{
+  struct piuio_history_entry *entry;
+  uint64_t head;
+
+  assert(history != NULL);
+
+  head = atomic_load_explicit(&history->head, memory_order_relaxed);
+  entry = &history->entries[head & PIUIO_HISTORY_INDEX_MASK];
+
+  // The previous head must be visible before the entry is overwritten. A
+  // reader seeing any of the new values also sees that its entry expired,
+  // see piuio_history_read
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&entry->time_ns, time_ns, memory_order_relaxed);
+  atomic_store_explicit(&entry->state, state, memory_order_relaxed);
+  atomic_store_explicit(&entry->stale_mask, stale_mask, memory_order_relaxed);
+
+  atomic_store_explicit(&history->head, head + 1, memory_order_release);
+}
+
+result_t piuio_history_state_at(
+    struct piuio_history *history, uint64_t time_ns, uint64_t *state)
+{
+  struct piuio_history_range range;
+  uint64_t index;
+  uint64_t entry_time_ns;
+
+  assert(history != NULL);
+  assert(state != NULL);
+
+  for (uint8_t i = 0; i < PIUIO_HISTORY_QUERY_RETRIES; i++) {
+    piuio_history_get_range(history, &range);
+
+    if (!piuio_history_upper_bound(history, &range, time_ns, &index)) {
+      continue;
+    }
+
+    if (index == range.begin) {
+      return range.begin == 0 ? ENOENT : ERANGE;
+    }
+
+    if (piuio_history_read(
+            history, index - 1, &entry_time_ns, state, NULL)) {
+      return RESULT_SUCCESS;
+    }
+  }
+
+  return ERANGE;
+}
+
+result_t piuio_history_first_press_after(
+    struct piuio_history *history,
+    uint64_t mask,
+    uint64_t time_ns,
+    uint64_t *press_time_ns)
+{
+  struct piuio_history_range range;
+  uint64_t index;
+  uint64_t prev_state;
+  uint64_t entry_time_ns;
+  uint64_t entry_state;
+  bool valid;
+
+  assert(history != NULL);
+  assert(press_time_ns != NULL);
+
+  for (uint8_t i = 0; i < PIUIO_HISTORY_QUERY_RETRIES; i++) {
+    piuio_history_get_range(history, &range);
+
+    if (!piuio_history_upper_bound(history, &range, time_ns, &index)) {
+      continue;
+    }
+
+    // Edge detection requires the state before the first cycle searched
+    if (index > range.begin) {
+      if (!piuio_history_read(
+              history, index - 1, &entry_time_ns, &prev_state, NULL)) {
+        continue;
+      }
+    } else if (range.begin == 0) {
+      prev_state = 0;
+    } else {
+      return ERANGE;
+    }
+
+    valid = true;
+
+    for (; index < range.end; index++) {
+      if (!piuio_history_read(
+              history, index, &entry_time_ns, &entry_state, NULL)) {
+        valid = false;
+        break;
+      }
+
+      if ((entry_state & mask) && !(prev_state & mask)) {
+        *press_time_ns = entry_time_ns;
+        return RESULT_SUCCESS;
+      }
+
+      prev_state = entry_state;
+    }
+
+    if (valid) {
+      return ENOENT;
+    }
+  }
+
+  return ERANGE;
+}
+
+result_t piuio_history_copy_after(
+    struct piuio_history *history,
+    uint64_t time_ns,
+    struct piuio_history_sample *samples,
+    size_t max_count,
+    size_t *count,
+    uint64_t *prev_state)
+{
+  struct piuio_history_range range;
+  uint64_t index;
+  uint64_t prev_time_ns;
+  bool valid;
+
+  assert(history != NULL);
+  assert(samples != NULL || max_count == 0);
+  assert(count != NULL);
+
+  *count = 0;
+
+  for (uint8_t i = 0; i < PIUIO_HISTORY_QUERY_RETRIES; i++) {
+    piuio_history_get_range(history, &range);
+
+    if (!piuio_history_upper_bound(history, &range, time_ns, &index)) {
+      continue;
+    }
+
+    // Keep the most recent entries if not all fit
+    if (range.end - index > max_count) {
+      index = range.end - max_count;
+    }
+
+    if (prev_state != NULL) {
+      if (index == range.begin && range.begin > 0) {
+        // The entry before the oldest one retained is being overwritten, use
+        // the oldest one instead
+        index++;
+      }
+
+      if (index == 0) {
+        *prev_state = 0;
+      } else if (!piuio_history_read(
+                     history, index - 1, &prev_time_ns, prev_state, NULL)) {
+        continue;
+      }
+    }
+
+    valid = true;
+    *count = 0;
+
+    for (; index < range.end; index++) {
+      if (!piuio_history_read(
+              history,
+              index,
+              &samples[*count].time_ns,
+              &samples[*count].state,
+              &samples[*count].stale_mask)) {
+        valid = false;
+        break;
+      }
+
+      (*count)++;
+    }
+
+    if (valid) {
+      return RESULT_SUCCESS;
+    }
+  }
+
+  *count = 0;
+
+  return ERANGE;
+}
@@ -0,0 +1,145 @@
+/**
+ * Time-indexed history of recent input update cycles.
+ *
+ * A fixed-size ring of packed states (see piuio-state.h) with the timestamp of
+ * the cycle they were polled in. This allows evaluating inputs against a point
+ * in time in the past, e.g. judging a step against the audio timestamp of a
+ * note, instead of the current state only.
+ *
+ * Timestamps are based on the monotonic clock, see pumpio_time_now_ns. A
+ * single writer (typically the poller thread) appends entries, any number of
+ * threads can query the history concurrently without locking. Queries are
+ * answered by binary search over the entries retained.
+ */
+#ifndef PIUIO_HISTORY_H
+#define PIUIO_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "atomic_.h"
+#include "result.h"
+
+/**
+ * Number of cycles retained, must be a power of two. At a typical cycle time
+ * of 1-4 ms this covers multiple seconds.
+ */
+#define PIUIO_HISTORY_SIZE 4096
+
+/**
+ * Single entry of the history
+ */
+struct piuio_history_entry {
+  PUMPIO_ATOMIC(uint64_t) time_ns;
+  PUMPIO_ATOMIC(uint64_t) state;
+  PUMPIO_ATOMIC(uint8_t) stale_mask;
+};
+
+/**
+ * Copy of a single entry returned by piuio_history_copy_after
+ */
+struct piuio_history_sample {
+  uint64_t time_ns;
+  uint64_t state;
+  /* Sensor mask slots (bit n = sensor mask n) of the state which kept the
+     inputs of a previous cycle as their sub-poll did not complete in time,
+     see piuio_usb_poll_full_cycle_deadline */
+  uint8_t stale_mask;
+};
+
+/**
+ * History ring. Treat as opaque, use the functions below.
+ */
+struct piuio_history {
+  PUMPIO_ATOMIC(uint64_t) head;
+  struct piuio_history_entry entries[PIUIO_HISTORY_SIZE];
+};
+
+/**
+ * Initialize an empty history.
+ *
+ * @param history Pointer to the history to initialize
+ */
+void piuio_history_init(struct piuio_history *history);
+
+/**
+ * Append the state of a cycle to the history overwriting the oldest entry once
+ * the history is full. Must be called from a single writer thread only.
+ *
+ * @param history Pointer to an initialized history
+ * @param time_ns Timestamp of the cycle, must not be older than the timestamp
+ *                of the previously appended cycle
+ * @param state Packed state of the cycle
+ * @param stale_mask Sensor mask slots of the state which are stale, see
+ *                   struct piuio_history_sample. 0 if all are fresh
+ */
+void piuio_history_push(
+    struct piuio_history *history,
+    uint64_t time_ns,
+    uint64_t state,
+    uint8_t stale_mask);
+
+/**
+ * Get the state that was current at the given point in time, i.e. the state
+ * of the most recent cycle polled at or before that time.
+ *
+ * @param history Pointer to an initialized history
+ * @param time_ns Point in time to query
+ * @param state Pointer to a variable to return the state in
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOENT if no cycle was polled at or before
+ *         that time, yet, ERANGE if the time is older than all entries
+ *         retained
+ */
+result_t piuio_history_state_at(
+    struct piuio_history *history, uint64_t time_ns, uint64_t *state);
+
+/**
+ * Get the time of the first press after the given point in time. A press is a
+ * cycle with any bit of the mask set while none was set in the cycle before.
+ *
+ * @param history Pointer to an initialized history
+ * @param mask Bits to consider, e.g. a single panel using
+ *             PIUIO_STATE_PANEL_MASK
+ * @param time_ns Point in time to search from (exclusive)
+ * @param press_time_ns Pointer to a variable to return the timestamp of the
+ *                      cycle the press was detected in
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOENT if no press happened after that time,
+ *         yet, ERANGE if the time is older than all entries retained
+ */
+result_t piuio_history_first_press_after(
+    struct piuio_history *history,
+    uint64_t mask,
+    uint64_t time_ns,
+    uint64_t *press_time_ns);
+
+/**
+ * Copy the cycles polled after the given point in time, oldest first, e.g. to
+ * process all inputs of a frame at once. If more cycles than fit were polled,
+ * only the most recent ones are copied.
+ *
+ * @param history Pointer to an initialized history
+ * @param time_ns Point in time to copy from (exclusive), e.g. the timestamp of
+ *                the last sample copied before or 0 for all entries retained
+ * @param samples Pointer to an allocated array to copy the cycles to
+ * @param max_count Number of elements of the samples array
+ * @param count Pointer to a variable to return the number of cycles copied in
+ * @param prev_state Pointer to a variable to return the state of the cycle
+ *                   before the first one copied in, e.g. for edge detection,
+ *                   0 if there was none. If that cycle is not retained
+ *                   anymore, the oldest cycle retained is returned here and
+ *                   not copied. NULL if not needed
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, also if no cycle was polled after that time,
+ *         ERANGE if the entries kept being overwritten while copying
+ */
+result_t piuio_history_copy_after(
+    struct piuio_history *history,
+    uint64_t time_ns,
+    struct piuio_history_sample *samples,
+    size_t max_count,
+    size_t *count,
+    uint64_t *prev_state);
+
+#endif
@@ -1,12 +1,135 @@
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "piuio-kmod.h"
+#include "piuio-state.h"
+#include "piuio-stats.h"
+#include "piuio-usbfs.h"
+#include "time_.h"
 
+#define PIUIO_KMOD_DEV_DIR "/dev"
 #define PIUIO_KMOD_DEV_PATH "/dev/piuio0"
+#define PIUIO_KMOD_DEV_PATH_FMT "/dev/piuio%u"
+#define PIUIO_KMOD_DEV_NAME_FMT "piuio%u%n"
+#define PIUIO_KMOD_SYSFS_DEV_FMT "/sys/class/usbmisc/piuio%u/device"
+
+struct piuio_kmod_ctx {
+  int fd;
+  /* Start of the cycle submitted, see piuio_kmod_cycle_submit */
+  uint64_t submit_ns;
+  /* Statistics to record in and start of the last cycle for its interval */
+  struct pumpio_stats *stats;
+  uint64_t last_cycle_ns;
+};
+
+static result_t
+piuio_kmod_io_error(struct piuio_kmod_ctx *ctx, ssize_t result)
+{
+  result_t error;
+
+  // Short transfers don't set errno
+  if (result < 0 && errno > 0) {
+    error = errno;
+  } else {
+    error = EIO;
+  }
+
+  pumpio_stats_record_error(ctx->stats, error);
+
+  return error;
+}
+
+static result_t piuio_kmod_cycle_collect(
+    struct piuio_kmod_ctx *ctx,
+    struct piuio_usb_input_batch_paket *input,
+    int timeout_ms)
+{
+  struct pollfd pfd;
+  ssize_t result;
+
+  pfd.fd = ctx->fd;
+  // Writable if no cycle is in flight, nothing to collect then
+  pfd.events = POLLIN | POLLOUT;
+  pfd.revents = 0;
+
+  do {
+    result = poll(&pfd, 1, timeout_ms);
+  } while (result < 0 && errno == EINTR);
+
+  if (result < 0) {
+    return errno;
+  }
+
+  if (result == 0) {
+    return EAGAIN;
+  }
+
+  if (pfd.revents & (POLLHUP | POLLERR)) {
+    return ENODEV;
+  }
+
+  if (!(pfd.revents & POLLIN)) {
+    return ENOENT;
+  }
+
+  // Outputs were written on submit, read only returns the inputs
+  result = read(ctx->fd, input, sizeof(*input));
+
+  if (result != sizeof(*input)) {
+    return piuio_kmod_io_error(ctx, result);
+  }
+
+  pumpio_stats_record_cycle(
+      ctx->stats, &ctx->last_cycle_ns, ctx->submit_ns, pumpio_time_now_ns());
+
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    piuio_state_invert_pull_ups(&input->pakets[i]);
+  }
+
+  return RESULT_SUCCESS;
+}
+
+static void piuio_kmod_get_path(uint8_t index, char *path, size_t len)
+{
+  char sysfs_path[PATH_MAX];
+  char link[PATH_MAX];
+  ssize_t link_len;
+  const char *name;
+  size_t name_len;
+
+  path[0] = '\0';
+
+  snprintf(sysfs_path, sizeof(sysfs_path), PIUIO_KMOD_SYSFS_DEV_FMT, index);
+
+  // Links to the usb interface, e.g. "../../../1-2.4:1.0"
+  link_len = readlink(sysfs_path, link, sizeof(link) - 1);
+
+  if (link_len < 0) {
+    return;
+  }
+
+  link[link_len] = '\0';
+
+  name = strrchr(link, '/');
+  name = name ? name + 1 : link;
+  name_len = strcspn(name, ":");
+
+  if (name_len >= len) {
+    return;
+  }
+
+  memcpy(path, name, name_len);
+  path[name_len] = '\0';
+}
 
 bool piuio_kmod_available()
 {
@@ -32,53 +155,238 @@ bool piuio_kmod_available()
   return true;
 }
 
-result_t piuio_kmod_open(int *fd)
+result_t piuio_kmod_enumerate(
+    struct piuio_kmod_device_info *infos, size_t max_count, size_t *count)
+{
+  DIR *dir;
+  struct dirent *entry;
+  unsigned int index;
+  int name_len;
+  size_t pos;
+
+  assert(infos != NULL || max_count == 0);
+  assert(count != NULL);
+
+  *count = 0;
+
+  dir = opendir(PIUIO_KMOD_DEV_DIR);
+
+  if (dir == NULL) {
+    return errno;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (sscanf(entry->d_name, PIUIO_KMOD_DEV_NAME_FMT, &index, &name_len) !=
+            1 ||
+        entry->d_name[name_len] != '\0' || index > UINT8_MAX) {
+      continue;
+    }
+
+    (*count)++;
+
+    // Insert sorted by index, drop the highest index if the array is full
+    pos = *count <= max_count ? *count - 1 : max_count;
+
+    while (pos > 0 && infos[pos - 1].index > index) {
+      if (pos < max_count) {
+        infos[pos] = infos[pos - 1];
+      }
+
+      pos--;
+    }
+
+    if (pos < max_count) {
+      infos[pos].index = index;
+      piuio_kmod_get_path(index, infos[pos].path, sizeof(infos[pos].path));
+    }
+  }
+
+  closedir(dir);
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_kmod_open(void **handle)
 {
+  return piuio_kmod_open_index(handle, 0);
+}
+
+result_t piuio_kmod_open_index(void **handle, uint8_t index)
+{
+  char dev_path[PATH_MAX];
+  struct piuio_kmod_ctx *ctx;
   int fd_tmp;
 
-  assert(fd != NULL);
+  assert(handle != NULL);
+
+  snprintf(dev_path, sizeof(dev_path), PIUIO_KMOD_DEV_PATH_FMT, index);
 
-  fd_tmp = open("/dev/piuio0", O_RDONLY);
+  // Writing is only required to submit cycles, polling works read only
+  fd_tmp = open(dev_path, O_RDWR);
+
+  if (fd_tmp < 0 && errno == EACCES) {
+    fd_tmp = open(dev_path, O_RDONLY);
+  }
 
   if (fd_tmp < 0) {
     return errno;
   }
 
-  *fd = fd_tmp;
+  ctx = (struct piuio_kmod_ctx *) malloc(sizeof(struct piuio_kmod_ctx));
+
+  if (ctx == NULL) {
+    close(fd_tmp);
+    return ENOMEM;
+  }
+
+  memset(ctx, 0, sizeof(struct piuio_kmod_ctx));
+  ctx->fd = fd_tmp;
+  ctx->stats = piuio_stats();
+
+  *handle = (void *) ctx;
 
   return RESULT_SUCCESS;
 }
 
-result_t piuio_kmod_poll(int fd, union piuio_kmod_paket *paket)
+result_t piuio_kmod_open_path(void **handle, const char *path)
 {
-  assert(fd >= 0);
+  struct piuio_kmod_device_info infos[UINT8_MAX + 1];
+  size_t count;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(path != NULL);
+
+  result = piuio_kmod_enumerate(infos, UINT8_MAX + 1, &count);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (!strcmp(infos[i].path, path)) {
+      return piuio_kmod_open_index(handle, infos[i].index);
+    }
+  }
+
+  return ENOENT;
+}
+
+result_t piuio_kmod_poll(void *handle, union piuio_kmod_paket *paket)
+{
+  assert(handle != NULL);
   assert(paket != NULL);
 
-  int result;
+  struct piuio_kmod_ctx *ctx = (struct piuio_kmod_ctx *) handle;
+  ssize_t result;
+  uint64_t start_ns;
+
+  start_ns = pumpio_time_now_ns();
 
   // Raw input field covers the entire buffer for writing to the kernel and
   // reading back
-  result = read(fd, paket->raw, sizeof(paket->raw));
+  result = read(ctx->fd, paket->raw, sizeof(paket->raw));
 
   if (result != sizeof(paket->raw)) {
-    if (errno > 0) {
-      return errno;
-    } else {
-      return EIO;
-    }
+    return piuio_kmod_io_error(ctx, result);
   } else {
-    // Invert pull ups
-    for (uint8_t i = 0; i < sizeof(paket->raw); i++) {
-      paket->raw[i] ^= 0xFF;
+    pumpio_stats_record_cycle(
+        ctx->stats, &ctx->last_cycle_ns, start_ns, pumpio_time_now_ns());
+
+    for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+      piuio_state_invert_pull_ups(&paket->input.pakets[i]);
     }
 
     return RESULT_SUCCESS;
   }
 }
 
-void piuio_kmod_close(int fd)
+result_t piuio_kmod_cycle_submit(
+    void *handle, const union piuio_output_paket *output)
 {
-  assert(fd >= 0);
+  struct piuio_kmod_ctx *ctx;
+  ssize_t result;
 
-  close(fd);
+  assert(handle != NULL);
+  assert(output != NULL);
+
+  ctx = (struct piuio_kmod_ctx *) handle;
+  ctx->submit_ns = pumpio_time_now_ns();
+
+  result = write(ctx->fd, output->raw, sizeof(output->raw));
+
+  if (result != sizeof(output->raw)) {
+    return piuio_kmod_io_error(ctx, result);
+  }
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_kmod_cycle_reap(
+    void *handle, struct piuio_usb_input_batch_paket *input)
+{
+  result_t result;
+
+  assert(handle != NULL);
+  assert(input != NULL);
+
+  result = piuio_kmod_cycle_collect(
+      (struct piuio_kmod_ctx *) handle, input, 0);
+
+  // Nothing in flight
+  if (result == ENOENT) {
+    return EINVAL;
+  }
+
+  return result;
+}
+
+result_t piuio_kmod_cycle_cancel(void *handle)
+{
+  struct piuio_usb_input_batch_paket input;
+  result_t result;
+
+  assert(handle != NULL);
+
+  // Transfers can't be cancelled, wait for the cycle and drop its inputs.
+  // Bounded like the cycles of usbfs in case the device stalls
+  result = piuio_kmod_cycle_collect(
+      (struct piuio_kmod_ctx *) handle, &input, PIUIO_USBFS_CYCLE_TIMEOUT_MS);
+
+  if (result == ENOENT) {
+    return RESULT_SUCCESS;
+  }
+
+  if (result == EAGAIN) {
+    return ETIMEDOUT;
+  }
+
+  return result;
+}
+
+int piuio_kmod_fd(void *handle)
+{
+  assert(handle != NULL);
+
+  return ((struct piuio_kmod_ctx *) handle)->fd;
+}
+
+void piuio_kmod_set_stats(void *handle, struct pumpio_stats *stats)
+{
+  assert(handle != NULL);
+  assert(stats != NULL);
+
+  ((struct piuio_kmod_ctx *) handle)->stats = stats;
+}
+
+void piuio_kmod_close(void *handle)
+{
+  struct piuio_kmod_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_kmod_ctx *) handle;
+
+  close(ctx->fd);
+  free(ctx);
 }
\ No newline at end of file
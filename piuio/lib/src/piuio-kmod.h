@@ -6,9 +6,12 @@
 #define PIUIO_KMOD_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "piuio.h"
 #include "result.h"
+#include "stats.h"
+#include "usb_.h"
 
 #define PIUIO_KMOD_INPUT_PAKET_SIZE \
   (PIUIO_INPUT_PAKET_SIZE * PIUIO_SENSOR_MASK_TOTAL_COUNT)
@@ -26,6 +29,17 @@ union piuio_kmod_paket {
   uint8_t raw[PIUIO_KMOD_INPUT_PAKET_SIZE];
 };
 
+/**
+ * Information identifying a single device exposed by the kernel module
+ */
+struct piuio_kmod_device_info {
+  /* Index N of the device file /dev/piuioN */
+  uint8_t index;
+  /* Physical location of the usb device, see pumpio_usb_device_info. Empty
+     if it can't be determined */
+  char path[PUMPIO_USB_PATH_MAX];
+};
+
 /**
  * Checks if the kernel module is loaded and the PIUIO device is connected.
  *
@@ -35,13 +49,51 @@ union piuio_kmod_paket {
 bool piuio_kmod_available();
 
 /**
- * Open a handle to the file device exposed by the kernel module.
+ * Enumerate all PIUIO devices exposed by the kernel module.
  *
- * @param fd Pointer to a variable to store the resulting handle reference in if
- *           the vall is successful.
+ * @param infos Pointer to an allocated array to return information about the
+ *              devices found in, sorted by index
+ * @param max_count Number of elements of the infos array
+ * @param count Pointer to a variable to return the total number of devices
+ *              found in. This can be larger than max_count in which case only
+ *              the max_count devices with the lowest indices are returned.
  * @return Success or an error code as defined by result_t.
  */
-result_t piuio_kmod_open(int *fd);
+result_t piuio_kmod_enumerate(
+    struct piuio_kmod_device_info *infos, size_t max_count, size_t *count);
+
+/**
+ * Open a handle to the (first) file device exposed by the kernel module.
+ *
+ * @param handle Pointer to a variable to store the resulting handle reference
+ *               in if the call is successful.
+ * @return Success or an error code as defined by result_t.
+ */
+result_t piuio_kmod_open(void **handle);
+
+/**
+ * Open a handle to a specific file device /dev/piuioN exposed by the kernel
+ * module. Use this if multiple PIUIO devices are connected to the same host.
+ *
+ * @param handle Pointer to a variable to store the resulting handle reference
+ *               in if the call is successful.
+ * @param index Index N of the device file
+ * @return Success or an error code as defined by result_t.
+ */
+result_t piuio_kmod_open_index(void **handle, uint8_t index);
+
+/**
+ * Open a handle to the file device of the PIUIO connected at the given usb
+ * path.
+ *
+ * @param handle Pointer to a variable to store the resulting handle reference
+ *               in if the call is successful.
+ * @param path Physical location of the usb device, e.g. "1-2.4", see
+ *             piuio_kmod_enumerate
+ * @return Success or an error code as defined by result_t. ENOENT if no device
+ *         exposed by the kernel module is connected at that path.
+ */
+result_t piuio_kmod_open_path(void **handle, const char *path);
 
 /**
  * Execute a single user-space to kernel call to issue a full polling cycle
@@ -53,7 +105,7 @@ result_t piuio_kmod_open(int *fd);
  * to issue four output queries to select each sensor and four input queries to
  * get the data for each selected sensor.
  *
- * @param fd A valid and opened file handle  to the PIUIO device
+ * @param handle Valid handle of an opened PIUIO device
  * @param output Pointer to an allocated buffer. When calling this function, the
  *               buffer should contain the output data to write. After returning
  *               successfully, it contains a full polling cycle of input data
@@ -62,16 +114,80 @@ result_t piuio_kmod_open(int *fd);
  *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
  *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
  */
-result_t piuio_kmod_poll(int fd, union piuio_kmod_paket *paket);
+result_t piuio_kmod_poll(void *handle, union piuio_kmod_paket *paket);
+
+/**
+ * Start a full polling cycle without blocking, e.g. to multiplex devices on
+ * a single thread. The kernel module runs the cycle in the background.
+ *
+ * Once the cycle completed, the device file (see piuio_kmod_fd) is readable
+ * (POLLIN), e.g. with poll or epoll, and the inputs are collected with
+ * piuio_kmod_cycle_reap. Only a single cycle can be in flight per device.
+ * Requires the device file to be writable, see piuio_kmod_open_index.
+ *
+ * @param handle Valid handle of an opened PIUIO device
+ * @param output Output data to write with the cycle
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EBUSY if a cycle is still in flight or not
+ *         collected, EBADF if the device file is read only, ENODEV, EIO,
+ *         EINVAL
+ */
+result_t piuio_kmod_cycle_submit(
+    void *handle, const union piuio_output_paket *output);
+
+/**
+ * Collect the inputs of a cycle started with piuio_kmod_cycle_submit without
+ * blocking.
+ *
+ * @param handle Valid handle of an opened PIUIO device
+ * @param input Pointer to a buffer to return the inputs of all sensors in
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EAGAIN if the cycle is still in flight,
+ *         EINVAL if no cycle was submitted, ENODEV, EIO, EPIPE, ETIMEDOUT
+ */
+result_t piuio_kmod_cycle_reap(
+    void *handle, struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Drop a cycle started with piuio_kmod_cycle_submit. The transfers of the
+ * cycle can't be cancelled, this blocks until the cycle completed, at most
+ * PIUIO_USBFS_CYCLE_TIMEOUT_MS.
+ *
+ * @param handle Valid handle of an opened PIUIO device
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ETIMEDOUT if the cycle didn't complete in
+ *         time, ENODEV, or the error of the cycle dropped
+ */
+result_t piuio_kmod_cycle_cancel(void *handle);
+
+/**
+ * Get the file descriptor of the device file of an opened PIUIO device, e.g.
+ * to wait for a cycle submitted with poll or epoll.
+ *
+ * @param handle Valid handle of an opened PIUIO device
+ * @return File descriptor, owned by the handle
+ */
+int piuio_kmod_fd(void *handle);
+
+/**
+ * Record the cycles and errors of an opened PIUIO device in the given
+ * statistics instead of the process-wide ones (see piuio-stats.h), e.g. to
+ * evaluate multiple devices individually.
+ *
+ * @param handle Valid handle of an opened PIUIO device
+ * @param stats Pointer to the statistics to record in, must stay valid until
+ *              the device is closed
+ */
+void piuio_kmod_set_stats(void *handle, struct pumpio_stats *stats);
 
 /**
  * Close an opened PIUIO usb device.
  *
  * Ensure you call this for every PIUIO device opened to free resources.
  *
- * @param fd Valid file handle of the opened PIUIO device to close
+ * @param handle Valid handle of the opened PIUIO device to close
  */
-void piuio_kmod_close(int fd);
+void piuio_kmod_close(void *handle);
 
 static_assert(
     sizeof(union piuio_kmod_paket) == PIUIO_KMOD_INPUT_PAKET_SIZE,
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "piuio-latch.h"
+
+void piuio_latch_init(struct piuio_latch *latch)
+{
+  assert(latch != NULL);
+
+  latch->state = 0;
+  atomic_init(&latch->slots_used, 0);
+
+  for (uint8_t i = 0; i < PIUIO_LATCH_MAX_READERS; i++) {
+    atomic_init(&latch->slots[i].pressed, 0);
+    atomic_init(&latch->slots[i].released, 0);
+  }
+
+  for (uint8_t i = 0; i < PIUIO_LATCH_BITS; i++) {
+    atomic_init(&latch->press_count[i], 0);
+  }
+}
+
+void piuio_latch_publish(struct piuio_latch *latch, uint64_t state)
+{
+  uint64_t edges;
+  uint64_t pressed;
+  uint64_t released;
+  uint64_t used;
+  uint64_t bits;
+
+  assert(latch != NULL);
+
+  edges = latch->state ^ state;
+
+  // Fast path, nothing changed which is the case for most cycles
+  if (edges == 0) {
+    return;
+  }
+
+  pressed = edges & state;
+  released = edges & ~state;
+
+  bits = pressed;
+
+  while (bits) {
+    atomic_fetch_add_explicit(
+        &latch->press_count[__builtin_ctzll(bits)], 1, memory_order_relaxed);
+    bits &= bits - 1;
+  }
+
+  used = atomic_load_explicit(&latch->slots_used, memory_order_acquire);
+
+  while (used) {
+    struct piuio_latch_slot *slot = &latch->slots[__builtin_ctzll(used)];
+
+    if (pressed) {
+      atomic_fetch_or_explicit(&slot->pressed, pressed, memory_order_release);
+    }
+
+    if (released) {
+      atomic_fetch_or_explicit(&slot->released, released, memory_order_release);
+    }
+
+    used &= used - 1;
+  }
+
+  latch->state = state;
+}
+
+result_t piuio_latch_reader_open(
+    struct piuio_latch *latch, struct piuio_latch_reader *reader)
+{
+  uint64_t used;
+  uint8_t slot;
+
+  assert(latch != NULL);
+  assert(reader != NULL);
+
+  used = atomic_load_explicit(&latch->slots_used, memory_order_relaxed);
+
+  do {
+    if (used == (UINT64_C(1) << PIUIO_LATCH_MAX_READERS) - 1) {
+      return EBUSY;
+    }
+
+    slot = __builtin_ctzll(~used);
+  } while (!atomic_compare_exchange_weak_explicit(
+      &latch->slots_used,
+      &used,
+      used | (UINT64_C(1) << slot),
+      memory_order_acq_rel,
+      memory_order_relaxed));
+
+  reader->latch = latch;
+  reader->slot = slot;
+
+  // Discard anything left over from a previous reader of the slot
+  atomic_store_explicit(&latch->slots[slot].pressed, 0, memory_order_relaxed);
+  atomic_store_explicit(&latch->slots[slot].released, 0, memory_order_relaxed);
+
+  for (uint8_t i = 0; i < PIUIO_LATCH_BITS; i++) {
+    reader->press_count[i] =
+        atomic_load_explicit(&latch->press_count[i], memory_order_relaxed);
+  }
+
+  return RESULT_SUCCESS;
+}
+
+void piuio_latch_reader_read(
+    struct piuio_latch_reader *reader, struct piuio_latch_result *result)
+{
+  struct piuio_latch_slot *slot;
+
+  assert(reader != NULL);
+  assert(reader->latch != NULL);
+  assert(result != NULL);
+
+  slot = &reader->latch->slots[reader->slot];
+
+  result->pressed =
+      atomic_exchange_explicit(&slot->pressed, 0, memory_order_acq_rel);
+  result->released =
+      atomic_exchange_explicit(&slot->released, 0, memory_order_acq_rel);
+
+  for (uint8_t i = 0; i < PIUIO_LATCH_BITS; i++) {
+    uint32_t count = atomic_load_explicit(
+        &reader->latch->press_count[i], memory_order_relaxed);
+
+    result->press_count[i] = count - reader->press_count[i];
+    reader->press_count[i] = count;
+  }
+}
+
+void piuio_latch_reader_close(struct piuio_latch_reader *reader)
+{
+  assert(reader != NULL);
+  assert(reader->latch != NULL);
+
+  atomic_fetch_and_explicit(
+      &reader->latch->slots_used,
+      ~(UINT64_C(1) << reader->slot),
+      memory_order_release);
+
+  reader->latch = NULL;
+}
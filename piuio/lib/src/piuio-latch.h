@@ -0,0 +1,120 @@
+/**
+ * Latched input edges for consumers running at a lower rate than the I/O.
+ *
+ * A single producer (typically the poller thread) publishes the packed state
+ * (see piuio-state.h) of every update cycle. Each consumer registers a reader
+ * and gets every press and release that happened since its last read, even if
+ * the input was active for a shorter time than the consumer's update interval.
+ *
+ * Edges are accumulated per reader with atomic or operations, press counts are
+ * kept as global monotonic counters incremented with atomic adds. Readers
+ * consume at their own rate without any queueing or locking. All functions
+ * for readers are thread-safe, piuio_latch_publish must only be called from a
+ * single thread.
+ */
+#ifndef PIUIO_LATCH_H
+#define PIUIO_LATCH_H
+
+#include <stdint.h>
+
+#include "atomic_.h"
+#include "result.h"
+
+/**
+ * Max number of readers that can be registered with a latch at the same time
+ */
+#define PIUIO_LATCH_MAX_READERS 32
+
+/**
+ * Number of state bits tracked
+ */
+#define PIUIO_LATCH_BITS 64
+
+/**
+ * Edges accumulated for a single reader, aligned to avoid false sharing of
+ * different readers.
+ */
+struct piuio_latch_slot {
+  PUMPIO_ATOMIC(uint64_t) pressed;
+  PUMPIO_ATOMIC(uint64_t) released;
+} __attribute__((aligned(64)));
+
+/**
+ * Latch shared by a producer and any number of readers. Treat as opaque.
+ */
+struct piuio_latch {
+  uint64_t state;
+  PUMPIO_ATOMIC(uint64_t) slots_used;
+  struct piuio_latch_slot slots[PIUIO_LATCH_MAX_READERS];
+  PUMPIO_ATOMIC(uint32_t) press_count[PIUIO_LATCH_BITS];
+};
+
+/**
+ * Reader handle of a single consumer. Each consumer needs its own reader.
+ */
+struct piuio_latch_reader {
+  struct piuio_latch *latch;
+  uint8_t slot;
+  uint32_t press_count[PIUIO_LATCH_BITS];
+};
+
+/**
+ * Result of a single read from the latch
+ */
+struct piuio_latch_result {
+  /* Bits that went from 0 to 1 at least once since the last read */
+  uint64_t pressed;
+  /* Bits that went from 1 to 0 at least once since the last read */
+  uint64_t released;
+  /* Number of presses per bit since the last read. Counts may reflect a
+     press one read before it is reported in the pressed mask */
+  uint32_t press_count[PIUIO_LATCH_BITS];
+};
+
+/**
+ * Initialize a latch.
+ *
+ * @param latch Pointer to the latch to initialize
+ */
+void piuio_latch_init(struct piuio_latch *latch);
+
+/**
+ * Publish the state of an update cycle to all readers. Must be called from a
+ * single producer thread only.
+ *
+ * @param latch Pointer to an initialized latch
+ * @param state Packed state of the current update cycle
+ */
+void piuio_latch_publish(struct piuio_latch *latch, uint64_t state);
+
+/**
+ * Register a new reader with a latch. Edges are accumulated for the reader
+ * starting with the next call to piuio_latch_publish.
+ *
+ * @param latch Pointer to an initialized latch
+ * @param reader Pointer to the reader to initialize
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EBUSY if PIUIO_LATCH_MAX_READERS are
+ *         already registered
+ */
+result_t piuio_latch_reader_open(
+    struct piuio_latch *latch, struct piuio_latch_reader *reader);
+
+/**
+ * Read and reset all edges and press counts accumulated for a reader since
+ * its last read.
+ *
+ * @param reader Pointer to an opened reader
+ * @param result Pointer to an allocated buffer to return the result in
+ */
+void piuio_latch_reader_read(
+    struct piuio_latch_reader *reader, struct piuio_latch_result *result);
+
+/**
+ * Unregister a reader from its latch.
+ *
+ * @param reader Pointer to an opened reader
+ */
+void piuio_latch_reader_close(struct piuio_latch_reader *reader);
+
+#endif
@@ -0,0 +1,87 @@
+#include <assert.h>
+
+#include "piuio-lights.h"
+
+void piuio_lights_init(struct piuio_lights *lights, uint64_t word)
+{
+  assert(lights != NULL);
+
+  atomic_init(&lights->word, word & ~PIUIO_LIGHTS_SENSOR_MASK);
+}
+
+void piuio_lights_set(struct piuio_lights *lights, uint64_t mask)
+{
+  assert(lights != NULL);
+
+  atomic_fetch_or_explicit(
+      &lights->word, mask & ~PIUIO_LIGHTS_SENSOR_MASK, memory_order_relaxed);
+}
+
+void piuio_lights_clear(struct piuio_lights *lights, uint64_t mask)
+{
+  assert(lights != NULL);
+
+  atomic_fetch_and_explicit(&lights->word, ~mask, memory_order_relaxed);
+}
+
+void piuio_lights_replace(
+    struct piuio_lights *lights, uint64_t mask, uint64_t value)
+{
+  uint64_t cur;
+
+  assert(lights != NULL);
+
+  mask &= ~PIUIO_LIGHTS_SENSOR_MASK;
+  cur = atomic_load_explicit(&lights->word, memory_order_relaxed);
+
+  while (!atomic_compare_exchange_weak_explicit(
+      &lights->word,
+      &cur,
+      (cur & ~mask) | (value & mask),
+      memory_order_relaxed,
+      memory_order_relaxed)) {
+    // Retry with the updated word
+  }
+}
+
+uint64_t piuio_lights_get(const struct piuio_lights *lights)
+{
+  assert(lights != NULL);
+
+  return atomic_load_explicit(
+      (_Atomic uint64_t *) &lights->word, memory_order_relaxed);
+}
+
+uint64_t piuio_lights_from_paket(const union piuio_output_paket *paket)
+{
+  uint64_t word;
+
+  assert(paket != NULL);
+
+  word = 0;
+
+  // Byte-wise to not depend on the byte order of the host
+  for (uint8_t i = 0; i < sizeof(paket->raw); i++) {
+    word |= (uint64_t) paket->raw[i] << (i * 8);
+  }
+
+  return word & ~PIUIO_LIGHTS_SENSOR_MASK;
+}
+
+void piuio_lights_apply(
+    const struct piuio_lights *lights, union piuio_output_paket *paket)
+{
+  uint64_t word;
+  uint8_t sensor_mask;
+
+  assert(lights != NULL);
+  assert(paket != NULL);
+
+  word = piuio_lights_get(lights);
+
+  for (uint8_t i = 0; i < sizeof(paket->raw); i++) {
+    sensor_mask = (uint8_t) (PIUIO_LIGHTS_SENSOR_MASK >> (i * 8));
+    paket->raw[i] =
+        (paket->raw[i] & sensor_mask) | (uint8_t) (word >> (i * 8));
+  }
+}
@@ -0,0 +1,154 @@
+/**
+ * Lock-free output word to drive lights and coin counters from any thread.
+ *
+ * The 8 bytes of an output paket are mapped to a single 64-bit word, byte n of
+ * the paket to bits 8n to 8n + 7 of the word. Any number of threads, e.g. the
+ * game's render thread, set, clear or replace bits with a single atomic
+ * operation, without locking. The polling thread picks up the current word
+ * with its next OUT transfer, i.e. changes cost no additional USB traffic.
+ *
+ * The sensor mask bits are owned by the polling backend and are never taken
+ * from the word.
+ */
+#ifndef PIUIO_LIGHTS_H
+#define PIUIO_LIGHTS_H
+
+#include <stdint.h>
+
+#include "atomic_.h"
+#include "piuio.h"
+
+/**
+ * Bit of the output word for a bit of a byte of the output paket
+ */
+#define PIUIO_LIGHTS_BIT(byte, bit) (UINT64_C(1) << ((byte) * 8 + (bit)))
+
+/**
+ * Sensor mask bits of both players, ignored by all functions
+ */
+#define PIUIO_LIGHTS_SENSOR_MASK \
+  (PIUIO_LIGHTS_BIT(0, 0) | PIUIO_LIGHTS_BIT(0, 1) | PIUIO_LIGHTS_BIT(2, 0) | \
+   PIUIO_LIGHTS_BIT(2, 1))
+
+/**
+ * Outputs of Pump It Up, see struct piuio_piu_output_paket
+ */
+#define PIUIO_LIGHTS_PIU_PAD_P1_LU PIUIO_LIGHTS_BIT(0, 2)
+#define PIUIO_LIGHTS_PIU_PAD_P1_RU PIUIO_LIGHTS_BIT(0, 3)
+#define PIUIO_LIGHTS_PIU_PAD_P1_CN PIUIO_LIGHTS_BIT(0, 4)
+#define PIUIO_LIGHTS_PIU_PAD_P1_LD PIUIO_LIGHTS_BIT(0, 5)
+#define PIUIO_LIGHTS_PIU_PAD_P1_RD PIUIO_LIGHTS_BIT(0, 6)
+#define PIUIO_LIGHTS_PIU_BASS PIUIO_LIGHTS_BIT(1, 2)
+#define PIUIO_LIGHTS_PIU_COIN_COUNTER_2 PIUIO_LIGHTS_BIT(1, 3)
+#define PIUIO_LIGHTS_PIU_PAD_P2_LU PIUIO_LIGHTS_BIT(2, 2)
+#define PIUIO_LIGHTS_PIU_PAD_P2_RU PIUIO_LIGHTS_BIT(2, 3)
+#define PIUIO_LIGHTS_PIU_PAD_P2_CN PIUIO_LIGHTS_BIT(2, 4)
+#define PIUIO_LIGHTS_PIU_PAD_P2_LD PIUIO_LIGHTS_BIT(2, 5)
+#define PIUIO_LIGHTS_PIU_PAD_P2_RD PIUIO_LIGHTS_BIT(2, 6)
+#define PIUIO_LIGHTS_PIU_TOP_LAMP_R2 PIUIO_LIGHTS_BIT(2, 7)
+#define PIUIO_LIGHTS_PIU_TOP_LAMP_R1 PIUIO_LIGHTS_BIT(3, 0)
+#define PIUIO_LIGHTS_PIU_TOP_LAMP_L2 PIUIO_LIGHTS_BIT(3, 1)
+#define PIUIO_LIGHTS_PIU_TOP_LAMP_L1 PIUIO_LIGHTS_BIT(3, 2)
+#define PIUIO_LIGHTS_PIU_COIN_COUNTER_1 PIUIO_LIGHTS_BIT(3, 4)
+
+#define PIUIO_LIGHTS_PIU_PADS_P1 \
+  (PIUIO_LIGHTS_PIU_PAD_P1_LU | PIUIO_LIGHTS_PIU_PAD_P1_RU | \
+   PIUIO_LIGHTS_PIU_PAD_P1_CN | PIUIO_LIGHTS_PIU_PAD_P1_LD | \
+   PIUIO_LIGHTS_PIU_PAD_P1_RD)
+#define PIUIO_LIGHTS_PIU_PADS_P2 \
+  (PIUIO_LIGHTS_PIU_PAD_P2_LU | PIUIO_LIGHTS_PIU_PAD_P2_RU | \
+   PIUIO_LIGHTS_PIU_PAD_P2_CN | PIUIO_LIGHTS_PIU_PAD_P2_LD | \
+   PIUIO_LIGHTS_PIU_PAD_P2_RD)
+
+/**
+ * Outputs of In The Groove, see struct piuio_itg_output_paket
+ */
+#define PIUIO_LIGHTS_ITG_PAD_P1_UP PIUIO_LIGHTS_BIT(0, 2)
+#define PIUIO_LIGHTS_ITG_PAD_P1_DOWN PIUIO_LIGHTS_BIT(0, 3)
+#define PIUIO_LIGHTS_ITG_PAD_P1_LEFT PIUIO_LIGHTS_BIT(0, 4)
+#define PIUIO_LIGHTS_ITG_PAD_P1_RIGHT PIUIO_LIGHTS_BIT(0, 5)
+#define PIUIO_LIGHTS_ITG_BASS PIUIO_LIGHTS_BIT(1, 2)
+#define PIUIO_LIGHTS_ITG_PAD_P2_UP PIUIO_LIGHTS_BIT(2, 2)
+#define PIUIO_LIGHTS_ITG_PAD_P2_DOWN PIUIO_LIGHTS_BIT(2, 3)
+#define PIUIO_LIGHTS_ITG_PAD_P2_LEFT PIUIO_LIGHTS_BIT(2, 4)
+#define PIUIO_LIGHTS_ITG_PAD_P2_RIGHT PIUIO_LIGHTS_BIT(2, 5)
+#define PIUIO_LIGHTS_ITG_TOP_LAMP_R2 PIUIO_LIGHTS_BIT(2, 7)
+#define PIUIO_LIGHTS_ITG_TOP_LAMP_R1 PIUIO_LIGHTS_BIT(3, 0)
+#define PIUIO_LIGHTS_ITG_TOP_LAMP_L2 PIUIO_LIGHTS_BIT(3, 1)
+#define PIUIO_LIGHTS_ITG_TOP_LAMP_L1 PIUIO_LIGHTS_BIT(3, 2)
+#define PIUIO_LIGHTS_ITG_COIN_COUNTER PIUIO_LIGHTS_BIT(3, 4)
+
+#define PIUIO_LIGHTS_TOP_LAMPS \
+  (PIUIO_LIGHTS_PIU_TOP_LAMP_R2 | PIUIO_LIGHTS_PIU_TOP_LAMP_R1 | \
+   PIUIO_LIGHTS_PIU_TOP_LAMP_L2 | PIUIO_LIGHTS_PIU_TOP_LAMP_L1)
+
+/**
+ * Output word shared by the polling thread and any number of writers. Treat
+ * as opaque, use the functions below.
+ */
+struct piuio_lights {
+  PUMPIO_ATOMIC(uint64_t) word;
+};
+
+/**
+ * Initialize the output word.
+ *
+ * @param lights Pointer to the output word to initialize
+ * @param word Initial value, e.g. all lights off (0)
+ */
+void piuio_lights_init(struct piuio_lights *lights, uint64_t word);
+
+/**
+ * Turn on outputs. Thread-safe.
+ *
+ * @param lights Pointer to an initialized output word
+ * @param mask Outputs to turn on, e.g. PIUIO_LIGHTS_PIU_BASS
+ */
+void piuio_lights_set(struct piuio_lights *lights, uint64_t mask);
+
+/**
+ * Turn off outputs. Thread-safe.
+ *
+ * @param lights Pointer to an initialized output word
+ * @param mask Outputs to turn off
+ */
+void piuio_lights_clear(struct piuio_lights *lights, uint64_t mask);
+
+/**
+ * Replace a group of outputs in a single atomic update, e.g. all pad lights
+ * of a player. Thread-safe.
+ *
+ * @param lights Pointer to an initialized output word
+ * @param mask Outputs to replace, outputs not in the mask are kept
+ * @param value New values of the outputs in the mask
+ */
+void piuio_lights_replace(
+    struct piuio_lights *lights, uint64_t mask, uint64_t value);
+
+/**
+ * Get the current output word. Thread-safe.
+ *
+ * @param lights Pointer to an initialized output word
+ * @return Current output word, sensor mask bits are 0
+ */
+uint64_t piuio_lights_get(const struct piuio_lights *lights);
+
+/**
+ * Convert an output paket to an output word.
+ *
+ * @param paket Output paket to convert
+ * @return Output word, sensor mask bits are 0
+ */
+uint64_t piuio_lights_from_paket(const union piuio_output_paket *paket);
+
+/**
+ * Apply the current output word to an output paket, called by the polling
+ * thread before every cycle. The sensor mask bits of the paket are kept.
+ *
+ * @param lights Pointer to an initialized output word
+ * @param paket Output paket to update
+ */
+void piuio_lights_apply(
+    const struct piuio_lights *lights, union piuio_output_paket *paket);
+
+#endif
@@ -0,0 +1,424 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "piuio-kmod.h"
+#include "piuio-loop.h"
+#include "piuio-state.h"
+#include "piuio-usbfs.h"
+#include "time_.h"
+
+struct piuio_loop_board {
+  /* Device of the board, either usbfs or kmod */
+  void *usbfs;
+  void *kmod;
+  struct piuio_lights lights;
+  union piuio_output_paket output;
+  struct piuio_usb_input_batch_paket input;
+  /* Submission time of the cycle in flight */
+  uint64_t submit_ns;
+  uint64_t state;
+  uint64_t cycle;
+  /* Error that stopped the board, RESULT_SUCCESS while running */
+  result_t error;
+};
+
+struct piuio_loop_ctx {
+  struct piuio_loop_config config;
+  int epoll_fd;
+  uint64_t cycle_timeout_ns;
+  struct piuio_loop_board boards[PIUIO_LOOP_BOARDS_MAX];
+  size_t board_count;
+  size_t running;
+};
+
+static int piuio_loop_board_fd(struct piuio_loop_board *board)
+{
+  return board->usbfs != NULL ? piuio_usbfs_fd(board->usbfs)
+                              : piuio_kmod_fd(board->kmod);
+}
+
+static result_t piuio_loop_submit(struct piuio_loop_board *board)
+{
+  piuio_lights_apply(&board->lights, &board->output);
+
+  board->submit_ns = pumpio_time_now_ns();
+
+  if (board->usbfs != NULL) {
+    return piuio_usbfs_cycle_submit(
+        board->usbfs, &board->output, &board->input);
+  } else {
+    return piuio_kmod_cycle_submit(board->kmod, &board->output);
+  }
+}
+
+static result_t piuio_loop_reap(struct piuio_loop_board *board)
+{
+  if (board->usbfs != NULL) {
+    return piuio_usbfs_cycle_reap(board->usbfs);
+  } else {
+    return piuio_kmod_cycle_reap(board->kmod, &board->input);
+  }
+}
+
+static void piuio_loop_cancel(struct piuio_loop_board *board)
+{
+  if (board->usbfs != NULL) {
+    piuio_usbfs_cycle_cancel(board->usbfs);
+  } else {
+    piuio_kmod_cycle_cancel(board->kmod);
+  }
+}
+
+static void piuio_loop_stop_board(
+    struct piuio_loop_ctx *ctx, size_t index, result_t result)
+{
+  struct piuio_loop_board *board;
+
+  board = &ctx->boards[index];
+  board->error = result;
+  ctx->running--;
+
+  epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, piuio_loop_board_fd(board), NULL);
+
+  if (ctx->config.cycle != NULL) {
+    ctx->config.cycle(ctx->config.ctx, index, result, 0);
+  }
+}
+
+/**
+ * Dispatch the completed cycle of a board and submit its next one
+ */
+static void
+piuio_loop_complete(struct piuio_loop_ctx *ctx, size_t index, result_t result)
+{
+  struct piuio_loop_board *board;
+
+  board = &ctx->boards[index];
+
+  if (RESULT_IS_ERROR(result)) {
+    piuio_loop_stop_board(ctx, index, result);
+    return;
+  }
+
+  board->state = piuio_state_decode(&board->input);
+  board->cycle++;
+
+  if (ctx->config.cycle != NULL) {
+    ctx->config.cycle(ctx->config.ctx, index, RESULT_SUCCESS, board->state);
+  }
+
+  result = piuio_loop_submit(board);
+
+  if (RESULT_IS_ERROR(result)) {
+    piuio_loop_stop_board(ctx, index, result);
+  }
+}
+
+/**
+ * Time until the oldest cycle in flight times out, -1 if none is in flight
+ */
+static int
+piuio_loop_next_timeout_ms(struct piuio_loop_ctx *ctx, uint64_t now_ns)
+{
+  uint64_t deadline_ns;
+  uint64_t next_ns;
+  bool found;
+
+  found = false;
+  next_ns = 0;
+
+  for (size_t i = 0; i < ctx->board_count; i++) {
+    if (RESULT_IS_ERROR(ctx->boards[i].error)) {
+      continue;
+    }
+
+    deadline_ns = ctx->boards[i].submit_ns + ctx->cycle_timeout_ns;
+
+    if (!found || deadline_ns < next_ns) {
+      next_ns = deadline_ns;
+      found = true;
+    }
+  }
+
+  if (!found) {
+    return -1;
+  }
+
+  if (next_ns <= now_ns) {
+    return 0;
+  }
+
+  // Round up to not busy loop on the last millisecond
+  return (int) ((next_ns - now_ns + 999999) / 1000000);
+}
+
+result_t piuio_loop_init(void **handle, const struct piuio_loop_config *config)
+{
+  struct piuio_loop_ctx *ctx;
+  uint32_t cycle_timeout_ms;
+
+  assert(handle != NULL);
+  assert(config != NULL);
+
+  ctx = (struct piuio_loop_ctx *) malloc(sizeof(struct piuio_loop_ctx));
+
+  if (ctx == NULL) {
+    return ENOMEM;
+  }
+
+  memset(ctx, 0, sizeof(struct piuio_loop_ctx));
+
+  ctx->config = *config;
+  ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if (ctx->epoll_fd < 0) {
+    free(ctx);
+    return errno;
+  }
+
+  cycle_timeout_ms = config->cycle_timeout_ms > 0 ?
+      config->cycle_timeout_ms :
+      PIUIO_USBFS_CYCLE_TIMEOUT_MS;
+  ctx->cycle_timeout_ns = (uint64_t) cycle_timeout_ms * 1000000;
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Add a board with its device set and submit its first cycle
+ */
+static result_t piuio_loop_add_board(
+    struct piuio_loop_ctx *ctx,
+    struct piuio_loop_board *entry,
+    const union piuio_output_paket *output,
+    size_t *board)
+{
+  struct epoll_event event;
+  result_t result;
+  int fd;
+
+  assert(output != NULL);
+  assert(board != NULL);
+
+  entry->output = *output;
+  piuio_lights_init(&entry->lights, piuio_lights_from_paket(output));
+
+  fd = piuio_loop_board_fd(entry);
+
+  // Completions of usbfs devices are signaled as writable, of the kernel
+  // module as readable. Level triggered to not lose any if a reap is
+  // interrupted
+  memset(&event, 0, sizeof(event));
+  event.events = entry->usbfs != NULL ? EPOLLOUT : EPOLLIN;
+  event.data.u64 = ctx->board_count;
+
+  if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+    return errno;
+  }
+
+  result = piuio_loop_submit(entry);
+
+  if (RESULT_IS_ERROR(result)) {
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    return result;
+  }
+
+  *board = ctx->board_count;
+  ctx->board_count++;
+  ctx->running++;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_loop_add(
+    void *handle,
+    void *usbfs,
+    const union piuio_output_paket *output,
+    size_t *board)
+{
+  struct piuio_loop_ctx *ctx;
+  struct piuio_loop_board *entry;
+
+  assert(handle != NULL);
+  assert(usbfs != NULL);
+
+  ctx = (struct piuio_loop_ctx *) handle;
+
+  if (ctx->board_count >= PIUIO_LOOP_BOARDS_MAX) {
+    return ENOSPC;
+  }
+
+  entry = &ctx->boards[ctx->board_count];
+  memset(entry, 0, sizeof(struct piuio_loop_board));
+
+  entry->usbfs = usbfs;
+
+  return piuio_loop_add_board(ctx, entry, output, board);
+}
+
+result_t piuio_loop_add_kmod(
+    void *handle,
+    void *kmod,
+    const union piuio_output_paket *output,
+    size_t *board)
+{
+  struct piuio_loop_ctx *ctx;
+  struct piuio_loop_board *entry;
+
+  assert(handle != NULL);
+  assert(kmod != NULL);
+
+  ctx = (struct piuio_loop_ctx *) handle;
+
+  if (ctx->board_count >= PIUIO_LOOP_BOARDS_MAX) {
+    return ENOSPC;
+  }
+
+  entry = &ctx->boards[ctx->board_count];
+  memset(entry, 0, sizeof(struct piuio_loop_board));
+
+  entry->kmod = kmod;
+
+  return piuio_loop_add_board(ctx, entry, output, board);
+}
+
+result_t piuio_loop_run(void *handle, uint32_t timeout_ms)
+{
+  struct piuio_loop_ctx *ctx;
+  struct epoll_event events[PIUIO_LOOP_BOARDS_MAX];
+  struct piuio_loop_board *board;
+  result_t result;
+  uint64_t now_ns;
+  int board_timeout_ms;
+  int wait_ms;
+  int count;
+  size_t index;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_loop_ctx *) handle;
+
+  if (ctx->running == 0) {
+    return ENOENT;
+  }
+
+  // Wake up for cycles timing out before the caller's timeout
+  wait_ms = (int) timeout_ms;
+  board_timeout_ms = piuio_loop_next_timeout_ms(ctx, pumpio_time_now_ns());
+
+  if (board_timeout_ms >= 0 && board_timeout_ms < wait_ms) {
+    wait_ms = board_timeout_ms;
+  }
+
+  count = epoll_wait(ctx->epoll_fd, events, PIUIO_LOOP_BOARDS_MAX, wait_ms);
+
+  if (count < 0) {
+    return errno;
+  }
+
+  for (int i = 0; i < count; i++) {
+    index = (size_t) events[i].data.u64;
+    board = &ctx->boards[index];
+
+    if (RESULT_IS_ERROR(board->error)) {
+      continue;
+    }
+
+    if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+      piuio_loop_cancel(board);
+      piuio_loop_complete(ctx, index, ENODEV);
+      continue;
+    }
+
+    result = piuio_loop_reap(board);
+
+    // Only some transfers of the cycle completed, yet
+    if (result == EAGAIN) {
+      continue;
+    }
+
+    piuio_loop_complete(ctx, index, result);
+  }
+
+  now_ns = pumpio_time_now_ns();
+
+  for (size_t i = 0; i < ctx->board_count; i++) {
+    board = &ctx->boards[i];
+
+    if (RESULT_IS_SUCCESS(board->error) &&
+        now_ns - board->submit_ns >= ctx->cycle_timeout_ns) {
+      piuio_loop_cancel(board);
+      piuio_loop_complete(ctx, i, ETIMEDOUT);
+    }
+  }
+
+  return count > 0 ? RESULT_SUCCESS : ETIMEDOUT;
+}
+
+uint64_t piuio_loop_state(void *handle, size_t board, uint64_t *cycle)
+{
+  struct piuio_loop_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_loop_ctx *) handle;
+
+  assert(board < ctx->board_count);
+
+  if (cycle != NULL) {
+    *cycle = ctx->boards[board].cycle;
+  }
+
+  return ctx->boards[board].state;
+}
+
+struct piuio_lights *piuio_loop_lights(void *handle, size_t board)
+{
+  struct piuio_loop_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_loop_ctx *) handle;
+
+  assert(board < ctx->board_count);
+
+  return &ctx->boards[board].lights;
+}
+
+result_t piuio_loop_error(void *handle, size_t board)
+{
+  struct piuio_loop_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_loop_ctx *) handle;
+
+  assert(board < ctx->board_count);
+
+  return ctx->boards[board].error;
+}
+
+void piuio_loop_free(void *handle)
+{
+  struct piuio_loop_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_loop_ctx *) handle;
+
+  for (size_t i = 0; i < ctx->board_count; i++) {
+    if (RESULT_IS_SUCCESS(ctx->boards[i].error)) {
+      piuio_loop_cancel(&ctx->boards[i]);
+    }
+  }
+
+  close(ctx->epoll_fd);
+  free(ctx);
+}
@@ -0,0 +1,173 @@
+/**
+ * Single-threaded event loop driving multiple PIUIO devices asynchronously.
+ *
+ * Instead of one blocking thread per device, the loop keeps a full polling
+ * cycle of every device in flight at once using the usbfs backend (see
+ * piuio-usbfs.h) or the kernel module (see piuio_kmod_cycle_submit) and waits
+ * for the completions of all devices on a single epoll set. Completed cycles
+ * are dispatched to the per-board state and an optional callback, then the
+ * board's next cycle is submitted right away.
+ * The devices run in parallel on the bus, i.e. throughput scales with the
+ * number of boards while all of them are driven from a single core.
+ *
+ * The libusb backend is not supported as its synchronous transfers block the
+ * calling thread. Cycles of the kernel module can't be cancelled, a timed out
+ * one blocks the loop until the module's transfers time out as well.
+ *
+ * All functions but piuio_loop_lights must be called on the thread running
+ * the loop. The lights of a board can be changed from any thread, changes
+ * are sent with the board's next cycle.
+ */
+#ifndef PIUIO_LOOP_H
+#define PIUIO_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "piuio-lights.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Max. number of boards driven by a single loop
+ */
+#define PIUIO_LOOP_BOARDS_MAX 16
+
+/**
+ * Function called for every completed cycle of any board.
+ *
+ * @param ctx Context of the loop's configuration
+ * @param board Index of the board as returned by piuio_loop_add or
+ *              piuio_loop_add_kmod
+ * @param result Result of the cycle. On error, the board is stopped and this
+ *               is the last call for it
+ * @param state Packed state of the cycle (see piuio-state.h), 0 on error
+ */
+typedef void (*piuio_loop_cycle_func_t)(
+    void *ctx, size_t board, result_t result, uint64_t state);
+
+/**
+ * Configuration of a loop
+ */
+struct piuio_loop_config {
+  /* Called for every completed cycle, NULL to only track the boards' states */
+  piuio_loop_cycle_func_t cycle;
+  /* Context passed to the cycle function */
+  void *ctx;
+  /* Max. time a cycle may be in flight in ms before it is cancelled and the
+     board is stopped with ETIMEDOUT, 0 for PIUIO_USBFS_CYCLE_TIMEOUT_MS */
+  uint32_t cycle_timeout_ms;
+};
+
+/**
+ * Create a loop without any boards.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_loop_free.
+ * @param config Configuration of the loop
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM, any error of epoll_create1
+ */
+result_t piuio_loop_init(void **handle, const struct piuio_loop_config *config);
+
+/**
+ * Add a board to the loop and submit its first cycle.
+ *
+ * @param handle Valid handle of a loop
+ * @param usbfs Handle of an opened PIUIO usbfs device. The loop does not take
+ *              ownership of it, the device must stay open until the loop is
+ *              freed
+ * @param output Initial outputs of the board, change them using
+ *               piuio_loop_lights
+ * @param board Pointer to return the index of the board in
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOSPC if PIUIO_LOOP_BOARDS_MAX boards were
+ *         added already, EBUSY if a cycle of the device is in flight already,
+ *         ENODEV, any error of epoll_ctl or ioctl
+ */
+result_t piuio_loop_add(
+    void *handle,
+    void *usbfs,
+    const union piuio_output_paket *output,
+    size_t *board);
+
+/**
+ * Add a board driven by the kernel module to the loop and submit its first
+ * cycle.
+ *
+ * @param handle Valid handle of a loop
+ * @param kmod Valid handle of an opened PIUIO kernel module device with a
+ *             writable device file, see piuio_kmod_open. The loop does not
+ *             take ownership of it, the device must stay open until the loop
+ *             is freed
+ * @param output Initial outputs of the board, change them using
+ *               piuio_loop_lights
+ * @param board Pointer to return the index of the board in
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOSPC if PIUIO_LOOP_BOARDS_MAX boards were
+ *         added already, EBUSY if a cycle of the device is in flight already,
+ *         EBADF if the device is read only, ENODEV, any error of epoll_ctl
+ */
+result_t piuio_loop_add_kmod(
+    void *handle,
+    void *kmod,
+    const union piuio_output_paket *output,
+    size_t *board);
+
+/**
+ * Wait for completions of any boards and dispatch them. Boards which
+ * completed a cycle get their next one submitted before returning.
+ *
+ * @param handle Valid handle of a loop
+ * @param timeout_ms Max. time to wait for a completion, 0 to not wait at all
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ETIMEDOUT if nothing completed in time,
+ *         ENOENT if no board is running, EINTR, any error of epoll_wait.
+ *         Errors of single boards stop only that board, see
+ *         piuio_loop_error
+ */
+result_t piuio_loop_run(void *handle, uint32_t timeout_ms);
+
+/**
+ * Get the packed state of the most recent cycle of a board.
+ *
+ * @param handle Valid handle of a loop
+ * @param board Index of the board
+ * @param cycle Optional pointer to return the number of the cycle the state
+ *              belongs to. The first cycle has number 1, 0 if no cycle
+ *              completed, yet.
+ * @return Packed state of the board
+ */
+uint64_t piuio_loop_state(void *handle, size_t board, uint64_t *cycle);
+
+/**
+ * Get the lights of a board to change its outputs from any thread (see
+ * piuio-lights.h).
+ *
+ * @param handle Valid handle of a loop
+ * @param board Index of the board
+ * @return Lights of the board, valid until the loop is freed
+ */
+struct piuio_lights *piuio_loop_lights(void *handle, size_t board);
+
+/**
+ * Get the error that stopped a board, if any.
+ *
+ * @param handle Valid handle of a loop
+ * @param board Index of the board
+ * @return RESULT_SUCCESS if the board is running, otherwise the error of its
+ *         last cycle
+ */
+result_t piuio_loop_error(void *handle, size_t board);
+
+/**
+ * Cancel the cycles in flight of all boards and free the loop. The devices
+ * are not closed.
+ *
+ * @param handle Valid handle of a loop
+ */
+void piuio_loop_free(void *handle);
+
+#endif
@@ -0,0 +1,422 @@
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "piuio-kmod.h"
+#include "piuio-poll.h"
+#include "piuio-usbfs.h"
+#include "time_.h"
+
+enum piuio_poll_state {
+  PIUIO_POLL_STATE_IDLE = 0,
+  /* Cycle started and in flight */
+  PIUIO_POLL_STATE_PENDING = 1,
+  /* Cycle completed, not collected, yet */
+  PIUIO_POLL_STATE_DONE = 2,
+};
+
+struct piuio_poll_ctx {
+  /* Device polled natively, either usbfs or kmod, false if polled on the
+     helper thread */
+  bool native;
+  void *usbfs;
+  void *kmod;
+  piuio_poller_poll_func_t poll;
+  void *poll_ctx;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  /* Signals state changes to both, the helper thread and the caller */
+  pthread_cond_t cond;
+  bool stop;
+  enum piuio_poll_state state;
+  union piuio_output_paket output;
+  struct piuio_usb_input_batch_paket input;
+  result_t result;
+};
+
+static void *piuio_poll_thread(void *arg)
+{
+  struct piuio_poll_ctx *ctx;
+  result_t result;
+
+  ctx = (struct piuio_poll_ctx *) arg;
+
+  pthread_mutex_lock(&ctx->mutex);
+
+  while (true) {
+    while (ctx->state != PIUIO_POLL_STATE_PENDING && !ctx->stop) {
+      pthread_cond_wait(&ctx->cond, &ctx->mutex);
+    }
+
+    if (ctx->stop) {
+      break;
+    }
+
+    // The caller doesn't touch the buffers while the cycle is pending
+    pthread_mutex_unlock(&ctx->mutex);
+    result = ctx->poll(ctx->poll_ctx, &ctx->output, &ctx->input);
+    pthread_mutex_lock(&ctx->mutex);
+
+    // EAGAIN of piuio_poll_try_end means the cycle is still in flight
+    ctx->result = result == EAGAIN ? ENODATA : result;
+    ctx->state = PIUIO_POLL_STATE_DONE;
+    pthread_cond_broadcast(&ctx->cond);
+  }
+
+  pthread_mutex_unlock(&ctx->mutex);
+
+  return NULL;
+}
+
+static result_t piuio_poll_alloc(struct piuio_poll_ctx **ctx)
+{
+  *ctx = (struct piuio_poll_ctx *) malloc(sizeof(struct piuio_poll_ctx));
+
+  if (*ctx == NULL) {
+    return ENOMEM;
+  }
+
+  memset(*ctx, 0, sizeof(struct piuio_poll_ctx));
+
+  return RESULT_SUCCESS;
+}
+
+static result_t piuio_poll_native_submit(
+    struct piuio_poll_ctx *ctx, const union piuio_output_paket *output)
+{
+  if (ctx->usbfs != NULL) {
+    return piuio_usbfs_cycle_submit(ctx->usbfs, output, &ctx->input);
+  } else {
+    return piuio_kmod_cycle_submit(ctx->kmod, output);
+  }
+}
+
+static result_t piuio_poll_native_reap(struct piuio_poll_ctx *ctx)
+{
+  if (ctx->usbfs != NULL) {
+    return piuio_usbfs_cycle_reap(ctx->usbfs);
+  } else {
+    return piuio_kmod_cycle_reap(ctx->kmod, &ctx->input);
+  }
+}
+
+static void piuio_poll_native_cancel(struct piuio_poll_ctx *ctx)
+{
+  if (ctx->usbfs != NULL) {
+    piuio_usbfs_cycle_cancel(ctx->usbfs);
+  } else {
+    piuio_kmod_cycle_cancel(ctx->kmod);
+  }
+}
+
+/**
+ * Wait for the cycle in flight of a natively polled device and reap it
+ */
+static result_t piuio_poll_native_wait(struct piuio_poll_ctx *ctx)
+{
+  struct pollfd pfd;
+  uint64_t deadline_ns;
+  uint64_t now_ns;
+  result_t result;
+  int timeout_ms;
+
+  deadline_ns = pumpio_time_now_ns() +
+      (uint64_t) PIUIO_USBFS_CYCLE_TIMEOUT_MS * 1000000;
+
+  while (true) {
+    result = piuio_poll_native_reap(ctx);
+
+    if (result != EAGAIN) {
+      return result;
+    }
+
+    now_ns = pumpio_time_now_ns();
+
+    if (now_ns >= deadline_ns) {
+      piuio_poll_native_cancel(ctx);
+      return ETIMEDOUT;
+    }
+
+    // Round up to not busy loop on the last millisecond
+    timeout_ms = (int) ((deadline_ns - now_ns + 999999) / 1000000);
+
+    // usbfs signals completions as writable, see piuio-loop.c, the kernel
+    // module as readable
+    if (ctx->usbfs != NULL) {
+      pfd.fd = piuio_usbfs_fd(ctx->usbfs);
+      pfd.events = POLLOUT;
+    } else {
+      pfd.fd = piuio_kmod_fd(ctx->kmod);
+      pfd.events = POLLIN;
+    }
+
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR) {
+      result = errno;
+      piuio_poll_native_cancel(ctx);
+      return result;
+    }
+  }
+}
+
+/**
+ * Hand out a completed cycle and return to idle, called with the mutex held
+ * if polled on the helper thread
+ */
+static result_t piuio_poll_collect(
+    struct piuio_poll_ctx *ctx, struct piuio_usb_input_batch_paket *input)
+{
+  ctx->state = PIUIO_POLL_STATE_IDLE;
+
+  if (RESULT_IS_SUCCESS(ctx->result)) {
+    *input = ctx->input;
+  }
+
+  return ctx->result;
+}
+
+result_t
+piuio_poll_open(void **handle, piuio_poller_poll_func_t poll, void *ctx)
+{
+  struct piuio_poll_ctx *poll_ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(poll != NULL);
+
+  result = piuio_poll_alloc(&poll_ctx);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  poll_ctx->poll = poll;
+  poll_ctx->poll_ctx = ctx;
+
+  pthread_mutex_init(&poll_ctx->mutex, NULL);
+  pthread_cond_init(&poll_ctx->cond, NULL);
+
+  result = pthread_create(
+      &poll_ctx->thread, NULL, piuio_poll_thread, (void *) poll_ctx);
+
+  if (result) {
+    pthread_cond_destroy(&poll_ctx->cond);
+    pthread_mutex_destroy(&poll_ctx->mutex);
+    free(poll_ctx);
+    return result;
+  }
+
+  *handle = (void *) poll_ctx;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_poll_open_usb(void **handle, void *usb)
+{
+  assert(usb != NULL);
+
+  return piuio_poll_open(handle, piuio_usb_poll_full_cycle, usb);
+}
+
+result_t piuio_poll_open_kmod(void **handle, void *kmod)
+{
+  struct piuio_poll_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(kmod != NULL);
+
+  result = piuio_poll_alloc(&ctx);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  ctx->native = true;
+  ctx->kmod = kmod;
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_poll_open_usbfs(void **handle, void *usbfs)
+{
+  struct piuio_poll_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(usbfs != NULL);
+
+  result = piuio_poll_alloc(&ctx);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  ctx->native = true;
+  ctx->usbfs = usbfs;
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_poll_begin(void *handle, const union piuio_output_paket *output)
+{
+  struct piuio_poll_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(output != NULL);
+
+  ctx = (struct piuio_poll_ctx *) handle;
+
+  if (ctx->native) {
+    if (ctx->state != PIUIO_POLL_STATE_IDLE) {
+      return EBUSY;
+    }
+
+    result = piuio_poll_native_submit(ctx, output);
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    ctx->state = PIUIO_POLL_STATE_PENDING;
+
+    return RESULT_SUCCESS;
+  }
+
+  pthread_mutex_lock(&ctx->mutex);
+
+  if (ctx->state != PIUIO_POLL_STATE_IDLE) {
+    pthread_mutex_unlock(&ctx->mutex);
+    return EBUSY;
+  }
+
+  ctx->output = *output;
+  ctx->state = PIUIO_POLL_STATE_PENDING;
+  pthread_cond_broadcast(&ctx->cond);
+
+  pthread_mutex_unlock(&ctx->mutex);
+
+  return RESULT_SUCCESS;
+}
+
+result_t
+piuio_poll_end(void *handle, struct piuio_usb_input_batch_paket *input)
+{
+  struct piuio_poll_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(input != NULL);
+
+  ctx = (struct piuio_poll_ctx *) handle;
+
+  if (ctx->native) {
+    if (ctx->state == PIUIO_POLL_STATE_IDLE) {
+      return ENOENT;
+    }
+
+    ctx->result = piuio_poll_native_wait(ctx);
+
+    return piuio_poll_collect(ctx, input);
+  }
+
+  pthread_mutex_lock(&ctx->mutex);
+
+  if (ctx->state == PIUIO_POLL_STATE_IDLE) {
+    pthread_mutex_unlock(&ctx->mutex);
+    return ENOENT;
+  }
+
+  while (ctx->state == PIUIO_POLL_STATE_PENDING) {
+    pthread_cond_wait(&ctx->cond, &ctx->mutex);
+  }
+
+  result = piuio_poll_collect(ctx, input);
+
+  pthread_mutex_unlock(&ctx->mutex);
+
+  return result;
+}
+
+result_t
+piuio_poll_try_end(void *handle, struct piuio_usb_input_batch_paket *input)
+{
+  struct piuio_poll_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(input != NULL);
+
+  ctx = (struct piuio_poll_ctx *) handle;
+
+  if (ctx->native) {
+    if (ctx->state == PIUIO_POLL_STATE_IDLE) {
+      return ENOENT;
+    }
+
+    result = piuio_poll_native_reap(ctx);
+
+    if (result == EAGAIN) {
+      return EAGAIN;
+    }
+
+    ctx->result = result;
+
+    return piuio_poll_collect(ctx, input);
+  }
+
+  pthread_mutex_lock(&ctx->mutex);
+
+  if (ctx->state == PIUIO_POLL_STATE_IDLE) {
+    result = ENOENT;
+  } else if (ctx->state == PIUIO_POLL_STATE_PENDING) {
+    result = EAGAIN;
+  } else {
+    result = piuio_poll_collect(ctx, input);
+  }
+
+  pthread_mutex_unlock(&ctx->mutex);
+
+  return result;
+}
+
+void piuio_poll_close(void *handle)
+{
+  struct piuio_poll_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_poll_ctx *) handle;
+
+  if (ctx->native) {
+    if (ctx->state == PIUIO_POLL_STATE_PENDING) {
+      piuio_poll_native_cancel(ctx);
+    }
+
+    free(ctx);
+    return;
+  }
+
+  // A cycle in flight can't be interrupted, the thread exits after it
+  pthread_mutex_lock(&ctx->mutex);
+  ctx->stop = true;
+  pthread_cond_broadcast(&ctx->cond);
+  pthread_mutex_unlock(&ctx->mutex);
+
+  pthread_join(ctx->thread, NULL);
+
+  pthread_cond_destroy(&ctx->cond);
+  pthread_mutex_destroy(&ctx->mutex);
+  free(ctx);
+}
@@ -0,0 +1,142 @@
+/**
+ * Non-blocking polling of a PIUIO device split into starting a full polling
+ * cycle and collecting it later.
+ *
+ * The blocking polling calls, e.g. piuio_usb_poll_full_cycle or
+ * piuio_kmod_poll, stall the caller for the whole cycle. With this API, a
+ * single-threaded game loop starts the cycle at the beginning of a frame, does
+ * its frame work, e.g. rendering, while the transfers are in flight and
+ * collects the inputs at the end of the frame:
+ *
+ *   piuio_poll_begin(poll, &output);
+ *   render_frame();
+ *   piuio_poll_end(poll, &input);
+ *
+ * Devices opened via usbfs (see piuio-usbfs.h) or the kernel module (see
+ * piuio-kmod.h) are polled natively asynchronous, i.e. the cycle is submitted
+ * to the kernel at once and reaped without any additional thread. The libusb
+ * backend only provides blocking calls, its cycles are run on a helper thread
+ * of the handle instead. The hand over to and from the helper thread adds a
+ * few us to the latency of a cycle.
+ *
+ * Only a single cycle can be in flight per handle. A handle must not be used
+ * from multiple threads at the same time.
+ */
+#ifndef PIUIO_POLL_H
+#define PIUIO_POLL_H
+
+#include "piuio-poller.h"
+#include "piuio-usb.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Open a handle to poll a device backend through a blocking polling function
+ * run on a helper thread.
+ *
+ * The device backend must be opened already and stay open until the handle is
+ * closed. The handle does not take ownership of it.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_poll_close.
+ * @param poll Polling function of the backend, e.g. piuio_usb_poll_full_cycle
+ *             or piuio_poller_poll_kmod
+ * @param ctx Context passed to the polling function, e.g. the usb device
+ *            handle
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM, EAGAIN
+ */
+result_t
+piuio_poll_open(void **handle, piuio_poller_poll_func_t poll, void *ctx);
+
+/**
+ * Open a handle to poll a device opened with piuio_usb_open.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful, see piuio_poll_open
+ * @param usb Valid handle of an opened PIUIO usb device
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM, EAGAIN
+ */
+result_t piuio_poll_open_usb(void **handle, void *usb);
+
+/**
+ * Open a handle to poll a device opened with piuio_kmod_open without a helper
+ * thread, see piuio_kmod_cycle_submit.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful, see piuio_poll_open
+ * @param kmod Valid handle of an opened PIUIO kernel module device which is
+ *             writable and not driven by anything else
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM
+ */
+result_t piuio_poll_open_kmod(void **handle, void *kmod);
+
+/**
+ * Open a handle to poll a device opened with piuio_usbfs_open without a
+ * helper thread.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful, see piuio_poll_open
+ * @param usbfs Valid handle of an opened PIUIO usbfs device which is not
+ *              driven by anything else, e.g. piuio-loop.h
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM
+ */
+result_t piuio_poll_open_usbfs(void **handle, void *usbfs);
+
+/**
+ * Start a full polling cycle and return right away.
+ *
+ * @param handle Valid handle of an opened poll handle
+ * @param output Output data to send with all sub-polls, copied by the call
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EBUSY if a cycle was started and not
+ *         collected, yet, any error of submitting the cycle (usbfs and
+ *         kernel module only)
+ */
+result_t piuio_poll_begin(void *handle, const union piuio_output_paket *output);
+
+/**
+ * Wait for the cycle started with piuio_poll_begin to complete and collect
+ * it.
+ *
+ * @param handle Valid handle of an opened poll handle
+ * @param input Pointer to an allocated buffer for the batched input data with
+ *              inverted pull ups to receive, left untouched on error
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOENT if no cycle was started, ETIMEDOUT
+ *         (usbfs and kernel module only, see PIUIO_USBFS_CYCLE_TIMEOUT_MS),
+ *         ENODATA if the backend received no inputs, e.g. while
+ *         reconnecting, any error of the backend's cycle
+ */
+result_t
+piuio_poll_end(void *handle, struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Collect the cycle started with piuio_poll_begin if it completed already,
+ * without blocking.
+ *
+ * @param handle Valid handle of an opened poll handle
+ * @param input Pointer to an allocated buffer for the batched input data with
+ *              inverted pull ups to receive, left untouched on error
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EAGAIN if the cycle is still in flight,
+ *         ENOENT if no cycle was started, ENODATA if the backend received no
+ *         inputs, e.g. while reconnecting, any error of the backend's cycle
+ */
+result_t
+piuio_poll_try_end(void *handle, struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Close a poll handle. A cycle still in flight is cancelled (usbfs) or waited
+ * for (kernel module, helper thread). The device backend is not closed.
+ *
+ * @param handle Valid handle of an opened poll handle
+ */
+void piuio_poll_close(void *handle);
+
+#endif
@@ -0,0 +1,661 @@
+#define _GNU_SOURCE
+
+#include <alloca.h>
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "piuio-debounce.h"
+#include "piuio-history.h"
+#include "piuio-kmod.h"
+#include "piuio-poller.h"
+#include "piuio-state.h"
+#include "time_.h"
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/* Stack kept on top of the pre-faulted stack for the polling loop itself */
+#define PIUIO_POLLER_STACK_RESERVE (256 * 1024)
+
+/* Pause after a cycle without inputs if polling without an interval */
+#define PIUIO_POLLER_RETRY_US 1000
+
+/**
+ * Parameters of the sched_setattr syscall which is not wrapped by all libc
+ * versions
+ */
+struct piuio_poller_sched_attr {
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+};
+
+/**
+ * Timing published by the polling thread, see struct piuio_poller_timing
+ */
+struct piuio_poller_timing_shared {
+  _Atomic uint64_t periods;
+  _Atomic uint64_t period_min_ns;
+  _Atomic uint64_t period_max_ns;
+  _Atomic uint64_t period_avg_ns;
+  _Atomic uint64_t period_stddev_ns;
+  _Atomic uint64_t wakeup_min_ns;
+  _Atomic uint64_t wakeup_max_ns;
+  _Atomic uint64_t wakeup_avg_ns;
+  _Atomic uint64_t missed;
+};
+
+/**
+ * Running timing statistics owned by the polling thread
+ */
+struct piuio_poller_timing_acc {
+  uint64_t prev_start_ns;
+  uint64_t periods;
+  uint64_t period_min_ns;
+  uint64_t period_max_ns;
+  double period_mean_ns;
+  double period_m2;
+  uint64_t wakeups;
+  uint64_t wakeup_min_ns;
+  uint64_t wakeup_max_ns;
+  uint64_t wakeup_sum_ns;
+};
+
+struct piuio_poller_ctx {
+  struct piuio_poller_config config;
+  pthread_t thread;
+  sem_t started;
+  result_t setup_result;
+  atomic_bool stop;
+  _Atomic result_t error;
+  _Atomic uint64_t state;
+  _Atomic uint8_t stale_mask;
+  _Atomic uint64_t cycle;
+  bool debounce_enabled;
+  struct piuio_debounce debounce;
+  struct piuio_latch latch;
+  struct piuio_lights lights;
+  struct piuio_sequencer sequencer;
+  struct piuio_history history;
+  struct piuio_poller_timing_shared timing;
+};
+
+static void piuio_poller_wait_until(uint64_t deadline_ns)
+{
+  struct timespec deadline;
+
+  deadline.tv_sec = (time_t) (deadline_ns / 1000000000);
+  deadline.tv_nsec = (long) (deadline_ns % 1000000000);
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) ==
+         EINTR) {
+    // Retry until deadline reached
+  }
+}
+
+/**
+ * Get the start of the next cycle at a fixed interval. If cycles were missed,
+ * e.g. due to a slow cycle or preemption, skip to the next start in the future
+ * instead of running the missed cycles back to back to catch up.
+ */
+static uint64_t piuio_poller_next_start(
+    struct piuio_poller_ctx *poller, uint64_t scheduled_ns, uint64_t now_ns)
+{
+  uint64_t interval_ns;
+  uint64_t missed;
+
+  interval_ns = (uint64_t) poller->config.interval_us * 1000;
+  scheduled_ns += interval_ns;
+
+  if (scheduled_ns > now_ns) {
+    return scheduled_ns;
+  }
+
+  missed = (now_ns - scheduled_ns) / interval_ns + 1;
+  atomic_store_explicit(
+      &poller->timing.missed,
+      atomic_load_explicit(&poller->timing.missed, memory_order_relaxed) +
+          missed,
+      memory_order_relaxed);
+
+  return scheduled_ns + missed * interval_ns;
+}
+
+static __attribute__((noinline)) void
+piuio_poller_prefault_stack(uint32_t size_kb)
+{
+  volatile uint8_t *stack;
+  size_t size;
+  long page_size;
+
+  size = (size_t) size_kb * 1024;
+  page_size = sysconf(_SC_PAGESIZE);
+  stack = (volatile uint8_t *) alloca(size);
+
+  for (size_t i = 0; i < size; i += page_size) {
+    stack[i] = 0;
+  }
+}
+
+static result_t piuio_poller_setup_thread(struct piuio_poller_ctx *poller)
+{
+  const struct piuio_poller_config *config;
+  struct sched_param param;
+  struct piuio_poller_sched_attr attr;
+  cpu_set_t cpus;
+  int result;
+
+  config = &poller->config;
+
+  if (config->pin_cpu) {
+    CPU_ZERO(&cpus);
+    CPU_SET(config->cpu, &cpus);
+
+    result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    if (result != 0) {
+      return result;
+    }
+  }
+
+  if (config->sched_policy == PIUIO_POLLER_SCHED_FIFO) {
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config->sched_priority;
+
+    result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    if (result != 0) {
+      return result;
+    }
+  } else if (config->sched_policy == PIUIO_POLLER_SCHED_DEADLINE) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = (uint64_t) config->sched_runtime_us * 1000;
+    attr.sched_deadline = (uint64_t) config->interval_us * 1000;
+    attr.sched_period = (uint64_t) config->interval_us * 1000;
+
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0) {
+      return errno;
+    }
+  }
+
+  if (config->prefault_stack_kb > 0) {
+    piuio_poller_prefault_stack(config->prefault_stack_kb);
+  }
+
+  return RESULT_SUCCESS;
+}
+
+static void piuio_poller_timing_update(
+    struct piuio_poller_ctx *poller,
+    struct piuio_poller_timing_acc *acc,
+    uint64_t start_ns,
+    uint64_t scheduled_ns)
+{
+  struct piuio_poller_timing_shared *timing;
+  uint64_t period_ns;
+  uint64_t wakeup_ns;
+  double delta;
+
+  timing = &poller->timing;
+
+  if (acc->prev_start_ns == 0) {
+    acc->prev_start_ns = start_ns;
+    return;
+  }
+
+  period_ns = start_ns - acc->prev_start_ns;
+  acc->prev_start_ns = start_ns;
+
+  // Welford's online algorithm for a numerically stable variance
+  acc->periods++;
+  delta = (double) period_ns - acc->period_mean_ns;
+  acc->period_mean_ns += delta / acc->periods;
+  acc->period_m2 += delta * ((double) period_ns - acc->period_mean_ns);
+
+  if (acc->periods == 1 || period_ns < acc->period_min_ns) {
+    acc->period_min_ns = period_ns;
+    atomic_store_explicit(
+        &timing->period_min_ns, period_ns, memory_order_relaxed);
+  }
+
+  if (period_ns > acc->period_max_ns) {
+    acc->period_max_ns = period_ns;
+    atomic_store_explicit(
+        &timing->period_max_ns, period_ns, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(
+      &timing->period_avg_ns,
+      (uint64_t) acc->period_mean_ns,
+      memory_order_relaxed);
+  atomic_store_explicit(
+      &timing->period_stddev_ns,
+      (uint64_t) sqrt(acc->period_m2 / acc->periods),
+      memory_order_relaxed);
+  atomic_store_explicit(&timing->periods, acc->periods, memory_order_relaxed);
+
+  if (scheduled_ns == 0) {
+    return;
+  }
+
+  wakeup_ns = start_ns > scheduled_ns ? start_ns - scheduled_ns : 0;
+
+  acc->wakeups++;
+  acc->wakeup_sum_ns += wakeup_ns;
+
+  if (acc->wakeups == 1 || wakeup_ns < acc->wakeup_min_ns) {
+    acc->wakeup_min_ns = wakeup_ns;
+    atomic_store_explicit(
+        &timing->wakeup_min_ns, wakeup_ns, memory_order_relaxed);
+  }
+
+  if (wakeup_ns > acc->wakeup_max_ns) {
+    acc->wakeup_max_ns = wakeup_ns;
+    atomic_store_explicit(
+        &timing->wakeup_max_ns, wakeup_ns, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(
+      &timing->wakeup_avg_ns,
+      acc->wakeup_sum_ns / acc->wakeups,
+      memory_order_relaxed);
+}
+
+static void piuio_poller_publish(
+    struct piuio_poller_ctx *poller,
+    const struct piuio_usb_input_batch_paket *input)
+{
+  uint64_t time_ns;
+  uint64_t state;
+  uint8_t stale_mask;
+
+  // Inputs are considered sampled when the cycle completes
+  time_ns = pumpio_time_now_ns();
+  state = piuio_state_decode(input);
+  stale_mask =
+      poller->config.stale_mask != NULL ? *poller->config.stale_mask : 0;
+
+  if (poller->debounce_enabled) {
+    state = piuio_debounce_update(&poller->debounce, state);
+  }
+
+  piuio_latch_publish(&poller->latch, state);
+  piuio_history_push(&poller->history, time_ns, state, stale_mask);
+
+  atomic_store_explicit(&poller->state, state, memory_order_relaxed);
+  atomic_store_explicit(&poller->stale_mask, stale_mask, memory_order_relaxed);
+  atomic_fetch_add_explicit(&poller->cycle, 1, memory_order_release);
+}
+
+static void *piuio_poller_thread(void *arg)
+{
+  struct piuio_poller_ctx *poller;
+  union piuio_output_paket output;
+  struct piuio_usb_input_batch_paket input;
+  struct piuio_poller_timing_acc timing;
+  result_t result;
+  uint64_t time_ns;
+  uint64_t next_ns;
+  uint64_t scheduled_ns;
+
+  poller = (struct piuio_poller_ctx *) arg;
+
+  poller->setup_result = piuio_poller_setup_thread(poller);
+  sem_post(&poller->started);
+
+  if (RESULT_IS_ERROR(poller->setup_result)) {
+    return NULL;
+  }
+
+  memset(&input, 0, sizeof(input));
+  memset(&timing, 0, sizeof(timing));
+  next_ns = pumpio_time_now_ns();
+  scheduled_ns = 0;
+
+  while (!atomic_load_explicit(&poller->stop, memory_order_relaxed)) {
+    time_ns = pumpio_time_now_ns();
+    piuio_poller_timing_update(poller, &timing, time_ns, scheduled_ns);
+
+    output = poller->config.output;
+    piuio_lights_apply(&poller->lights, &output);
+    piuio_sequencer_apply(&poller->sequencer, time_ns, &output);
+
+    result = poller->config.poll(poller->config.ctx, &output, &input);
+
+    if (result == EAGAIN) {
+      // No inputs this cycle, e.g. the backend is reconnecting. Keep the
+      // last state and the schedule
+      if (poller->config.interval_us == 0) {
+        usleep(PIUIO_POLLER_RETRY_US);
+      }
+    } else if (RESULT_IS_ERROR(result)) {
+      atomic_store_explicit(&poller->error, result, memory_order_release);
+      break;
+    } else {
+      piuio_poller_publish(poller, &input);
+    }
+
+    if (poller->config.interval_us > 0) {
+      next_ns = piuio_poller_next_start(poller, next_ns, pumpio_time_now_ns());
+      scheduled_ns = next_ns;
+
+      piuio_poller_wait_until(next_ns);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Undo locking the memory of the process if starting the poller failed
+ */
+static void piuio_poller_unlock_memory(const struct piuio_poller_config *config)
+{
+  if (config->lock_memory) {
+    munlockall();
+  }
+}
+
+result_t piuio_poller_poll_kmod(
+    void *ctx,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  union piuio_kmod_paket paket;
+  result_t result;
+
+  assert(output != NULL);
+  assert(input != NULL);
+
+  memset(&paket, 0, sizeof(paket));
+  paket.output = *output;
+
+  result = piuio_kmod_poll(ctx, &paket);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  *input = paket.input;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_poller_poll_usb_deadline(
+    void *ctx,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  struct piuio_poller_usb_deadline_ctx *usb;
+  result_t result;
+
+  assert(ctx != NULL);
+
+  usb = (struct piuio_poller_usb_deadline_ctx *) ctx;
+
+  // Stale slots keep the data of the previous cycle as the poller reuses the
+  // input buffer
+  result = piuio_usb_poll_full_cycle_deadline(
+      usb->handle, &usb->config, output, input, &usb->stale_mask);
+
+  // Keep polling, the next cycle might get through
+  if (RESULT_IS_ERROR(result) && usb->stale_mask == PIUIO_USB_STALE_MASK_ALL) {
+    return EAGAIN;
+  }
+
+  return result;
+}
+
+result_t
+piuio_poller_start(void **handle, const struct piuio_poller_config *config)
+{
+  struct piuio_poller_ctx *poller;
+  pthread_attr_t attr;
+  size_t stack_size;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(config != NULL);
+
+  if (config->poll == NULL) {
+    return EINVAL;
+  }
+
+  if (config->sched_policy == PIUIO_POLLER_SCHED_DEADLINE &&
+      (config->interval_us == 0 || config->sched_runtime_us == 0 ||
+       config->sched_runtime_us > config->interval_us)) {
+    return EINVAL;
+  }
+
+  if (config->pin_cpu && config->cpu >= CPU_SETSIZE) {
+    return EINVAL;
+  }
+
+  // The kernel rejects SCHED_DEADLINE for threads with a restricted affinity
+  // with EPERM, regardless of privileges
+  if (config->pin_cpu && config->sched_policy == PIUIO_POLLER_SCHED_DEADLINE) {
+    return EINVAL;
+  }
+
+  if (config->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    return errno;
+  }
+
+  // malloc only guarantees the alignment of fundamental types, the latch
+  // slots are aligned to cache lines
+  if (posix_memalign(
+          (void **) &poller,
+          _Alignof(struct piuio_poller_ctx),
+          sizeof(struct piuio_poller_ctx)) != 0) {
+    piuio_poller_unlock_memory(config);
+    return ENOMEM;
+  }
+
+  poller->config = *config;
+  atomic_init(&poller->stop, false);
+  atomic_init(&poller->error, RESULT_SUCCESS);
+  atomic_init(&poller->state, 0);
+  atomic_init(&poller->stale_mask, 0);
+  atomic_init(&poller->cycle, 0);
+
+  poller->debounce_enabled =
+      config->debounce_press_cycles > 0 || config->debounce_release_cycles > 0;
+
+  if (poller->debounce_enabled) {
+    result = piuio_debounce_init(
+        &poller->debounce,
+        config->debounce_press_cycles,
+        config->debounce_release_cycles);
+
+    if (RESULT_IS_ERROR(result)) {
+      free(poller);
+      piuio_poller_unlock_memory(config);
+      return result;
+    }
+  }
+
+  piuio_latch_init(&poller->latch);
+  piuio_lights_init(
+      &poller->lights, piuio_lights_from_paket(&config->output));
+  piuio_sequencer_init(&poller->sequencer);
+  piuio_history_init(&poller->history);
+  atomic_init(&poller->timing.periods, 0);
+  atomic_init(&poller->timing.period_min_ns, 0);
+  atomic_init(&poller->timing.period_max_ns, 0);
+  atomic_init(&poller->timing.period_avg_ns, 0);
+  atomic_init(&poller->timing.period_stddev_ns, 0);
+  atomic_init(&poller->timing.wakeup_min_ns, 0);
+  atomic_init(&poller->timing.wakeup_max_ns, 0);
+  atomic_init(&poller->timing.wakeup_avg_ns, 0);
+  atomic_init(&poller->timing.missed, 0);
+
+  pthread_attr_init(&attr);
+
+  if (config->prefault_stack_kb > 0) {
+    pthread_attr_getstacksize(&attr, &stack_size);
+
+    if ((size_t) config->prefault_stack_kb * 1024 +
+            PIUIO_POLLER_STACK_RESERVE >
+        stack_size) {
+      pthread_attr_setstacksize(
+          &attr,
+          (size_t) config->prefault_stack_kb * 1024 +
+              PIUIO_POLLER_STACK_RESERVE);
+    }
+  }
+
+  sem_init(&poller->started, 0, 0);
+
+  result = pthread_create(&poller->thread, &attr, piuio_poller_thread, poller);
+
+  pthread_attr_destroy(&attr);
+
+  if (result != 0) {
+    sem_destroy(&poller->started);
+    piuio_sequencer_destroy(&poller->sequencer);
+    free(poller);
+    piuio_poller_unlock_memory(config);
+    return result;
+  }
+
+  // Scheduling options are applied by the thread itself before polling
+  while (sem_wait(&poller->started) != 0) {
+    // Retry if interrupted by a signal
+  }
+
+  sem_destroy(&poller->started);
+
+  if (RESULT_IS_ERROR(poller->setup_result)) {
+    result = poller->setup_result;
+    pthread_join(poller->thread, NULL);
+    piuio_sequencer_destroy(&poller->sequencer);
+    free(poller);
+    piuio_poller_unlock_memory(config);
+    return result;
+  }
+
+  *handle = (void *) poller;
+
+  return RESULT_SUCCESS;
+}
+
+uint64_t piuio_poller_state(void *handle, uint64_t *cycle)
+{
+  struct piuio_poller_ctx *poller;
+
+  assert(handle != NULL);
+
+  poller = (struct piuio_poller_ctx *) handle;
+
+  if (cycle != NULL) {
+    *cycle = atomic_load_explicit(&poller->cycle, memory_order_acquire);
+  }
+
+  return atomic_load_explicit(&poller->state, memory_order_relaxed);
+}
+
+uint8_t piuio_poller_stale_mask(void *handle)
+{
+  assert(handle != NULL);
+
+  return atomic_load_explicit(
+      &((struct piuio_poller_ctx *) handle)->stale_mask, memory_order_relaxed);
+}
+
+struct piuio_latch *piuio_poller_latch(void *handle)
+{
+  assert(handle != NULL);
+
+  return &((struct piuio_poller_ctx *) handle)->latch;
+}
+
+struct piuio_lights *piuio_poller_lights(void *handle)
+{
+  assert(handle != NULL);
+
+  return &((struct piuio_poller_ctx *) handle)->lights;
+}
+
+struct piuio_sequencer *piuio_poller_sequencer(void *handle)
+{
+  assert(handle != NULL);
+
+  return &((struct piuio_poller_ctx *) handle)->sequencer;
+}
+
+struct piuio_history *piuio_poller_history(void *handle)
+{
+  assert(handle != NULL);
+
+  return &((struct piuio_poller_ctx *) handle)->history;
+}
+
+void piuio_poller_timing(void *handle, struct piuio_poller_timing *timing)
+{
+  struct piuio_poller_timing_shared *shared;
+
+  assert(handle != NULL);
+  assert(timing != NULL);
+
+  shared = &((struct piuio_poller_ctx *) handle)->timing;
+
+  timing->periods =
+      atomic_load_explicit(&shared->periods, memory_order_relaxed);
+  timing->period_min_ns =
+      atomic_load_explicit(&shared->period_min_ns, memory_order_relaxed);
+  timing->period_max_ns =
+      atomic_load_explicit(&shared->period_max_ns, memory_order_relaxed);
+  timing->period_avg_ns =
+      atomic_load_explicit(&shared->period_avg_ns, memory_order_relaxed);
+  timing->period_stddev_ns =
+      atomic_load_explicit(&shared->period_stddev_ns, memory_order_relaxed);
+  timing->wakeup_min_ns =
+      atomic_load_explicit(&shared->wakeup_min_ns, memory_order_relaxed);
+  timing->wakeup_max_ns =
+      atomic_load_explicit(&shared->wakeup_max_ns, memory_order_relaxed);
+  timing->wakeup_avg_ns =
+      atomic_load_explicit(&shared->wakeup_avg_ns, memory_order_relaxed);
+  timing->missed = atomic_load_explicit(&shared->missed, memory_order_relaxed);
+}
+
+result_t piuio_poller_error(void *handle)
+{
+  assert(handle != NULL);
+
+  return atomic_load_explicit(
+      &((struct piuio_poller_ctx *) handle)->error, memory_order_acquire);
+}
+
+void piuio_poller_stop(void *handle)
+{
+  struct piuio_poller_ctx *poller;
+
+  assert(handle != NULL);
+
+  poller = (struct piuio_poller_ctx *) handle;
+
+  atomic_store_explicit(&poller->stop, true, memory_order_relaxed);
+  pthread_join(poller->thread, NULL);
+
+  piuio_sequencer_destroy(&poller->sequencer);
+  free(poller);
+}
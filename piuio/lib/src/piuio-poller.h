@@ -0,0 +1,274 @@
+/**
+ * Poller driving a PIUIO device continuously on a dedicated thread.
+ *
+ * The poller runs full polling cycles back to back (or at a fixed interval)
+ * using any of the device backends, e.g. piuio-usb or piuio-kmod. Every cycle
+ * is folded into the packed state (see piuio-state.h), optionally debounced
+ * and published to the latest state snapshot, the poller's latch (see
+ * piuio-latch.h) and its history (see piuio-history.h).
+ *
+ * Outputs are sent with every cycle. Other threads change them at any time
+ * through the poller's lights (see piuio-lights.h) without additional USB
+ * transfers, or play precompiled light shows on the poller's sequencer (see
+ * piuio-sequencer.h) applied at the start of the cycles.
+ *
+ * To reduce jitter caused by preemption, e.g. from render or audio threads,
+ * the polling thread can run with real-time scheduling, pinned to a CPU and
+ * with its memory locked and pre-faulted. The achieved timing is measured
+ * continuously, see piuio_poller_timing.
+ */
+#ifndef PIUIO_POLLER_H
+#define PIUIO_POLLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "piuio-history.h"
+#include "piuio-latch.h"
+#include "piuio-lights.h"
+#include "piuio-sequencer.h"
+#include "piuio-usb.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Function executing a full polling cycle on a device backend.
+ *
+ * @param ctx Backend specific context, e.g. device handle
+ * @param output Output data to send for all sub-polls. The sensor mask may be
+ *               modified by the backend
+ * @param input Batch of input pakets with inverted pull ups to receive
+ * @return Success or an error code as defined by result_t. EAGAIN if no
+ *         inputs were received this cycle but the backend is still usable,
+ *         e.g. while reconnecting. Any other error stops the poller
+ */
+typedef result_t (*piuio_poller_poll_func_t)(
+    void *ctx,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Scheduling policy of the polling thread
+ */
+enum piuio_poller_sched_policy {
+  /* Keep the policy inherited from the creating thread */
+  PIUIO_POLLER_SCHED_DEFAULT = 0,
+  /* SCHED_FIFO with sched_priority */
+  PIUIO_POLLER_SCHED_FIFO = 1,
+  /* SCHED_DEADLINE with a period of interval_us and a runtime of
+     sched_runtime_us, requires interval_us > 0 and no pin_cpu */
+  PIUIO_POLLER_SCHED_DEADLINE = 2,
+};
+
+/**
+ * Configuration of a poller
+ */
+struct piuio_poller_config {
+  /* Backend polling function, e.g. piuio_usb_poll_full_cycle or
+     piuio_poller_poll_kmod */
+  piuio_poller_poll_func_t poll;
+  /* Context passed to the polling function, e.g. the usb device handle */
+  void *ctx;
+  /* Optional stale mask of the last cycle written by the polling function,
+     e.g. &stale_mask of struct piuio_poller_usb_deadline_ctx. Published with
+     the state and to the history. NULL if the backend has no stale inputs */
+  const uint8_t *stale_mask;
+  /* Initial output data sent with every polling cycle, change it while
+     running using piuio_poller_lights */
+  union piuio_output_paket output;
+  /* Min. time between the start of two polling cycles in us, 0 to poll back
+     to back. Cycles are started at multiples of the interval, missed ones
+     are skipped (see missed of struct piuio_poller_timing) */
+  uint32_t interval_us;
+  /* Debounce thresholds in cycles, see piuio-debounce.h. 0 for both to
+     disable debouncing */
+  uint8_t debounce_press_cycles;
+  uint8_t debounce_release_cycles;
+  /* Scheduling policy of the polling thread. Real-time policies typically
+     require root or CAP_SYS_NICE */
+  enum piuio_poller_sched_policy sched_policy;
+  /* Priority for PIUIO_POLLER_SCHED_FIFO, 1 (lowest) to 99 (highest) */
+  uint8_t sched_priority;
+  /* Worst case execution time of a cycle in us reserved for
+     PIUIO_POLLER_SCHED_DEADLINE, must not exceed interval_us */
+  uint32_t sched_runtime_us;
+  /* Pin the polling thread to the CPU with index cpu. Not supported with
+     PIUIO_POLLER_SCHED_DEADLINE as the kernel rejects it for threads with a
+     restricted affinity */
+  bool pin_cpu;
+  uint16_t cpu;
+  /* Lock all current and future memory of the process into RAM using
+     mlockall, avoids page faults on the polling thread. Unlocked again if
+     starting the poller fails */
+  bool lock_memory;
+  /* Amount of stack of the polling thread in KiB to touch on start, avoids
+     page faults when the stack grows. 0 to disable */
+  uint32_t prefault_stack_kb;
+};
+
+/**
+ * Timing of the polling cycles measured by the poller.
+ *
+ * The values are updated by the polling thread on every cycle and are not
+ * read atomically as a whole, i.e. a snapshot might mix two cycles.
+ */
+struct piuio_poller_timing {
+  /* Number of cycle periods measured */
+  uint64_t periods;
+  /* Time between the start of two consecutive cycles */
+  uint64_t period_min_ns;
+  uint64_t period_max_ns;
+  uint64_t period_avg_ns;
+  /* Standard deviation of the period, i.e. the jitter of the cycles */
+  uint64_t period_stddev_ns;
+  /* Delay between the scheduled and the actual start of a cycle, only
+     measured if polling at a fixed interval */
+  uint64_t wakeup_min_ns;
+  uint64_t wakeup_max_ns;
+  uint64_t wakeup_avg_ns;
+  /* Number of cycles skipped as they were due before the previous cycle
+     completed, only counted if polling at a fixed interval */
+  uint64_t missed;
+};
+
+/**
+ * Polling function for the piuio-kmod backend.
+ *
+ * @param ctx Valid handle of an opened PIUIO device, see piuio_kmod_open
+ */
+result_t piuio_poller_poll_kmod(
+    void *ctx,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Context of piuio_poller_poll_usb_deadline
+ */
+struct piuio_poller_usb_deadline_ctx {
+  /* Handle of the opened piuio-usb device */
+  void *handle;
+  /* Time bounds of every cycle */
+  struct piuio_usb_cycle_config config;
+  /* Stale mask of the last cycle, written by the polling function */
+  uint8_t stale_mask;
+};
+
+/**
+ * Polling function for the piuio-usb backend with deadline bounded cycles, see
+ * piuio_usb_poll_full_cycle_deadline. Sub-polls not completed in time keep the
+ * inputs of the previous cycle. Set stale_mask of the poller's config to the
+ * stale_mask of the context to publish them. Returns EAGAIN for cycles in
+ * which no sub-poll completed to keep polling.
+ *
+ * @param ctx Pointer to a struct piuio_poller_usb_deadline_ctx which must stay
+ *            valid until the poller is stopped
+ */
+result_t piuio_poller_poll_usb_deadline(
+    void *ctx,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Create a poller and start its polling thread.
+ *
+ * The device backend must be opened already and stay open until the poller is
+ * stopped. The poller does not take ownership of it.
+ *
+ * Scheduling, CPU pinning and memory options are applied before the first
+ * cycle. If any of them fails, the poller is not started.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for stopping the poller using piuio_poller_stop.
+ * @param config Configuration of the poller
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL, ENOMEM, EAGAIN, EPERM if real-time
+ *         scheduling or locking memory is not permitted
+ */
+result_t
+piuio_poller_start(void **handle, const struct piuio_poller_config *config);
+
+/**
+ * Get the packed state of the most recent polling cycle.
+ *
+ * @param handle Valid handle of a started poller
+ * @param cycle Optional pointer to return the number of the cycle the state
+ *              belongs to. The first cycle has number 1, 0 if no cycle
+ *              completed, yet.
+ * @return Packed (and debounced, if enabled) state
+ */
+uint64_t piuio_poller_state(void *handle, uint64_t *cycle);
+
+/**
+ * Get the stale mask of the most recent polling cycle, see stale_mask of
+ * struct piuio_poller_config.
+ *
+ * @param handle Valid handle of a started poller
+ * @return Sensor mask slots (bit n = sensor mask n) of the state which kept
+ *         the inputs of a previous cycle, 0 if all are fresh
+ */
+uint8_t piuio_poller_stale_mask(void *handle);
+
+/**
+ * Get the latch of the poller to register readers on for consuming edges at
+ * a lower rate than polling (see piuio-latch.h).
+ *
+ * @param handle Valid handle of a started poller
+ * @return Latch fed by the polling thread, valid until the poller is stopped
+ */
+struct piuio_latch *piuio_poller_latch(void *handle);
+
+/**
+ * Get the lights of the poller to change the outputs from any thread (see
+ * piuio-lights.h). Changes are sent with the next polling cycle.
+ *
+ * @param handle Valid handle of a started poller
+ * @return Lights read by the polling thread, valid until the poller is stopped
+ */
+struct piuio_lights *piuio_poller_lights(void *handle);
+
+/**
+ * Get the sequencer of the poller to play light shows on (see
+ * piuio-sequencer.h). Sequences take precedence over the lights for the
+ * outputs they set.
+ *
+ * @param handle Valid handle of a started poller
+ * @return Sequencer applied by the polling thread, valid until the poller is
+ *         stopped
+ */
+struct piuio_sequencer *piuio_poller_sequencer(void *handle);
+
+/**
+ * Get the history of the poller to query states of past cycles (see
+ * piuio-history.h). Entries are timestamped when a cycle completes.
+ *
+ * @param handle Valid handle of a started poller
+ * @return History fed by the polling thread, valid until the poller is stopped
+ */
+struct piuio_history *piuio_poller_history(void *handle);
+
+/**
+ * Get the timing of the polling cycles measured since the poller started.
+ *
+ * @param handle Valid handle of a started poller
+ * @param timing Pointer to a struct to return the timing in
+ */
+void piuio_poller_timing(void *handle, struct piuio_poller_timing *timing);
+
+/**
+ * Get the error that stopped the polling thread, if any.
+ *
+ * @param handle Valid handle of a started poller
+ * @return RESULT_SUCCESS if the poller is running, otherwise the error
+ *         returned by the backend polling function
+ */
+result_t piuio_poller_error(void *handle);
+
+/**
+ * Stop the polling thread and free all resources of the poller.
+ *
+ * @param handle Valid handle of a started poller
+ */
+void piuio_poller_stop(void *handle);
+
+#endif
@@ -0,0 +1,420 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "piuio-lights.h"
+#include "piuio-sequencer.h"
+
+#define PIUIO_SEQUENCE_MAGIC "PSEQ"
+#define PIUIO_SEQUENCE_HEADER_SIZE 16
+#define PIUIO_SEQUENCE_FRAME_SIZE 20
+
+static uint64_t piuio_sequence_get_le(const uint8_t *data, uint8_t size)
+{
+  uint64_t value;
+
+  value = 0;
+
+  for (uint8_t i = 0; i < size; i++) {
+    value |= (uint64_t) data[i] << (i * 8);
+  }
+
+  return value;
+}
+
+static void piuio_sequence_put_le(uint8_t *data, uint64_t value, uint8_t size)
+{
+  for (uint8_t i = 0; i < size; i++) {
+    data[i] = (uint8_t) (value >> (i * 8));
+  }
+}
+
+static struct piuio_sequence *piuio_sequence_alloc(uint32_t frame_count)
+{
+  return (struct piuio_sequence *) malloc(
+      sizeof(struct piuio_sequence) +
+      frame_count * sizeof(struct piuio_sequence_frame));
+}
+
+static result_t piuio_sequence_validate(struct piuio_sequence *sequence)
+{
+  const struct piuio_sequence_frame *frames;
+  uint32_t prev_us;
+
+  if (sequence->flags & PIUIO_SEQUENCE_FLAG_LOOP &&
+      sequence->length_us == 0) {
+    return EINVAL;
+  }
+
+  frames = sequence->frames;
+  prev_us = 0;
+  sequence->mask = 0;
+
+  for (uint32_t i = 0; i < sequence->frame_count; i++) {
+    if (frames[i].time_us < prev_us ||
+        frames[i].time_us > sequence->length_us) {
+      return EINVAL;
+    }
+
+    prev_us = frames[i].time_us;
+    sequence->mask |= frames[i].mask;
+  }
+
+  sequence->mask &= ~PIUIO_LIGHTS_SENSOR_MASK;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_sequence_create(
+    struct piuio_sequence **sequence,
+    const struct piuio_sequence_frame *frames,
+    uint32_t frame_count,
+    uint32_t length_us,
+    uint16_t flags)
+{
+  struct piuio_sequence *tmp;
+  result_t result;
+
+  assert(sequence != NULL);
+  assert(frames != NULL || frame_count == 0);
+
+  if (frame_count > PIUIO_SEQUENCE_FRAMES_MAX) {
+    return EINVAL;
+  }
+
+  tmp = piuio_sequence_alloc(frame_count);
+
+  if (tmp == NULL) {
+    return ENOMEM;
+  }
+
+  tmp->flags = flags;
+  tmp->length_us = length_us;
+  tmp->frame_count = frame_count;
+
+  if (frame_count > 0) {
+    memcpy(tmp->frames, frames, frame_count * sizeof(*frames));
+  }
+
+  result = piuio_sequence_validate(tmp);
+
+  if (RESULT_IS_ERROR(result)) {
+    free(tmp);
+    return result;
+  }
+
+  *sequence = tmp;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_sequence_load(
+    struct piuio_sequence **sequence, const void *data, size_t size)
+{
+  const uint8_t *buf;
+  const uint8_t *frame;
+  struct piuio_sequence *tmp;
+  uint32_t frame_count;
+  result_t result;
+
+  assert(sequence != NULL);
+  assert(data != NULL);
+
+  buf = (const uint8_t *) data;
+
+  if (size < PIUIO_SEQUENCE_HEADER_SIZE ||
+      memcmp(buf, PIUIO_SEQUENCE_MAGIC, 4) != 0) {
+    return EINVAL;
+  }
+
+  if (piuio_sequence_get_le(buf + 4, 2) != PIUIO_SEQUENCE_VERSION) {
+    return ENOTSUP;
+  }
+
+  frame_count = (uint32_t) piuio_sequence_get_le(buf + 12, 4);
+
+  if (frame_count > PIUIO_SEQUENCE_FRAMES_MAX ||
+      size - PIUIO_SEQUENCE_HEADER_SIZE <
+          (size_t) frame_count * PIUIO_SEQUENCE_FRAME_SIZE) {
+    return EINVAL;
+  }
+
+  tmp = piuio_sequence_alloc(frame_count);
+
+  if (tmp == NULL) {
+    return ENOMEM;
+  }
+
+  tmp->flags = (uint16_t) piuio_sequence_get_le(buf + 6, 2);
+  tmp->length_us = (uint32_t) piuio_sequence_get_le(buf + 8, 4);
+  tmp->frame_count = frame_count;
+
+  for (uint32_t i = 0; i < frame_count; i++) {
+    frame = buf + PIUIO_SEQUENCE_HEADER_SIZE + i * PIUIO_SEQUENCE_FRAME_SIZE;
+
+    tmp->frames[i].time_us = (uint32_t) piuio_sequence_get_le(frame, 4);
+    tmp->frames[i].mask = piuio_sequence_get_le(frame + 4, 8);
+    tmp->frames[i].value = piuio_sequence_get_le(frame + 12, 8);
+  }
+
+  result = piuio_sequence_validate(tmp);
+
+  if (RESULT_IS_ERROR(result)) {
+    free(tmp);
+    return result;
+  }
+
+  *sequence = tmp;
+
+  return RESULT_SUCCESS;
+}
+
+result_t
+piuio_sequence_load_file(struct piuio_sequence **sequence, const char *path)
+{
+  FILE *file;
+  uint8_t *data;
+  long size;
+  result_t result;
+
+  assert(sequence != NULL);
+  assert(path != NULL);
+
+  file = fopen(path, "rb");
+
+  if (file == NULL) {
+    return errno;
+  }
+
+  if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 ||
+      fseek(file, 0, SEEK_SET) != 0) {
+    result = errno;
+    fclose(file);
+    return result;
+  }
+
+  data = (uint8_t *) malloc(size > 0 ? size : 1);
+
+  if (data == NULL) {
+    fclose(file);
+    return ENOMEM;
+  }
+
+  if (size > 0 && fread(data, size, 1, file) != 1) {
+    result = ferror(file) ? errno : EIO;
+  } else {
+    result = piuio_sequence_load(sequence, data, size);
+  }
+
+  free(data);
+  fclose(file);
+
+  return result;
+}
+
+result_t piuio_sequence_save_file(
+    const struct piuio_sequence *sequence, const char *path)
+{
+  FILE *file;
+  uint8_t header[PIUIO_SEQUENCE_HEADER_SIZE];
+  uint8_t frame[PIUIO_SEQUENCE_FRAME_SIZE];
+  result_t result;
+
+  assert(sequence != NULL);
+  assert(path != NULL);
+
+  file = fopen(path, "wb");
+
+  if (file == NULL) {
+    return errno;
+  }
+
+  memcpy(header, PIUIO_SEQUENCE_MAGIC, 4);
+  piuio_sequence_put_le(header + 4, PIUIO_SEQUENCE_VERSION, 2);
+  piuio_sequence_put_le(header + 6, sequence->flags, 2);
+  piuio_sequence_put_le(header + 8, sequence->length_us, 4);
+  piuio_sequence_put_le(header + 12, sequence->frame_count, 4);
+
+  result = RESULT_SUCCESS;
+
+  if (fwrite(header, sizeof(header), 1, file) != 1) {
+    result = errno;
+  }
+
+  for (uint32_t i = 0; i < sequence->frame_count && !result; i++) {
+    piuio_sequence_put_le(frame, sequence->frames[i].time_us, 4);
+    piuio_sequence_put_le(frame + 4, sequence->frames[i].mask, 8);
+    piuio_sequence_put_le(frame + 12, sequence->frames[i].value, 8);
+
+    if (fwrite(frame, sizeof(frame), 1, file) != 1) {
+      result = errno;
+    }
+  }
+
+  if (fclose(file) != 0 && !result) {
+    result = errno;
+  }
+
+  return result;
+}
+
+void piuio_sequence_free(struct piuio_sequence *sequence)
+{
+  free(sequence);
+}
+
+void piuio_sequencer_init(struct piuio_sequencer *sequencer)
+{
+  assert(sequencer != NULL);
+
+  pthread_mutex_init(&sequencer->request_mutex, NULL);
+  atomic_init(&sequencer->request_seq, 0);
+  atomic_init(&sequencer->request_sequence, NULL);
+  atomic_init(&sequencer->request_start_ns, 0);
+  atomic_init(&sequencer->active, NULL);
+
+  sequencer->seen_seq = 0;
+  sequencer->sequence = NULL;
+  sequencer->start_ns = 0;
+  sequencer->frame = 0;
+  sequencer->word = 0;
+}
+
+void piuio_sequencer_play(
+    struct piuio_sequencer *sequencer,
+    const struct piuio_sequence *sequence,
+    uint64_t start_ns)
+{
+  uint_fast32_t seq;
+
+  assert(sequencer != NULL);
+
+  // Controlling threads serialize on the mutex, the polling thread only reads
+  // the request and retries on the next cycle if it raced with an update
+  pthread_mutex_lock(&sequencer->request_mutex);
+
+  seq = atomic_load_explicit(&sequencer->request_seq, memory_order_relaxed);
+  atomic_store_explicit(&sequencer->request_seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(
+      &sequencer->request_sequence, sequence, memory_order_relaxed);
+  atomic_store_explicit(
+      &sequencer->request_start_ns, start_ns, memory_order_relaxed);
+
+  atomic_store_explicit(&sequencer->request_seq, seq + 2, memory_order_release);
+
+  pthread_mutex_unlock(&sequencer->request_mutex);
+}
+
+const struct piuio_sequence *
+piuio_sequencer_active(const struct piuio_sequencer *sequencer)
+{
+  assert(sequencer != NULL);
+
+  return atomic_load_explicit(
+      (_Atomic(const struct piuio_sequence *) *) &sequencer->active,
+      memory_order_acquire);
+}
+
+static void piuio_sequencer_take_request(
+    struct piuio_sequencer *sequencer, uint64_t time_ns)
+{
+  const struct piuio_sequence *sequence;
+  uint_fast32_t seq;
+  uint64_t start_ns;
+
+  seq = atomic_load_explicit(&sequencer->request_seq, memory_order_acquire);
+
+  if (seq == sequencer->seen_seq || (seq & 1)) {
+    return;
+  }
+
+  sequence = atomic_load_explicit(
+      &sequencer->request_sequence, memory_order_relaxed);
+  start_ns = atomic_load_explicit(
+      &sequencer->request_start_ns, memory_order_relaxed);
+
+  atomic_thread_fence(memory_order_acquire);
+
+  if (atomic_load_explicit(&sequencer->request_seq, memory_order_relaxed) !=
+      seq) {
+    return;
+  }
+
+  sequencer->seen_seq = seq;
+  sequencer->sequence = sequence;
+  sequencer->start_ns = start_ns > 0 ? start_ns : time_ns;
+  sequencer->frame = 0;
+  sequencer->word = 0;
+
+  atomic_store_explicit(&sequencer->active, sequence, memory_order_release);
+}
+
+void piuio_sequencer_apply(
+    struct piuio_sequencer *sequencer,
+    uint64_t time_ns,
+    union piuio_output_paket *paket)
+{
+  const struct piuio_sequence *sequence;
+  const struct piuio_sequence_frame *frame;
+  uint64_t length_ns;
+  uint64_t elapsed_ns;
+  uint8_t mask;
+  uint8_t value;
+
+  assert(sequencer != NULL);
+  assert(paket != NULL);
+
+  piuio_sequencer_take_request(sequencer, time_ns);
+
+  sequence = sequencer->sequence;
+
+  if (sequence == NULL || time_ns < sequencer->start_ns) {
+    return;
+  }
+
+  length_ns = (uint64_t) sequence->length_us * 1000;
+  elapsed_ns = time_ns - sequencer->start_ns;
+
+  if (elapsed_ns >= length_ns) {
+    if (!(sequence->flags & PIUIO_SEQUENCE_FLAG_LOOP)) {
+      sequencer->sequence = NULL;
+      atomic_store_explicit(&sequencer->active, NULL, memory_order_release);
+      return;
+    }
+
+    // Skip all loops missed, e.g. if the polling thread stalled
+    sequencer->start_ns += elapsed_ns - elapsed_ns % length_ns;
+    elapsed_ns %= length_ns;
+    sequencer->frame = 0;
+    sequencer->word = 0;
+  }
+
+  while (sequencer->frame < sequence->frame_count) {
+    frame = &sequence->frames[sequencer->frame];
+
+    if ((uint64_t) frame->time_us * 1000 > elapsed_ns) {
+      break;
+    }
+
+    sequencer->word =
+        (sequencer->word & ~frame->mask) | (frame->value & frame->mask);
+    sequencer->frame++;
+  }
+
+  for (uint8_t i = 0; i < sizeof(paket->raw); i++) {
+    mask = (uint8_t) (sequence->mask >> (i * 8));
+    value = (uint8_t) (sequencer->word >> (i * 8));
+    paket->raw[i] = (paket->raw[i] & ~mask) | (value & mask);
+  }
+}
+
+void piuio_sequencer_destroy(struct piuio_sequencer *sequencer)
+{
+  assert(sequencer != NULL);
+
+  pthread_mutex_destroy(&sequencer->request_mutex);
+}
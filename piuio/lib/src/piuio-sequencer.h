@@ -0,0 +1,222 @@
+/**
+ * Sequencer playing precompiled light shows from the polling thread.
+ *
+ * A sequence is a timeline of frames, each one setting a group of outputs at
+ * a time relative to the start of the sequence. Outputs are addressed by the
+ * output word of piuio-lights.h, i.e. sequences cover the PIU and the ITG
+ * layout alike.
+ *
+ * The polling thread applies the sequence to the outputs of every cycle based
+ * on the start time of the cycle. Light changes are therefore accurate to a
+ * polling cycle without the game having to wake up for every change, e.g. at
+ * frame rate. While playing, the sequence owns all outputs any of its frames
+ * touches. All other outputs are taken from the lights word.
+ *
+ * Sequences are loaded from a compact binary format (all values little
+ * endian):
+ *
+ * - Header, 16 bytes: magic "PSEQ", version (uint16), flags (uint16), length
+ *   in us (uint32), number of frames (uint32)
+ * - Frames, 20 bytes each, sorted by time: time in us (uint32), mask of the
+ *   outputs to set (uint64), values of the outputs (uint64)
+ */
+#ifndef PIUIO_SEQUENCER_H
+#define PIUIO_SEQUENCER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "atomic_.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Version of the binary format
+ */
+#define PIUIO_SEQUENCE_VERSION 1
+
+/**
+ * Restart the sequence when reaching its length
+ */
+#define PIUIO_SEQUENCE_FLAG_LOOP (1 << 0)
+
+/**
+ * Max. number of frames of a sequence
+ */
+#define PIUIO_SEQUENCE_FRAMES_MAX (1 << 20)
+
+/**
+ * Single frame of a sequence
+ */
+struct piuio_sequence_frame {
+  /* Time relative to the start of the sequence */
+  uint32_t time_us;
+  /* Outputs set by the frame, see piuio-lights.h */
+  uint64_t mask;
+  /* Values of the outputs in the mask */
+  uint64_t value;
+};
+
+/**
+ * Loaded sequence, immutable once created
+ */
+struct piuio_sequence {
+  /* See PIUIO_SEQUENCE_FLAG_* */
+  uint16_t flags;
+  /* Time the sequence ends, or restarts if looping, at. The outputs keep the
+     values of the last frame until then */
+  uint32_t length_us;
+  /* Union of the masks of all frames, i.e. the outputs owned while playing */
+  uint64_t mask;
+  uint32_t frame_count;
+  struct piuio_sequence_frame frames[];
+};
+
+/**
+ * Sequencer state shared by the polling thread and the threads controlling
+ * it. Treat as opaque, use the functions below.
+ */
+struct piuio_sequencer {
+  /* Requests of the controlling threads, seqlock protected */
+  pthread_mutex_t request_mutex;
+  PUMPIO_ATOMIC(uint_fast32_t) request_seq;
+  PUMPIO_ATOMIC(const struct piuio_sequence *) request_sequence;
+  PUMPIO_ATOMIC(uint64_t) request_start_ns;
+  /* Sequence currently played, published by the polling thread */
+  PUMPIO_ATOMIC(const struct piuio_sequence *) active;
+  /* Playback state, polling thread only */
+  uint_fast32_t seen_seq;
+  const struct piuio_sequence *sequence;
+  uint64_t start_ns;
+  uint32_t frame;
+  uint64_t word;
+};
+
+/**
+ * Create a sequence from frames, e.g. generated by the game.
+ *
+ * @param sequence Pointer to variable to store the created sequence in if the
+ *                 call is successful. The caller is responsible for freeing it
+ *                 using piuio_sequence_free
+ * @param frames Frames sorted by time
+ * @param frame_count Number of frames
+ * @param length_us Length of the sequence, must not be less than the time of
+ *                  the last frame and must be > 0 if looping
+ * @param flags See PIUIO_SEQUENCE_FLAG_*
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL if the frames are not sorted or
+ *         exceed the length, ENOMEM
+ */
+result_t piuio_sequence_create(
+    struct piuio_sequence **sequence,
+    const struct piuio_sequence_frame *frames,
+    uint32_t frame_count,
+    uint32_t length_us,
+    uint16_t flags);
+
+/**
+ * Load a sequence from a buffer containing the binary format.
+ *
+ * @param sequence Pointer to variable to store the loaded sequence in if the
+ *                 call is successful. The caller is responsible for freeing it
+ *                 using piuio_sequence_free
+ * @param data Buffer with the binary format
+ * @param size Size of the buffer in bytes
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL if the data is malformed or
+ *         truncated, ENOTSUP if the version is not supported, ENOMEM
+ */
+result_t piuio_sequence_load(
+    struct piuio_sequence **sequence, const void *data, size_t size);
+
+/**
+ * Load a sequence from a file containing the binary format.
+ *
+ * @param sequence Pointer to variable to store the loaded sequence in if the
+ *                 call is successful. The caller is responsible for freeing it
+ *                 using piuio_sequence_free
+ * @param path Path to the file
+ * @return Success or an error code as defined by piuio_sequence_load, any
+ *         error of fopen or fread
+ */
+result_t
+piuio_sequence_load_file(struct piuio_sequence **sequence, const char *path);
+
+/**
+ * Save a sequence to a file in the binary format, e.g. to precompile a light
+ * show once.
+ *
+ * @param sequence Sequence to save
+ * @param path Path to the file, replaced if existing
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, any error of fopen or fwrite
+ */
+result_t piuio_sequence_save_file(
+    const struct piuio_sequence *sequence, const char *path);
+
+/**
+ * Free a sequence. It must not be played by any sequencer anymore.
+ *
+ * @param sequence Sequence to free
+ */
+void piuio_sequence_free(struct piuio_sequence *sequence);
+
+/**
+ * Initialize a sequencer, no sequence is played.
+ *
+ * @param sequencer Pointer to the sequencer to initialize
+ */
+void piuio_sequencer_init(struct piuio_sequencer *sequencer);
+
+/**
+ * Play a sequence, replacing any sequence currently played. Thread-safe.
+ *
+ * The sequence must stay valid until it is not returned by
+ * piuio_sequencer_active anymore or the polling thread is stopped.
+ *
+ * @param sequencer Pointer to an initialized sequencer
+ * @param sequence Sequence to play, NULL to stop playing
+ * @param start_ns Time to start the sequence at, e.g. synchronized to the
+ *                 music, see pumpio_time_now_ns. 0 to start with the next
+ *                 polling cycle
+ */
+void piuio_sequencer_play(
+    struct piuio_sequencer *sequencer,
+    const struct piuio_sequence *sequence,
+    uint64_t start_ns);
+
+/**
+ * Get the sequence currently played. Thread-safe.
+ *
+ * @param sequencer Pointer to an initialized sequencer
+ * @return Sequence played by the polling thread, NULL if none is played or a
+ *         non-looping sequence ended
+ */
+const struct piuio_sequence *
+piuio_sequencer_active(const struct piuio_sequencer *sequencer);
+
+/**
+ * Apply the played sequence to the output paket of a cycle, called by the
+ * polling thread before every cycle. The sensor mask bits of the paket are
+ * kept.
+ *
+ * @param sequencer Pointer to an initialized sequencer
+ * @param time_ns Start time of the cycle, see pumpio_time_now_ns
+ * @param paket Output paket to update
+ */
+void piuio_sequencer_apply(
+    struct piuio_sequencer *sequencer,
+    uint64_t time_ns,
+    union piuio_output_paket *paket);
+
+/**
+ * Release the resources of a sequencer. The sequence played, if any, is not
+ * freed.
+ *
+ * @param sequencer Pointer to an initialized sequencer
+ */
+void piuio_sequencer_destroy(struct piuio_sequencer *sequencer);
+
+#endif
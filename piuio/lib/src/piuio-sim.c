@@ -0,0 +1,93 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "devices.h"
+#include "piuio-sim.h"
+#include "piuio-state.h"
+#include "piuio-usb.h"
+
+static result_t piuio_sim_transfer(
+    void *ctx,
+    uint8_t request_type,
+    uint8_t request,
+    uint16_t value,
+    uint16_t index,
+    uint8_t *data,
+    uint16_t len,
+    uint32_t timeout_ms,
+    uint16_t *len_res)
+{
+  struct piuio_sim *sim;
+  union piuio_input_paket input;
+
+  sim = (struct piuio_sim *) ctx;
+
+  if (request != PUMPIO_CTRL_REQUEST) {
+    return EPIPE;
+  }
+
+  sim->transfers++;
+
+  if (request_type == PUMPIO_CTRL_TYPE_OUT) {
+    if (len != sizeof(sim->output.raw)) {
+      return EPIPE;
+    }
+
+    memcpy(sim->output.raw, data, sizeof(sim->output.raw));
+  } else if (request_type == PUMPIO_CTRL_TYPE_IN) {
+    if (len != sizeof(sim->inputs[0].raw)) {
+      return EPIPE;
+    }
+
+    // Active inputs pull the lines low
+    input = sim->inputs[sim->output.piu.sensor_mask];
+    piuio_state_invert_pull_ups(&input);
+    memcpy(data, input.raw, sizeof(input.raw));
+  } else {
+    return EPIPE;
+  }
+
+  *len_res = len;
+
+  return RESULT_SUCCESS;
+}
+
+void piuio_sim_init(struct piuio_sim *sim)
+{
+  assert(sim != NULL);
+
+  memset(sim, 0, sizeof(struct piuio_sim));
+}
+
+void piuio_sim_set_state(struct piuio_sim *sim, uint64_t state)
+{
+  uint8_t extra;
+  uint8_t *raw;
+
+  assert(sim != NULL);
+
+  extra = (uint8_t) (state >> PIUIO_STATE_PLAYER_EXTRA_SHIFT);
+
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    raw = sim->inputs[i].raw;
+
+    memset(raw, 0, sizeof(sim->inputs[i].raw));
+
+    // Inverse of piuio_state_decode
+    raw[0] = (uint8_t) ((state >> PIUIO_STATE_SENSOR_BIT(i, 0, 0)) & 0x1F) |
+        (uint8_t) ((extra & 0x07) << PIUIO_STATE_PANEL_COUNT);
+    raw[2] = (uint8_t) ((state >> PIUIO_STATE_SENSOR_BIT(i, 1, 0)) & 0x1F) |
+        (uint8_t) (((extra >> 3) & 0x07) << PIUIO_STATE_PANEL_COUNT);
+    raw[1] = (uint8_t) (state >> PIUIO_STATE_OPERATOR_1_SHIFT);
+    raw[3] = (uint8_t) (state >> PIUIO_STATE_OPERATOR_3_SHIFT);
+  }
+}
+
+result_t piuio_sim_open(struct piuio_sim *sim, void **handle)
+{
+  assert(sim != NULL);
+  assert(handle != NULL);
+
+  return piuio_usb_open_transport(handle, piuio_sim_transfer, sim);
+}
@@ -0,0 +1,63 @@
+/**
+ * Simulated PIUIO device for testing and benchmarking without hardware.
+ *
+ * The simulation implements the control transfer protocol of the real device:
+ * an OUT transfer sets the outputs including the sensor mask, an IN transfer
+ * returns the inputs of the sensor mask selected last with pull ups like the
+ * real hardware. Use piuio_sim_open to get a regular usb handle driven by the
+ * simulation which works with all piuio_usb_* functions, e.g. the poller.
+ *
+ * The inputs of the simulation are set from the packed state representation
+ * (see piuio-state.h), e.g. to replay synthetic traces.
+ */
+#ifndef PIUIO_SIM_H
+#define PIUIO_SIM_H
+
+#include <stdint.h>
+
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * State of a simulated device. Treat as opaque, use the functions below.
+ */
+struct piuio_sim {
+  /* Inputs per sensor mask, active high */
+  union piuio_input_paket inputs[PIUIO_SENSOR_MASK_TOTAL_COUNT];
+  /* Outputs received last */
+  union piuio_output_paket output;
+  uint64_t transfers;
+};
+
+/**
+ * Initialize a simulated device with all inputs inactive.
+ *
+ * @param sim Pointer to the simulated device to initialize
+ */
+void piuio_sim_init(struct piuio_sim *sim);
+
+/**
+ * Set the inputs of a simulated device. Not thread-safe, do not call while a
+ * transfer on the device is in progress.
+ *
+ * @param sim Pointer to an initialized simulated device
+ * @param state Packed state of the inputs, see piuio-state.h. Bits or'd over
+ *              all sensor masks are active for every sensor mask
+ */
+void piuio_sim_set_state(struct piuio_sim *sim, uint64_t state);
+
+/**
+ * Open a PIUIO usb device handle driven by a simulated device.
+ *
+ * @param sim Pointer to an initialized simulated device. Must stay valid
+ *            until the handle is closed
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_usb_close.
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM
+ */
+result_t piuio_sim_open(struct piuio_sim *sim, void **handle);
+
+#endif
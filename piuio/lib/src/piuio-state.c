@@ -0,0 +1,49 @@
+#include <assert.h>
+
+#include "piuio-state.h"
+
+void piuio_state_invert_pull_ups(union piuio_input_paket *paket)
+{
+  assert(paket != NULL);
+
+  for (uint8_t i = 0; i < sizeof(paket->raw); i++) {
+    paket->raw[i] ^= 0xFF;
+  }
+}
+
+uint64_t piuio_state_decode(const struct piuio_usb_input_batch_paket *batch)
+{
+  uint64_t state;
+  uint8_t extra_p1;
+  uint8_t extra_p2;
+  uint8_t operator_1;
+  uint8_t operator_3;
+
+  assert(batch != NULL);
+
+  state = 0;
+  extra_p1 = 0;
+  extra_p2 = 0;
+  operator_1 = 0;
+  operator_3 = 0;
+
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    const uint8_t *raw = batch->pakets[i].raw;
+
+    state |= ((uint64_t) (raw[0] & 0x1F) |
+              ((uint64_t) (raw[2] & 0x1F) << PIUIO_STATE_PANEL_COUNT))
+        << PIUIO_STATE_SENSOR_BIT(i, 0, 0);
+
+    extra_p1 |= raw[0] >> PIUIO_STATE_PANEL_COUNT;
+    extra_p2 |= raw[2] >> PIUIO_STATE_PANEL_COUNT;
+    operator_1 |= raw[1];
+    operator_3 |= raw[3];
+  }
+
+  state |= (uint64_t) (extra_p1 | (extra_p2 << 3))
+      << PIUIO_STATE_PLAYER_EXTRA_SHIFT;
+  state |= (uint64_t) operator_1 << PIUIO_STATE_OPERATOR_1_SHIFT;
+  state |= (uint64_t) operator_3 << PIUIO_STATE_OPERATOR_3_SHIFT;
+
+  return state;
+}
@@ -0,0 +1,93 @@
+/**
+ * Packed representation of a full PIUIO input update cycle.
+ *
+ * The four input pakets of a polling cycle are folded into a single 64-bit
+ * word which allows higher level processing stages (e.g. debouncing, edge
+ * detection) to operate on all sensors and operator inputs at once using plain
+ * word operations.
+ *
+ * Bit layout of the packed state:
+ *
+ * - Bits 0-39: Pad sensors. Each sensor mask (see piuio_sensor_mask) occupies
+ *   10 bits, 5 bits for player 1 (bits 0-4 of input byte 0) followed by 5 bits
+ *   for player 2 (bits 0-4 of input byte 2).
+ * - Bits 40-42: Bits 5-7 of input byte 0 (player 1), or'd over all sensor
+ *   masks
+ * - Bits 43-45: Bits 5-7 of input byte 2 (player 2), or'd over all sensor
+ *   masks
+ * - Bits 46-47: Unused, always 0
+ * - Bits 48-55: Input byte 1 (operator inputs), or'd over all sensor masks
+ * - Bits 56-63: Input byte 3 (operator inputs), or'd over all sensor masks
+ *
+ * Pull ups are expected to be inverted already, i.e. a set bit is an active
+ * input.
+ */
+#ifndef PIUIO_STATE_H
+#define PIUIO_STATE_H
+
+#include <stdint.h>
+
+#include "piuio.h"
+
+#define PIUIO_STATE_PLAYER_COUNT 2
+#define PIUIO_STATE_PANEL_COUNT 5
+
+#define PIUIO_STATE_SENSOR_COUNT \
+  (PIUIO_SENSOR_MASK_TOTAL_COUNT * PIUIO_STATE_PLAYER_COUNT * \
+   PIUIO_STATE_PANEL_COUNT)
+
+#define PIUIO_STATE_PLAYER_EXTRA_SHIFT 40
+#define PIUIO_STATE_OPERATOR_1_SHIFT 48
+#define PIUIO_STATE_OPERATOR_3_SHIFT 56
+
+/**
+ * Bit index of a single pad sensor.
+ *
+ * @param sensor_mask Sensor mask the input was polled with, see
+ *                    piuio_sensor_mask
+ * @param player Player index, 0 or 1
+ * @param panel Bit index of the panel in the input byte of the player, 0-4
+ */
+#define PIUIO_STATE_SENSOR_BIT(sensor_mask, player, panel) \
+  ((sensor_mask) * PIUIO_STATE_PLAYER_COUNT * PIUIO_STATE_PANEL_COUNT + \
+   (player) * PIUIO_STATE_PANEL_COUNT + (panel))
+
+/**
+ * Mask covering all four sensors of a single panel.
+ *
+ * @param player Player index, 0 or 1
+ * @param panel Bit index of the panel in the input byte of the player, 0-4
+ */
+#define PIUIO_STATE_PANEL_MASK(player, panel) \
+  (UINT64_C(0x0000000040100401) \
+   << ((player) * PIUIO_STATE_PANEL_COUNT + (panel)))
+
+/**
+ * Mask covering all pad sensors of all players
+ */
+#define PIUIO_STATE_SENSORS_MASK UINT64_C(0x000000FFFFFFFFFF)
+
+/**
+ * Mask covering all operator inputs, i.e. input bytes 1 and 3
+ */
+#define PIUIO_STATE_OPERATOR_MASK UINT64_C(0xFFFF000000000000)
+
+/**
+ * Invert the pull ups of an input paket as received from the device, i.e.
+ * turn the active low inputs into active high ones.
+ *
+ * @param paket Pointer to the input paket to invert in place
+ */
+void piuio_state_invert_pull_ups(union piuio_input_paket *paket);
+
+/**
+ * Fold a batch of four input pakets (one full polling cycle) into the packed
+ * state representation.
+ *
+ * @param batch Pointer to a batch of input pakets with inverted pull ups, e.g.
+ *              as returned by piuio_usb_poll_full_cycle or piuio_kmod_poll
+ * @return Packed state as documented above
+ */
+uint64_t piuio_state_decode(const struct piuio_usb_input_batch_paket *batch);
+
+#endif
@@ -0,0 +1,23 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include "piuio-stats.h"
+
+static struct pumpio_stats piuio_stats_global;
+
+void piuio_stats_snapshot(struct pumpio_stats_snapshot *snapshot)
+{
+  assert(snapshot != NULL);
+
+  pumpio_stats_snapshot(&piuio_stats_global, snapshot);
+}
+
+void piuio_stats_reset()
+{
+  pumpio_stats_reset(&piuio_stats_global);
+}
+
+struct pumpio_stats *piuio_stats()
+{
+  return &piuio_stats_global;
+}
@@ -0,0 +1,51 @@
+/**
+ * Process-wide statistics of all PIUIO devices driven by this library.
+ *
+ * Recording is always enabled and low overhead (see stats.h). The piuio-usb
+ * backend records every transfer, full polling cycle and the time it takes for
+ * changed outputs to be transferred. The piuio-kmod backend records polling
+ * cycles. Errors of both backends are counted by result_t. Backend switches of
+ * the failover supervisor (see piuio-failover.h) are counted as failovers.
+ * Cycle intervals are tracked per device, the poll rate is the sum of all
+ * devices. Use piuio_usb_set_stats, piuio_usbfs_set_stats or
+ * piuio_kmod_set_stats to record a device in its own statistics instead.
+ *
+ * Example to log percentiles from a running game:
+ *
+ *   static struct pumpio_stats_snapshot snapshot;
+ *   struct pumpio_hist_snapshot *cycle;
+ *
+ *   piuio_stats_snapshot(&snapshot);
+ *   cycle = &snapshot.hists[PUMPIO_STATS_HIST_CYCLE];
+ *
+ *   printf("p50 %lu p99 %lu p99.9 %lu ns, %.1f Hz\n",
+ *       pumpio_hist_percentile(cycle, 50.0),
+ *       pumpio_hist_percentile(cycle, 99.0),
+ *       pumpio_hist_percentile(cycle, 99.9),
+ *       snapshot.poll_rate_hz);
+ */
+#ifndef PIUIO_STATS_H
+#define PIUIO_STATS_H
+
+#include "stats.h"
+
+/**
+ * Take a snapshot of the statistics of all PIUIO devices.
+ *
+ * @param snapshot Pointer to the snapshot to fill
+ */
+void piuio_stats_snapshot(struct pumpio_stats_snapshot *snapshot);
+
+/**
+ * Reset the statistics of all PIUIO devices.
+ */
+void piuio_stats_reset();
+
+/**
+ * Get the statistics instance the backends record in.
+ *
+ * @return Pointer to the process-wide statistics
+ */
+struct pumpio_stats *piuio_stats();
+
+#endif
@@ -1,31 +1,173 @@
 #include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "devices.h"
+#include "encoder.h"
+#include "piuio-state.h"
+#include "piuio-stats.h"
 #include "piuio-usb.h"
+#include "time_.h"
 #include "usb_.h"
 
-#define PIUIO_USB_VID 0x0547
-#define PIUIO_USB_PID 0x1002
+/* Sensor mask bits of byte 0 of the output, changed on every sub-poll. Byte 0
+   is the lowest byte of the raw output word */
+#define PIUIO_USB_OUTPUT_SENSOR_MASK_BITS UINT64_C(0x03)
 
-#define PIUIO_USB_CONFIG 0x01
-#define PIUIO_USB_IFACE 0x00
+/* Timestamp a transfer of a profiled cycle, no-op if not profiling */
+#define PIUIO_USB_PROFILE_MARK(profile, field) \
+  do { \
+    if ((profile) != NULL) { \
+      (profile)->field = pumpio_time_now_ns(); \
+    } \
+  } while (0)
 
-#define PIUIO_USB_CTRL_TYPE_IN 0xC0
-#define PIUIO_USB_CTRL_TYPE_OUT 0x40
-#define PIUIO_USB_CTRL_REQUEST 0xAE
-#define PIUIO_USB_REQ_TIMEOUT 10000
+struct piuio_usb_ctx {
+  void *usb;
+  /* Outputs including the sensor mask last sent as raw output word, see
+     encoder.h */
+  uint64_t output;
+  /* Device latched the outputs with the last poll, unknown if it failed as
+     the device might have been reset since */
+  bool latched;
+  /* Statistics to record in and start of the last cycle for its interval */
+  struct pumpio_stats *stats;
+  uint64_t last_cycle_ns;
+};
+
+/**
+ * Wrap an opened usb device into a context of this library
+ */
+static result_t piuio_usb_open_ctx(void **handle, void *usb)
+{
+  struct piuio_usb_ctx *ctx;
+
+  ctx = (struct piuio_usb_ctx *) malloc(sizeof(struct piuio_usb_ctx));
+
+  if (ctx == NULL) {
+    pumpio_usb_close(usb);
+    return ENOMEM;
+  }
+
+  ctx->usb = usb;
+  ctx->stats = piuio_stats();
+  ctx->last_cycle_ns = 0;
+  pumpio_usb_set_stats(ctx->usb, ctx->stats);
+  ctx->output = 0;
+  ctx->latched = false;
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+static result_t piuio_usb_open_usb(void **handle, const char *id)
+{
+  void *usb;
+  result_t result;
+
+  result = pumpio_usb_open_id(
+      &usb,
+      PUMPIO_PIUIO_VID,
+      PUMPIO_PIUIO_PID,
+      id,
+      PUMPIO_DEVICE_CONFIG,
+      PUMPIO_DEVICE_IFACE);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  return piuio_usb_open_ctx(handle, usb);
+}
+
+/**
+ * Check if the device latched the given outputs with the last poll
+ */
+static bool piuio_usb_output_latched(
+    const struct piuio_usb_ctx *ctx, const union piuio_output_paket *output)
+{
+  return ctx->latched &&
+      pumpio_encoder_diff(
+          ctx->output, pumpio_encoder_from_raw(output->raw)) == 0;
+}
+
+static void piuio_usb_output_latch(
+    struct piuio_usb_ctx *ctx, const union piuio_output_paket *output)
+{
+  ctx->output = pumpio_encoder_from_raw(output->raw);
+  ctx->latched = true;
+}
+
+/**
+ * Remember the outputs just transferred and record the output latency if
+ * they changed, ignoring the sensor mask
+ */
+static void piuio_usb_record_output(
+    struct piuio_usb_ctx *ctx,
+    const union piuio_output_paket *output,
+    uint64_t start_ns)
+{
+  uint64_t word;
+  uint8_t diff;
+
+  word = pumpio_encoder_from_raw(output->raw);
+  diff = pumpio_encoder_diff(
+      ctx->output & ~PIUIO_USB_OUTPUT_SENSOR_MASK_BITS,
+      word & ~PIUIO_USB_OUTPUT_SENSOR_MASK_BITS);
+  ctx->output = word;
+
+  if (diff != 0) {
+    pumpio_stats_record_output(ctx->stats, pumpio_time_now_ns() - start_ns);
+  }
+}
 
 bool piuio_usb_available()
 {
-  return pumpio_usb_available(PIUIO_USB_VID, PIUIO_USB_PID);
+  return pumpio_usb_available(PUMPIO_PIUIO_VID, PUMPIO_PIUIO_PID);
+}
+
+result_t piuio_usb_enumerate(
+    struct pumpio_usb_device_info *infos, size_t max_count, size_t *count)
+{
+  assert(count != NULL);
+
+  return pumpio_usb_enumerate(
+      PUMPIO_PIUIO_VID, PUMPIO_PIUIO_PID, infos, max_count, count);
 }
 
 result_t piuio_usb_open(void **handle)
 {
   assert(handle != NULL);
 
-  return pumpio_usb_open(
-      handle, PIUIO_USB_VID, PIUIO_USB_PID, PIUIO_USB_CONFIG, PIUIO_USB_IFACE);
+  return piuio_usb_open_usb(handle, NULL);
+}
+
+result_t piuio_usb_open_id(void **handle, const char *id)
+{
+  assert(handle != NULL);
+  assert(id != NULL);
+
+  return piuio_usb_open_usb(handle, id);
+}
+
+result_t piuio_usb_open_transport(
+    void **handle, pumpio_usb_transport_func_t transport, void *ctx)
+{
+  void *usb;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(transport != NULL);
+
+  result = pumpio_usb_open_transport(&usb, transport, ctx);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  return piuio_usb_open_ctx(handle, usb);
 }
 
 result_t piuio_usb_poll_one_cycle(
@@ -33,43 +175,59 @@ result_t piuio_usb_poll_one_cycle(
     const union piuio_output_paket *output,
     union piuio_input_paket *input)
 {
+  struct piuio_usb_ctx *ctx;
   result_t result;
   uint16_t res_len;
+  uint64_t start_ns;
+  bool output_latched;
 
   assert(handle != NULL);
   assert(output != NULL);
   assert(input != NULL);
 
-  // Write outputs
-  result = pumpio_usb_control_transfer(
-      handle,
-      PIUIO_USB_CTRL_TYPE_OUT,
-      PIUIO_USB_CTRL_REQUEST,
-      0,
-      0,
-      (uint8_t *) output->raw,
-      sizeof(output->raw),
-      PIUIO_USB_REQ_TIMEOUT,
-      &res_len);
+  ctx = (struct piuio_usb_ctx *) handle;
+  start_ns = pumpio_time_now_ns();
 
-  if (RESULT_IS_ERROR(result)) {
-    return result;
-  }
+  // Until this poll succeeds, it is unknown what the device latched, e.g. it
+  // might get reset and reconnected on errors
+  output_latched = piuio_usb_output_latched(ctx, output);
+  ctx->latched = false;
 
-  if (res_len != sizeof(output->raw)) {
-    return EIO;
+  // Write outputs, skipped if neither the outputs nor the sensor mask changed
+  // since the last poll which halves the transfers when polling a fixed mask
+  if (!output_latched) {
+    result = pumpio_usb_control_transfer(
+        ctx->usb,
+        PUMPIO_CTRL_TYPE_OUT,
+        PUMPIO_CTRL_REQUEST,
+        0,
+        0,
+        (uint8_t *) output->raw,
+        sizeof(output->raw),
+        PIUIO_USB_REQ_TIMEOUT_MS,
+        &res_len);
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    if (res_len != sizeof(output->raw)) {
+      return EIO;
+    }
+
+    piuio_usb_record_output(ctx, output, start_ns);
   }
 
   // Read inputs
   result = pumpio_usb_control_transfer(
-      handle,
-      PIUIO_USB_CTRL_TYPE_IN,
-      PIUIO_USB_CTRL_REQUEST,
+      ctx->usb,
+      PUMPIO_CTRL_TYPE_IN,
+      PUMPIO_CTRL_REQUEST,
       0,
       0,
       (uint8_t *) input->raw,
       sizeof(input->raw),
-      PIUIO_USB_REQ_TIMEOUT,
+      PIUIO_USB_REQ_TIMEOUT_MS,
       &res_len);
 
   if (RESULT_IS_ERROR(result)) {
@@ -80,42 +238,54 @@ result_t piuio_usb_poll_one_cycle(
     return EIO;
   }
 
-  // Invert pull ups
-  for (uint8_t j = 0; j < sizeof(input->raw); j++) {
-    input->raw[j] ^= 0xFF;
-  }
+  piuio_state_invert_pull_ups(input);
+
+  piuio_usb_output_latch(ctx, output);
 
   return RESULT_SUCCESS;
 }
 
-result_t piuio_usb_poll_full_cycle(
-    void *handle,
+static result_t piuio_usb_full_cycle(
+    struct piuio_usb_ctx *ctx,
     union piuio_output_paket *output,
-    struct piuio_usb_input_batch_paket *input)
+    struct piuio_usb_input_batch_paket *input,
+    struct piuio_usb_cycle_profile *profile)
 {
   result_t result;
   uint16_t res_len;
+  uint64_t start_ns;
 
-  assert(handle != NULL);
-  assert(output != NULL);
-  assert(input != NULL);
+  start_ns = pumpio_time_now_ns();
+
+  // The sensor mask changes with every sub-poll, i.e. all outputs are
+  // written. Only remember the last one for single sub-polls
+  ctx->latched = false;
+
+  if (profile != NULL) {
+    memset(profile, 0, sizeof(struct piuio_usb_cycle_profile));
+    profile->start_ns = start_ns;
+  }
 
   for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
     // Cycle sensor mask, itg and piu have sensor mask on same bits
     output->piu.sensor_mask = i;
 
+    PIUIO_USB_PROFILE_MARK(profile, out_start_ns[i]);
+
     // Write outputs
     result = pumpio_usb_control_transfer(
-        handle,
-        PIUIO_USB_CTRL_TYPE_OUT,
-        PIUIO_USB_CTRL_REQUEST,
+        ctx->usb,
+        PUMPIO_CTRL_TYPE_OUT,
+        PUMPIO_CTRL_REQUEST,
         0,
         0,
         (uint8_t *) output->raw,
         sizeof(output->raw),
-        PIUIO_USB_REQ_TIMEOUT,
+        PIUIO_USB_REQ_TIMEOUT_MS,
         &res_len);
 
+    PIUIO_USB_PROFILE_MARK(profile, out_end_ns[i]);
+
     if (RESULT_IS_ERROR(result)) {
       return result;
     }
@@ -124,19 +294,27 @@ result_t piuio_usb_poll_full_cycle(
       return EIO;
     }
 
+    if (i == 0) {
+      piuio_usb_record_output(ctx, output, start_ns);
+    }
+
+    PIUIO_USB_PROFILE_MARK(profile, in_start_ns[i]);
+
     // Read inputs, doesn't matter which struct we use here, using piu as
     // default
     result = pumpio_usb_control_transfer(
-        handle,
-        PIUIO_USB_CTRL_TYPE_IN,
-        PIUIO_USB_CTRL_REQUEST,
+        ctx->usb,
+        PUMPIO_CTRL_TYPE_IN,
+        PUMPIO_CTRL_REQUEST,
         0,
         0,
         (uint8_t *) &input->pakets[i].raw,
         sizeof(input->pakets[i].raw),
-        PIUIO_USB_REQ_TIMEOUT,
+        PIUIO_USB_REQ_TIMEOUT_MS,
         &res_len);
 
+    PIUIO_USB_PROFILE_MARK(profile, in_end_ns[i]);
+
     if (RESULT_IS_ERROR(result)) {
       return result;
     }
@@ -145,18 +323,199 @@ result_t piuio_usb_poll_full_cycle(
       return EIO;
     }
 
-    // Invert pull ups
-    for (uint8_t j = 0; j < sizeof(input->pakets[i].raw); j++) {
-      input->pakets[i].raw[j] ^= 0xFF;
+    piuio_state_invert_pull_ups(&input->pakets[i]);
+  }
+
+  PIUIO_USB_PROFILE_MARK(profile, end_ns);
+
+  piuio_usb_output_latch(ctx, output);
+
+  pumpio_stats_record_cycle(
+      ctx->stats, &ctx->last_cycle_ns, start_ns, pumpio_time_now_ns());
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_usb_poll_full_cycle(
+    void *handle,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  assert(handle != NULL);
+  assert(output != NULL);
+  assert(input != NULL);
+
+  return piuio_usb_full_cycle(
+      (struct piuio_usb_ctx *) handle, output, input, NULL);
+}
+
+result_t piuio_usb_poll_full_cycle_profile(
+    void *handle,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input,
+    struct piuio_usb_cycle_profile *profile)
+{
+  assert(handle != NULL);
+  assert(output != NULL);
+  assert(input != NULL);
+  assert(profile != NULL);
+
+  return piuio_usb_full_cycle(
+      (struct piuio_usb_ctx *) handle, output, input, profile);
+}
+
+result_t piuio_usb_poll_full_cycle_deadline(
+    void *handle,
+    const struct piuio_usb_cycle_config *config,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input,
+    uint8_t *stale_mask)
+{
+  struct piuio_usb_ctx *ctx;
+  struct pumpio_usb_deadline deadline;
+  union piuio_input_paket paket;
+  result_t result;
+  result_t stale_result;
+  uint16_t res_len;
+  uint64_t start_ns;
+  bool output_sent;
+
+  assert(handle != NULL);
+  assert(config != NULL);
+  assert(output != NULL);
+  assert(input != NULL);
+  assert(stale_mask != NULL);
+
+  ctx = (struct piuio_usb_ctx *) handle;
+  start_ns = pumpio_time_now_ns();
+  output_sent = false;
+
+  deadline.deadline_ns = start_ns + (uint64_t) config->deadline_us * 1000;
+  deadline.timeout_ms = config->transfer_timeout_ms;
+  deadline.backoff_us = config->backoff_us;
+  deadline.backoff_max_us = config->backoff_max_us;
+
+  ctx->latched = false;
+
+  *stale_mask = 0;
+  stale_result = RESULT_SUCCESS;
+
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    // Cycle sensor mask, itg and piu have sensor mask on same bits
+    output->piu.sensor_mask = i;
+
+    // Write outputs
+    result = pumpio_usb_control_transfer_deadline(
+        ctx->usb,
+        PUMPIO_CTRL_TYPE_OUT,
+        PUMPIO_CTRL_REQUEST,
+        0,
+        0,
+        (uint8_t *) output->raw,
+        sizeof(output->raw),
+        &deadline,
+        &res_len);
+
+    if (result == ETIMEDOUT) {
+      // Deadline passed, all remaining slots are stale
+      *stale_mask |= PIUIO_USB_STALE_MASK_ALL & ~((1 << i) - 1);
+      stale_result = ETIMEDOUT;
+      break;
+    }
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    if (res_len != sizeof(output->raw)) {
+      *stale_mask |= 1 << i;
+      stale_result = EIO;
+      continue;
+    }
+
+    if (!output_sent) {
+      piuio_usb_record_output(ctx, output, start_ns);
+      output_sent = true;
+    }
+
+    // Read inputs into a temporary buffer to not clobber the stale data of
+    // the slot with a partial transfer
+    result = pumpio_usb_control_transfer_deadline(
+        ctx->usb,
+        PUMPIO_CTRL_TYPE_IN,
+        PUMPIO_CTRL_REQUEST,
+        0,
+        0,
+        (uint8_t *) paket.raw,
+        sizeof(paket.raw),
+        &deadline,
+        &res_len);
+
+    if (result == ETIMEDOUT) {
+      *stale_mask |= PIUIO_USB_STALE_MASK_ALL & ~((1 << i) - 1);
+      stale_result = ETIMEDOUT;
+      break;
     }
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    if (res_len != sizeof(paket.raw)) {
+      *stale_mask |= 1 << i;
+      stale_result = EIO;
+      continue;
+    }
+
+    piuio_state_invert_pull_ups(&paket);
+    input->pakets[i] = paket;
+  }
+
+  // Not a cycle without any fresh inputs, fail like a single poll
+  if (*stale_mask == PIUIO_USB_STALE_MASK_ALL) {
+    return stale_result;
   }
 
+  // Stale slots leave it unknown which outputs the device latched last
+  if (*stale_mask == 0) {
+    piuio_usb_output_latch(ctx, output);
+  }
+
+  pumpio_stats_record_cycle(
+      ctx->stats, &ctx->last_cycle_ns, start_ns, pumpio_time_now_ns());
+
   return RESULT_SUCCESS;
 }
 
+void piuio_usb_set_reattach_kernel_driver(void *handle, bool reattach)
+{
+  assert(handle != NULL);
+
+  pumpio_usb_set_reattach_kernel_driver(
+      ((struct piuio_usb_ctx *) handle)->usb, reattach);
+}
+
+void piuio_usb_set_stats(void *handle, struct pumpio_stats *stats)
+{
+  struct piuio_usb_ctx *ctx;
+
+  assert(handle != NULL);
+  assert(stats != NULL);
+
+  ctx = (struct piuio_usb_ctx *) handle;
+
+  ctx->stats = stats;
+  pumpio_usb_set_stats(ctx->usb, stats);
+}
+
 void piuio_usb_close(void *handle)
 {
+  struct piuio_usb_ctx *ctx;
+
   assert(handle != NULL);
 
-  pumpio_usb_close(handle);
+  ctx = (struct piuio_usb_ctx *) handle;
+
+  pumpio_usb_close(ctx->usb);
+  free(ctx);
 }
\ No newline at end of file
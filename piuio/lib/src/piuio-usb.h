@@ -10,14 +10,72 @@
 
 #include "piuio.h"
 #include "result.h"
+#include "usb_.h"
 
 /**
- * Check if a PIUIO device is connected via USB and available to be opened.
+ * Default timeout of a single transfer in ms used by the polling calls without
+ * explicit timeouts
+ */
+#define PIUIO_USB_REQ_TIMEOUT_MS 10000
+
+/**
+ * Stale mask of a cycle in which no sub-poll completed, see
+ * piuio_usb_poll_full_cycle_deadline
+ */
+#define PIUIO_USB_STALE_MASK_ALL ((1 << PIUIO_SENSOR_MASK_TOTAL_COUNT) - 1)
+
+/**
+ * Time bounds of a full polling cycle, see piuio_usb_poll_full_cycle_deadline
+ */
+struct piuio_usb_cycle_config {
+  /* Max. duration of the whole cycle in us, measured from the call */
+  uint32_t deadline_us;
+  /* Max. timeout of a single transfer in ms, 0 to use the time left until the
+     deadline only */
+  uint32_t transfer_timeout_ms;
+  /* Time to wait before retrying a failed transfer in us, doubled with every
+     retry up to backoff_max_us */
+  uint32_t backoff_us;
+  uint32_t backoff_max_us;
+};
+
+/**
+ * Timestamps of a profiled full polling cycle, see
+ * piuio_usb_poll_full_cycle_profile. All in ns, see pumpio_time_now_ns
+ */
+struct piuio_usb_cycle_profile {
+  uint64_t start_ns;
+  uint64_t end_ns;
+  /* Start and end of the OUT transfer selecting sensor mask n */
+  uint64_t out_start_ns[PIUIO_SENSOR_MASK_TOTAL_COUNT];
+  uint64_t out_end_ns[PIUIO_SENSOR_MASK_TOTAL_COUNT];
+  /* Start and end of the IN transfer reading the inputs of sensor mask n */
+  uint64_t in_start_ns[PIUIO_SENSOR_MASK_TOTAL_COUNT];
+  uint64_t in_end_ns[PIUIO_SENSOR_MASK_TOTAL_COUNT];
+};
+
+/**
+ * Check if a PIUIO device is connected via USB. The device is not opened, see
+ * pumpio_usb_available.
  *
  * @return True if device is connected, false otherwise.
  */
 bool piuio_usb_available();
 
+/**
+ * Enumerate all PIUIO devices connected via USB.
+ *
+ * @param infos Pointer to an allocated array to return information about the
+ *              devices found in
+ * @param max_count Number of elements of the infos array
+ * @param count Pointer to a variable to return the total number of devices
+ *              found in, can be larger than max_count
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENOMEM, ENOTSUP
+ */
+result_t piuio_usb_enumerate(
+    struct pumpio_usb_device_info *infos, size_t max_count, size_t *count);
+
 /**
  * Open a connected PIUIO device using a user space usb library.
  *
@@ -31,6 +89,39 @@ bool piuio_usb_available();
  */
 result_t piuio_usb_open(void **handle);
 
+/**
+ * Open a specific PIUIO device using a user space usb library. Use this if
+ * multiple PIUIO devices are connected to the same host.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_usb_close.
+ * @param id Identifier of the device, either its path (e.g. "1-2.4") or its
+ *           serial number as returned by piuio_usb_enumerate
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
+ *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
+ */
+result_t piuio_usb_open_id(void **handle, const char *id);
+
+/**
+ * Open a PIUIO device driven by a custom transport instead of libusb, e.g. the
+ * simulated device of piuio-sim.h.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_usb_close.
+ * @param transport Transfer function of the transport, see
+ *                  pumpio_usb_open_transport
+ * @param ctx Context passed to the transport on every transfer
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM
+ */
+result_t piuio_usb_open_transport(
+    void **handle, pumpio_usb_transport_func_t transport, void *ctx);
+
 /**
  * Run a single set output, get input poll cycle.
  *
@@ -39,6 +130,10 @@ result_t piuio_usb_open(void **handle);
  * mask in the output paket or use piuio_usb_poll_full_cycle for
  * convenience.
  *
+ * The output transfer is skipped if neither the outputs nor the sensor mask
+ * changed since the previous successful poll, i.e. the device latched them
+ * already. Polling a single fixed sensor mask needs one transfer per call.
+ *
  * @param handle Valid handle of an opened PIUIO usb device
  * @param output Pointer to an allocated buffer with the output data to send.
  * @param input Pointer to an allocated buffer for the input data to receive.
@@ -73,6 +168,83 @@ result_t piuio_usb_poll_full_cycle(
     union piuio_output_paket *output,
     struct piuio_usb_input_batch_paket *input);
 
+/**
+ * Execute a full polling cycle (see piuio_usb_poll_full_cycle) and timestamp
+ * every transfer of it, e.g. to find out which of them dominates the latency
+ * of the cycle. Costs a few additional clock reads, use for debugging only.
+ *
+ * @param handle Valid handle of an opened PIUIO usb device
+ * @param output Pointer to an allocated buffer with the output data to send.
+ * @param input Pointer to an allocated buffer for the batched input data to
+ *              receive.
+ * @param profile Pointer to an allocated buffer for the timestamps. Transfers
+ *                not executed due to an error are left 0
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
+ *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
+ */
+result_t piuio_usb_poll_full_cycle_profile(
+    void *handle,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input,
+    struct piuio_usb_cycle_profile *profile);
+
+/**
+ * Execute a full polling cycle (see piuio_usb_poll_full_cycle) which is bounded
+ * by a deadline.
+ *
+ * Instead of blocking on a stalled transfer, failed transfers are retried with
+ * bounded backoff until the deadline of the cycle is reached. Sub-polls that
+ * did not complete in time are flagged as stale and their input pakets are left
+ * untouched, i.e. they keep the data of a previous cycle if the same buffer is
+ * reused. This degrades the freshness of the inputs on a flaky connection
+ * instead of stalling the caller. The cycle fails if no sub-poll completed,
+ * like piubtn_usb_poll_deadline for its single poll, and is not recorded as a
+ * cycle in the statistics then.
+ *
+ * @param handle Valid handle of an opened PIUIO usb device
+ * @param config Time bounds of the cycle
+ * @param output Pointer to an allocated buffer with the output data to send.
+ * @param input Pointer to an allocated buffer for the batched input data to
+ *              receive.
+ * @param stale_mask Pointer to a variable to return a bit mask of the sensor
+ *                   mask slots (bit n = input->pakets[n]) which did not
+ *                   complete in time. 0 if the full cycle completed,
+ *                   PIUIO_USB_STALE_MASK_ALL if none did
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, also if some slots are stale, ETIMEDOUT if
+ *         the deadline passed before any slot completed, EIO if all slots
+ *         transferred incomplete data, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
+ *         ENOMEM, ENOTSUP
+ */
+result_t piuio_usb_poll_full_cycle_deadline(
+    void *handle,
+    const struct piuio_usb_cycle_config *config,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input,
+    uint8_t *stale_mask);
+
+/**
+ * Hand the device back to the piuio kernel module when closing it, e.g. to
+ * switch to the piuio-kmod backend afterwards. Disabled by default, see
+ * pumpio_usb_set_reattach_kernel_driver.
+ *
+ * @param handle Valid handle of an opened PIUIO usb device
+ * @param reattach True to re-attach the kernel module on close
+ */
+void piuio_usb_set_reattach_kernel_driver(void *handle, bool reattach);
+
+/**
+ * Record the cycles, transfers and errors of an opened PIUIO usb device in the
+ * given statistics instead of the process-wide ones (see piuio-stats.h), e.g.
+ * to evaluate multiple devices individually.
+ *
+ * @param handle Valid handle of an opened PIUIO usb device
+ * @param stats Pointer to the statistics to record in, must stay valid until
+ *              the device is closed
+ */
+void piuio_usb_set_stats(void *handle, struct pumpio_stats *stats);
+
 /**
  * Close an opened PIUIO usb device.
  *
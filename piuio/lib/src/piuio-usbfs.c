@@ -0,0 +1,257 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "devices.h"
+#include "piuio-state.h"
+#include "piuio-stats.h"
+#include "piuio-usbfs.h"
+#include "time_.h"
+#include "usbfs.h"
+
+#define PIUIO_USBFS_TRANSFERS (PIUIO_SENSOR_MASK_TOTAL_COUNT * 2)
+
+struct piuio_usbfs_ctx {
+  void *usbfs;
+  /* Output per sub-poll with its sensor mask selected */
+  union piuio_output_paket outputs[PIUIO_SENSOR_MASK_TOTAL_COUNT];
+  struct pumpio_usbfs_control transfers[PIUIO_USBFS_TRANSFERS];
+  /* Outputs last sent, sensor mask cleared, to detect changes */
+  union piuio_output_paket output;
+  /* Inputs and start of the cycle in flight */
+  struct piuio_usb_input_batch_paket *input;
+  uint64_t start_ns;
+  /* Statistics to record in and start of the last cycle for its interval */
+  struct pumpio_stats *stats;
+  uint64_t last_cycle_ns;
+};
+
+static result_t piuio_usbfs_open_ctx(void **handle, const char *id)
+{
+  struct piuio_usbfs_ctx *ctx;
+  struct pumpio_usbfs_control *transfer;
+  result_t result;
+
+  ctx = (struct piuio_usbfs_ctx *) malloc(sizeof(struct piuio_usbfs_ctx));
+
+  if (ctx == NULL) {
+    return ENOMEM;
+  }
+
+  memset(ctx, 0, sizeof(struct piuio_usbfs_ctx));
+  ctx->stats = piuio_stats();
+
+  result = pumpio_usbfs_open(
+      &ctx->usbfs,
+      PUMPIO_PIUIO_VID,
+      PUMPIO_PIUIO_PID,
+      id,
+      PUMPIO_DEVICE_CONFIG,
+      PUMPIO_DEVICE_IFACE);
+
+  if (RESULT_IS_ERROR(result)) {
+    free(ctx);
+    return result;
+  }
+
+  // The transfers of a cycle never change, only their data
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    transfer = &ctx->transfers[i * 2];
+    transfer->request_type = PUMPIO_CTRL_TYPE_OUT;
+    transfer->request = PUMPIO_CTRL_REQUEST;
+    transfer->data = ctx->outputs[i].raw;
+    transfer->len = sizeof(ctx->outputs[i].raw);
+
+    transfer = &ctx->transfers[i * 2 + 1];
+    transfer->request_type = PUMPIO_CTRL_TYPE_IN;
+    transfer->request = PUMPIO_CTRL_REQUEST;
+    transfer->len = PIUIO_INPUT_PAKET_SIZE;
+  }
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_usbfs_open(void **handle)
+{
+  assert(handle != NULL);
+
+  return piuio_usbfs_open_ctx(handle, NULL);
+}
+
+result_t piuio_usbfs_open_id(void **handle, const char *id)
+{
+  assert(handle != NULL);
+  assert(id != NULL);
+
+  return piuio_usbfs_open_ctx(handle, id);
+}
+
+/**
+ * Set up the transfers of a cycle for the given outputs and inputs
+ */
+static void piuio_usbfs_prepare(
+    struct piuio_usbfs_ctx *ctx,
+    const union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    // Cycle sensor mask, itg and piu have sensor mask on same bits
+    ctx->outputs[i] = *output;
+    ctx->outputs[i].piu.sensor_mask = i;
+    ctx->transfers[i * 2 + 1].data = input->pakets[i].raw;
+  }
+
+  ctx->input = input;
+  ctx->start_ns = pumpio_time_now_ns();
+}
+
+/**
+ * Validate the transfers of a completed cycle and post-process its inputs
+ */
+static result_t piuio_usbfs_finish(struct piuio_usbfs_ctx *ctx, result_t result)
+{
+  uint64_t end_ns;
+
+  end_ns = pumpio_time_now_ns();
+
+  if (RESULT_IS_ERROR(result)) {
+    pumpio_stats_record_error(ctx->stats, result);
+    return result;
+  }
+
+  for (uint8_t i = 0; i < PIUIO_USBFS_TRANSFERS; i++) {
+    if (ctx->transfers[i].len_res != ctx->transfers[i].len) {
+      pumpio_stats_record_error(ctx->stats, EIO);
+      return EIO;
+    }
+  }
+
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    piuio_state_invert_pull_ups(&ctx->input->pakets[i]);
+  }
+
+  // Outputs are latched by the first transfer. Its completion time is not
+  // known, count the whole cycle
+  if (memcmp(ctx->output.raw, ctx->outputs[0].raw, sizeof(ctx->output.raw))) {
+    ctx->output = ctx->outputs[0];
+    pumpio_stats_record_output(ctx->stats, end_ns - ctx->start_ns);
+  }
+
+  pumpio_stats_record_cycle(
+      ctx->stats, &ctx->last_cycle_ns, ctx->start_ns, end_ns);
+
+  return RESULT_SUCCESS;
+}
+
+result_t piuio_usbfs_poll_full_cycle(
+    void *handle,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  struct piuio_usbfs_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(output != NULL);
+  assert(input != NULL);
+
+  ctx = (struct piuio_usbfs_ctx *) handle;
+
+  piuio_usbfs_prepare(ctx, output, input);
+
+  result = pumpio_usbfs_control_batch(
+      ctx->usbfs,
+      ctx->transfers,
+      PIUIO_USBFS_TRANSFERS,
+      PIUIO_USBFS_CYCLE_TIMEOUT_MS);
+
+  result = piuio_usbfs_finish(ctx, result);
+
+  if (RESULT_IS_SUCCESS(result)) {
+    output->piu.sensor_mask = PIUIO_SENSOR_MASK_TOTAL_COUNT - 1;
+  }
+
+  return result;
+}
+
+int piuio_usbfs_fd(void *handle)
+{
+  assert(handle != NULL);
+
+  return pumpio_usbfs_fd(((struct piuio_usbfs_ctx *) handle)->usbfs);
+}
+
+result_t piuio_usbfs_cycle_submit(
+    void *handle,
+    const union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input)
+{
+  struct piuio_usbfs_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(output != NULL);
+  assert(input != NULL);
+
+  ctx = (struct piuio_usbfs_ctx *) handle;
+
+  piuio_usbfs_prepare(ctx, output, input);
+
+  result = pumpio_usbfs_submit_batch(
+      ctx->usbfs, ctx->transfers, PIUIO_USBFS_TRANSFERS);
+
+  if (RESULT_IS_ERROR(result)) {
+    pumpio_stats_record_error(ctx->stats, result);
+  }
+
+  return result;
+}
+
+result_t piuio_usbfs_cycle_reap(void *handle)
+{
+  struct piuio_usbfs_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_usbfs_ctx *) handle;
+
+  result = pumpio_usbfs_reap_batch(ctx->usbfs);
+
+  if (result == EAGAIN) {
+    return EAGAIN;
+  }
+
+  return piuio_usbfs_finish(ctx, result);
+}
+
+void piuio_usbfs_cycle_cancel(void *handle)
+{
+  assert(handle != NULL);
+
+  pumpio_usbfs_cancel_batch(((struct piuio_usbfs_ctx *) handle)->usbfs);
+}
+
+void piuio_usbfs_set_stats(void *handle, struct pumpio_stats *stats)
+{
+  assert(handle != NULL);
+  assert(stats != NULL);
+
+  ((struct piuio_usbfs_ctx *) handle)->stats = stats;
+}
+
+void piuio_usbfs_close(void *handle)
+{
+  struct piuio_usbfs_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct piuio_usbfs_ctx *) handle;
+
+  pumpio_usbfs_close(ctx->usbfs);
+  free(ctx);
+}
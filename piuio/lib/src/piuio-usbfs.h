@@ -0,0 +1,145 @@
+/**
+ * Device level abstraction for opening, polling and closing a PIUIO usb device
+ * through the kernel's usbfs interface, bypassing libusb (see usbfs.h).
+ *
+ * All eight transfers of a full polling cycle are submitted to the kernel at
+ * once and reaped in bulk. The kernel executes them in order, i.e. the cycle
+ * is equivalent to the one of piuio_usb_poll_full_cycle, but with a single
+ * wake up of the calling thread per cycle and without libusb's per-transfer
+ * overhead. This gets close to the overhead of the kernel module without
+ * requiring an out-of-tree driver.
+ *
+ * Cycles can also be submitted and reaped asynchronously to drive several
+ * devices from a single thread, see piuio-loop.h.
+ *
+ * Permissions are the same as for the libusb backend, i.e. write access to the
+ * device node /dev/bus/usb/BBB/DDD.
+ */
+#ifndef PIUIO_USBFS_H_
+#define PIUIO_USBFS_H_
+
+#include <stdint.h>
+
+#include "piuio-usb.h"
+#include "piuio.h"
+#include "result.h"
+
+/**
+ * Default timeout of a full polling cycle in ms
+ */
+#define PIUIO_USBFS_CYCLE_TIMEOUT_MS 10000
+
+/**
+ * Open the first PIUIO device found through usbfs. A kernel driver bound to
+ * the device, e.g. the piuio kernel module, is detached until the device is
+ * closed.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_usbfs_close.
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOENT, EACCES, EBUSY, ENOMEM, any error of
+ *         open or ioctl
+ */
+result_t piuio_usbfs_open(void **handle);
+
+/**
+ * Open a specific PIUIO device through usbfs. Use this if multiple PIUIO
+ * devices are connected to the same host.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if the call is successful. The caller is
+ *               responsible for managing the handle and free it using
+ *               piuio_usbfs_close.
+ * @param id Identifier of the device, either its path (e.g. "1-2.4") or its
+ *           serial number, see piuio_usb_enumerate
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOENT, EACCES, EBUSY, ENOMEM, any error of
+ *         open or ioctl
+ */
+result_t piuio_usbfs_open_id(void **handle, const char *id);
+
+/**
+ * Run a full polling cycle, see piuio_usb_poll_full_cycle. The function
+ * matches piuio_poller_poll_func_t to drive the device with the poller.
+ *
+ * @param handle Valid handle of an opened PIUIO usbfs device
+ * @param output Pointer to an allocated buffer with the output data to send.
+ *               The sensor mask is set to the one of the last sub-poll
+ * @param input Pointer to an allocated buffer for the input data to receive
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, ETIMEDOUT, ENODEV, EPIPE, any error of
+ *         ioctl
+ */
+result_t piuio_usbfs_poll_full_cycle(
+    void *handle,
+    union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Get the file descriptor of the device to wait for the completion of a cycle
+ * submitted with piuio_usbfs_cycle_submit, see pumpio_usbfs_fd.
+ *
+ * @param handle Valid handle of an opened PIUIO usbfs device
+ * @return File descriptor owned by the handle, do not close it
+ */
+int piuio_usbfs_fd(void *handle);
+
+/**
+ * Submit a full polling cycle without waiting for its completion. Only a
+ * single cycle can be in flight per device.
+ *
+ * @param handle Valid handle of an opened PIUIO usbfs device
+ * @param output Output data to send with all sub-polls, copied by the call
+ * @param input Pointer to an allocated buffer for the input data to receive.
+ *              Must stay valid until the cycle is reaped or cancelled
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EBUSY if a cycle is in flight already,
+ *         ENODEV, any error of ioctl
+ */
+result_t piuio_usbfs_cycle_submit(
+    void *handle,
+    const union piuio_output_paket *output,
+    struct piuio_usb_input_batch_paket *input);
+
+/**
+ * Collect the cycle in flight without blocking. Once completed, the inputs
+ * are available with inverted pull ups like with piuio_usbfs_poll_full_cycle.
+ *
+ * @param handle Valid handle of an opened PIUIO usbfs device
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EAGAIN if the cycle is still in flight,
+ *         EINVAL if no cycle is in flight, EIO, ENODEV, EPIPE, any error of
+ *         ioctl
+ */
+result_t piuio_usbfs_cycle_reap(void *handle);
+
+/**
+ * Cancel the cycle in flight, if any, and wait for the kernel to return its
+ * transfers.
+ *
+ * @param handle Valid handle of an opened PIUIO usbfs device
+ */
+void piuio_usbfs_cycle_cancel(void *handle);
+
+/**
+ * Record the cycles, outputs and errors of an opened PIUIO usbfs device in the
+ * given statistics instead of the process-wide ones (see piuio-stats.h), e.g.
+ * to evaluate multiple devices individually.
+ *
+ * @param handle Valid handle of an opened PIUIO usbfs device
+ * @param stats Pointer to the statistics to record in, must stay valid until
+ *              the device is closed
+ */
+void piuio_usbfs_set_stats(void *handle, struct pumpio_stats *stats);
+
+/**
+ * Close an opened PIUIO usbfs device and re-attach the kernel driver detached
+ * on open.
+ *
+ * @param handle Valid handle of the opened PIUIO usbfs device to close
+ */
+void piuio_usbfs_close(void *handle);
+
+#endif
@@ -0,0 +1,1169 @@
+/**
+ * Header-only C++17 interface of the PIUIO library.
+ *
+ * Wraps the device backends, the poller and the non-blocking polling API in
+ * RAII types and maps the packed state (see piuio-state.h) and the output word
+ * (see piuio-lights.h) to game specific types. The game is a template
+ * parameter, i.e. all accessors fold into constant masks on the 64-bit words
+ * at compile time and lights of one game can't be sent to the other:
+ *
+ *   using Itg = piuio::Piuio<piuio::Game::Itg>;
+ *
+ *   piuio::UsbDevice device;
+ *   Itg::Poller poller(device);
+ *
+ *   Itg::State state = poller.state();
+ *
+ *   if (state.panel(piuio::Player::P1, Itg::Panel::Up)) {
+ *     poller.lights().set(Itg::Light::PadP1Up | Itg::Light::Bass);
+ *   }
+ *
+ * Errors of the C functions are thrown as std::system_error with the errno
+ * style error code, see result.h.
+ */
+#ifndef PIUIO_HPP
+#define PIUIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <optional>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "piuio-history.h"
+#include "piuio-kmod.h"
+#include "piuio-latch.h"
+#include "piuio-lights.h"
+#include "piuio-poll.h"
+#include "piuio-poller.h"
+#include "piuio-state.h"
+#include "piuio-usb.h"
+#include "piuio-usbfs.h"
+#include "piuio.h"
+#include "result.h"
+}
+
+namespace piuio {
+
+enum class Game {
+  Piu,
+  Itg,
+};
+
+enum class Player : uint8_t {
+  P1 = 0,
+  P2 = 1,
+};
+
+/**
+ * Sensor of a panel, i.e. the sensor mask the input was polled with
+ */
+enum class Sensor : uint8_t {
+  Right = PIUIO_SENSOR_MASK_RIGHT,
+  Left = PIUIO_SENSOR_MASK_LEFT,
+  Down = PIUIO_SENSOR_MASK_DOWN,
+  Up = PIUIO_SENSOR_MASK_UP,
+};
+
+namespace piu {
+
+/**
+ * Pad panels of Pump It Up, the value is the bit of the input byte
+ */
+enum class Panel : uint8_t {
+  LeftUp = 0,
+  RightUp = 1,
+  Center = 2,
+  LeftDown = 3,
+  RightDown = 4,
+};
+
+enum class Button : uint8_t {
+  Test,
+  Service,
+  Clear,
+  Coin1,
+  Coin2,
+};
+
+enum class Light : uint64_t {
+  PadP1LeftUp = PIUIO_LIGHTS_PIU_PAD_P1_LU,
+  PadP1RightUp = PIUIO_LIGHTS_PIU_PAD_P1_RU,
+  PadP1Center = PIUIO_LIGHTS_PIU_PAD_P1_CN,
+  PadP1LeftDown = PIUIO_LIGHTS_PIU_PAD_P1_LD,
+  PadP1RightDown = PIUIO_LIGHTS_PIU_PAD_P1_RD,
+  PadP2LeftUp = PIUIO_LIGHTS_PIU_PAD_P2_LU,
+  PadP2RightUp = PIUIO_LIGHTS_PIU_PAD_P2_RU,
+  PadP2Center = PIUIO_LIGHTS_PIU_PAD_P2_CN,
+  PadP2LeftDown = PIUIO_LIGHTS_PIU_PAD_P2_LD,
+  PadP2RightDown = PIUIO_LIGHTS_PIU_PAD_P2_RD,
+  Bass = PIUIO_LIGHTS_PIU_BASS,
+  TopLampR1 = PIUIO_LIGHTS_PIU_TOP_LAMP_R1,
+  TopLampR2 = PIUIO_LIGHTS_PIU_TOP_LAMP_R2,
+  TopLampL1 = PIUIO_LIGHTS_PIU_TOP_LAMP_L1,
+  TopLampL2 = PIUIO_LIGHTS_PIU_TOP_LAMP_L2,
+  CoinCounter1 = PIUIO_LIGHTS_PIU_COIN_COUNTER_1,
+  CoinCounter2 = PIUIO_LIGHTS_PIU_COIN_COUNTER_2,
+};
+
+} // namespace piu
+
+namespace itg {
+
+/**
+ * Pad panels of In The Groove, the value is the bit of the input byte
+ */
+enum class Panel : uint8_t {
+  Up = 0,
+  Down = 1,
+  Left = 2,
+  Right = 3,
+};
+
+enum class Button : uint8_t {
+  Test,
+  Service,
+  Clear,
+  Coin,
+  MenuP1Start,
+  MenuP1Back,
+  MenuP1Left,
+  MenuP1Right,
+  MenuP2Start,
+  MenuP2Back,
+  MenuP2Left,
+  MenuP2Right,
+};
+
+enum class Light : uint64_t {
+  PadP1Up = PIUIO_LIGHTS_ITG_PAD_P1_UP,
+  PadP1Down = PIUIO_LIGHTS_ITG_PAD_P1_DOWN,
+  PadP1Left = PIUIO_LIGHTS_ITG_PAD_P1_LEFT,
+  PadP1Right = PIUIO_LIGHTS_ITG_PAD_P1_RIGHT,
+  PadP2Up = PIUIO_LIGHTS_ITG_PAD_P2_UP,
+  PadP2Down = PIUIO_LIGHTS_ITG_PAD_P2_DOWN,
+  PadP2Left = PIUIO_LIGHTS_ITG_PAD_P2_LEFT,
+  PadP2Right = PIUIO_LIGHTS_ITG_PAD_P2_RIGHT,
+  Bass = PIUIO_LIGHTS_ITG_BASS,
+  TopLampR1 = PIUIO_LIGHTS_ITG_TOP_LAMP_R1,
+  TopLampR2 = PIUIO_LIGHTS_ITG_TOP_LAMP_R2,
+  TopLampL1 = PIUIO_LIGHTS_ITG_TOP_LAMP_L1,
+  TopLampL2 = PIUIO_LIGHTS_ITG_TOP_LAMP_L2,
+  CoinCounter = PIUIO_LIGHTS_ITG_COIN_COUNTER,
+};
+
+} // namespace itg
+
+/**
+ * Input and output types of a game
+ */
+template <Game G>
+struct Layout;
+
+template <>
+struct Layout<Game::Piu> {
+  using Panel = piu::Panel;
+  using Button = piu::Button;
+  using Light = piu::Light;
+};
+
+template <>
+struct Layout<Game::Itg> {
+  using Panel = itg::Panel;
+  using Button = itg::Button;
+  using Light = itg::Light;
+};
+
+namespace detail {
+
+constexpr uint64_t operator_1_bit(unsigned bit) noexcept
+{
+  return UINT64_C(1) << (PIUIO_STATE_OPERATOR_1_SHIFT + bit);
+}
+
+constexpr uint64_t operator_3_bit(unsigned bit) noexcept
+{
+  return UINT64_C(1) << (PIUIO_STATE_OPERATOR_3_SHIFT + bit);
+}
+
+/**
+ * Bits 5-7 of the input byte of a player, or'd over all sensor masks
+ */
+constexpr uint64_t player_extra_bit(Player player, unsigned bit) noexcept
+{
+  return UINT64_C(1)
+      << (PIUIO_STATE_PLAYER_EXTRA_SHIFT + static_cast<unsigned>(player) * 3 +
+          bit - PIUIO_STATE_PANEL_COUNT);
+}
+
+constexpr uint64_t button_mask(piu::Button button) noexcept
+{
+  switch (button) {
+    case piu::Button::Test:
+      return operator_1_bit(1);
+    case piu::Button::Service:
+      return operator_1_bit(6);
+    case piu::Button::Clear:
+      return operator_1_bit(7);
+    case piu::Button::Coin1:
+      return operator_1_bit(2);
+    case piu::Button::Coin2:
+      return operator_3_bit(2);
+  }
+
+  return 0;
+}
+
+constexpr uint64_t button_mask(itg::Button button) noexcept
+{
+  switch (button) {
+    case itg::Button::Test:
+      return operator_1_bit(1);
+    case itg::Button::Service:
+      return operator_1_bit(6);
+    case itg::Button::Clear:
+      return operator_1_bit(7);
+    case itg::Button::Coin:
+      return operator_1_bit(2);
+    // Start shares the input byte with the pad sensors, any sensor mask
+    case itg::Button::MenuP1Start:
+      return PIUIO_STATE_PANEL_MASK(0, 4);
+    case itg::Button::MenuP1Back:
+      return player_extra_bit(Player::P1, 5);
+    case itg::Button::MenuP1Left:
+      return player_extra_bit(Player::P1, 6);
+    case itg::Button::MenuP1Right:
+      return player_extra_bit(Player::P1, 7);
+    case itg::Button::MenuP2Start:
+      return PIUIO_STATE_PANEL_MASK(1, 4);
+    case itg::Button::MenuP2Back:
+      return player_extra_bit(Player::P2, 5);
+    case itg::Button::MenuP2Left:
+      return player_extra_bit(Player::P2, 6);
+    case itg::Button::MenuP2Right:
+      return player_extra_bit(Player::P2, 7);
+  }
+
+  return 0;
+}
+
+[[noreturn]] inline void throw_error(result_t result, const char *what)
+{
+  throw std::system_error(result, std::generic_category(), what);
+}
+
+inline void check(result_t result, const char *what)
+{
+  if (RESULT_IS_ERROR(result)) {
+    throw_error(result, what);
+  }
+}
+
+} // namespace detail
+
+/**
+ * Non-owning view of a contiguous buffer, like std::span of C++20
+ */
+template <typename T>
+class Span {
+public:
+  constexpr Span() noexcept = default;
+
+  constexpr Span(T *data, size_t size) noexcept : data_(data), size_(size) {}
+
+  template <size_t N>
+  constexpr Span(T (&array)[N]) noexcept : data_(array), size_(N)
+  {
+  }
+
+  constexpr T *data() const noexcept { return data_; }
+  constexpr size_t size() const noexcept { return size_; }
+  constexpr bool empty() const noexcept { return size_ == 0; }
+  constexpr T *begin() const noexcept { return data_; }
+  constexpr T *end() const noexcept { return data_ + size_; }
+  constexpr T &operator[](size_t index) const noexcept { return data_[index]; }
+
+private:
+  T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+/**
+ * Packed state of a full polling cycle (see piuio-state.h) with the inputs of
+ * a game
+ */
+template <Game G>
+class State {
+public:
+  using Panel = typename Layout<G>::Panel;
+  using Button = typename Layout<G>::Button;
+
+  constexpr State() noexcept = default;
+  constexpr explicit State(uint64_t raw) noexcept : raw_(raw) {}
+
+  /**
+   * Mask of all four sensors of a panel
+   */
+  static constexpr uint64_t mask(Player player, Panel panel) noexcept
+  {
+    return PIUIO_STATE_PANEL_MASK(
+        static_cast<unsigned>(player), static_cast<unsigned>(panel));
+  }
+
+  /**
+   * Mask of a single sensor of a panel
+   */
+  static constexpr uint64_t
+  mask(Player player, Panel panel, Sensor sensor) noexcept
+  {
+    return UINT64_C(1) << PIUIO_STATE_SENSOR_BIT(
+               static_cast<unsigned>(sensor),
+               static_cast<unsigned>(player),
+               static_cast<unsigned>(panel));
+  }
+
+  static constexpr uint64_t mask(Button button) noexcept
+  {
+    return detail::button_mask(button);
+  }
+
+  constexpr uint64_t raw() const noexcept { return raw_; }
+
+  /**
+   * Any sensor of the panel is active
+   */
+  constexpr bool panel(Player player, Panel panel) const noexcept
+  {
+    return raw_ & mask(player, panel);
+  }
+
+  constexpr bool
+  sensor(Player player, Panel panel, Sensor sensor) const noexcept
+  {
+    return raw_ & mask(player, panel, sensor);
+  }
+
+  constexpr bool button(Button button) const noexcept
+  {
+    return raw_ & mask(button);
+  }
+
+  constexpr bool any(uint64_t mask) const noexcept { return raw_ & mask; }
+
+  constexpr bool operator==(State other) const noexcept
+  {
+    return raw_ == other.raw_;
+  }
+
+  constexpr bool operator!=(State other) const noexcept
+  {
+    return raw_ != other.raw_;
+  }
+
+private:
+  uint64_t raw_ = 0;
+};
+
+/**
+ * Set of outputs of a game, i.e. an output word (see piuio-lights.h)
+ */
+template <Game G>
+class LightSet {
+public:
+  using Light = typename Layout<G>::Light;
+
+  constexpr LightSet() noexcept = default;
+
+  constexpr LightSet(Light light) noexcept : word_(static_cast<uint64_t>(light))
+  {
+  }
+
+  constexpr uint64_t word() const noexcept { return word_; }
+
+  constexpr bool contains(Light light) const noexcept
+  {
+    return word_ & static_cast<uint64_t>(light);
+  }
+
+  friend constexpr LightSet operator|(LightSet a, LightSet b) noexcept
+  {
+    return from_word(a.word_ | b.word_);
+  }
+
+  friend constexpr LightSet operator&(LightSet a, LightSet b) noexcept
+  {
+    return from_word(a.word_ & b.word_);
+  }
+
+  constexpr LightSet without(LightSet other) const noexcept
+  {
+    return from_word(word_ & ~other.word_);
+  }
+
+  constexpr bool operator==(LightSet other) const noexcept
+  {
+    return word_ == other.word_;
+  }
+
+  constexpr bool operator!=(LightSet other) const noexcept
+  {
+    return word_ != other.word_;
+  }
+
+  /**
+   * Output paket with these outputs, sensor mask 0
+   */
+  union piuio_output_paket paket() const noexcept
+  {
+    union piuio_output_paket paket = {};
+
+    for (size_t i = 0; i < PIUIO_OUTPUT_PAKET_SIZE; i++) {
+      paket.raw[i] = static_cast<uint8_t>(word_ >> (i * 8));
+    }
+
+    return paket;
+  }
+
+  static constexpr LightSet from_word(uint64_t word) noexcept
+  {
+    LightSet set;
+
+    set.word_ = word & ~PIUIO_LIGHTS_SENSOR_MASK;
+
+    return set;
+  }
+
+private:
+  uint64_t word_ = 0;
+};
+
+// Next to the light enums to be found by argument-dependent lookup
+namespace piu {
+
+constexpr LightSet<Game::Piu> operator|(Light a, Light b) noexcept
+{
+  return LightSet<Game::Piu>(a) | LightSet<Game::Piu>(b);
+}
+
+} // namespace piu
+
+namespace itg {
+
+constexpr LightSet<Game::Itg> operator|(Light a, Light b) noexcept
+{
+  return LightSet<Game::Itg>(a) | LightSet<Game::Itg>(b);
+}
+
+} // namespace itg
+
+/**
+ * Lights of a running poller, changed from any thread (see piuio-lights.h)
+ */
+template <Game G>
+class Lights {
+public:
+  explicit Lights(struct piuio_lights *lights) noexcept : lights_(lights) {}
+
+  void set(LightSet<G> lights) noexcept
+  {
+    piuio_lights_set(lights_, lights.word());
+  }
+
+  void clear(LightSet<G> lights) noexcept
+  {
+    piuio_lights_clear(lights_, lights.word());
+  }
+
+  /**
+   * Replace the outputs of a group in a single atomic update
+   */
+  void replace(LightSet<G> group, LightSet<G> lights) noexcept
+  {
+    piuio_lights_replace(lights_, group.word(), lights.word());
+  }
+
+  LightSet<G> get() const noexcept
+  {
+    return LightSet<G>::from_word(piuio_lights_get(lights_));
+  }
+
+private:
+  struct piuio_lights *lights_;
+};
+
+/**
+ * Cycle of the history in which inputs changed
+ */
+template <Game G>
+struct Event {
+  uint64_t time_ns;
+  State<G> state;
+  State<G> pressed;
+  State<G> released;
+};
+
+/**
+ * Range of the cycles of a history copy in which inputs changed, see
+ * History::events_after
+ */
+template <Game G>
+class Events {
+public:
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Event<G>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Event<G> *;
+    using reference = Event<G>;
+
+    Iterator(
+        const struct piuio_history_sample *pos,
+        const struct piuio_history_sample *end,
+        uint64_t previous) noexcept :
+        pos_(pos), end_(end), previous_(previous)
+    {
+      skip_unchanged();
+    }
+
+    Event<G> operator*() const noexcept
+    {
+      return Event<G>{
+          pos_->time_ns,
+          State<G>(pos_->state),
+          State<G>(pos_->state & ~previous_),
+          State<G>(previous_ & ~pos_->state)};
+    }
+
+    Iterator &operator++() noexcept
+    {
+      previous_ = pos_->state;
+      pos_++;
+      skip_unchanged();
+
+      return *this;
+    }
+
+    bool operator==(const Iterator &other) const noexcept
+    {
+      return pos_ == other.pos_;
+    }
+
+    bool operator!=(const Iterator &other) const noexcept
+    {
+      return pos_ != other.pos_;
+    }
+
+  private:
+    void skip_unchanged() noexcept
+    {
+      while (pos_ != end_ && pos_->state == previous_) {
+        pos_++;
+      }
+    }
+
+    const struct piuio_history_sample *pos_;
+    const struct piuio_history_sample *end_;
+    uint64_t previous_;
+  };
+
+  /**
+   * @param samples Cycles, oldest first
+   * @param previous State of the cycle before the first one
+   */
+  Events(Span<const struct piuio_history_sample> samples, State<G> previous) :
+      samples_(samples), previous_(previous)
+  {
+  }
+
+  Iterator begin() const noexcept
+  {
+    return Iterator(samples_.begin(), samples_.end(), previous_.raw());
+  }
+
+  Iterator end() const noexcept
+  {
+    return Iterator(samples_.end(), samples_.end(), previous_.raw());
+  }
+
+private:
+  Span<const struct piuio_history_sample> samples_;
+  State<G> previous_;
+};
+
+/**
+ * History of a running poller (see piuio-history.h)
+ */
+template <Game G>
+class History {
+public:
+  explicit History(struct piuio_history *history) noexcept : history_(history)
+  {
+  }
+
+  /**
+   * State current at a point in time, none if not retained (anymore)
+   */
+  std::optional<State<G>> state_at(uint64_t time_ns) const noexcept
+  {
+    uint64_t state;
+
+    if (RESULT_IS_ERROR(piuio_history_state_at(history_, time_ns, &state))) {
+      return std::nullopt;
+    }
+
+    return State<G>(state);
+  }
+
+  /**
+   * Time of the first press of any bit of the mask after a point in time,
+   * none if there was none or the time is not retained (anymore)
+   */
+  std::optional<uint64_t>
+  first_press_after(uint64_t mask, uint64_t time_ns) const noexcept
+  {
+    uint64_t press_time_ns;
+    result_t result;
+
+    result = piuio_history_first_press_after(
+        history_, mask, time_ns, &press_time_ns);
+
+    if (RESULT_IS_ERROR(result)) {
+      return std::nullopt;
+    }
+
+    return press_time_ns;
+  }
+
+  /**
+   * Copy the cycles polled after a point in time to a buffer, oldest first.
+   * If the buffer is too small, only the most recent cycles are copied.
+   *
+   * @return The part of the buffer filled
+   */
+  Span<const struct piuio_history_sample> copy_after(
+      uint64_t time_ns, Span<struct piuio_history_sample> buffer) const
+  {
+    size_t count;
+
+    detail::check(
+        piuio_history_copy_after(
+            history_, time_ns, buffer.data(), buffer.size(), &count, nullptr),
+        "Copying PIUIO history failed");
+
+    return Span<const struct piuio_history_sample>(buffer.data(), count);
+  }
+
+  /**
+   * Copy the cycles polled after a point in time to a buffer and iterate the
+   * ones in which inputs changed. If the buffer is too small, the edges are
+   * relative to the cycle before the most recent cycles copied.
+   */
+  Events<G> events_after(
+      uint64_t time_ns, Span<struct piuio_history_sample> buffer) const
+  {
+    size_t count;
+    uint64_t previous;
+
+    detail::check(
+        piuio_history_copy_after(
+            history_,
+            time_ns,
+            buffer.data(),
+            buffer.size(),
+            &count,
+            &previous),
+        "Copying PIUIO history failed");
+
+    return Events<G>(
+        Span<const struct piuio_history_sample>(buffer.data(), count),
+        State<G>(previous));
+  }
+
+private:
+  struct piuio_history *history_;
+};
+
+/**
+ * Edges of a poller's latch accumulated since the previous read
+ */
+template <Game G>
+class LatchResult {
+public:
+  LatchResult() noexcept : result_() {}
+
+  State<G> pressed() const noexcept { return State<G>(result_.pressed); }
+  State<G> released() const noexcept { return State<G>(result_.released); }
+
+  /**
+   * Number of presses of every bit of the packed state
+   */
+  Span<const uint32_t> press_counts() const noexcept
+  {
+    return Span<const uint32_t>(result_.press_count);
+  }
+
+  struct piuio_latch_result *get() noexcept { return &result_; }
+
+private:
+  struct piuio_latch_result result_;
+};
+
+/**
+ * Reader registered with a poller's latch (see piuio-latch.h)
+ */
+template <Game G>
+class LatchReader {
+public:
+  explicit LatchReader(struct piuio_latch *latch) : reader_()
+  {
+    detail::check(
+        piuio_latch_reader_open(latch, &reader_),
+        "Registering PIUIO latch reader failed");
+  }
+
+  ~LatchReader() { reset(); }
+
+  LatchReader(LatchReader &&other) noexcept : reader_(other.reader_)
+  {
+    other.reader_.latch = nullptr;
+  }
+
+  LatchReader &operator=(LatchReader &&other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      reader_ = other.reader_;
+      other.reader_.latch = nullptr;
+    }
+
+    return *this;
+  }
+
+  LatchReader(const LatchReader &) = delete;
+  LatchReader &operator=(const LatchReader &) = delete;
+
+  LatchResult<G> read() noexcept
+  {
+    LatchResult<G> result;
+
+    piuio_latch_reader_read(&reader_, result.get());
+
+    return result;
+  }
+
+private:
+  void reset() noexcept
+  {
+    if (reader_.latch != nullptr) {
+      piuio_latch_reader_close(&reader_);
+      reader_.latch = nullptr;
+    }
+  }
+
+  struct piuio_latch_reader reader_;
+};
+
+namespace detail {
+
+struct UsbBackend {
+  using Handle = void *;
+
+  static constexpr Handle invalid = nullptr;
+  static constexpr piuio_poller_poll_func_t poll = piuio_usb_poll_full_cycle;
+
+  static result_t open(Handle *handle) { return piuio_usb_open(handle); }
+
+  static result_t open_id(Handle *handle, const char *id)
+  {
+    return piuio_usb_open_id(handle, id);
+  }
+
+  static void close(Handle handle) { piuio_usb_close(handle); }
+
+  static void *ctx(Handle handle) noexcept { return handle; }
+
+  static result_t open_poll(void **poll, Handle handle)
+  {
+    return piuio_poll_open_usb(poll, handle);
+  }
+};
+
+struct UsbfsBackend {
+  using Handle = void *;
+
+  static constexpr Handle invalid = nullptr;
+  static constexpr piuio_poller_poll_func_t poll = piuio_usbfs_poll_full_cycle;
+
+  static result_t open(Handle *handle) { return piuio_usbfs_open(handle); }
+
+  static result_t open_id(Handle *handle, const char *id)
+  {
+    return piuio_usbfs_open_id(handle, id);
+  }
+
+  static void close(Handle handle) { piuio_usbfs_close(handle); }
+
+  static void *ctx(Handle handle) noexcept { return handle; }
+
+  static result_t open_poll(void **poll, Handle handle)
+  {
+    return piuio_poll_open_usbfs(poll, handle);
+  }
+};
+
+struct KmodBackend {
+  using Handle = void *;
+
+  static constexpr Handle invalid = nullptr;
+  static constexpr piuio_poller_poll_func_t poll = piuio_poller_poll_kmod;
+
+  static result_t open(Handle *handle) { return piuio_kmod_open(handle); }
+
+  /**
+   * Either the index N of /dev/piuioN or the usb path, e.g. "1-2.4"
+   */
+  static result_t open_id(Handle *handle, const char *id)
+  {
+    char *end;
+    unsigned long index;
+
+    index = strtoul(id, &end, 10);
+
+    if (*id != '\0' && *end == '\0' && index <= UINT8_MAX) {
+      return piuio_kmod_open_index(handle, static_cast<uint8_t>(index));
+    }
+
+    return piuio_kmod_open_path(handle, id);
+  }
+
+  static void close(Handle handle) { piuio_kmod_close(handle); }
+
+  static void *ctx(Handle handle) noexcept { return handle; }
+
+  static result_t open_poll(void **poll, Handle handle)
+  {
+    return piuio_poll_open_kmod(poll, handle);
+  }
+};
+
+} // namespace detail
+
+/**
+ * Opened PIUIO device of a backend, closed on destruction
+ */
+template <typename Backend>
+class Device {
+public:
+  using Handle = typename Backend::Handle;
+
+  /**
+   * Open the first device found
+   */
+  Device()
+  {
+    detail::check(Backend::open(&handle_), "Opening PIUIO failed");
+  }
+
+  /**
+   * Open a specific device, see the open_id function of the backend
+   */
+  explicit Device(const char *id)
+  {
+    detail::check(Backend::open_id(&handle_, id), "Opening PIUIO failed");
+  }
+
+  ~Device() { reset(); }
+
+  Device(Device &&other) noexcept :
+      handle_(std::exchange(other.handle_, Backend::invalid))
+  {
+  }
+
+  Device &operator=(Device &&other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      handle_ = std::exchange(other.handle_, Backend::invalid);
+    }
+
+    return *this;
+  }
+
+  Device(const Device &) = delete;
+  Device &operator=(const Device &) = delete;
+
+  /**
+   * Take ownership of a handle opened with the C API, e.g. a simulated device
+   * opened with piuio_sim_open
+   */
+  static Device adopt(Handle handle) noexcept { return Device(handle, 0); }
+
+  Handle handle() const noexcept { return handle_; }
+
+  piuio_poller_poll_func_t poll_func() const noexcept { return Backend::poll; }
+
+  void *poll_ctx() const noexcept { return Backend::ctx(handle_); }
+
+  /**
+   * Open a poll handle of the non-blocking polling API, see piuio-poll.h
+   */
+  result_t open_poll(void **poll) const
+  {
+    return Backend::open_poll(poll, handle_);
+  }
+
+  /**
+   * Run a full polling cycle blocking the caller
+   */
+  template <Game G>
+  State<G> poll(LightSet<G> lights)
+  {
+    union piuio_output_paket output;
+    struct piuio_usb_input_batch_paket input;
+
+    output = lights.paket();
+
+    detail::check(
+        Backend::poll(Backend::ctx(handle_), &output, &input),
+        "Polling PIUIO failed");
+
+    return State<G>(piuio_state_decode(&input));
+  }
+
+private:
+  Device(Handle handle, int) noexcept : handle_(handle) {}
+
+  void reset() noexcept
+  {
+    if (handle_ != Backend::invalid) {
+      Backend::close(handle_);
+      handle_ = Backend::invalid;
+    }
+  }
+
+  Handle handle_ = Backend::invalid;
+};
+
+using UsbDevice = Device<detail::UsbBackend>;
+using UsbfsDevice = Device<detail::UsbfsBackend>;
+using KmodDevice = Device<detail::KmodBackend>;
+
+/**
+ * Poller driving a device on a dedicated thread (see piuio-poller.h), stopped
+ * on destruction. The device must outlive the poller.
+ */
+template <Game G>
+class Poller {
+public:
+  /**
+   * @param device Opened device of any backend
+   * @param config Configuration of the poller, the polling function and its
+   *               context are taken from the device
+   */
+  template <typename Backend>
+  explicit Poller(
+      Device<Backend> &device, struct piuio_poller_config config = {})
+  {
+    config.poll = device.poll_func();
+    config.ctx = device.poll_ctx();
+
+    detail::check(
+        piuio_poller_start(&handle_, &config), "Starting PIUIO poller failed");
+  }
+
+  ~Poller() { reset(); }
+
+  Poller(Poller &&other) noexcept :
+      handle_(std::exchange(other.handle_, nullptr))
+  {
+  }
+
+  Poller &operator=(Poller &&other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+
+    return *this;
+  }
+
+  Poller(const Poller &) = delete;
+  Poller &operator=(const Poller &) = delete;
+
+  void *handle() const noexcept { return handle_; }
+
+  /**
+   * State of the most recent cycle
+   *
+   * @param cycle Optional pointer to return the number of the cycle in
+   */
+  State<G> state(uint64_t *cycle = nullptr) const noexcept
+  {
+    return State<G>(piuio_poller_state(handle_, cycle));
+  }
+
+  Lights<G> lights() const noexcept
+  {
+    return Lights<G>(piuio_poller_lights(handle_));
+  }
+
+  History<G> history() const noexcept
+  {
+    return History<G>(piuio_poller_history(handle_));
+  }
+
+  LatchReader<G> latch_reader() const
+  {
+    return LatchReader<G>(piuio_poller_latch(handle_));
+  }
+
+  struct piuio_poller_timing timing() const noexcept
+  {
+    struct piuio_poller_timing timing;
+
+    piuio_poller_timing(handle_, &timing);
+
+    return timing;
+  }
+
+  /**
+   * Error that stopped the polling thread, RESULT_SUCCESS while running
+   */
+  result_t error() const noexcept { return piuio_poller_error(handle_); }
+
+private:
+  void reset() noexcept
+  {
+    if (handle_ != nullptr) {
+      piuio_poller_stop(handle_);
+      handle_ = nullptr;
+    }
+  }
+
+  void *handle_ = nullptr;
+};
+
+/**
+ * Non-blocking polling of a device split into begin and end (see
+ * piuio-poll.h), closed on destruction. The device must outlive it.
+ */
+template <Game G>
+class AsyncPoll {
+public:
+  template <typename Backend>
+  explicit AsyncPoll(Device<Backend> &device)
+  {
+    detail::check(device.open_poll(&handle_), "Opening PIUIO poll failed");
+  }
+
+  ~AsyncPoll() { reset(); }
+
+  AsyncPoll(AsyncPoll &&other) noexcept :
+      handle_(std::exchange(other.handle_, nullptr))
+  {
+  }
+
+  AsyncPoll &operator=(AsyncPoll &&other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+
+    return *this;
+  }
+
+  AsyncPoll(const AsyncPoll &) = delete;
+  AsyncPoll &operator=(const AsyncPoll &) = delete;
+
+  /**
+   * Start a full polling cycle sending the given outputs
+   */
+  void begin(LightSet<G> lights)
+  {
+    union piuio_output_paket output;
+
+    output = lights.paket();
+
+    detail::check(
+        piuio_poll_begin(handle_, &output), "Starting PIUIO cycle failed");
+  }
+
+  /**
+   * Wait for the cycle started to complete
+   */
+  State<G> end()
+  {
+    struct piuio_usb_input_batch_paket input;
+
+    detail::check(
+        piuio_poll_end(handle_, &input), "Collecting PIUIO cycle failed");
+
+    return State<G>(piuio_state_decode(&input));
+  }
+
+  /**
+   * Collect the cycle started if it completed already, none otherwise
+   */
+  std::optional<State<G>> try_end()
+  {
+    struct piuio_usb_input_batch_paket input;
+    result_t result;
+
+    result = piuio_poll_try_end(handle_, &input);
+
+    if (result == EAGAIN) {
+      return std::nullopt;
+    }
+
+    detail::check(result, "Collecting PIUIO cycle failed");
+
+    return State<G>(piuio_state_decode(&input));
+  }
+
+private:
+  void reset() noexcept
+  {
+    if (handle_ != nullptr) {
+      piuio_poll_close(handle_);
+      handle_ = nullptr;
+    }
+  }
+
+  void *handle_ = nullptr;
+};
+
+/**
+ * All types of a game, e.g. Piuio<Game::Itg>::State
+ */
+template <Game G>
+struct Piuio {
+  static constexpr Game game = G;
+
+  using Panel = typename Layout<G>::Panel;
+  using Button = typename Layout<G>::Button;
+  using Light = typename Layout<G>::Light;
+  using State = piuio::State<G>;
+  using LightSet = piuio::LightSet<G>;
+  using Lights = piuio::Lights<G>;
+  using Event = piuio::Event<G>;
+  using Events = piuio::Events<G>;
+  using History = piuio::History<G>;
+  using LatchResult = piuio::LatchResult<G>;
+  using LatchReader = piuio::LatchReader<G>;
+  using Poller = piuio::Poller<G>;
+  using AsyncPoll = piuio::AsyncPoll<G>;
+};
+
+using Piu = Piuio<Game::Piu>;
+using Itg = Piuio<Game::Itg>;
+
+} // namespace piuio
+
+#endif
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -7,9 +8,17 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "bench.h"
+#include "piuio-encoder.h"
+#include "piuio-failover.h"
 #include "piuio-kmod.h"
+#include "piuio-loop.h"
+#include "piuio-poll.h"
+#include "piuio-poller.h"
 #include "piuio-usb.h"
+#include "piuio-usbfs.h"
 #include "piuio.h"
+#include "time_.h"
 
 #include "options.h"
 
@@ -18,6 +27,10 @@ typedef bool (*func_render_data_t)(
     const struct piuio_usb_input_batch_paket *input,
     double io_time_sec);
 
+#define BENCH_KMOD_OPEN_RETRIES 200
+#define BENCH_USB_DEADLINE_US 4000
+#define PROFILE_MICROFRAME_NS 125000
+
 static bool interrupted = false;
 
 // -----------------------------------------------------------------------------------------
@@ -92,11 +105,19 @@ static void handle_pad_lights_on_input_itg(
   }
 }
 
-static bool draw_menu_piu_tui(struct piuio_piu_output_paket *output)
+static bool draw_menu_piu_tui(union piuio_output_paket *output)
 {
+  static struct pumpio_encoder encoder;
+  static bool encoder_initialized = false;
   int n;
   int state;
   char buf[5];
+  uint64_t value;
+
+  if (!encoder_initialized) {
+    piuio_encoder_init_piu(&encoder);
+    encoder_initialized = true;
+  }
 
   system("clear");
   printf(
@@ -126,7 +147,8 @@ static bool draw_menu_piu_tui(struct piuio_piu_output_paket *output)
       n = scanf("%d", &state);
 
       if (n > 0) {
-        output->light_bass = state > 0;
+        value = PUMPIO_ENCODER_OUTPUT(PIUIO_ENCODER_PIU_BASS);
+        piuio_encoder_apply(&encoder, value, state > 0 ? value : 0, output);
       }
 
       break;
@@ -137,67 +159,50 @@ static bool draw_menu_piu_tui(struct piuio_piu_output_paket *output)
       n = scanf("%4s", buf);
 
       if (n > 0) {
-        output->top_lamp_l1 = buf[0] == '1';
-        output->top_lamp_l2 = buf[1] == '1';
-        output->top_lamp_r1 = buf[2] == '1';
-        output->top_lamp_r2 = buf[3] == '1';
+        value = 0;
+
+        // Order of the chain matches the order of the logical outputs
+        for (uint8_t i = 0; i < 4; i++) {
+          if (buf[i] == '1') {
+            value |= PUMPIO_ENCODER_OUTPUT(PIUIO_ENCODER_PIU_TOP_LAMP_L1 + i);
+          }
+        }
+
+        piuio_encoder_apply(
+            &encoder, PIUIO_ENCODER_PIU_TOP_LAMPS, value, output);
       }
 
       break;
 
     case 4:
-      output->light_bass = 1;
-
-      output->top_lamp_l1 = 1;
-      output->top_lamp_l2 = 1;
-      output->top_lamp_r1 = 1;
-      output->top_lamp_r2 = 1;
-
-      output->pad_light_p1_lu = 1;
-      output->pad_light_p1_ru = 1;
-      output->pad_light_p1_cn = 1;
-      output->pad_light_p1_ld = 1;
-      output->pad_light_p1_rd = 1;
-
-      output->pad_light_p2_lu = 1;
-      output->pad_light_p2_ru = 1;
-      output->pad_light_p2_cn = 1;
-      output->pad_light_p2_ld = 1;
-      output->pad_light_p2_rd = 1;
-
+      piuio_encoder_apply(
+          &encoder,
+          PIUIO_ENCODER_PIU_LIGHTS,
+          PIUIO_ENCODER_PIU_LIGHTS,
+          output);
       break;
 
     case 5:
-      output->light_bass = 0;
-
-      output->top_lamp_l1 = 0;
-      output->top_lamp_l2 = 0;
-      output->top_lamp_r1 = 0;
-      output->top_lamp_r2 = 0;
-
-      output->pad_light_p1_lu = 0;
-      output->pad_light_p1_ru = 0;
-      output->pad_light_p1_cn = 0;
-      output->pad_light_p1_ld = 0;
-      output->pad_light_p1_rd = 0;
-
-      output->pad_light_p2_lu = 0;
-      output->pad_light_p2_ru = 0;
-      output->pad_light_p2_cn = 0;
-      output->pad_light_p2_ld = 0;
-      output->pad_light_p2_rd = 0;
-
+      piuio_encoder_apply(&encoder, PIUIO_ENCODER_PIU_LIGHTS, 0, output);
       break;
   }
 
   return true;
 }
 
-static bool draw_menu_itg_tui(struct piuio_itg_output_paket *output)
+static bool draw_menu_itg_tui(union piuio_output_paket *output)
 {
+  static struct pumpio_encoder encoder;
+  static bool encoder_initialized = false;
   int n;
   int state;
   char buf[5];
+  uint64_t value;
+
+  if (!encoder_initialized) {
+    piuio_encoder_init_itg(&encoder);
+    encoder_initialized = true;
+  }
 
   system("clear");
   printf(
@@ -227,7 +232,8 @@ static bool draw_menu_itg_tui(struct piuio_itg_output_paket *output)
       n = scanf("%d", &state);
 
       if (n > 0) {
-        output->light_bass = state > 0;
+        value = PUMPIO_ENCODER_OUTPUT(PIUIO_ENCODER_ITG_BASS);
+        piuio_encoder_apply(&encoder, value, state > 0 ? value : 0, output);
       }
 
       break;
@@ -238,52 +244,31 @@ static bool draw_menu_itg_tui(struct piuio_itg_output_paket *output)
       n = scanf("%4s", buf);
 
       if (n > 0) {
-        output->top_lamp_l1 = buf[0] == '1';
-        output->top_lamp_l2 = buf[1] == '1';
-        output->top_lamp_r1 = buf[2] == '1';
-        output->top_lamp_r2 = buf[3] == '1';
+        value = 0;
+
+        // Order of the chain matches the order of the logical outputs
+        for (uint8_t i = 0; i < 4; i++) {
+          if (buf[i] == '1') {
+            value |= PUMPIO_ENCODER_OUTPUT(PIUIO_ENCODER_ITG_TOP_LAMP_L1 + i);
+          }
+        }
+
+        piuio_encoder_apply(
+            &encoder, PIUIO_ENCODER_ITG_TOP_LAMPS, value, output);
       }
 
       break;
 
     case 4:
-      output->light_bass = 1;
-
-      output->top_lamp_l1 = 1;
-      output->top_lamp_l2 = 1;
-      output->top_lamp_r1 = 1;
-      output->top_lamp_r2 = 1;
-
-      output->pad_light_p1_up = 1;
-      output->pad_light_p1_down = 1;
-      output->pad_light_p1_left = 1;
-      output->pad_light_p1_right = 1;
-
-      output->pad_light_p2_up = 1;
-      output->pad_light_p2_down = 1;
-      output->pad_light_p2_left = 1;
-      output->pad_light_p2_right = 1;
-
+      piuio_encoder_apply(
+          &encoder,
+          PIUIO_ENCODER_ITG_LIGHTS,
+          PIUIO_ENCODER_ITG_LIGHTS,
+          output);
       break;
 
     case 5:
-      output->light_bass = 0;
-
-      output->top_lamp_l1 = 0;
-      output->top_lamp_l2 = 0;
-      output->top_lamp_r1 = 0;
-      output->top_lamp_r2 = 0;
-
-      output->pad_light_p1_up = 0;
-      output->pad_light_p1_down = 0;
-      output->pad_light_p1_left = 0;
-      output->pad_light_p1_right = 0;
-
-      output->pad_light_p2_up = 0;
-      output->pad_light_p2_down = 0;
-      output->pad_light_p2_left = 0;
-      output->pad_light_p2_right = 0;
-
+      piuio_encoder_apply(&encoder, PIUIO_ENCODER_ITG_LIGHTS, 0, output);
       break;
   }
 
@@ -832,7 +817,7 @@ static bool render_tui_piu(
   assert(input != NULL);
 
   if (interrupted) {
-    if (draw_menu_piu_tui(&output->piu)) {
+    if (draw_menu_piu_tui(output)) {
       interrupted = false;
     } else {
       return false;
@@ -858,7 +843,7 @@ static bool render_tui_itg(
   assert(input != NULL);
 
   if (interrupted) {
-    if (draw_menu_itg_tui(&output->itg)) {
+    if (draw_menu_itg_tui(output)) {
       interrupted = false;
     } else {
       return false;
@@ -875,31 +860,60 @@ static bool render_tui_itg(
   return true;
 }
 
-static bool render_benchmark(
-    union piuio_output_paket *output,
-    const struct piuio_usb_input_batch_paket *input,
-    double io_time_sec)
+// -----------------------------------------------------------------------------------------
+
+static void proc_list_usb()
 {
-  assert(output);
-  assert(input);
+  struct pumpio_usb_device_info infos[16];
+  size_t count;
+  result_t result;
 
-  static uint64_t counter = 0;
-  static double accu = 0;
+  result = piuio_usb_enumerate(infos, 16, &count);
 
-  counter++;
-  accu += io_time_sec;
+  if (result) {
+    errno = result;
+    perror("Enumerating PIUIO devices failed");
+    exit(EXIT_FAILURE);
+  }
 
-  system("clear");
-  printf("Samples: %ld\n", counter);
-  printf("Latest time: %.5f secs\n", io_time_sec);
-  printf("Average time: %.5f secs\n", accu / counter);
+  printf("Found %zu PIUIO device(s)\n", count);
 
-  return !interrupted;
+  for (size_t i = 0; i < count && i < 16; i++) {
+    printf(
+        "  path %s, bus %d, address %d, serial %s\n",
+        infos[i].path,
+        infos[i].bus,
+        infos[i].address,
+        infos[i].serial[0] ? infos[i].serial : "n/a");
+  }
 }
 
-// -----------------------------------------------------------------------------------------
+static void proc_list_kmod()
+{
+  struct piuio_kmod_device_info infos[16];
+  size_t count;
+  result_t result;
 
-static void proc_usb(int32_t delay_ms, func_render_data_t render)
+  result = piuio_kmod_enumerate(infos, 16, &count);
+
+  if (result) {
+    errno = result;
+    perror("Enumerating PIUIO kmod devices failed");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("Found %zu PIUIO kmod device(s)\n", count);
+
+  for (size_t i = 0; i < count && i < 16; i++) {
+    printf(
+        "  /dev/piuio%d, path %s\n",
+        infos[i].index,
+        infos[i].path[0] ? infos[i].path : "n/a");
+  }
+}
+
+static void
+proc_usb(const char *device_id, int32_t delay_ms, func_render_data_t render)
 {
   void *handle;
   int32_t result;
@@ -918,7 +932,11 @@ static void proc_usb(int32_t delay_ms, func_render_data_t render)
   memset(output.raw, 0, sizeof(output.raw));
   memset(&input, 0, sizeof(struct piuio_usb_input_batch_paket));
 
-  result = piuio_usb_open(&handle);
+  if (device_id) {
+    result = piuio_usb_open_id(&handle, device_id);
+  } else {
+    result = piuio_usb_open(&handle);
+  }
 
   if (result) {
     errno = result;
@@ -952,9 +970,10 @@ static void proc_usb(int32_t delay_ms, func_render_data_t render)
   piuio_usb_close(handle);
 }
 
-static void proc_kmod(int32_t delay_ms, func_render_data_t render)
+static void
+proc_kmod(const char *device_id, int32_t delay_ms, func_render_data_t render)
 {
-  int32_t fd;
+  void *handle;
   int32_t result;
   union piuio_kmod_paket paket;
   struct timespec tstart;
@@ -970,7 +989,13 @@ static void proc_kmod(int32_t delay_ms, func_render_data_t render)
   // Null largest field spanning entire union
   memset(&paket, 0, sizeof(paket));
 
-  result = piuio_kmod_open(&fd);
+  if (device_id == NULL) {
+    result = piuio_kmod_open(&handle);
+  } else if (strchr(device_id, '-') == NULL) {
+    result = piuio_kmod_open_index(&handle, atoi(device_id));
+  } else {
+    result = piuio_kmod_open_path(&handle, device_id);
+  }
 
   if (result) {
     errno = result;
@@ -991,7 +1016,7 @@ static void proc_kmod(int32_t delay_ms, func_render_data_t render)
 
     clock_gettime(CLOCK_MONOTONIC, &tstart);
 
-    result = piuio_kmod_poll(fd, &paket);
+    result = piuio_kmod_poll(handle, &paket);
 
     clock_gettime(CLOCK_MONOTONIC, &tend);
 
@@ -1010,7 +1035,1055 @@ static void proc_kmod(int32_t delay_ms, func_render_data_t render)
     sleep_ms(delay_ms);
   }
 
-  piuio_kmod_close(fd);
+  piuio_kmod_close(handle);
+}
+
+struct bench_ctx {
+  enum backend backend;
+  const char *device_id;
+  void *handle;
+  union piuio_output_paket output;
+  struct piuio_usb_input_batch_paket input;
+  union piuio_kmod_paket paket;
+};
+
+static const char *bench_backend_name(enum backend backend)
+{
+  switch (backend) {
+    case BACKEND_USB:
+      return "usb";
+    case BACKEND_USB_DEADLINE:
+      return "usb-deadline";
+    case BACKEND_KMOD:
+      return "kmod";
+    case BACKEND_USBFS:
+      return "usbfs";
+    default:
+      return "unknown";
+  }
+}
+
+static result_t bench_open(void *ctx)
+{
+  struct bench_ctx *bench;
+  result_t result;
+
+  bench = (struct bench_ctx *) ctx;
+
+  if (bench->backend == BACKEND_USBFS) {
+    if (bench->device_id) {
+      return piuio_usbfs_open_id(&bench->handle, bench->device_id);
+    } else {
+      return piuio_usbfs_open(&bench->handle);
+    }
+  }
+
+  if (bench->backend != BACKEND_KMOD) {
+    if (bench->device_id) {
+      result = piuio_usb_open_id(&bench->handle, bench->device_id);
+    } else {
+      result = piuio_usb_open(&bench->handle);
+    }
+
+    // Hand the device back to the kernel module for the kmod backend
+    if (RESULT_IS_SUCCESS(result)) {
+      piuio_usb_set_reattach_kernel_driver(bench->handle, true);
+    }
+
+    return result;
+  }
+
+  // The device node re-appears with a delay once libusb handed the device
+  // back to the kernel module
+  for (uint32_t i = 0; i < BENCH_KMOD_OPEN_RETRIES; i++) {
+    if (bench->device_id == NULL) {
+      result = piuio_kmod_open(&bench->handle);
+    } else if (strchr(bench->device_id, '-') == NULL) {
+      result = piuio_kmod_open_index(&bench->handle, atoi(bench->device_id));
+    } else {
+      result = piuio_kmod_open_path(&bench->handle, bench->device_id);
+    }
+
+    if (result != ENOENT && result != ENODEV) {
+      break;
+    }
+
+    sleep_ms(10);
+  }
+
+  return result;
+}
+
+static result_t bench_close(void *ctx)
+{
+  struct bench_ctx *bench;
+
+  bench = (struct bench_ctx *) ctx;
+
+  if (bench->backend == BACKEND_KMOD) {
+    piuio_kmod_close(bench->handle);
+  } else if (bench->backend == BACKEND_USBFS) {
+    piuio_usbfs_close(bench->handle);
+  } else {
+    piuio_usb_close(bench->handle);
+  }
+
+  return RESULT_SUCCESS;
+}
+
+static result_t bench_poll(void *ctx)
+{
+  static const struct piuio_usb_cycle_config deadline_config = {
+      .deadline_us = BENCH_USB_DEADLINE_US,
+      .transfer_timeout_ms = 0,
+      .backoff_us = 50,
+      .backoff_max_us = 400,
+  };
+
+  struct bench_ctx *bench;
+  uint8_t stale_mask;
+
+  bench = (struct bench_ctx *) ctx;
+
+  switch (bench->backend) {
+    case BACKEND_USB:
+      return piuio_usb_poll_full_cycle(
+          bench->handle, &bench->output, &bench->input);
+    case BACKEND_USB_DEADLINE:
+      return piuio_usb_poll_full_cycle_deadline(
+          bench->handle,
+          &deadline_config,
+          &bench->output,
+          &bench->input,
+          &stale_mask);
+    case BACKEND_KMOD:
+      // Output is overwritten by the kernel module, keep all outputs off
+      memset(&bench->paket.output, 0, sizeof(bench->paket.output));
+
+      return piuio_kmod_poll(bench->handle, &bench->paket);
+    case BACKEND_USBFS:
+      return piuio_usbfs_poll_full_cycle(
+          bench->handle, &bench->output, &bench->input);
+    default:
+      return EINVAL;
+  }
+}
+
+static void bench_init_config(
+    struct pumpio_bench_config *config,
+    uint32_t delay_ms,
+    const struct bench_options *bench_options)
+{
+  memset(config, 0, sizeof(struct pumpio_bench_config));
+
+  config->warmup = bench_options->warmup;
+  config->samples = bench_options->samples;
+  config->duration_ms = bench_options->duration_s * 1000;
+  config->delay_us = delay_ms * 1000;
+}
+
+static void proc_bench(
+    enum type type,
+    const char *device_id,
+    uint32_t delay_ms,
+    const struct bench_options *bench_options)
+{
+  struct pumpio_bench_config config;
+  struct pumpio_bench_result bench_result;
+  struct bench_ctx bench;
+  char name[32];
+  result_t result;
+
+  memset(&bench, 0, sizeof(bench));
+
+  if (type == TYPE_USB) {
+    bench.backend = BACKEND_USB;
+  } else if (type == TYPE_USBFS) {
+    bench.backend = BACKEND_USBFS;
+  } else {
+    bench.backend = BACKEND_KMOD;
+  }
+
+  bench.device_id = device_id;
+
+  result = bench_open(&bench);
+
+  if (result) {
+    errno = result;
+    perror("Opening PIUIO failed");
+    exit(EXIT_FAILURE);
+  }
+
+  bench_init_config(&config, delay_ms, bench_options);
+
+  // Status to stderr, keeps stdout clean for the csv/json results
+  fprintf(
+      stderr,
+      "Running %u warmup iterations, then measuring, press CTRL + C to "
+      "stop early\n",
+      config.warmup);
+
+  result = pumpio_bench_run(
+      &config, bench_poll, &bench, &interrupted, &bench_result);
+
+  if (result) {
+    errno = result;
+    perror("Running benchmark for PIUIO failed");
+    exit(EXIT_FAILURE);
+  }
+
+  snprintf(name, sizeof(name), "piuio-%s", bench_backend_name(bench.backend));
+
+  pumpio_bench_print(
+      stdout,
+      name,
+      &config,
+      &bench_result,
+      (enum pumpio_bench_format) bench_options->format);
+
+  bench_close(&bench);
+}
+
+static void proc_compare(
+    const char *device_id,
+    uint32_t delay_ms,
+    const struct bench_options *bench_options)
+{
+  struct pumpio_bench_config config;
+  struct pumpio_bench_backend backends[BENCH_BACKENDS_MAX];
+  struct pumpio_bench_result results[BENCH_BACKENDS_MAX];
+  struct pumpio_bench_comparison comparisons[BENCH_BACKENDS_MAX];
+  struct bench_ctx benches[BENCH_BACKENDS_MAX];
+  bool has_usb;
+  bool has_kmod;
+  bool has_usbfs;
+  bool exclusive;
+  uint32_t block;
+  result_t result;
+
+  memset(backends, 0, sizeof(backends));
+  memset(benches, 0, sizeof(benches));
+
+  has_usb = false;
+  has_kmod = false;
+  has_usbfs = false;
+
+  for (size_t i = 0; i < bench_options->backend_count; i++) {
+    has_kmod |= bench_options->backends[i] == BACKEND_KMOD;
+    has_usbfs |= bench_options->backends[i] == BACKEND_USBFS;
+    has_usb |= bench_options->backends[i] == BACKEND_USB ||
+        bench_options->backends[i] == BACKEND_USB_DEADLINE;
+  }
+
+  // Opening the device with libusb or usbfs detaches the kernel module and
+  // claims the interface. Only one of them can own the device at the same
+  // time, i.e. every block has to claim and release it which takes a while.
+  // Use larger blocks to amortize that. The test compares the medians of the
+  // blocks, short blocks still alternate often enough to spread drift evenly
+  exclusive = has_usb + has_kmod + has_usbfs > 1;
+
+  if (bench_options->block > 0) {
+    block = bench_options->block;
+  } else {
+    block = exclusive ? 1000 : 16;
+  }
+
+  for (size_t i = 0; i < bench_options->backend_count; i++) {
+    benches[i].backend = bench_options->backends[i];
+    benches[i].device_id = device_id;
+
+    backends[i].name = bench_backend_name(benches[i].backend);
+    backends[i].func = bench_poll;
+    backends[i].ctx = &benches[i];
+
+    if (exclusive) {
+      backends[i].acquire = bench_open;
+      backends[i].release = bench_close;
+      continue;
+    }
+
+    result = bench_open(&benches[i]);
+
+    if (result) {
+      errno = result;
+      perror("Opening PIUIO failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  bench_init_config(&config, delay_ms, bench_options);
+
+  fprintf(
+      stderr,
+      "Comparing %zu backend(s) interleaved in blocks of %u iteration(s)%s, "
+      "press CTRL + C to stop early\n",
+      bench_options->backend_count,
+      block,
+      exclusive ? ", re-opening the device for every block" : "");
+
+  result = pumpio_bench_run_interleaved(
+      &config,
+      block,
+      backends,
+      bench_options->backend_count,
+      &interrupted,
+      results,
+      comparisons);
+
+  if (result) {
+    errno = result;
+    perror("Running benchmark for PIUIO failed");
+    exit(EXIT_FAILURE);
+  }
+
+  pumpio_bench_print_interleaved(
+      stdout,
+      &config,
+      block,
+      backends,
+      bench_options->backend_count,
+      results,
+      comparisons,
+      (enum pumpio_bench_format) bench_options->format);
+
+  for (size_t i = 0; !exclusive && i < bench_options->backend_count; i++) {
+    bench_close(&benches[i]);
+  }
+}
+
+/* Series of the per transfer breakdown of the profile mode */
+enum profile_series {
+  PROFILE_SERIES_OUT = 0,
+  PROFILE_SERIES_IN = PIUIO_SENSOR_MASK_TOTAL_COUNT,
+  PROFILE_SERIES_OUT_TOTAL = 2 * PIUIO_SENSOR_MASK_TOTAL_COUNT,
+  PROFILE_SERIES_IN_TOTAL,
+  PROFILE_SERIES_HOST,
+  PROFILE_SERIES_CYCLE,
+  PROFILE_SERIES_COUNT,
+};
+
+static void profile_series_name(char *name, size_t len, uint32_t series)
+{
+  if (series < PROFILE_SERIES_IN) {
+    snprintf(name, len, "out-%u", series - PROFILE_SERIES_OUT);
+  } else if (series < PROFILE_SERIES_OUT_TOTAL) {
+    snprintf(name, len, "in-%u", series - PROFILE_SERIES_IN);
+  } else if (series == PROFILE_SERIES_OUT_TOTAL) {
+    snprintf(name, len, "out-total");
+  } else if (series == PROFILE_SERIES_IN_TOTAL) {
+    snprintf(name, len, "in-total");
+  } else if (series == PROFILE_SERIES_HOST) {
+    snprintf(name, len, "host");
+  } else {
+    snprintf(name, len, "cycle");
+  }
+}
+
+static void profile_record(
+    uint64_t **series,
+    uint64_t index,
+    const struct piuio_usb_cycle_profile *profile)
+{
+  uint64_t out_total;
+  uint64_t in_total;
+  uint64_t cycle;
+
+  out_total = 0;
+  in_total = 0;
+
+  for (uint8_t i = 0; i < PIUIO_SENSOR_MASK_TOTAL_COUNT; i++) {
+    series[PROFILE_SERIES_OUT + i][index] =
+        profile->out_end_ns[i] - profile->out_start_ns[i];
+    series[PROFILE_SERIES_IN + i][index] =
+        profile->in_end_ns[i] - profile->in_start_ns[i];
+
+    out_total += series[PROFILE_SERIES_OUT + i][index];
+    in_total += series[PROFILE_SERIES_IN + i][index];
+  }
+
+  cycle = profile->end_ns - profile->start_ns;
+
+  series[PROFILE_SERIES_OUT_TOTAL][index] = out_total;
+  series[PROFILE_SERIES_IN_TOTAL][index] = in_total;
+  // Time spent on the host between the transfers
+  series[PROFILE_SERIES_HOST][index] = cycle - out_total - in_total;
+  series[PROFILE_SERIES_CYCLE][index] = cycle;
+}
+
+/**
+ * Share of sorted samples taking at least a USB microframe longer than the
+ * fastest one, i.e. which likely missed a (micro)frame of the bus schedule
+ */
+static double profile_late_share(const uint64_t *samples, uint64_t count)
+{
+  uint64_t late;
+
+  if (count == 0) {
+    return 0;
+  }
+
+  late = 0;
+
+  while (late < count &&
+         samples[count - 1 - late] >= samples[0] + PROFILE_MICROFRAME_NS) {
+    late++;
+  }
+
+  return (double) late / count;
+}
+
+static void profile_print(
+    uint64_t **series, uint64_t count, enum bench_format format)
+{
+  struct pumpio_bench_result results[PROFILE_SERIES_COUNT];
+  double late[PROFILE_SERIES_COUNT];
+  double share;
+  char name[16];
+
+  for (uint32_t i = 0; i < PROFILE_SERIES_COUNT; i++) {
+    pumpio_bench_evaluate(series[i], count, 0, &results[i]);
+    late[i] = profile_late_share(series[i], count);
+  }
+
+  if (format == BENCH_FORMAT_CSV) {
+    printf(
+        "name,samples,min_us,p50_us,p90_us,p99_us,max_us,mean_us,share,"
+        "late\n");
+  } else if (format == BENCH_FORMAT_JSON) {
+    printf("[");
+  } else {
+    printf(
+        "%-10s %9s %9s %9s %9s %9s %9s %6s %6s\n",
+        "Transfer",
+        "min us",
+        "p50 us",
+        "p90 us",
+        "p99 us",
+        "max us",
+        "mean us",
+        "share",
+        "late");
+  }
+
+  for (uint32_t i = 0; i < PROFILE_SERIES_COUNT; i++) {
+    profile_series_name(name, sizeof(name), i);
+
+    // Share of the mean cycle time
+    share = results[PROFILE_SERIES_CYCLE].mean_ns > 0 ?
+        results[i].mean_ns / results[PROFILE_SERIES_CYCLE].mean_ns :
+        0;
+
+    if (format == BENCH_FORMAT_CSV) {
+      printf(
+          "%s,%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f,%.4f\n",
+          name,
+          results[i].samples,
+          results[i].min_ns / 1.0e3,
+          results[i].p50_ns / 1.0e3,
+          results[i].p90_ns / 1.0e3,
+          results[i].p99_ns / 1.0e3,
+          results[i].max_ns / 1.0e3,
+          results[i].mean_ns / 1.0e3,
+          share,
+          late[i]);
+    } else if (format == BENCH_FORMAT_JSON) {
+      printf(
+          "{\"name\": \"%s\", \"samples\": %lu, \"min_us\": %.3f, "
+          "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, "
+          "\"max_us\": %.3f, \"mean_us\": %.3f, \"share\": %.4f, "
+          "\"late\": %.4f}%s",
+          name,
+          results[i].samples,
+          results[i].min_ns / 1.0e3,
+          results[i].p50_ns / 1.0e3,
+          results[i].p90_ns / 1.0e3,
+          results[i].p99_ns / 1.0e3,
+          results[i].max_ns / 1.0e3,
+          results[i].mean_ns / 1.0e3,
+          share,
+          late[i],
+          i + 1 < PROFILE_SERIES_COUNT ? ", " : "");
+    } else {
+      printf(
+          "%-10s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %5.1f%% %5.1f%%\n",
+          name,
+          results[i].min_ns / 1.0e3,
+          results[i].p50_ns / 1.0e3,
+          results[i].p90_ns / 1.0e3,
+          results[i].p99_ns / 1.0e3,
+          results[i].max_ns / 1.0e3,
+          results[i].mean_ns / 1.0e3,
+          share * 100,
+          late[i] * 100);
+    }
+  }
+
+  if (format == BENCH_FORMAT_JSON) {
+    printf("]\n");
+  } else if (format == BENCH_FORMAT_TEXT) {
+    printf(
+        "Samples: %lu, share: of the mean cycle time, late: samples at least "
+        "one USB microframe (125 us) slower than the fastest one\n",
+        count);
+  }
+}
+
+static void proc_profile(
+    const char *device_id,
+    uint32_t delay_ms,
+    const struct bench_options *bench_options)
+{
+  struct bench_ctx bench;
+  struct piuio_usb_cycle_profile profile;
+  uint64_t *series[PROFILE_SERIES_COUNT];
+  uint64_t capacity;
+  uint64_t count;
+  uint64_t start_ns;
+  result_t result;
+
+  memset(&bench, 0, sizeof(bench));
+
+  bench.backend = BACKEND_USB;
+  bench.device_id = device_id;
+
+  result = bench_open(&bench);
+
+  if (result) {
+    errno = result;
+    perror("Opening PIUIO failed");
+    exit(EXIT_FAILURE);
+  }
+
+  // Without a sample count, the duration is bounded by the default count
+  capacity = bench_options->samples > 0 ? bench_options->samples : 10000;
+
+  for (uint32_t i = 0; i < PROFILE_SERIES_COUNT; i++) {
+    series[i] = (uint64_t *) malloc(capacity * sizeof(uint64_t));
+
+    if (series[i] == NULL) {
+      fprintf(stderr, "Allocating samples failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  fprintf(
+      stderr,
+      "Running %u warmup cycles, then profiling up to %lu cycles, press "
+      "CTRL + C to stop early\n",
+      bench_options->warmup,
+      capacity);
+
+  for (uint32_t i = 0; i < bench_options->warmup && !interrupted; i++) {
+    result = bench_poll(&bench);
+
+    if (result) {
+      errno = result;
+      perror("Running update cycle for PIUIO failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  count = 0;
+  start_ns = pumpio_time_now_ns();
+
+  while (count < capacity && !interrupted) {
+    if (bench_options->duration_s > 0 &&
+        pumpio_time_now_ns() - start_ns >=
+            bench_options->duration_s * UINT64_C(1000000000)) {
+      break;
+    }
+
+    result = piuio_usb_poll_full_cycle_profile(
+        bench.handle, &bench.output, &bench.input, &profile);
+
+    if (result) {
+      errno = result;
+      perror("Running update cycle for PIUIO failed");
+      exit(EXIT_FAILURE);
+    }
+
+    profile_record(series, count++, &profile);
+
+    if (delay_ms > 0) {
+      sleep_ms(delay_ms);
+    }
+  }
+
+  profile_print(series, count, bench_options->format);
+
+  for (uint32_t i = 0; i < PROFILE_SERIES_COUNT; i++) {
+    free(series[i]);
+  }
+
+  bench_close(&bench);
+}
+
+static void print_poller_settings(const struct piuio_poller_config *config)
+{
+  printf("Poller settings:\n");
+  printf("  Interval: %u us\n", config->interval_us);
+
+  if (config->sched_policy == PIUIO_POLLER_SCHED_FIFO) {
+    printf("  Scheduling: SCHED_FIFO, priority %u\n", config->sched_priority);
+  } else if (config->sched_policy == PIUIO_POLLER_SCHED_DEADLINE) {
+    printf(
+        "  Scheduling: SCHED_DEADLINE, runtime %u us\n",
+        config->sched_runtime_us);
+  } else {
+    printf("  Scheduling: default\n");
+  }
+
+  if (config->pin_cpu) {
+    printf("  CPU: %u\n", config->cpu);
+  } else {
+    printf("  CPU: any\n");
+  }
+
+  printf("  Memory locked: %s\n", config->lock_memory ? "yes" : "no");
+  printf("  Pre-faulted stack: %u KiB\n", config->prefault_stack_kb);
+}
+
+static void print_poller_timing(const struct piuio_poller_timing *timing)
+{
+  printf(
+      "Periods %lu, period min/avg/max %.3f/%.3f/%.3f ms, jitter (stddev) "
+      "%.3f ms, wakeup delay min/avg/max %.3f/%.3f/%.3f ms, missed %lu\n",
+      timing->periods,
+      timing->period_min_ns / 1.0e6,
+      timing->period_avg_ns / 1.0e6,
+      timing->period_max_ns / 1.0e6,
+      timing->period_stddev_ns / 1.0e6,
+      timing->wakeup_min_ns / 1.0e6,
+      timing->wakeup_avg_ns / 1.0e6,
+      timing->wakeup_max_ns / 1.0e6,
+      timing->missed);
+}
+
+static void print_failover_status(const struct piuio_failover_status *status)
+{
+  printf(
+      "Backend %s, switches %lu, mean latency kmod/usb %.3f/%.3f ms\n",
+      status->backend == PIUIO_FAILOVER_BACKEND_KMOD ? "kmod" : "usb",
+      status->switches,
+      status->latency_ns[PIUIO_FAILOVER_BACKEND_KMOD] / 1.0e6,
+      status->latency_ns[PIUIO_FAILOVER_BACKEND_USB] / 1.0e6);
+}
+
+static void proc_poller(
+    enum type type,
+    const char *device_id,
+    const struct poller_options *poller_options)
+{
+  struct piuio_failover_config failover_config;
+  struct piuio_failover_status failover_status;
+  struct piuio_poller_config config;
+  struct piuio_poller_timing timing;
+  struct piuio_sequence *sequence;
+  void *device;
+  void *poller;
+  result_t result;
+
+  memset(&config, 0, sizeof(config));
+  sequence = NULL;
+
+  if (poller_options->sequence_path) {
+    result = piuio_sequence_load_file(&sequence, poller_options->sequence_path);
+
+    if (result) {
+      errno = result;
+      perror("Loading light sequence failed");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (poller_options->failover_latency_us > 0) {
+    memset(&failover_config, 0, sizeof(failover_config));
+    failover_config.path = device_id;
+    failover_config.backend = type == TYPE_KMOD ?
+        PIUIO_FAILOVER_BACKEND_KMOD :
+        PIUIO_FAILOVER_BACKEND_USB;
+    failover_config.latency_threshold_us = poller_options->failover_latency_us;
+
+    result = piuio_failover_open(&device, &failover_config);
+
+    config.poll = piuio_failover_poll;
+    config.ctx = device;
+  } else if (type == TYPE_USB) {
+    if (device_id) {
+      result = piuio_usb_open_id(&device, device_id);
+    } else {
+      result = piuio_usb_open(&device);
+    }
+
+    config.poll = piuio_usb_poll_full_cycle;
+    config.ctx = device;
+  } else if (type == TYPE_USBFS) {
+    if (device_id) {
+      result = piuio_usbfs_open_id(&device, device_id);
+    } else {
+      result = piuio_usbfs_open(&device);
+    }
+
+    config.poll = piuio_usbfs_poll_full_cycle;
+    config.ctx = device;
+  } else {
+    if (device_id == NULL) {
+      result = piuio_kmod_open(&device);
+    } else if (strchr(device_id, '-') == NULL) {
+      result = piuio_kmod_open_index(&device, atoi(device_id));
+    } else {
+      result = piuio_kmod_open_path(&device, device_id);
+    }
+
+    config.poll = piuio_poller_poll_kmod;
+    config.ctx = device;
+  }
+
+  if (result) {
+    errno = result;
+    perror("Opening PIUIO failed");
+    exit(EXIT_FAILURE);
+  }
+
+  config.interval_us = poller_options->interval_us;
+
+  if (poller_options->scheduler == SCHEDULER_FIFO) {
+    config.sched_policy = PIUIO_POLLER_SCHED_FIFO;
+    config.sched_priority = poller_options->priority;
+  } else if (poller_options->scheduler == SCHEDULER_DEADLINE) {
+    config.sched_policy = PIUIO_POLLER_SCHED_DEADLINE;
+    config.sched_runtime_us = poller_options->runtime_us > 0 ?
+        poller_options->runtime_us :
+        poller_options->interval_us / 2;
+  }
+
+  config.pin_cpu = poller_options->cpu >= 0;
+  config.cpu = poller_options->cpu >= 0 ? poller_options->cpu : 0;
+  config.lock_memory = poller_options->lock_memory;
+  config.prefault_stack_kb = poller_options->prefault_stack_kb;
+
+  print_poller_settings(&config);
+
+  result = piuio_poller_start(&poller, &config);
+
+  if (result) {
+    errno = result;
+    perror("Starting poller failed");
+    exit(EXIT_FAILURE);
+  }
+
+  if (sequence) {
+    piuio_sequencer_play(piuio_poller_sequencer(poller), sequence, 0);
+
+    printf(
+        "Playing light sequence, %u frames, %.3f s%s\n",
+        sequence->frame_count,
+        sequence->length_us / 1.0e6,
+        sequence->flags & PIUIO_SEQUENCE_FLAG_LOOP ? ", looping" : "");
+  }
+
+  printf("Press CTRL + C to stop\n");
+
+  while (!interrupted) {
+    sleep_ms(1000);
+
+    result = piuio_poller_error(poller);
+
+    if (result) {
+      errno = result;
+      perror("Running update cycle for PIUIO failed");
+      exit(EXIT_FAILURE);
+    }
+
+    piuio_poller_timing(poller, &timing);
+    print_poller_timing(&timing);
+
+    if (poller_options->failover_latency_us > 0) {
+      piuio_failover_status(device, &failover_status);
+      print_failover_status(&failover_status);
+    }
+  }
+
+  piuio_poller_stop(poller);
+
+  if (poller_options->failover_latency_us > 0) {
+    piuio_failover_close(device);
+  } else if (type == TYPE_USB) {
+    piuio_usb_close(device);
+  } else if (type == TYPE_USBFS) {
+    piuio_usbfs_close(device);
+  } else {
+    piuio_kmod_close(device);
+  }
+
+  piuio_sequence_free(sequence);
+}
+
+static void proc_loop(enum type type)
+{
+  struct piuio_loop_config config;
+  struct pumpio_usb_device_info infos[PIUIO_LOOP_BOARDS_MAX];
+  struct piuio_kmod_device_info kmod_infos[PIUIO_LOOP_BOARDS_MAX];
+  union piuio_output_paket output;
+  void *devices[PIUIO_LOOP_BOARDS_MAX];
+  uint64_t cycles[PIUIO_LOOP_BOARDS_MAX];
+  uint64_t cycle;
+  uint64_t total;
+  uint64_t start_ns;
+  uint64_t now_ns;
+  double elapsed_sec;
+  size_t count;
+  size_t board;
+  result_t result;
+  void *loop;
+
+  if (type == TYPE_KMOD) {
+    result = piuio_kmod_enumerate(kmod_infos, PIUIO_LOOP_BOARDS_MAX, &count);
+  } else {
+    result = piuio_usb_enumerate(infos, PIUIO_LOOP_BOARDS_MAX, &count);
+  }
+
+  if (result) {
+    errno = result;
+    perror("Enumerating PIUIO devices failed");
+    exit(EXIT_FAILURE);
+  }
+
+  if (count == 0) {
+    fprintf(stderr, "No PIUIO devices connected\n");
+    exit(EXIT_FAILURE);
+  }
+
+  count = count < PIUIO_LOOP_BOARDS_MAX ? count : PIUIO_LOOP_BOARDS_MAX;
+
+  memset(&config, 0, sizeof(config));
+  memset(&output, 0, sizeof(output));
+
+  result = piuio_loop_init(&loop, &config);
+
+  if (result) {
+    errno = result;
+    perror("Creating loop failed");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (type == TYPE_KMOD) {
+      result = piuio_kmod_open_index(&devices[i], kmod_infos[i].index);
+    } else {
+      result = piuio_usbfs_open_id(&devices[i], infos[i].path);
+    }
+
+    if (result) {
+      errno = result;
+      perror("Opening PIUIO failed");
+      exit(EXIT_FAILURE);
+    }
+
+    if (type == TYPE_KMOD) {
+      result = piuio_loop_add_kmod(loop, devices[i], &output, &board);
+    } else {
+      result = piuio_loop_add(loop, devices[i], &output, &board);
+    }
+
+    if (result) {
+      errno = result;
+      perror("Adding PIUIO to loop failed");
+      exit(EXIT_FAILURE);
+    }
+
+    cycles[board] = 0;
+    printf(
+        "Board %zu: path %s\n",
+        board,
+        type == TYPE_KMOD ? kmod_infos[i].path : infos[i].path);
+  }
+
+  printf("Driving %zu board(s) on a single thread\n", count);
+  printf("Press CTRL + C to stop\n");
+
+  start_ns = pumpio_time_now_ns();
+
+  while (!interrupted) {
+    result = piuio_loop_run(loop, 100);
+
+    if (result == ENOENT) {
+      fprintf(stderr, "All boards stopped\n");
+      break;
+    }
+
+    now_ns = pumpio_time_now_ns();
+
+    if (now_ns - start_ns < 1000000000) {
+      continue;
+    }
+
+    elapsed_sec = (now_ns - start_ns) / 1.0e9;
+    total = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      piuio_loop_state(loop, i, &cycle);
+      result = piuio_loop_error(loop, i);
+
+      printf(
+          "Board %zu: %.1f cycles/s%s%s\n",
+          i,
+          (cycle - cycles[i]) / elapsed_sec,
+          result ? ", stopped: " : "",
+          result ? strerror(result) : "");
+
+      total += cycle - cycles[i];
+      cycles[i] = cycle;
+    }
+
+    printf("Total: %.1f cycles/s\n", total / elapsed_sec);
+
+    start_ns = now_ns;
+  }
+
+  piuio_loop_free(loop);
+
+  for (size_t i = 0; i < count; i++) {
+    if (type == TYPE_KMOD) {
+      piuio_kmod_close(devices[i]);
+    } else {
+      piuio_usbfs_close(devices[i]);
+    }
+  }
+}
+
+static void proc_async(enum type type, const char *device_id, uint32_t delay_ms)
+{
+  struct piuio_usb_input_batch_paket input;
+  union piuio_output_paket output;
+  uint64_t frame_ns;
+  uint64_t frame_end_ns;
+  uint64_t start_ns;
+  uint64_t wait_start_ns;
+  uint64_t now_ns;
+  uint64_t wait_ns;
+  uint64_t cycles;
+  uint64_t overlapped;
+  void *device;
+  void *poll;
+  result_t result;
+
+  device = NULL;
+
+  if (type == TYPE_USB) {
+    if (device_id) {
+      result = piuio_usb_open_id(&device, device_id);
+    } else {
+      result = piuio_usb_open(&device);
+    }
+  } else if (type == TYPE_USBFS) {
+    if (device_id) {
+      result = piuio_usbfs_open_id(&device, device_id);
+    } else {
+      result = piuio_usbfs_open(&device);
+    }
+  } else {
+    if (device_id == NULL) {
+      result = piuio_kmod_open(&device);
+    } else if (strchr(device_id, '-') == NULL) {
+      result = piuio_kmod_open_index(&device, atoi(device_id));
+    } else {
+      result = piuio_kmod_open_path(&device, device_id);
+    }
+  }
+
+  if (result) {
+    errno = result;
+    perror("Opening PIUIO failed");
+    exit(EXIT_FAILURE);
+  }
+
+  if (type == TYPE_USB) {
+    result = piuio_poll_open_usb(&poll, device);
+  } else if (type == TYPE_USBFS) {
+    result = piuio_poll_open_usbfs(&poll, device);
+  } else {
+    result = piuio_poll_open_kmod(&poll, device);
+  }
+
+  if (result) {
+    errno = result;
+    perror("Opening poll handle failed");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&output, 0, sizeof(output));
+  frame_ns = (uint64_t) delay_ms * 1000000;
+  cycles = 0;
+  overlapped = 0;
+  wait_ns = 0;
+
+  printf("Simulating %u ms of frame work per cycle\n", delay_ms);
+  printf("Press CTRL + C to stop\n");
+
+  start_ns = pumpio_time_now_ns();
+
+  while (!interrupted) {
+    result = piuio_poll_begin(poll, &output);
+
+    if (result) {
+      errno = result;
+      perror("Starting cycle failed");
+      break;
+    }
+
+    // Frame work, e.g. rendering, while the cycle is in flight
+    frame_end_ns = pumpio_time_now_ns() + frame_ns;
+
+    while (pumpio_time_now_ns() < frame_end_ns) {
+    }
+
+    wait_start_ns = pumpio_time_now_ns();
+    result = piuio_poll_try_end(poll, &input);
+
+    if (result == EAGAIN) {
+      result = piuio_poll_end(poll, &input);
+    } else {
+      overlapped++;
+    }
+
+    now_ns = pumpio_time_now_ns();
+    wait_ns += now_ns - wait_start_ns;
+
+    if (result) {
+      errno = result;
+      perror("Collecting cycle failed");
+      break;
+    }
+
+    cycles++;
+
+    if (now_ns - start_ns < 1000000000) {
+      continue;
+    }
+
+    printf(
+        "%.1f cycles/s, %.1f%% completed during the frame work, avg. wait "
+        "%.1f us\n",
+        cycles / ((now_ns - start_ns) / 1.0e9),
+        overlapped * 100.0 / cycles,
+        wait_ns / 1000.0 / cycles);
+
+    cycles = 0;
+    overlapped = 0;
+    wait_ns = 0;
+    start_ns = now_ns;
+  }
+
+  piuio_poll_close(poll);
+
+  if (type == TYPE_USB) {
+    piuio_usb_close(device);
+  } else if (type == TYPE_USBFS) {
+    piuio_usbfs_close(device);
+  } else {
+    piuio_kmod_close(device);
+  }
 }
 
 // -----------------------------------------------------------------------------------------
@@ -1028,55 +2101,68 @@ int main(int argc, char *argv[])
 
   if (options.mode == MODE_RAW && options.type == TYPE_USB &&
       options.game == GAME_PIU) {
-    proc_usb(options.delay_ms, render_raw_piu);
+    proc_usb(options.device_id, options.delay_ms, render_raw_piu);
   } else if (
       options.mode == MODE_RAW && options.type == TYPE_USB &&
       options.game == GAME_ITG) {
-    proc_usb(options.delay_ms, render_raw_itg);
+    proc_usb(options.device_id, options.delay_ms, render_raw_itg);
   } else if (
       options.mode == MODE_RAW && options.type == TYPE_KMOD &&
       options.game == GAME_PIU) {
-    proc_kmod(options.delay_ms, render_raw_piu);
+    proc_kmod(options.device_id, options.delay_ms, render_raw_piu);
   } else if (
       options.mode == MODE_RAW && options.type == TYPE_KMOD &&
       options.game == GAME_ITG) {
-    proc_kmod(options.delay_ms, render_raw_itg);
+    proc_kmod(options.device_id, options.delay_ms, render_raw_itg);
   } else if (
       options.mode == MODE_TEXT && options.type == TYPE_USB &&
       options.game == GAME_PIU) {
-    proc_usb(options.delay_ms, render_text_piu);
+    proc_usb(options.device_id, options.delay_ms, render_text_piu);
   } else if (
       options.mode == MODE_TEXT && options.type == TYPE_USB &&
       options.game == GAME_ITG) {
-    proc_usb(options.delay_ms, render_text_itg);
+    proc_usb(options.device_id, options.delay_ms, render_text_itg);
   } else if (
       options.mode == MODE_TEXT && options.type == TYPE_KMOD &&
       options.game == GAME_PIU) {
-    proc_kmod(options.delay_ms, render_text_piu);
+    proc_kmod(options.device_id, options.delay_ms, render_text_piu);
   } else if (
       options.mode == MODE_TEXT && options.type == TYPE_KMOD &&
       options.game == GAME_ITG) {
-    proc_kmod(options.delay_ms, render_text_itg);
+    proc_kmod(options.device_id, options.delay_ms, render_text_itg);
   } else if (
       options.mode == MODE_TUI && options.type == TYPE_USB &&
       options.game == GAME_PIU) {
-    proc_usb(options.delay_ms, render_tui_piu);
+    proc_usb(options.device_id, options.delay_ms, render_tui_piu);
   } else if (
       options.mode == MODE_TUI && options.type == TYPE_USB &&
       options.game == GAME_ITG) {
-    proc_usb(options.delay_ms, render_tui_itg);
+    proc_usb(options.device_id, options.delay_ms, render_tui_itg);
   } else if (
       options.mode == MODE_TUI && options.type == TYPE_KMOD &&
       options.game == GAME_PIU) {
-    proc_kmod(options.delay_ms, render_tui_piu);
+    proc_kmod(options.device_id, options.delay_ms, render_tui_piu);
   } else if (
       options.mode == MODE_TUI && options.type == TYPE_KMOD &&
       options.game == GAME_ITG) {
-    proc_kmod(options.delay_ms, render_tui_itg);
-  } else if (options.mode == MODE_BENCHMARK && options.type == TYPE_USB) {
-    proc_usb(options.delay_ms, render_benchmark);
-  } else if (options.mode == MODE_BENCHMARK && options.type == TYPE_KMOD) {
-    proc_kmod(options.delay_ms, render_benchmark);
+    proc_kmod(options.device_id, options.delay_ms, render_tui_itg);
+  } else if (options.mode == MODE_BENCHMARK) {
+    proc_bench(
+        options.type, options.device_id, options.delay_ms, &options.bench);
+  } else if (options.mode == MODE_LIST && options.type == TYPE_USB) {
+    proc_list_usb();
+  } else if (options.mode == MODE_LIST && options.type == TYPE_KMOD) {
+    proc_list_kmod();
+  } else if (options.mode == MODE_PROFILE && options.type == TYPE_USB) {
+    proc_profile(options.device_id, options.delay_ms, &options.bench);
+  } else if (options.mode == MODE_COMPARE) {
+    proc_compare(options.device_id, options.delay_ms, &options.bench);
+  } else if (options.mode == MODE_LOOP) {
+    proc_loop(options.type);
+  } else if (options.mode == MODE_ASYNC) {
+    proc_async(options.type, options.device_id, options.delay_ms);
+  } else if (options.mode == MODE_POLLER) {
+    proc_poller(options.type, options.device_id, &options.poller);
   } else {
     fprintf(stderr, "Invalid parameters selected\n");
     print_usage(argv);
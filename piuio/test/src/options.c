@@ -15,6 +15,61 @@ static void options_init_defaults(struct options *options)
   options->mode = MODE_RAW;
   options->type = TYPE_USB;
   options->delay_ms = 100;
+  options->device_id = NULL;
+  options->bench.warmup = 100;
+  options->bench.samples = 0;
+  options->bench.duration_s = 0;
+  options->bench.format = BENCH_FORMAT_TEXT;
+  options->bench.backends[0] = BACKEND_USB;
+  options->bench.backends[1] = BACKEND_KMOD;
+  options->bench.backend_count = 2;
+  options->bench.block = 0;
+  options->poller.interval_us = 1000;
+  options->poller.scheduler = SCHEDULER_DEFAULT;
+  options->poller.priority = 50;
+  options->poller.runtime_us = 0;
+  options->poller.cpu = -1;
+  options->poller.lock_memory = false;
+  options->poller.prefault_stack_kb = 0;
+  options->poller.sequence_path = NULL;
+  options->poller.failover_latency_us = 0;
+}
+
+static bool parse_backends(struct bench_options *bench, const char *list)
+{
+  const char *token;
+  size_t len;
+
+  bench->backend_count = 0;
+  token = list;
+
+  while (*token) {
+    len = strcspn(token, ",");
+
+    if (bench->backend_count >= BENCH_BACKENDS_MAX) {
+      return false;
+    }
+
+    if (len == 3 && !strncmp(token, "usb", len)) {
+      bench->backends[bench->backend_count++] = BACKEND_USB;
+    } else if (len == 12 && !strncmp(token, "usb-deadline", len)) {
+      bench->backends[bench->backend_count++] = BACKEND_USB_DEADLINE;
+    } else if (len == 4 && !strncmp(token, "kmod", len)) {
+      bench->backends[bench->backend_count++] = BACKEND_KMOD;
+    } else if (len == 5 && !strncmp(token, "usbfs", len)) {
+      bench->backends[bench->backend_count++] = BACKEND_USBFS;
+    } else {
+      return false;
+    }
+
+    token += len;
+
+    if (*token == ',') {
+      token++;
+    }
+  }
+
+  return bench->backend_count > 0;
 }
 
 void print_usage(char **argv)
@@ -33,22 +88,77 @@ void print_usage(char **argv)
       "outputs\n"
       "        bench: Benchmark the update call driving IO. Useful to debug "
       "performance/hardware issues\n"
+      "        list: List all connected devices of the selected type and exit\n"
+      "        poller: Drive the I/O with the library's polling thread and "
+      "report the jitter achieved with the poller options below\n"
+      "        compare: Benchmark multiple backends interleaved on the same "
+      "device and compare them, see -b\n"
+      "        profile: Break down the latency of the full cycle into its "
+      "single transfers by direction and sensor mask, usb only\n"
+      "        loop: Drive all connected devices through usbfs from a single "
+      "thread and report the cycle rate per device\n"
+      "        async: Overlap polling cycles with frame work simulated by busy "
+      "waiting for -d ms and report the time left waiting for the inputs\n"
       "  -t  Type of driving I/O (default: usb)\n"
       "        usb: Drive the I/O using user space libusb library\n"
       "        kmod: Use the piuio.ko kernel module to drive the I/O. Less "
       "user->kernel call overhead\n"
+      "        usbfs: Drive the I/O through usbfs bypassing libusb, bench, "
+      "poller and async modes only\n"
       "  -g  Game (default: piu)\n"
       "        piu: Make debug output aware of PIU output/input mappings\n"
       "        itg: Make debug output aware of ITG output/input mappings\n"
-      "  -d  Update loop delay in ms, use to reduce CPU load (default: 100)\n");
+      "  -d  Update loop delay in ms, use to reduce CPU load (default: 100, "
+      "bench: 0)\n"
+      "  -i  Identifier of the device to open if multiple are connected, see "
+      "list mode\n"
+      "        usb: Path (e.g. 1-2.4) or serial number\n"
+      "        kmod: Index N of /dev/piuioN or path (e.g. 1-2.4)\n"
+      "Poller options:\n"
+      "  -u  Polling interval in us, 0 to poll back to back (default: 1000)\n"
+      "  -s  Scheduling policy of the polling thread (default: default)\n"
+      "        default: Inherit policy of the tool\n"
+      "        fifo: SCHED_FIFO, set priority with -r\n"
+      "        deadline: SCHED_DEADLINE with the polling interval as period, "
+      "set runtime with -R\n"
+      "  -r  SCHED_FIFO priority 1-99 (default: 50)\n"
+      "  -R  SCHED_DEADLINE runtime in us (default: half the interval)\n"
+      "  -c  Pin the polling thread to the CPU with the given index\n"
+      "  -l  Lock all memory of the process with mlockall\n"
+      "  -f  Pre-fault the given amount of stack of the polling thread in "
+      "KiB\n"
+      "  -q  Play the light sequence file on the poller's sequencer\n"
+      "  -F  Switch live between usb and kmod, starting with -t, if the mean "
+      "cycle latency exceeds the given us or cycles fail\n"
+      "Benchmark options:\n"
+      "  -w  Number of warmup iterations not measured (default: 100)\n"
+      "  -n  Number of samples to measure (default: 10000, unlimited if -T "
+      "is set)\n"
+      "  -T  Max. time to measure in seconds, stops on -n or -T, whichever "
+      "comes first\n"
+      "  -o  Output format of the results (default: text)\n"
+      "        text: Human readable\n"
+      "        csv: Header and a line of values per backend\n"
+      "        json: Single object\n"
+      "  -b  Comma separated backends to compare, the first one is the "
+      "baseline (default: usb,kmod)\n"
+      "        usb: libusb, full cycle\n"
+      "        usb-deadline: libusb, full cycle bounded by a deadline\n"
+      "        kmod: piuio.ko kernel module\n"
+      "        usbfs: usbfs without libusb, full cycle submitted at once\n"
+      "  -B  Iterations per block before switching to the next backend "
+      "(default: 16, 1000 when mixing usb, kmod or usbfs)\n");
 }
 
 bool parse_args(struct options *options, int argc, char **argv)
 {
+  bool delay_set;
+
   assert(options != NULL);
   assert(argv != NULL);
 
   options_init_defaults(options);
+  delay_set = false;
 
   for (int32_t i = 1; i < argc; i++) {
     if (!strcmp(argv[i], "-h")) {
@@ -85,6 +195,18 @@ bool parse_args(struct options *options, int argc, char **argv)
         options->mode = MODE_TEXT;
       } else if (!strcmp(argv[i], "bench")) {
         options->mode = MODE_BENCHMARK;
+      } else if (!strcmp(argv[i], "list")) {
+        options->mode = MODE_LIST;
+      } else if (!strcmp(argv[i], "poller")) {
+        options->mode = MODE_POLLER;
+      } else if (!strcmp(argv[i], "compare")) {
+        options->mode = MODE_COMPARE;
+      } else if (!strcmp(argv[i], "profile")) {
+        options->mode = MODE_PROFILE;
+      } else if (!strcmp(argv[i], "loop")) {
+        options->mode = MODE_LOOP;
+      } else if (!strcmp(argv[i], "async")) {
+        options->mode = MODE_ASYNC;
       } else {
         fprintf(stderr, "Invalid parameter for -m argument\n");
         return false;
@@ -101,6 +223,8 @@ bool parse_args(struct options *options, int argc, char **argv)
         options->type = TYPE_USB;
       } else if (!strcmp(argv[i], "kmod")) {
         options->type = TYPE_KMOD;
+      } else if (!strcmp(argv[i], "usbfs")) {
+        options->type = TYPE_USBFS;
       } else {
         fprintf(stderr, "Invalid parameter for -t argument\n");
         return false;
@@ -123,8 +247,275 @@ bool parse_args(struct options *options, int argc, char **argv)
       }
 
       options->delay_ms = tmp;
+      delay_set = true;
+    } else if (!strcmp(argv[i], "-i")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -i argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->device_id = argv[i];
+    } else if (!strcmp(argv[i], "-u")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -u argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 0) {
+        fprintf(stderr, "Invalid value for for -u argument, must be >= 0\n");
+        return false;
+      }
+
+      options->poller.interval_us = tmp;
+    } else if (!strcmp(argv[i], "-s")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -s argument\n");
+        return false;
+      }
+
+      i++;
+
+      if (!strcmp(argv[i], "default")) {
+        options->poller.scheduler = SCHEDULER_DEFAULT;
+      } else if (!strcmp(argv[i], "fifo")) {
+        options->poller.scheduler = SCHEDULER_FIFO;
+      } else if (!strcmp(argv[i], "deadline")) {
+        options->poller.scheduler = SCHEDULER_DEADLINE;
+      } else {
+        fprintf(stderr, "Invalid parameter for -s argument\n");
+        return false;
+      }
+    } else if (!strcmp(argv[i], "-r")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -r argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 1 || tmp > 99) {
+        fprintf(stderr, "Invalid value for for -r argument, must be 1-99\n");
+        return false;
+      }
+
+      options->poller.priority = tmp;
+    } else if (!strcmp(argv[i], "-R")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -R argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for for -R argument, must be > 0\n");
+        return false;
+      }
+
+      options->poller.runtime_us = tmp;
+    } else if (!strcmp(argv[i], "-c")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -c argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 0) {
+        fprintf(stderr, "Invalid value for for -c argument, must be >= 0\n");
+        return false;
+      }
+
+      options->poller.cpu = tmp;
+    } else if (!strcmp(argv[i], "-l")) {
+      options->poller.lock_memory = true;
+    } else if (!strcmp(argv[i], "-f")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -f argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 0) {
+        fprintf(stderr, "Invalid value for for -f argument, must be >= 0\n");
+        return false;
+      }
+
+      options->poller.prefault_stack_kb = tmp;
+    } else if (!strcmp(argv[i], "-q")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -q argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->poller.sequence_path = argv[i];
+    } else if (!strcmp(argv[i], "-F")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -F argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for -F argument, must be > 0\n");
+        return false;
+      }
+
+      options->poller.failover_latency_us = tmp;
+    } else if (!strcmp(argv[i], "-w")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -w argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 0) {
+        fprintf(stderr, "Invalid value for for -w argument, must be >= 0\n");
+        return false;
+      }
+
+      options->bench.warmup = tmp;
+    } else if (!strcmp(argv[i], "-n")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -n argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for for -n argument, must be > 0\n");
+        return false;
+      }
+
+      options->bench.samples = tmp;
+    } else if (!strcmp(argv[i], "-T")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -T argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for for -T argument, must be > 0\n");
+        return false;
+      }
+
+      options->bench.duration_s = tmp;
+    } else if (!strcmp(argv[i], "-o")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -o argument\n");
+        return false;
+      }
+
+      i++;
+
+      if (!strcmp(argv[i], "text")) {
+        options->bench.format = BENCH_FORMAT_TEXT;
+      } else if (!strcmp(argv[i], "csv")) {
+        options->bench.format = BENCH_FORMAT_CSV;
+      } else if (!strcmp(argv[i], "json")) {
+        options->bench.format = BENCH_FORMAT_JSON;
+      } else {
+        fprintf(stderr, "Invalid parameter for -o argument\n");
+        return false;
+      }
+    } else if (!strcmp(argv[i], "-b")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -b argument\n");
+        return false;
+      }
+
+      i++;
+
+      if (!parse_backends(&options->bench, argv[i])) {
+        fprintf(stderr, "Invalid parameter for -b argument\n");
+        return false;
+      }
+    } else if (!strcmp(argv[i], "-B")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -B argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for for -B argument, must be > 0\n");
+        return false;
+      }
+
+      options->bench.block = tmp;
     }
   }
 
+  if (options->poller.failover_latency_us > 0 &&
+      options->type == TYPE_USBFS) {
+    fprintf(stderr, "Failover is supported with usb and kmod only\n");
+    return false;
+  }
+
+  // Benchmark back to back unless a delay is requested explicitly
+  if ((options->mode == MODE_BENCHMARK || options->mode == MODE_COMPARE ||
+       options->mode == MODE_PROFILE) &&
+      !delay_set) {
+    options->delay_ms = 0;
+  }
+
+  // Without any limit, measure a fixed number of samples
+  if (options->bench.samples == 0 && options->bench.duration_s == 0) {
+    options->bench.samples = 10000;
+  }
+
   return true;
-}
\ No newline at end of file
+}
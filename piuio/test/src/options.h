@@ -15,11 +15,61 @@ enum mode {
   MODE_TEXT = 1,
   MODE_TUI = 2,
   MODE_BENCHMARK = 3,
+  MODE_LIST = 4,
+  MODE_POLLER = 5,
+  MODE_COMPARE = 6,
+  MODE_PROFILE = 7,
+  MODE_LOOP = 8,
+  MODE_ASYNC = 9,
 };
 
 enum type {
   TYPE_USB = 0,
   TYPE_KMOD = 1,
+  TYPE_USBFS = 2,
+};
+
+enum scheduler {
+  SCHEDULER_DEFAULT = 0,
+  SCHEDULER_FIFO = 1,
+  SCHEDULER_DEADLINE = 2,
+};
+
+enum bench_format {
+  BENCH_FORMAT_TEXT = 0,
+  BENCH_FORMAT_CSV = 1,
+  BENCH_FORMAT_JSON = 2,
+};
+
+enum backend {
+  BACKEND_USB = 0,
+  BACKEND_USB_DEADLINE = 1,
+  BACKEND_KMOD = 2,
+  BACKEND_USBFS = 3,
+};
+
+#define BENCH_BACKENDS_MAX 8
+
+struct bench_options {
+  uint32_t warmup;
+  uint32_t samples;
+  uint32_t duration_s;
+  enum bench_format format;
+  enum backend backends[BENCH_BACKENDS_MAX];
+  size_t backend_count;
+  uint32_t block;
+};
+
+struct poller_options {
+  uint32_t interval_us;
+  enum scheduler scheduler;
+  uint8_t priority;
+  uint32_t runtime_us;
+  int32_t cpu;
+  bool lock_memory;
+  uint32_t prefault_stack_kb;
+  const char *sequence_path;
+  uint32_t failover_latency_us;
 };
 
 struct options {
@@ -27,6 +77,9 @@ struct options {
   enum mode mode;
   enum type type;
   uint32_t delay_ms;
+  const char *device_id;
+  struct bench_options bench;
+  struct poller_options poller;
 };
 
 void print_usage(char **argv);
@@ -0,0 +1,579 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "devices.h"
+#include "options.h"
+#include "usbmon.h"
+
+/* Max. number of devices evaluated */
+#define DEVICES_MAX 16
+
+#define CTRL_GET_DESCRIPTOR_TYPE 0x80
+#define CTRL_GET_DESCRIPTOR 0x06
+#define CTRL_DESCRIPTOR_DEVICE 0x01
+
+#define PAKET_SIZE 8
+#define SENSOR_MASK_BITS 0x03
+
+enum series {
+  SERIES_OUT = 0,
+  SERIES_IN = 1,
+  SERIES_GAP = 2,
+  SERIES_CYCLE = 3,
+  SERIES_COUNT = 4,
+};
+
+struct samples {
+  uint64_t *values;
+  uint64_t count;
+  uint64_t capacity;
+};
+
+/**
+ * Control transfer submitted and waiting for its completion
+ */
+struct pending {
+  bool valid;
+  uint64_t id;
+  uint64_t submit_ns;
+  uint8_t request_type;
+  uint8_t request;
+  uint16_t value;
+  uint8_t data[PAKET_SIZE];
+  uint32_t data_len;
+};
+
+struct device {
+  uint16_t busnum;
+  uint8_t devnum;
+  enum device_type type;
+  struct pending pending;
+  /* Sensor masks of P1 and P2 of the last output, selecting the sensors of
+     the next input */
+  uint8_t sensor_mask[2];
+  uint64_t last_complete_ns;
+  uint64_t cycle_start_ns;
+  uint64_t transfers;
+  uint64_t errors;
+  struct samples samples[SERIES_COUNT];
+};
+
+static volatile bool interrupted = false;
+
+static struct device devices[DEVICES_MAX];
+static size_t device_count;
+
+static void sig_handler(int sig)
+{
+  interrupted = true;
+}
+
+static const char *series_name(enum series series)
+{
+  switch (series) {
+    case SERIES_OUT:
+      return "out";
+    case SERIES_IN:
+      return "in";
+    case SERIES_GAP:
+      return "gap";
+    case SERIES_CYCLE:
+      return "cycle";
+    default:
+      return "unknown";
+  }
+}
+
+static const char *device_type_name(enum device_type type)
+{
+  return type == DEVICE_TYPE_PIUBTN ? "piubtn" : "piuio";
+}
+
+static bool samples_add(struct samples *samples, uint64_t value)
+{
+  uint64_t *values;
+  uint64_t capacity;
+
+  if (samples->count == samples->capacity) {
+    capacity = samples->capacity == 0 ? 4096 : samples->capacity * 2;
+    values =
+        (uint64_t *) realloc(samples->values, capacity * sizeof(uint64_t));
+
+    if (values == NULL) {
+      return false;
+    }
+
+    samples->values = values;
+    samples->capacity = capacity;
+  }
+
+  samples->values[samples->count++] = value;
+
+  return true;
+}
+
+static struct device *device_get(
+    const struct options *options, uint16_t busnum, uint8_t devnum)
+{
+  struct device *device;
+
+  for (size_t i = 0; i < device_count; i++) {
+    if (devices[i].busnum == busnum && devices[i].devnum == devnum) {
+      return &devices[i];
+    }
+  }
+
+  if (device_count == DEVICES_MAX) {
+    return NULL;
+  }
+
+  device = &devices[device_count++];
+  memset(device, 0, sizeof(struct device));
+  device->busnum = busnum;
+  device->devnum = devnum;
+  device->type = options->device_type;
+
+  return device;
+}
+
+// -----------------------------------------------------------------------------------------
+
+static void print_transfer_header(const struct options *options)
+{
+  if (options->format == FORMAT_CSV) {
+    printf(
+        "time_s,bus,dev,device,dir,sensor_mask_p1,sensor_mask_p2,latency_us,"
+        "gap_us,status,data\n");
+  }
+}
+
+/**
+ * Print a decoded transfer. Input data is printed with the pull ups
+ * inverted, i.e. a set bit is an active input.
+ */
+static void print_transfer(
+    const struct options *options,
+    const struct device *device,
+    const struct pending *pending,
+    const struct pumpio_usbmon_event *event,
+    int64_t gap_ns)
+{
+  const uint8_t *data;
+  uint32_t data_len;
+  bool in;
+  char mask[8];
+  char gap[16];
+
+  in = pending->request_type == PUMPIO_CTRL_TYPE_IN;
+  data = in ? event->data : pending->data;
+  data_len = in ? event->data_len : pending->data_len;
+
+  if (data_len > PAKET_SIZE) {
+    data_len = PAKET_SIZE;
+  }
+
+  if (device->type == DEVICE_TYPE_PIUIO) {
+    snprintf(
+        mask,
+        sizeof(mask),
+        "%u/%u",
+        device->sensor_mask[0],
+        device->sensor_mask[1]);
+  } else {
+    strcpy(mask, "-");
+  }
+
+  if (gap_ns >= 0) {
+    snprintf(gap, sizeof(gap), "%.1f", gap_ns / 1000.0);
+  } else {
+    strcpy(gap, "-");
+  }
+
+  if (options->format == FORMAT_CSV) {
+    printf(
+        "%.6f,%u,%u,%s,%s,%u,%u,%.1f,%s,%d,",
+        pending->submit_ns / 1e9,
+        device->busnum,
+        device->devnum,
+        device_type_name(device->type),
+        in ? "in" : "out",
+        device->sensor_mask[0],
+        device->sensor_mask[1],
+        (event->time_ns - pending->submit_ns) / 1000.0,
+        gap_ns >= 0 ? gap : "",
+        event->status);
+  } else {
+    printf(
+        "%.6f %3u.%-3u %-6s %-3s mask %-3s lat %7.1f us gap %7s us "
+        "status %4d data",
+        pending->submit_ns / 1e9,
+        device->busnum,
+        device->devnum,
+        device_type_name(device->type),
+        in ? "IN" : "OUT",
+        mask,
+        (event->time_ns - pending->submit_ns) / 1000.0,
+        gap,
+        event->status);
+  }
+
+  for (uint32_t i = 0; i < data_len; i++) {
+    printf(
+        options->format == FORMAT_CSV ? "%02X" : " %02X",
+        in ? data[i] ^ 0xFF : data[i]);
+  }
+
+  printf("\n");
+}
+
+static void print_summary(const struct options *options)
+{
+  struct pumpio_bench_result result;
+  struct device *device;
+  struct samples *samples;
+
+  if (options->format == FORMAT_CSV) {
+    printf(
+        "bus,dev,device,series,count,min_us,p50_us,p90_us,p99_us,p999_us,"
+        "max_us,mean_us\n");
+  }
+
+  for (size_t i = 0; i < device_count; i++) {
+    device = &devices[i];
+
+    if (device->transfers == 0) {
+      continue;
+    }
+
+    if (options->format == FORMAT_TEXT) {
+      printf(
+          "Device %u.%u (%s): %lu transfers, %lu errors\n",
+          device->busnum,
+          device->devnum,
+          device_type_name(device->type),
+          device->transfers,
+          device->errors);
+      printf(
+          "  %-6s %9s %9s %9s %9s %9s %9s %9s %9s\n",
+          "us",
+          "count",
+          "min",
+          "p50",
+          "p90",
+          "p99",
+          "p99.9",
+          "max",
+          "mean");
+    }
+
+    for (uint8_t j = 0; j < SERIES_COUNT; j++) {
+      samples = &device->samples[j];
+
+      if (samples->count == 0) {
+        continue;
+      }
+
+      pumpio_bench_evaluate(samples->values, samples->count, 0, &result);
+
+      if (options->format == FORMAT_CSV) {
+        printf(
+            "%u,%u,%s,%s,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+            device->busnum,
+            device->devnum,
+            device_type_name(device->type),
+            series_name(j),
+            samples->count,
+            result.min_ns / 1000.0,
+            result.p50_ns / 1000.0,
+            result.p90_ns / 1000.0,
+            result.p99_ns / 1000.0,
+            result.p999_ns / 1000.0,
+            result.max_ns / 1000.0,
+            result.mean_ns / 1000.0);
+      } else {
+        printf(
+            "  %-6s %9lu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+            series_name(j),
+            samples->count,
+            result.min_ns / 1000.0,
+            result.p50_ns / 1000.0,
+            result.p90_ns / 1000.0,
+            result.p99_ns / 1000.0,
+            result.p999_ns / 1000.0,
+            result.max_ns / 1000.0,
+            result.mean_ns / 1000.0);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------------------
+
+/**
+ * Identify a device by its device descriptor, if the capture includes the
+ * enumeration, e.g. when started before plugging in the device.
+ */
+static void
+proc_descriptor(struct device *device, const struct pumpio_usbmon_event *event)
+{
+  uint16_t vid;
+  uint16_t pid;
+
+  if (event->data_len < 12) {
+    return;
+  }
+
+  vid = event->data[8] | (event->data[9] << 8);
+  pid = event->data[10] | (event->data[11] << 8);
+
+  if (vid == PUMPIO_PIUIO_VID && pid == PUMPIO_PIUIO_PID) {
+    device->type = DEVICE_TYPE_PIUIO;
+  } else if (vid == PUMPIO_PIUBTN_VID && pid == PUMPIO_PIUBTN_PID) {
+    device->type = DEVICE_TYPE_PIUBTN;
+  }
+}
+
+static bool proc_submit(
+    const struct options *options,
+    struct device *device,
+    const struct pumpio_usbmon_event *event)
+{
+  struct pending *pending;
+  uint8_t cycle_mask;
+
+  pending = &device->pending;
+
+  pending->valid = true;
+  pending->id = event->id;
+  pending->submit_ns = event->time_ns;
+  pending->request_type = event->setup[0];
+  pending->request = event->setup[1];
+  pending->value = event->setup[2] | (event->setup[3] << 8);
+  pending->data_len =
+      event->data_len < PAKET_SIZE ? event->data_len : PAKET_SIZE;
+  memcpy(pending->data, event->data, pending->data_len);
+
+  if (pending->request != PUMPIO_CTRL_REQUEST ||
+      pending->request_type != PUMPIO_CTRL_TYPE_OUT) {
+    return true;
+  }
+
+  // A cycle starts with selecting the first sensor, PIUBTN has no sensors
+  cycle_mask = 0;
+
+  if (device->type == DEVICE_TYPE_PIUIO && pending->data_len >= 3) {
+    device->sensor_mask[0] = pending->data[0] & SENSOR_MASK_BITS;
+    device->sensor_mask[1] = pending->data[2] & SENSOR_MASK_BITS;
+    cycle_mask = device->sensor_mask[0];
+  }
+
+  if (cycle_mask == 0) {
+    if (device->cycle_start_ns != 0 &&
+        !samples_add(
+            &device->samples[SERIES_CYCLE],
+            event->time_ns - device->cycle_start_ns)) {
+      return false;
+    }
+
+    device->cycle_start_ns = event->time_ns;
+  }
+
+  return true;
+}
+
+static bool proc_complete(
+    const struct options *options,
+    struct device *device,
+    const struct pumpio_usbmon_event *event)
+{
+  struct pending *pending;
+  int64_t gap_ns;
+  enum series series;
+
+  pending = &device->pending;
+
+  if (!pending->valid || pending->id != event->id) {
+    return true;
+  }
+
+  pending->valid = false;
+
+  if (pending->request_type == CTRL_GET_DESCRIPTOR_TYPE &&
+      pending->request == CTRL_GET_DESCRIPTOR &&
+      pending->value >> 8 == CTRL_DESCRIPTOR_DEVICE) {
+    proc_descriptor(device, event);
+    return true;
+  }
+
+  if (pending->request != PUMPIO_CTRL_REQUEST ||
+      (pending->request_type != PUMPIO_CTRL_TYPE_OUT &&
+       pending->request_type != PUMPIO_CTRL_TYPE_IN)) {
+    return true;
+  }
+
+  // Time the bus was idle from the host's perspective
+  gap_ns = -1;
+
+  if (device->last_complete_ns != 0 &&
+      pending->submit_ns >= device->last_complete_ns) {
+    gap_ns = pending->submit_ns - device->last_complete_ns;
+  }
+
+  device->last_complete_ns = event->time_ns;
+  device->transfers++;
+
+  if (options->verbose) {
+    print_transfer(options, device, pending, event, gap_ns);
+  }
+
+  // Latencies of failed transfers, e.g. timeouts, would skew the results
+  if (event->status != 0 || event->type == PUMPIO_USBMON_TYPE_ERROR) {
+    device->errors++;
+    return true;
+  }
+
+  series =
+      pending->request_type == PUMPIO_CTRL_TYPE_IN ? SERIES_IN : SERIES_OUT;
+
+  if (!samples_add(
+          &device->samples[series], event->time_ns - pending->submit_ns)) {
+    return false;
+  }
+
+  if (gap_ns >= 0 && !samples_add(&device->samples[SERIES_GAP], gap_ns)) {
+    return false;
+  }
+
+  return true;
+}
+
+static uint64_t transfers_total()
+{
+  uint64_t count;
+
+  count = 0;
+
+  for (size_t i = 0; i < device_count; i++) {
+    count += devices[i].transfers;
+  }
+
+  return count;
+}
+
+static bool proc_capture(const struct options *options)
+{
+  struct pumpio_usbmon_event event;
+  struct device *device;
+  void *handle;
+  result_t result;
+  bool success;
+
+  result = pumpio_usbmon_open(&handle, options->input, options->record);
+
+  if (RESULT_IS_ERROR(result)) {
+    errno = result;
+    perror("Opening capture failed");
+    return false;
+  }
+
+  if (pumpio_usbmon_is_live(handle)) {
+    fprintf(stderr, "Capturing from %s, CTRL + C to stop\n", options->input);
+  }
+
+  if (options->verbose) {
+    print_transfer_header(options);
+  }
+
+  success = true;
+
+  while (!interrupted) {
+    result = pumpio_usbmon_read(handle, &event);
+
+    if (result == ENODATA || result == EINTR) {
+      break;
+    }
+
+    if (RESULT_IS_ERROR(result)) {
+      errno = result;
+      perror("Reading capture failed");
+      success = false;
+      break;
+    }
+
+    if (event.xfer_type != PUMPIO_USBMON_XFER_CONTROL ||
+        (options->busnum != 0 && event.busnum != options->busnum) ||
+        (options->devnum != 0 && event.devnum != options->devnum)) {
+      continue;
+    }
+
+    device = device_get(options, event.busnum, event.devnum);
+
+    if (device == NULL) {
+      continue;
+    }
+
+    if (event.type == PUMPIO_USBMON_TYPE_SUBMIT) {
+      if (event.setup_valid) {
+        success = proc_submit(options, device, &event);
+      }
+    } else {
+      success = proc_complete(options, device, &event);
+    }
+
+    if (!success) {
+      fprintf(stderr, "Out of memory storing samples\n");
+      break;
+    }
+
+    if (options->count != 0 && transfers_total() >= options->count) {
+      break;
+    }
+  }
+
+  pumpio_usbmon_close(handle);
+
+  // Keep the CSV output to a single table
+  if (transfers_total() == 0) {
+    fprintf(stderr, "No PIUIO/PIUBTN transfers found\n");
+  } else if (!options->verbose) {
+    print_summary(options);
+  } else if (options->format == FORMAT_TEXT) {
+    printf("\n");
+    print_summary(options);
+  }
+
+  return success;
+}
+
+int main(int argc, char *argv[])
+{
+  struct options options;
+  struct sigaction action;
+
+  // No SA_RESTART, a blocking read of a live capture returns on CTRL + C
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sig_handler;
+  sigaction(SIGINT, &action, NULL);
+
+  if (!parse_args(&options, argc, argv)) {
+    print_usage(argv);
+    return EXIT_FAILURE;
+  }
+
+  if (!proc_capture(&options)) {
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; i < device_count; i++) {
+    for (uint8_t j = 0; j < SERIES_COUNT; j++) {
+      free(devices[i].samples[j].values);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
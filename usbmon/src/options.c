@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "options.h"
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+static void options_init_defaults(struct options *options)
+{
+  assert(options != NULL);
+
+  options->input = "/dev/usbmon0";
+  options->record = NULL;
+  options->busnum = 0;
+  options->devnum = 0;
+  options->device_type = DEVICE_TYPE_PIUIO;
+  options->verbose = false;
+  options->count = 0;
+  options->format = FORMAT_TEXT;
+}
+
+void print_usage(char **argv)
+{
+  printf(
+      "pumpio-usbmon tool, build " __DATE__ " " __TIME__ " gitrev %s\n",
+      STRINGIFY(GITREV));
+  printf("Usage: %s [OPTION] ...\n", argv[0]);
+  printf(
+      "Decode PIUIO/PIUBTN transfers captured by usbmon and report their "
+      "latencies on the bus\n"
+      "  -h  Print this help/usage message\n"
+      "  -i  usbmon device to capture from live, e.g. /dev/usbmon1 for bus 1, "
+      "or a pcap capture file to read (default: /dev/usbmon0, all buses)\n"
+      "  -w  Record a live capture to the given pcap file\n"
+      "  -b  Only evaluate devices on the given bus number\n"
+      "  -d  Only evaluate the device with the given device number\n"
+      "  -t  Type of devices which are not identified by their device "
+      "descriptor in the capture (default: piuio)\n"
+      "        piuio: PIUIO, decodes the sensor masks\n"
+      "        piubtn: PIUBTN\n"
+      "  -v  Print every transfer decoded\n"
+      "  -n  Stop after the given number of transfers (default: unlimited, "
+      "stop a live capture with CTRL + C)\n"
+      "  -o  Output format (default: text)\n"
+      "        text: Human readable\n"
+      "        csv: Header and a line of values per series of each device, "
+      "per transfer instead if -v is set\n");
+}
+
+bool parse_args(struct options *options, int argc, char **argv)
+{
+  assert(options != NULL);
+  assert(argv != NULL);
+
+  options_init_defaults(options);
+
+  for (int32_t i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-h")) {
+      return false;
+    } else if (!strcmp(argv[i], "-i")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -i argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->input = argv[i];
+    } else if (!strcmp(argv[i], "-w")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -w argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->record = argv[i];
+    } else if (!strcmp(argv[i], "-b")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -b argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0 || tmp > UINT16_MAX) {
+        fprintf(stderr, "Invalid value for -b argument, must be > 0\n");
+        return false;
+      }
+
+      options->busnum = tmp;
+    } else if (!strcmp(argv[i], "-d")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -d argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0 || tmp > 127) {
+        fprintf(stderr, "Invalid value for -d argument, must be 1-127\n");
+        return false;
+      }
+
+      options->devnum = tmp;
+    } else if (!strcmp(argv[i], "-t")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -t argument\n");
+        return false;
+      }
+
+      i++;
+
+      if (!strcmp(argv[i], "piuio")) {
+        options->device_type = DEVICE_TYPE_PIUIO;
+      } else if (!strcmp(argv[i], "piubtn")) {
+        options->device_type = DEVICE_TYPE_PIUBTN;
+      } else {
+        fprintf(stderr, "Invalid parameter for -t argument\n");
+        return false;
+      }
+    } else if (!strcmp(argv[i], "-v")) {
+      options->verbose = true;
+    } else if (!strcmp(argv[i], "-n")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -n argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp <= 0) {
+        fprintf(stderr, "Invalid value for -n argument, must be > 0\n");
+        return false;
+      }
+
+      options->count = tmp;
+    } else if (!strcmp(argv[i], "-o")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -o argument\n");
+        return false;
+      }
+
+      i++;
+
+      if (!strcmp(argv[i], "text")) {
+        options->format = FORMAT_TEXT;
+      } else if (!strcmp(argv[i], "csv")) {
+        options->format = FORMAT_CSV;
+      } else {
+        fprintf(stderr, "Invalid parameter for -o argument\n");
+        return false;
+      }
+    } else {
+      fprintf(stderr, "Invalid argument %s\n", argv[i]);
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,32 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+enum device_type {
+  DEVICE_TYPE_PIUIO = 0,
+  DEVICE_TYPE_PIUBTN = 1,
+};
+
+enum format {
+  FORMAT_TEXT = 0,
+  FORMAT_CSV = 1,
+};
+
+struct options {
+  const char *input;
+  const char *record;
+  uint16_t busnum;
+  uint8_t devnum;
+  enum device_type device_type;
+  bool verbose;
+  uint32_t count;
+  enum format format;
+};
+
+void print_usage(char **argv);
+bool parse_args(struct options *options, int argc, char **argv);
+
+#endif
@@ -0,0 +1,969 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "devices.h"
+#include "options.h"
+#include "usbfs.h"
+
+/* Max. number of devices and controllers evaluated */
+#define DEVICES_MAX 16
+#define CONTROLLERS_MAX 32
+
+/* Max. number of hubs between a root hub and a device, USB allows 5 */
+#define HUBS_MAX 8
+
+#define NAME_MAX_LEN (NAME_MAX + 1)
+#define ATTR_MAX_LEN 64
+
+#define PAKET_SIZE 8
+#define PIUIO_SENSOR_MASKS 4
+#define CYCLE_TIMEOUT_MS 1000
+#define CYCLE_WARMUP 10
+
+/* Median latency of a single transfer for the verdicts, a full PIUIO cycle on
+   a good port takes about 3 ms, i.e. 0.4 ms per transfer */
+#define VERDICT_GOOD_NS 500000
+#define VERDICT_FAIR_NS 1500000
+
+enum device_type {
+  DEVICE_TYPE_PIUIO = 0,
+  DEVICE_TYPE_PIUBTN = 1,
+};
+
+enum verdict {
+  VERDICT_UNKNOWN = 0,
+  VERDICT_GOOD = 1,
+  VERDICT_FAIR = 2,
+  VERDICT_POOR = 3,
+};
+
+/**
+ * Host controller with its root hub, i.e. one usb bus
+ */
+struct controller {
+  uint32_t busnum;
+  /* PCI address or platform device name */
+  char name[NAME_MAX_LEN];
+  char driver[NAME_MAX_LEN];
+  /* USB version of the root hub, e.g. "2.00" */
+  char version[ATTR_MAX_LEN];
+  uint32_t speed_mbps;
+  /* Number of PCI devices on the path from the root complex down to the
+     controller, 1 if attached to the root complex directly */
+  uint32_t pci_depth;
+};
+
+struct hub {
+  char name[NAME_MAX_LEN];
+  char product[ATTR_MAX_LEN];
+  uint16_t vid;
+  uint16_t pid;
+  uint32_t speed_mbps;
+  /* Hub built into the machine, e.g. on the mainboard */
+  bool internal;
+};
+
+struct device {
+  enum device_type type;
+  char name[NAME_MAX_LEN];
+  uint32_t busnum;
+  uint32_t devnum;
+  uint32_t speed_mbps;
+  char connect_type[ATTR_MAX_LEN];
+  /* Hubs from the root hub down to the device, excluding the root hub */
+  struct hub hubs[HUBS_MAX];
+  size_t hub_count;
+  const struct controller *controller;
+};
+
+/**
+ * Free port of a root hub a device can be moved to
+ */
+struct port {
+  const struct controller *controller;
+  uint32_t number;
+  char connect_type[ATTR_MAX_LEN];
+};
+
+struct sample_ctx {
+  void *usbfs;
+  struct pumpio_usbfs_control transfers[PIUIO_SENSOR_MASKS * 2];
+  size_t count;
+  uint8_t outputs[PIUIO_SENSOR_MASKS][PAKET_SIZE];
+  uint8_t inputs[PIUIO_SENSOR_MASKS][PAKET_SIZE];
+};
+
+static volatile bool interrupted = false;
+
+static struct controller controllers[CONTROLLERS_MAX];
+static size_t controller_count;
+
+static void sig_handler(int sig)
+{
+  interrupted = true;
+}
+
+static void devices_path(
+    const struct options *options, const char *name, char *path, size_t len)
+{
+  snprintf(path, len, "%s/bus/usb/devices/%s", options->sysfs, name);
+}
+
+/**
+ * Read a single line attribute of a usb device, trailing newline and leading
+ * spaces removed
+ */
+static bool read_attr(
+    const struct options *options,
+    const char *name,
+    const char *attr,
+    char *value,
+    size_t len)
+{
+  char path[PATH_MAX];
+  char line[ATTR_MAX_LEN];
+  FILE *file;
+  char *begin;
+  bool ok;
+
+  devices_path(options, name, path, sizeof(path));
+  strncat(path, "/", sizeof(path) - strlen(path) - 1);
+  strncat(path, attr, sizeof(path) - strlen(path) - 1);
+
+  file = fopen(path, "r");
+
+  if (file == NULL) {
+    return false;
+  }
+
+  ok = fgets(line, sizeof(line), file) != NULL;
+  fclose(file);
+
+  if (!ok) {
+    return false;
+  }
+
+  line[strcspn(line, "\n")] = '\0';
+  begin = line + strspn(line, " ");
+
+  snprintf(value, len, "%s", begin);
+
+  return true;
+}
+
+static uint32_t read_attr_uint(
+    const struct options *options, const char *name, const char *attr, int base)
+{
+  char value[ATTR_MAX_LEN];
+
+  if (!read_attr(options, name, attr, value, sizeof(value))) {
+    return 0;
+  }
+
+  return (uint32_t) strtoul(value, NULL, base);
+}
+
+static bool device_exists(const struct options *options, const char *name)
+{
+  char path[PATH_MAX];
+
+  devices_path(options, name, path, sizeof(path));
+
+  return access(path, F_OK) == 0;
+}
+
+/**
+ * Join a directory and a file name, false if the result does not fit
+ */
+static bool join_path(char *path, size_t len, const char *dir, const char *name)
+{
+  return (size_t) snprintf(path, len, "%s/%s", dir, name) < len;
+}
+
+static const char *path_basename(const char *path)
+{
+  const char *slash;
+
+  slash = strrchr(path, '/');
+
+  return slash != NULL ? slash + 1 : path;
+}
+
+static bool is_pci_address(const char *name, size_t len)
+{
+  unsigned int domain;
+  unsigned int bus;
+  unsigned int slot;
+  unsigned int function;
+  char buf[NAME_MAX_LEN];
+  char end;
+
+  if (len >= sizeof(buf)) {
+    return false;
+  }
+
+  memcpy(buf, name, len);
+  buf[len] = '\0';
+
+  return sscanf(
+             buf, "%x:%x:%x.%x%c", &domain, &bus, &slot, &function, &end) ==
+      4;
+}
+
+static bool load_controller(
+    const struct options *options,
+    const char *root_hub,
+    struct controller *controller)
+{
+  char path[PATH_MAX];
+  char resolved[PATH_MAX];
+  char driver[PATH_MAX];
+  const char *component;
+  char *slash;
+  ssize_t len;
+
+  memset(controller, 0, sizeof(struct controller));
+
+  controller->busnum = read_attr_uint(options, root_hub, "busnum", 10);
+  controller->speed_mbps = read_attr_uint(options, root_hub, "speed", 10);
+  read_attr(
+      options,
+      root_hub,
+      "version",
+      controller->version,
+      sizeof(controller->version));
+
+  devices_path(options, root_hub, path, sizeof(path));
+
+  if (realpath(path, resolved) == NULL) {
+    return false;
+  }
+
+  // The root hub is a child of the host controller device
+  slash = strrchr(resolved, '/');
+
+  if (slash == NULL) {
+    return false;
+  }
+
+  *slash = '\0';
+
+  snprintf(
+      controller->name,
+      sizeof(controller->name),
+      "%.*s",
+      NAME_MAX,
+      path_basename(resolved));
+
+  len = join_path(path, sizeof(path), resolved, "driver") ?
+      readlink(path, driver, sizeof(driver) - 1) :
+      -1;
+
+  if (len > 0) {
+    driver[len] = '\0';
+    snprintf(
+        controller->driver,
+        sizeof(controller->driver),
+        "%.*s",
+        NAME_MAX,
+        path_basename(driver));
+  } else {
+    snprintf(controller->driver, sizeof(controller->driver), "unknown");
+  }
+
+  // Every PCI bridge on the way adds a hop, e.g. the chipset of the mainboard
+  component = resolved;
+
+  while (*component) {
+    len = strcspn(component, "/");
+
+    if (is_pci_address(component, len)) {
+      controller->pci_depth++;
+    }
+
+    component += len;
+    component += *component == '/';
+  }
+
+  return true;
+}
+
+static void load_controllers(const struct options *options)
+{
+  char path[PATH_MAX];
+  struct dirent *entry;
+  DIR *dir;
+
+  controller_count = 0;
+
+  snprintf(path, sizeof(path), "%s/bus/usb/devices", options->sysfs);
+  dir = opendir(path);
+
+  if (dir == NULL) {
+    return;
+  }
+
+  while ((entry = readdir(dir)) != NULL &&
+         controller_count < CONTROLLERS_MAX) {
+    if (strncmp(entry->d_name, "usb", 3)) {
+      continue;
+    }
+
+    if (load_controller(
+            options, entry->d_name, &controllers[controller_count])) {
+      controller_count++;
+    }
+  }
+
+  closedir(dir);
+}
+
+static const struct controller *find_controller(uint32_t busnum)
+{
+  for (size_t i = 0; i < controller_count; i++) {
+    if (controllers[i].busnum == busnum) {
+      return &controllers[i];
+    }
+  }
+
+  return NULL;
+}
+
+static bool is_xhci(const struct controller *controller)
+{
+  return strstr(controller->driver, "xhci") != NULL;
+}
+
+static void load_hub(
+    const struct options *options, const char *name, struct hub *hub)
+{
+  char removable[ATTR_MAX_LEN];
+  char connect_type[ATTR_MAX_LEN];
+
+  memset(hub, 0, sizeof(struct hub));
+
+  snprintf(hub->name, sizeof(hub->name), "%s", name);
+  hub->vid = (uint16_t) read_attr_uint(options, name, "idVendor", 16);
+  hub->pid = (uint16_t) read_attr_uint(options, name, "idProduct", 16);
+  hub->speed_mbps = read_attr_uint(options, name, "speed", 10);
+
+  if (!read_attr(
+          options, name, "product", hub->product, sizeof(hub->product))) {
+    snprintf(hub->product, sizeof(hub->product), "n/a");
+  }
+
+  // Firmware marks ports without an external connector as fixed/hardwired
+  hub->internal =
+      (read_attr(options, name, "removable", removable, sizeof(removable)) &&
+       !strcmp(removable, "fixed")) ||
+      (read_attr(
+           options,
+           name,
+           "port/connect_type",
+           connect_type,
+           sizeof(connect_type)) &&
+       !strcmp(connect_type, "hardwired"));
+}
+
+static void load_device(
+    const struct options *options,
+    const char *name,
+    enum device_type type,
+    struct device *device)
+{
+  char parent[NAME_MAX_LEN];
+  char *separator;
+  size_t count;
+
+  memset(device, 0, sizeof(struct device));
+
+  device->type = type;
+  snprintf(device->name, sizeof(device->name), "%s", name);
+  device->busnum = read_attr_uint(options, name, "busnum", 10);
+  device->devnum = read_attr_uint(options, name, "devnum", 10);
+  device->speed_mbps = read_attr_uint(options, name, "speed", 10);
+
+  if (!read_attr(
+          options,
+          name,
+          "port/connect_type",
+          device->connect_type,
+          sizeof(device->connect_type))) {
+    snprintf(device->connect_type, sizeof(device->connect_type), "unknown");
+  }
+
+  device->controller = find_controller(device->busnum);
+
+  // Walk up the hub chain, e.g. 1-2.4.1 is behind 1-2.4 and 1-2
+  snprintf(parent, sizeof(parent), "%s", device->name);
+  count = 0;
+
+  while ((separator = strrchr(parent, '.')) != NULL && count < HUBS_MAX) {
+    *separator = '\0';
+    count++;
+  }
+
+  device->hub_count = count;
+  snprintf(parent, sizeof(parent), "%s", device->name);
+
+  for (size_t i = count; i > 0; i--) {
+    *strrchr(parent, '.') = '\0';
+    load_hub(options, parent, &device->hubs[i - 1]);
+  }
+}
+
+static size_t load_devices(
+    const struct options *options, struct device *devices, size_t max_count)
+{
+  char path[PATH_MAX];
+  struct dirent *entry;
+  enum device_type type;
+  uint16_t vid;
+  uint16_t pid;
+  size_t count;
+  DIR *dir;
+
+  count = 0;
+
+  snprintf(path, sizeof(path), "%s/bus/usb/devices", options->sysfs);
+  dir = opendir(path);
+
+  if (dir == NULL) {
+    return 0;
+  }
+
+  while ((entry = readdir(dir)) != NULL && count < max_count) {
+    // Skip root hubs, interfaces and dot entries
+    if (entry->d_name[0] == '.' || !strncmp(entry->d_name, "usb", 3) ||
+        strchr(entry->d_name, ':') != NULL) {
+      continue;
+    }
+
+    if (options->device_id && strcmp(entry->d_name, options->device_id)) {
+      continue;
+    }
+
+    vid = (uint16_t) read_attr_uint(options, entry->d_name, "idVendor", 16);
+    pid = (uint16_t) read_attr_uint(options, entry->d_name, "idProduct", 16);
+
+    if (vid == PUMPIO_PIUIO_VID && pid == PUMPIO_PIUIO_PID) {
+      type = DEVICE_TYPE_PIUIO;
+    } else if (vid == PUMPIO_PIUBTN_VID && pid == PUMPIO_PIUBTN_PID) {
+      type = DEVICE_TYPE_PIUBTN;
+    } else {
+      continue;
+    }
+
+    load_device(options, entry->d_name, type, &devices[count]);
+    count++;
+  }
+
+  closedir(dir);
+
+  return count;
+}
+
+/**
+ * Check if a root hub port is taken by a device, including its peer port of
+ * the other root hub of the same xHCI controller
+ */
+static bool port_taken(
+    const struct options *options,
+    const char *port_dir,
+    uint32_t busnum,
+    uint32_t number)
+{
+  char name[NAME_MAX_LEN];
+  char path[PATH_MAX];
+  char peer[PATH_MAX];
+  uint32_t peer_bus;
+  uint32_t peer_number;
+  ssize_t len;
+
+  snprintf(name, sizeof(name), "%u-%u", busnum, number);
+
+  if (device_exists(options, name)) {
+    return true;
+  }
+
+  if (!join_path(path, sizeof(path), port_dir, "peer")) {
+    return false;
+  }
+
+  len = readlink(path, peer, sizeof(peer) - 1);
+
+  if (len <= 0) {
+    return false;
+  }
+
+  peer[len] = '\0';
+
+  if (sscanf(path_basename(peer), "usb%u-port%u", &peer_bus, &peer_number) !=
+      2) {
+    return false;
+  }
+
+  snprintf(name, sizeof(name), "%u-%u", peer_bus, peer_number);
+
+  return device_exists(options, name);
+}
+
+static size_t load_free_ports(
+    const struct options *options, struct port *ports, size_t max_count)
+{
+  const struct controller *controller;
+  char path[PATH_MAX];
+  char port_dir[PATH_MAX];
+  struct dirent *entry;
+  struct port *port;
+  uint32_t busnum;
+  uint32_t number;
+  size_t count;
+  FILE *file;
+  DIR *dir;
+
+  count = 0;
+
+  for (size_t i = 0; i < controller_count; i++) {
+    controller = &controllers[i];
+
+    // PIUIO and PIUBTN are full speed devices, they never use SuperSpeed
+    // root hubs
+    if (controller->speed_mbps > 480) {
+      continue;
+    }
+
+    snprintf(
+        path,
+        sizeof(path),
+        "%s/bus/usb/devices/%u-0:1.0",
+        options->sysfs,
+        controller->busnum);
+    dir = opendir(path);
+
+    if (dir == NULL) {
+      continue;
+    }
+
+    while ((entry = readdir(dir)) != NULL && count < max_count) {
+      if (sscanf(entry->d_name, "usb%u-port%u", &busnum, &number) != 2) {
+        continue;
+      }
+
+      if (!join_path(port_dir, sizeof(port_dir), path, entry->d_name) ||
+          port_taken(options, port_dir, busnum, number)) {
+        continue;
+      }
+
+      port = &ports[count];
+      port->controller = controller;
+      port->number = number;
+      snprintf(port->connect_type, sizeof(port->connect_type), "unknown");
+
+      strncat(
+          port_dir, "/connect_type", sizeof(port_dir) - strlen(port_dir) - 1);
+      file = fopen(port_dir, "r");
+
+      if (file != NULL) {
+        if (fgets(port->connect_type, sizeof(port->connect_type), file)) {
+          port->connect_type[strcspn(port->connect_type, "\n")] = '\0';
+        }
+
+        fclose(file);
+      }
+
+      // No connector to plug a device into
+      if (!strcmp(port->connect_type, "hardwired") ||
+          !strcmp(port->connect_type, "not used")) {
+        continue;
+      }
+
+      count++;
+    }
+
+    closedir(dir);
+  }
+
+  return count;
+}
+
+/**
+ * Compare two controllers by their expected latency, < 0 if a is better
+ */
+static int compare_controllers(
+    const struct controller *a, const struct controller *b)
+{
+  if (a->pci_depth != b->pci_depth) {
+    return a->pci_depth < b->pci_depth ? -1 : 1;
+  }
+
+  if (is_xhci(a) != is_xhci(b)) {
+    return is_xhci(a) ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static const struct port *find_best_port(const struct port *ports, size_t count)
+{
+  const struct port *best;
+  int cmp;
+
+  best = NULL;
+
+  for (size_t i = 0; i < count; i++) {
+    if (best == NULL) {
+      best = &ports[i];
+      continue;
+    }
+
+    cmp = compare_controllers(ports[i].controller, best->controller);
+
+    // Prefer ports known to have a connector
+    if (cmp < 0 ||
+        (cmp == 0 && !strcmp(ports[i].connect_type, "hotplug") &&
+         strcmp(best->connect_type, "hotplug"))) {
+      best = &ports[i];
+    }
+  }
+
+  return best;
+}
+
+static result_t sample_cycle(void *ctx)
+{
+  struct sample_ctx *sample;
+  result_t result;
+
+  sample = (struct sample_ctx *) ctx;
+
+  result = pumpio_usbfs_control_batch(
+      sample->usbfs, sample->transfers, sample->count, CYCLE_TIMEOUT_MS);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  for (size_t i = 0; i < sample->count; i++) {
+    if (sample->transfers[i].len_res != sample->transfers[i].len) {
+      return EIO;
+    }
+  }
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Run polling cycles like the libraries do, all outputs off
+ */
+static result_t sample_latency(
+    const struct options *options,
+    const struct device *device,
+    struct pumpio_bench_result *result)
+{
+  struct pumpio_bench_config config;
+  struct pumpio_usbfs_control *transfer;
+  struct sample_ctx sample;
+  result_t ret;
+  size_t cycles;
+
+  memset(&sample, 0, sizeof(sample));
+
+  if (device->type == DEVICE_TYPE_PIUIO) {
+    ret = pumpio_usbfs_open(
+        &sample.usbfs,
+        PUMPIO_PIUIO_VID,
+        PUMPIO_PIUIO_PID,
+        device->name,
+        PUMPIO_DEVICE_CONFIG,
+        PUMPIO_DEVICE_IFACE);
+    cycles = PIUIO_SENSOR_MASKS;
+  } else {
+    ret = pumpio_usbfs_open(
+        &sample.usbfs,
+        PUMPIO_PIUBTN_VID,
+        PUMPIO_PIUBTN_PID,
+        device->name,
+        PUMPIO_DEVICE_CONFIG,
+        PUMPIO_DEVICE_IFACE);
+    cycles = 1;
+  }
+
+  if (RESULT_IS_ERROR(ret)) {
+    return ret;
+  }
+
+  // PIUIO selects the sensors of the next input with the sensor mask in the
+  // first output byte, like the libraries do
+  for (size_t i = 0; i < cycles; i++) {
+    sample.outputs[i][0] = (uint8_t) i;
+
+    transfer = &sample.transfers[sample.count++];
+    transfer->request_type = PUMPIO_CTRL_TYPE_OUT;
+    transfer->request = PUMPIO_CTRL_REQUEST;
+    transfer->data = sample.outputs[i];
+    transfer->len = PAKET_SIZE;
+
+    transfer = &sample.transfers[sample.count++];
+    transfer->request_type = PUMPIO_CTRL_TYPE_IN;
+    transfer->request = PUMPIO_CTRL_REQUEST;
+    transfer->data = sample.inputs[i];
+    transfer->len = PAKET_SIZE;
+  }
+
+  memset(&config, 0, sizeof(config));
+  config.warmup = CYCLE_WARMUP;
+  config.samples = options->cycles;
+
+  ret = pumpio_bench_run(&config, sample_cycle, &sample, &interrupted, result);
+
+  pumpio_usbfs_close(sample.usbfs);
+
+  return ret;
+}
+
+static enum verdict evaluate_latency(
+    const struct device *device, const struct pumpio_bench_result *result)
+{
+  uint64_t transfer_ns;
+
+  transfer_ns = result->p50_ns /
+      (device->type == DEVICE_TYPE_PIUIO ? PIUIO_SENSOR_MASKS * 2 : 2);
+
+  if (transfer_ns <= VERDICT_GOOD_NS) {
+    return VERDICT_GOOD;
+  } else if (transfer_ns <= VERDICT_FAIR_NS) {
+    return VERDICT_FAIR;
+  } else {
+    return VERDICT_POOR;
+  }
+}
+
+static const char *verdict_str(enum verdict verdict)
+{
+  switch (verdict) {
+    case VERDICT_GOOD:
+      return "good";
+    case VERDICT_FAIR:
+      return "fair";
+    case VERDICT_POOR:
+      return "poor";
+    default:
+      return "unknown, latency not sampled";
+  }
+}
+
+static void print_controller(const struct controller *controller)
+{
+  printf(
+      "  Controller %s, driver %s, PCI depth %u\n",
+      controller->name,
+      controller->driver,
+      controller->pci_depth);
+  printf(
+      "  Root hub usb%u, USB %s, %u Mbps\n",
+      controller->busnum,
+      controller->version,
+      controller->speed_mbps);
+}
+
+static void print_recommendation(
+    const struct device *device,
+    enum verdict verdict,
+    const struct port *ports,
+    size_t port_count)
+{
+  const struct port *best;
+  bool internal;
+  bool better;
+
+  internal = false;
+
+  for (size_t i = 0; i < device->hub_count; i++) {
+    internal |= device->hubs[i].internal;
+  }
+
+  if (device->hub_count == 0) {
+    printf("  Topology: directly on the root hub\n");
+  } else if (internal) {
+    printf("  Topology: behind an internal hub\n");
+  } else {
+    printf("  Topology: behind an external hub\n");
+  }
+
+  printf("  Verdict: %s\n", verdict_str(verdict));
+
+  if (verdict == VERDICT_GOOD) {
+    printf("  Recommendation: keep the current port\n");
+    return;
+  }
+
+  best = find_best_port(ports, port_count);
+
+  // Any root hub port beats a hub, otherwise only a faster controller helps
+  better = best != NULL &&
+      (device->hub_count > 0 || device->controller == NULL ||
+       compare_controllers(best->controller, device->controller) < 0);
+
+  if (better) {
+    printf(
+        "  Recommendation: move to port %u of bus %u (controller %s, %s, "
+        "connector %s)\n",
+        best->number,
+        best->controller->busnum,
+        best->controller->name,
+        best->controller->driver,
+        best->connect_type);
+  } else if (verdict == VERDICT_UNKNOWN) {
+    printf("  Recommendation: keep the current port, sample to verify\n");
+  } else {
+    printf(
+        "  Recommendation: no free port with a better topology, try the "
+        "remaining ports by hand or a PCIe USB card\n");
+  }
+}
+
+static void print_device(
+    const struct options *options,
+    struct device *device,
+    const struct port *ports,
+    size_t port_count)
+{
+  struct pumpio_bench_result result;
+  const struct hub *hub;
+  enum verdict verdict;
+  result_t ret;
+
+  printf(
+      "%s %s, bus %u, device %u, %u Mbps, connector %s\n",
+      device->type == DEVICE_TYPE_PIUIO ? "PIUIO" : "PIUBTN",
+      device->name,
+      device->busnum,
+      device->devnum,
+      device->speed_mbps,
+      device->connect_type);
+
+  if (device->controller != NULL) {
+    print_controller(device->controller);
+  }
+
+  for (size_t i = 0; i < device->hub_count; i++) {
+    hub = &device->hubs[i];
+
+    printf(
+        "  Hub %s, %04x:%04x %s, %u Mbps, %s\n",
+        hub->name,
+        hub->vid,
+        hub->pid,
+        hub->product,
+        hub->speed_mbps,
+        hub->internal ? "internal" : "external");
+  }
+
+  verdict = VERDICT_UNKNOWN;
+
+  if (options->cycles > 0) {
+    ret = sample_latency(options, device, &result);
+
+    if (RESULT_IS_SUCCESS(ret)) {
+      printf(
+          "  Latency of %lu cycles: min %.3f, p50 %.3f, p99 %.3f, max %.3f "
+          "ms\n",
+          result.samples,
+          result.min_ns / 1.0e6,
+          result.p50_ns / 1.0e6,
+          result.p99_ns / 1.0e6,
+          result.max_ns / 1.0e6);
+
+      verdict = evaluate_latency(device, &result);
+    } else {
+      printf("  Latency not sampled: %s\n", strerror(ret));
+    }
+  }
+
+  print_recommendation(device, verdict, ports, port_count);
+}
+
+static void print_ports(const struct port *ports, size_t port_count)
+{
+  printf("Controllers:\n");
+
+  for (size_t i = 0; i < controller_count; i++) {
+    print_controller(&controllers[i]);
+  }
+
+  printf("Free ports usable by full speed devices:\n");
+
+  for (size_t i = 0; i < port_count; i++) {
+    printf(
+        "  Bus %u port %u, controller %s, connector %s\n",
+        ports[i].controller->busnum,
+        ports[i].number,
+        ports[i].controller->name,
+        ports[i].connect_type);
+  }
+}
+
+static bool proc_topology(const struct options *options)
+{
+  struct device devices[DEVICES_MAX];
+  struct port ports[CONTROLLERS_MAX * 16];
+  size_t device_count;
+  size_t port_count;
+
+  load_controllers(options);
+
+  if (controller_count == 0) {
+    fprintf(
+        stderr,
+        "No usb controllers found in %s/bus/usb/devices\n",
+        options->sysfs);
+    return false;
+  }
+
+  port_count =
+      load_free_ports(options, ports, sizeof(ports) / sizeof(ports[0]));
+
+  if (options->verbose) {
+    print_ports(ports, port_count);
+  }
+
+  device_count = load_devices(options, devices, DEVICES_MAX);
+
+  if (device_count == 0) {
+    fprintf(stderr, "No PIUIO or PIUBTN devices found\n");
+    return false;
+  }
+
+  for (size_t i = 0; i < device_count && !interrupted; i++) {
+    print_device(options, &devices[i], ports, port_count);
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  struct options options;
+
+  signal(SIGINT, sig_handler);
+
+  if (!parse_args(&options, argc, argv)) {
+    print_usage(argv);
+    return EXIT_FAILURE;
+  }
+
+  if (!proc_topology(&options)) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
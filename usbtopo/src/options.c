@@ -0,0 +1,93 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "options.h"
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+static void options_init_defaults(struct options *options)
+{
+  assert(options != NULL);
+
+  options->sysfs = "/sys";
+  options->device_id = NULL;
+  options->cycles = 500;
+  options->verbose = false;
+}
+
+void print_usage(char **argv)
+{
+  printf(
+      "pumpio-usbtopo tool, build " __DATE__ " " __TIME__ " gitrev %s\n",
+      STRINGIFY(GITREV));
+  printf("Usage: %s [OPTION] ...\n", argv[0]);
+  printf(
+      "Map the position of connected PIUIO/PIUBTN devices in the USB "
+      "topology, sample their latency and recommend a port\n"
+      "  -h  Print this help/usage message\n"
+      "  -i  Only evaluate the device with the given path, e.g. 1-2.4\n"
+      "  -n  Number of polling cycles to sample per device, 0 to only map "
+      "the topology (default: 500)\n"
+      "  -r  Root of the sysfs tree, e.g. of a copy taken on another machine "
+      "(default: /sys)\n"
+      "  -v  Also list all controllers and their free ports\n");
+}
+
+bool parse_args(struct options *options, int argc, char **argv)
+{
+  assert(options != NULL);
+  assert(argv != NULL);
+
+  options_init_defaults(options);
+
+  for (int32_t i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-h")) {
+      return false;
+    } else if (!strcmp(argv[i], "-i")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -i argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->device_id = argv[i];
+    } else if (!strcmp(argv[i], "-n")) {
+      int32_t tmp;
+
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -n argument\n");
+        return false;
+      }
+
+      i++;
+
+      tmp = atoi(argv[i]);
+
+      if (tmp < 0) {
+        fprintf(stderr, "Invalid value for -n argument, must be >= 0\n");
+        return false;
+      }
+
+      options->cycles = tmp;
+    } else if (!strcmp(argv[i], "-r")) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing parameter for -r argument\n");
+        return false;
+      }
+
+      i++;
+
+      options->sysfs = argv[i];
+    } else if (!strcmp(argv[i], "-v")) {
+      options->verbose = true;
+    } else {
+      fprintf(stderr, "Invalid argument %s\n", argv[i]);
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,18 @@
+#ifndef OPTIONS_H_
+#define OPTIONS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct options {
+  const char *sysfs;
+  const char *device_id;
+  uint32_t cycles;
+  bool verbose;
+};
+
+void print_usage(char **argv);
+bool parse_args(struct options *options, int argc, char **argv);
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * Atomic members of structs shared by all device libraries which are also
+ * included from C++. C++ has no _Atomic qualifier, std::atomic of the lock-free
+ * types used has the same size, alignment and representation with gcc and
+ * clang.
+ */
+#ifndef PUMPIO_ATOMIC_H
+#define PUMPIO_ATOMIC_H
+
+#ifdef __cplusplus
+extern "C++" {
+#include <atomic>
+}
+
+#define PUMPIO_ATOMIC(type) std::atomic<type>
+#else
+#include <stdatomic.h>
+
+#define PUMPIO_ATOMIC(type) _Atomic(type)
+#endif
+
+#endif
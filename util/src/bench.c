@@ -0,0 +1,709 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "hist.h"
+#include "time_.h"
+
+#define PUMPIO_BENCH_INITIAL_CAPACITY 4096
+
+/**
+ * Samples of a single backend
+ */
+struct pumpio_bench_samples {
+  uint64_t *values;
+  uint64_t count;
+  uint64_t capacity;
+  uint64_t elapsed_ns;
+  /* Median of every block run. Consecutive samples are autocorrelated, e.g.
+     by a busy bus, the blocks are compared instead */
+  uint64_t *block_medians;
+  uint64_t blocks;
+  uint64_t block_capacity;
+};
+
+static int pumpio_bench_compare(const void *a, const void *b)
+{
+  uint64_t va;
+  uint64_t vb;
+
+  va = *((const uint64_t *) a);
+  vb = *((const uint64_t *) b);
+
+  return (va > vb) - (va < vb);
+}
+
+/**
+ * Nearest rank percentile of sorted samples, ranked like the histograms
+ */
+static uint64_t pumpio_bench_percentile(
+    const uint64_t *samples, uint64_t count, double percentile)
+{
+  return samples[pumpio_hist_rank(count, percentile) - 1];
+}
+
+void pumpio_bench_evaluate(
+    uint64_t *samples,
+    uint64_t count,
+    uint64_t elapsed_ns,
+    struct pumpio_bench_result *result)
+{
+  double accu;
+  double diff;
+
+  assert(samples != NULL || count == 0);
+  assert(result != NULL);
+
+  memset(result, 0, sizeof(struct pumpio_bench_result));
+
+  result->samples = count;
+  result->elapsed_ns = elapsed_ns;
+
+  if (count == 0) {
+    return;
+  }
+
+  if (elapsed_ns > 0) {
+    result->rate_hz = count * 1.0e9 / elapsed_ns;
+  }
+
+  qsort(samples, count, sizeof(uint64_t), pumpio_bench_compare);
+
+  result->min_ns = samples[0];
+  result->p50_ns = pumpio_bench_percentile(samples, count, 50.0);
+  result->p90_ns = pumpio_bench_percentile(samples, count, 90.0);
+  result->p99_ns = pumpio_bench_percentile(samples, count, 99.0);
+  result->p999_ns = pumpio_bench_percentile(samples, count, 99.9);
+  result->max_ns = samples[count - 1];
+
+  accu = 0;
+
+  for (uint64_t i = 0; i < count; i++) {
+    accu += samples[i];
+  }
+
+  result->mean_ns = accu / count;
+
+  accu = 0;
+
+  for (uint64_t i = 0; i < count; i++) {
+    diff = samples[i] - result->mean_ns;
+    accu += diff * diff;
+  }
+
+  result->stddev_ns = sqrt(accu / count);
+}
+
+/**
+ * Mann-Whitney U test of two sets of sorted samples using the normal
+ * approximation. Ties get the average rank, the variance is not corrected for
+ * ties which are rare with ns resolution.
+ */
+static void pumpio_bench_mann_whitney(
+    const uint64_t *a,
+    uint64_t n,
+    const uint64_t *b,
+    uint64_t m,
+    struct pumpio_bench_comparison *comparison)
+{
+  uint64_t i;
+  uint64_t j;
+  uint64_t value;
+  uint64_t ties_a;
+  uint64_t ties_b;
+  double rank;
+  double rank_sum;
+  double u;
+  double sigma;
+
+  comparison->z = 0;
+  comparison->p_value = 1;
+
+  if (n == 0 || m == 0) {
+    return;
+  }
+
+  i = 0;
+  j = 0;
+  rank = 1;
+  rank_sum = 0;
+
+  while (i < n || j < m) {
+    if (j >= m || (i < n && a[i] <= b[j])) {
+      value = a[i];
+    } else {
+      value = b[j];
+    }
+
+    ties_a = 0;
+    ties_b = 0;
+
+    while (i < n && a[i] == value) {
+      ties_a++;
+      i++;
+    }
+
+    while (j < m && b[j] == value) {
+      ties_b++;
+      j++;
+    }
+
+    // All tied values get the average of the ranks they occupy
+    rank_sum += ties_a * (rank + (ties_a + ties_b - 1) / 2.0);
+    rank += ties_a + ties_b;
+  }
+
+  u = rank_sum - n * (n + 1) / 2.0;
+  sigma = sqrt(n * (double) m * (n + m + 1) / 12.0);
+
+  comparison->z = (u - n * (double) m / 2.0) / sigma;
+  comparison->p_value = erfc(fabs(comparison->z) / M_SQRT2);
+}
+
+static result_t
+pumpio_bench_samples_init(struct pumpio_bench_samples *samples, uint64_t count)
+{
+  samples->count = 0;
+  samples->elapsed_ns = 0;
+  samples->block_medians = NULL;
+  samples->blocks = 0;
+  samples->block_capacity = 0;
+  samples->capacity = count > 0 ? count : PUMPIO_BENCH_INITIAL_CAPACITY;
+
+  // Allocate up front to keep allocations off the measuring path if the
+  // number of samples is known
+  samples->values = (uint64_t *) malloc(samples->capacity * sizeof(uint64_t));
+
+  if (samples->values == NULL) {
+    return ENOMEM;
+  }
+
+  return RESULT_SUCCESS;
+}
+
+static result_t
+pumpio_bench_samples_reserve(struct pumpio_bench_samples *samples)
+{
+  uint64_t *tmp;
+
+  if (samples->count < samples->capacity) {
+    return RESULT_SUCCESS;
+  }
+
+  tmp = (uint64_t *) realloc(
+      samples->values, samples->capacity * 2 * sizeof(uint64_t));
+
+  if (tmp == NULL) {
+    return ENOMEM;
+  }
+
+  samples->values = tmp;
+  samples->capacity *= 2;
+
+  return RESULT_SUCCESS;
+}
+
+static bool pumpio_bench_stopped(
+    const struct pumpio_bench_config *config,
+    const volatile bool *stop,
+    uint64_t start_ns,
+    uint64_t now_ns)
+{
+  if (stop != NULL && *stop) {
+    return true;
+  }
+
+  return config->duration_ms > 0 &&
+      now_ns - start_ns >= config->duration_ms * UINT64_C(1000000);
+}
+
+static result_t pumpio_bench_warmup(
+    const struct pumpio_bench_config *config,
+    const struct pumpio_bench_backend *backend,
+    const volatile bool *stop)
+{
+  result_t result;
+
+  for (uint32_t i = 0; i < config->warmup; i++) {
+    if (stop != NULL && *stop) {
+      break;
+    }
+
+    result = backend->func(backend->ctx);
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    if (config->delay_us > 0) {
+      usleep(config->delay_us);
+    }
+  }
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Append the median of the samples of a block starting at the given sample
+ */
+static result_t pumpio_bench_samples_add_block(
+    struct pumpio_bench_samples *samples, uint64_t first)
+{
+  uint64_t *tmp;
+  uint64_t count;
+
+  count = samples->count - first;
+
+  if (count == 0) {
+    return RESULT_SUCCESS;
+  }
+
+  if (samples->blocks == samples->block_capacity) {
+    tmp = (uint64_t *) realloc(
+        samples->block_medians,
+        (samples->block_capacity + PUMPIO_BENCH_INITIAL_CAPACITY) *
+            sizeof(uint64_t));
+
+    if (tmp == NULL) {
+      return ENOMEM;
+    }
+
+    samples->block_medians = tmp;
+    samples->block_capacity += PUMPIO_BENCH_INITIAL_CAPACITY;
+  }
+
+  // Order of the samples does not matter, all are sorted by the evaluation
+  qsort(
+      &samples->values[first],
+      count,
+      sizeof(uint64_t),
+      pumpio_bench_compare);
+
+  samples->block_medians[samples->blocks++] =
+      pumpio_bench_percentile(&samples->values[first], count, 50.0);
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Run a block of iterations of a backend and append the samples
+ */
+static result_t pumpio_bench_block(
+    const struct pumpio_bench_config *config,
+    uint32_t block,
+    const struct pumpio_bench_backend *backend,
+    const volatile bool *stop,
+    uint64_t run_start_ns,
+    struct pumpio_bench_samples *samples)
+{
+  uint64_t block_start_ns;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  uint64_t first;
+  result_t result;
+
+  block_start_ns = pumpio_time_now_ns();
+  end_ns = block_start_ns;
+  first = samples->count;
+
+  for (uint32_t i = 0; i < block; i++) {
+    if (config->samples > 0 && samples->count >= config->samples) {
+      break;
+    }
+
+    if (pumpio_bench_stopped(config, stop, run_start_ns, end_ns)) {
+      break;
+    }
+
+    result = pumpio_bench_samples_reserve(samples);
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    start_ns = pumpio_time_now_ns();
+
+    result = backend->func(backend->ctx);
+
+    end_ns = pumpio_time_now_ns();
+
+    if (RESULT_IS_ERROR(result)) {
+      return result;
+    }
+
+    samples->values[samples->count++] = end_ns - start_ns;
+
+    if (config->delay_us > 0) {
+      usleep(config->delay_us);
+      end_ns = pumpio_time_now_ns();
+    }
+  }
+
+  samples->elapsed_ns += end_ns - block_start_ns;
+
+  return pumpio_bench_samples_add_block(samples, first);
+}
+
+/**
+ * Run a single block of a backend including acquiring and releasing it
+ */
+static result_t pumpio_bench_acquired_block(
+    const struct pumpio_bench_config *config,
+    uint32_t block,
+    const struct pumpio_bench_backend *backend,
+    const volatile bool *stop,
+    uint64_t run_start_ns,
+    struct pumpio_bench_samples *samples)
+{
+  result_t result;
+
+  if (backend->acquire == NULL) {
+    return pumpio_bench_block(
+        config, block, backend, stop, run_start_ns, samples);
+  }
+
+  result = backend->acquire(backend->ctx);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  result = pumpio_bench_warmup(config, backend, stop);
+
+  if (RESULT_IS_SUCCESS(result)) {
+    result =
+        pumpio_bench_block(config, block, backend, stop, run_start_ns, samples);
+  }
+
+  if (backend->release != NULL) {
+    backend->release(backend->ctx);
+  }
+
+  return result;
+}
+
+result_t pumpio_bench_run(
+    const struct pumpio_bench_config *config,
+    pumpio_bench_func_t func,
+    void *ctx,
+    const volatile bool *stop,
+    struct pumpio_bench_result *result)
+{
+  struct pumpio_bench_backend backend;
+
+  assert(config != NULL);
+  assert(func != NULL);
+  assert(result != NULL);
+
+  memset(&backend, 0, sizeof(backend));
+  backend.func = func;
+  backend.ctx = ctx;
+
+  // A single block spanning the whole run
+  return pumpio_bench_run_interleaved(
+      config, UINT32_MAX, &backend, 1, stop, result, NULL);
+}
+
+result_t pumpio_bench_run_interleaved(
+    const struct pumpio_bench_config *config,
+    uint32_t block,
+    const struct pumpio_bench_backend *backends,
+    size_t count,
+    const volatile bool *stop,
+    struct pumpio_bench_result *results,
+    struct pumpio_bench_comparison *comparisons)
+{
+  struct pumpio_bench_samples samples[PUMPIO_BENCH_BACKENDS_MAX];
+  uint64_t run_start_ns;
+  uint64_t round;
+  size_t index;
+  bool pending;
+  result_t result;
+
+  assert(config != NULL);
+  assert(backends != NULL);
+  assert(results != NULL);
+
+  if (count == 0 || count > PUMPIO_BENCH_BACKENDS_MAX || block == 0) {
+    return EINVAL;
+  }
+
+  if (config->samples == 0 && config->duration_ms == 0 && stop == NULL) {
+    return EINVAL;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    result = pumpio_bench_samples_init(&samples[i], config->samples);
+
+    if (RESULT_IS_ERROR(result)) {
+      for (size_t j = 0; j < i; j++) {
+        free(samples[j].values);
+        free(samples[j].block_medians);
+      }
+
+      return result;
+    }
+  }
+
+  result = RESULT_SUCCESS;
+
+  // Backends that need to be acquired warm up after each acquire instead
+  for (size_t i = 0; i < count && RESULT_IS_SUCCESS(result); i++) {
+    if (backends[i].acquire == NULL) {
+      result = pumpio_bench_warmup(config, &backends[i], stop);
+    }
+  }
+
+  run_start_ns = pumpio_time_now_ns();
+  round = 0;
+  pending = true;
+
+  while (RESULT_IS_SUCCESS(result) && pending &&
+         !pumpio_bench_stopped(
+             config, stop, run_start_ns, pumpio_time_now_ns())) {
+    pending = false;
+
+    for (size_t i = 0; i < count; i++) {
+      // Rotate the order every round, no backend always runs first
+      index = (round + i) % count;
+
+      if (config->samples > 0 && samples[index].count >= config->samples) {
+        continue;
+      }
+
+      pending = true;
+
+      result = pumpio_bench_acquired_block(
+          config, block, &backends[index], stop, run_start_ns, &samples[index]);
+
+      if (RESULT_IS_ERROR(result)) {
+        break;
+      }
+    }
+
+    round++;
+  }
+
+  if (RESULT_IS_SUCCESS(result)) {
+    for (size_t i = 0; i < count; i++) {
+      pumpio_bench_evaluate(
+          samples[i].values,
+          samples[i].count,
+          samples[i].elapsed_ns,
+          &results[i]);
+    }
+
+    for (size_t i = 0; comparisons != NULL && i < count; i++) {
+      qsort(
+          samples[i].block_medians,
+          samples[i].blocks,
+          sizeof(uint64_t),
+          pumpio_bench_compare);
+    }
+
+    // The test assumes independent observations, which samples of a block
+    // are not. Compare the medians of the blocks instead
+    for (size_t i = 0; comparisons != NULL && i < count; i++) {
+      comparisons[i].p50_diff_ns =
+          (int64_t) results[i].p50_ns - (int64_t) results[0].p50_ns;
+      comparisons[i].blocks = samples[i].blocks;
+
+      pumpio_bench_mann_whitney(
+          samples[i].block_medians,
+          samples[i].blocks,
+          samples[0].block_medians,
+          samples[0].blocks,
+          &comparisons[i]);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    free(samples[i].values);
+    free(samples[i].block_medians);
+  }
+
+  return result;
+}
+
+static void pumpio_bench_print_csv_header(FILE *file, bool comparison)
+{
+  fprintf(
+      file,
+      "name,warmup,samples,elapsed_s,rate_hz,min_us,p50_us,p90_us,p99_us,"
+      "p999_us,max_us,mean_us,stddev_us%s\n",
+      comparison ? ",baseline,p50_diff_us,blocks,z,p_value" : "");
+}
+
+static void pumpio_bench_print_csv(
+    FILE *file,
+    const char *name,
+    const struct pumpio_bench_config *config,
+    const struct pumpio_bench_result *result)
+{
+  fprintf(
+      file,
+      "%s,%u,%lu,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f",
+      name,
+      config->warmup,
+      result->samples,
+      result->elapsed_ns / 1.0e9,
+      result->rate_hz,
+      result->min_ns / 1.0e3,
+      result->p50_ns / 1.0e3,
+      result->p90_ns / 1.0e3,
+      result->p99_ns / 1.0e3,
+      result->p999_ns / 1.0e3,
+      result->max_ns / 1.0e3,
+      result->mean_ns / 1.0e3,
+      result->stddev_ns / 1.0e3);
+}
+
+static void pumpio_bench_print_json(
+    FILE *file,
+    const char *name,
+    const struct pumpio_bench_config *config,
+    const struct pumpio_bench_result *result)
+{
+  fprintf(
+      file,
+      "{\"name\": \"%s\", \"warmup\": %u, \"samples\": %lu, "
+      "\"elapsed_s\": %.6f, \"rate_hz\": %.3f, \"min_us\": %.3f, "
+      "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, "
+      "\"p999_us\": %.3f, \"max_us\": %.3f, \"mean_us\": %.3f, "
+      "\"stddev_us\": %.3f",
+      name,
+      config->warmup,
+      result->samples,
+      result->elapsed_ns / 1.0e9,
+      result->rate_hz,
+      result->min_ns / 1.0e3,
+      result->p50_ns / 1.0e3,
+      result->p90_ns / 1.0e3,
+      result->p99_ns / 1.0e3,
+      result->p999_ns / 1.0e3,
+      result->max_ns / 1.0e3,
+      result->mean_ns / 1.0e3,
+      result->stddev_ns / 1.0e3);
+}
+
+static void pumpio_bench_print_text(
+    FILE *file,
+    const char *name,
+    const struct pumpio_bench_config *config,
+    const struct pumpio_bench_result *result)
+{
+  fprintf(file, "Benchmark: %s\n", name);
+  fprintf(file, "  Warmup: %u\n", config->warmup);
+  fprintf(file, "  Samples: %lu\n", result->samples);
+  fprintf(file, "  Elapsed: %.3f s\n", result->elapsed_ns / 1.0e9);
+  fprintf(file, "  Rate: %.1f Hz\n", result->rate_hz);
+  fprintf(file, "  Min: %.3f us\n", result->min_ns / 1.0e3);
+  fprintf(file, "  p50: %.3f us\n", result->p50_ns / 1.0e3);
+  fprintf(file, "  p90: %.3f us\n", result->p90_ns / 1.0e3);
+  fprintf(file, "  p99: %.3f us\n", result->p99_ns / 1.0e3);
+  fprintf(file, "  p99.9: %.3f us\n", result->p999_ns / 1.0e3);
+  fprintf(file, "  Max: %.3f us\n", result->max_ns / 1.0e3);
+  fprintf(file, "  Mean: %.3f us\n", result->mean_ns / 1.0e3);
+  fprintf(file, "  Stddev: %.3f us\n", result->stddev_ns / 1.0e3);
+}
+
+void pumpio_bench_print(
+    FILE *file,
+    const char *name,
+    const struct pumpio_bench_config *config,
+    const struct pumpio_bench_result *result,
+    enum pumpio_bench_format format)
+{
+  assert(file != NULL);
+  assert(name != NULL);
+  assert(config != NULL);
+  assert(result != NULL);
+
+  // Times in us with ns precision, fixed field order for diffing
+  if (format == PUMPIO_BENCH_FORMAT_CSV) {
+    pumpio_bench_print_csv_header(file, false);
+    pumpio_bench_print_csv(file, name, config, result);
+    fprintf(file, "\n");
+  } else if (format == PUMPIO_BENCH_FORMAT_JSON) {
+    pumpio_bench_print_json(file, name, config, result);
+    fprintf(file, "}\n");
+  } else {
+    pumpio_bench_print_text(file, name, config, result);
+  }
+}
+
+void pumpio_bench_print_interleaved(
+    FILE *file,
+    const struct pumpio_bench_config *config,
+    uint32_t block,
+    const struct pumpio_bench_backend *backends,
+    size_t count,
+    const struct pumpio_bench_result *results,
+    const struct pumpio_bench_comparison *comparisons,
+    enum pumpio_bench_format format)
+{
+  assert(file != NULL);
+  assert(config != NULL);
+  assert(backends != NULL);
+  assert(results != NULL);
+  assert(comparisons != NULL);
+
+  if (format == PUMPIO_BENCH_FORMAT_CSV) {
+    pumpio_bench_print_csv_header(file, true);
+
+    for (size_t i = 0; i < count; i++) {
+      pumpio_bench_print_csv(file, backends[i].name, config, &results[i]);
+      fprintf(
+          file,
+          ",%s,%.3f,%lu,%.3f,%.6f\n",
+          backends[0].name,
+          comparisons[i].p50_diff_ns / 1.0e3,
+          comparisons[i].blocks,
+          comparisons[i].z,
+          comparisons[i].p_value);
+    }
+  } else if (format == PUMPIO_BENCH_FORMAT_JSON) {
+    fprintf(file, "{\"block\": %u, \"backends\": [", block);
+
+    for (size_t i = 0; i < count; i++) {
+      pumpio_bench_print_json(file, backends[i].name, config, &results[i]);
+      fprintf(
+          file,
+          ", \"baseline\": \"%s\", \"p50_diff_us\": %.3f, \"blocks\": %lu, "
+          "\"z\": %.3f, \"p_value\": %.6f}%s",
+          backends[0].name,
+          comparisons[i].p50_diff_ns / 1.0e3,
+          comparisons[i].blocks,
+          comparisons[i].z,
+          comparisons[i].p_value,
+          i + 1 < count ? ", " : "");
+    }
+
+    fprintf(file, "]}\n");
+  } else {
+    fprintf(file, "Interleaved in blocks of %u iteration(s)\n", block);
+
+    for (size_t i = 0; i < count; i++) {
+      pumpio_bench_print_text(file, backends[i].name, config, &results[i]);
+
+      if (i == 0) {
+        fprintf(file, "  Baseline\n");
+        continue;
+      }
+
+      fprintf(
+          file,
+          "  vs %s: p50 %+.3f us, z %.2f, p %.6f over %lu block medians, %s\n",
+          backends[0].name,
+          comparisons[i].p50_diff_ns / 1.0e3,
+          comparisons[i].z,
+          comparisons[i].p_value,
+          comparisons[i].blocks,
+          comparisons[i].p_value < 0.01 ? "significant (p < 0.01)" :
+                                          "not significant");
+    }
+  }
+}
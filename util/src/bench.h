@@ -0,0 +1,225 @@
+/**
+ * Benchmark harness for measuring the latency of device I/O calls.
+ *
+ * A benchmark runs a number of warmup iterations that are discarded, followed
+ * by the measured iterations. Only the call itself is timed and every sample
+ * is stored, i.e. the statistics are exact and nothing is printed while
+ * measuring. The report is available as human readable text or as CSV/JSON
+ * with stable field names, e.g. to diff results of different machines.
+ *
+ * To compare backends, e.g. libusb against the kernel module, run them
+ * interleaved in a single run instead of one after another. Load and thermal
+ * drift then affect all of them alike. Each backend is compared against the
+ * first one with a Mann-Whitney U test, which does not assume any particular
+ * latency distribution. Consecutive samples are not independent, e.g. a busy
+ * bus slows down a whole block, so the test compares the medians of the
+ * blocks instead of single samples.
+ */
+#ifndef PUMPIO_BENCH_H
+#define PUMPIO_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "result.h"
+
+/**
+ * Output formats of a benchmark report
+ */
+enum pumpio_bench_format {
+  PUMPIO_BENCH_FORMAT_TEXT = 0,
+  PUMPIO_BENCH_FORMAT_CSV = 1,
+  PUMPIO_BENCH_FORMAT_JSON = 2,
+};
+
+/**
+ * Configuration of a benchmark run. The run stops on whichever limit is
+ * reached first, samples or duration.
+ */
+struct pumpio_bench_config {
+  /* Number of iterations to run before measuring, discarded */
+  uint32_t warmup;
+  /* Number of samples to measure, 0 for no limit */
+  uint32_t samples;
+  /* Max. time to measure in ms, 0 for no limit */
+  uint32_t duration_ms;
+  /* Delay between two iterations in us, not included in the samples */
+  uint32_t delay_us;
+};
+
+/**
+ * Function benchmarked, called once per iteration.
+ *
+ * @param ctx Context provided to pumpio_bench_run
+ * @return Success or an error code as defined by result_t. An error aborts
+ *         the benchmark
+ */
+typedef result_t (*pumpio_bench_func_t)(void *ctx);
+
+/**
+ * Max. number of backends of an interleaved run
+ */
+#define PUMPIO_BENCH_BACKENDS_MAX 8
+
+/**
+ * A backend of an interleaved benchmark run
+ */
+struct pumpio_bench_backend {
+  const char *name;
+  /* Function to benchmark */
+  pumpio_bench_func_t func;
+  /* Optional, called before and after each block of the backend, e.g. to
+     claim and release a device shared with other backends. Not measured,
+     warmup iterations are run after each acquire. NULL if not used */
+  pumpio_bench_func_t acquire;
+  pumpio_bench_func_t release;
+  /* Context passed to all functions of the backend */
+  void *ctx;
+};
+
+/**
+ * Result of a benchmark run, all times in ns
+ */
+struct pumpio_bench_result {
+  /* Number of samples measured, excluding warmup */
+  uint64_t samples;
+  /* Wall clock time of the measuring phase, including delays */
+  uint64_t elapsed_ns;
+  /* Achieved number of iterations per second of the measuring phase */
+  double rate_hz;
+  uint64_t min_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+  uint64_t max_ns;
+  double mean_ns;
+  double stddev_ns;
+};
+
+/**
+ * Comparison of a backend against the first (baseline) backend of an
+ * interleaved run
+ */
+struct pumpio_bench_comparison {
+  /* Difference of the medians, backend - baseline */
+  int64_t p50_diff_ns;
+  /* Number of blocks of the backend the test was run on */
+  uint64_t blocks;
+  /* z-score of the Mann-Whitney U test over the medians of the blocks, > 0
+     if the backend is slower. Unreliable with less than ~10 blocks per
+     backend */
+  double z;
+  /* Two-sided p-value, i.e. the probability of a difference at least this
+     large if both backends had the same latency distribution */
+  double p_value;
+};
+
+/**
+ * Run a benchmark.
+ *
+ * @param config Configuration of the run
+ * @param func Function to benchmark
+ * @param ctx Context passed to func on every call
+ * @param stop Optional pointer to a flag, e.g. set by a signal handler, to
+ *             stop the run early. NULL if not used
+ * @param result Pointer to a result to fill on success
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL, ENOMEM or any error returned by
+ *         func
+ */
+result_t pumpio_bench_run(
+    const struct pumpio_bench_config *config,
+    pumpio_bench_func_t func,
+    void *ctx,
+    const volatile bool *stop,
+    struct pumpio_bench_result *result);
+
+/**
+ * Run a benchmark of multiple backends interleaved.
+ *
+ * The backends take turns running blocks of iterations in round robin order.
+ * The starting backend rotates every round to not favor any of them. The
+ * limits of the config apply per backend for samples and to the whole run for
+ * the duration.
+ *
+ * @param config Configuration of the run
+ * @param block Number of iterations per block, 1 to alternate every iteration
+ * @param backends Backends to benchmark, the first one is the baseline
+ * @param count Number of backends, max. PUMPIO_BENCH_BACKENDS_MAX
+ * @param stop Optional pointer to a flag, e.g. set by a signal handler, to
+ *             stop the run early. NULL if not used
+ * @param results Pointer to count results to fill on success
+ * @param comparisons Pointer to count comparisons against the baseline to fill
+ *                    on success. The first one compares the baseline against
+ *                    itself
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL, ENOMEM or any error returned by
+ *         the functions of a backend
+ */
+result_t pumpio_bench_run_interleaved(
+    const struct pumpio_bench_config *config,
+    uint32_t block,
+    const struct pumpio_bench_backend *backends,
+    size_t count,
+    const volatile bool *stop,
+    struct pumpio_bench_result *results,
+    struct pumpio_bench_comparison *comparisons);
+
+/**
+ * Evaluate samples collected by other means than a benchmark run, e.g. the
+ * durations of single transfers of a polling cycle.
+ *
+ * @param samples Samples in ns, sorted in place
+ * @param count Number of samples
+ * @param elapsed_ns Wall clock time it took to collect the samples, used to
+ *                   calculate the rate. 0 if not applicable
+ * @param result Pointer to a result to fill
+ */
+void pumpio_bench_evaluate(
+    uint64_t *samples,
+    uint64_t count,
+    uint64_t elapsed_ns,
+    struct pumpio_bench_result *result);
+
+/**
+ * Print the report of a benchmark run.
+ *
+ * @param file File to print to, e.g. stdout
+ * @param name Name of the benchmark, e.g. the backend used
+ * @param config Configuration of the run
+ * @param result Result of the run
+ * @param format Format of the report
+ */
+void pumpio_bench_print(
+    FILE *file,
+    const char *name,
+    const struct pumpio_bench_config *config,
+    const struct pumpio_bench_result *result,
+    enum pumpio_bench_format format);
+
+/**
+ * Print the report of an interleaved benchmark run.
+ *
+ * @param file File to print to, e.g. stdout
+ * @param config Configuration of the run
+ * @param block Number of iterations per block of the run
+ * @param backends Backends of the run
+ * @param count Number of backends
+ * @param results Results of the run
+ * @param comparisons Comparisons of the run
+ * @param format Format of the report
+ */
+void pumpio_bench_print_interleaved(
+    FILE *file,
+    const struct pumpio_bench_config *config,
+    uint32_t block,
+    const struct pumpio_bench_backend *backends,
+    size_t count,
+    const struct pumpio_bench_result *results,
+    const struct pumpio_bench_comparison *comparisons,
+    enum pumpio_bench_format format);
+
+#endif
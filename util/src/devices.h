@@ -0,0 +1,23 @@
+/**
+ * USB identifiers and vendor request of the devices supported, shared by the
+ * device libraries and the diagnostic tools
+ */
+#ifndef PUMPIO_DEVICES_H
+#define PUMPIO_DEVICES_H
+
+#define PUMPIO_PIUIO_VID 0x0547
+#define PUMPIO_PIUIO_PID 0x1002
+#define PUMPIO_PIUBTN_VID 0x0D2F
+#define PUMPIO_PIUBTN_PID 0x1010
+
+/* Configuration and interface claimed on both devices */
+#define PUMPIO_DEVICE_CONFIG 0x01
+#define PUMPIO_DEVICE_IFACE 0x00
+
+/* Vendor control request exchanging outputs and inputs, type selects the
+   direction */
+#define PUMPIO_CTRL_TYPE_IN 0xC0
+#define PUMPIO_CTRL_TYPE_OUT 0x40
+#define PUMPIO_CTRL_REQUEST 0xAE
+
+#endif
@@ -0,0 +1,33 @@
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "encoder.h"
+
+void pumpio_encoder_init(
+    struct pumpio_encoder *encoder, const uint64_t *outputs, uint8_t count)
+{
+  uint64_t word;
+
+  assert(encoder != NULL);
+  assert(outputs != NULL || count == 0);
+  assert(count <= PUMPIO_ENCODER_MAX_OUTPUTS);
+
+  memset(encoder, 0, sizeof(struct pumpio_encoder));
+
+  encoder->table_count = (count + 7) / 8;
+
+  for (uint8_t i = 0; i < encoder->table_count; i++) {
+    for (uint16_t value = 0; value < 256; value++) {
+      word = 0;
+
+      for (uint8_t bit = 0; bit < 8 && i * 8 + bit < count; bit++) {
+        if (value & (1 << bit)) {
+          word |= outputs[i * 8 + bit];
+        }
+      }
+
+      encoder->tables[i][value] = word;
+    }
+  }
+}
@@ -0,0 +1,174 @@
+/**
+ * Table-driven encoder from a logical output mask to the raw output word of a
+ * device.
+ *
+ * Logical outputs are numbered densely, e.g. all lights of a game, and are
+ * mapped to arbitrary bits of the raw output paket by a table of the device.
+ * The raw output word maps byte n of an output paket to bits 8n to 8n + 7 of
+ * the word. On init, the table is expanded to one lookup table per byte of the
+ * logical mask, i.e. encoding is a single load and or per 8 logical outputs
+ * instead of setting single bitfields.
+ *
+ * The diff of two raw words tells which bytes of the paket changed, e.g. to
+ * elide writing unchanged outputs to the device.
+ *
+ * Everything but the init is inline as it runs with every polling cycle.
+ */
+#ifndef PUMPIO_ENCODER_H
+#define PUMPIO_ENCODER_H
+
+#include <assert.h>
+#include <endian.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Max. number of logical outputs of an encoder
+ */
+#define PUMPIO_ENCODER_MAX_OUTPUTS 64
+
+/**
+ * Size of the raw output paket covered by the raw output word
+ */
+#define PUMPIO_ENCODER_RAW_SIZE 8
+
+#define PUMPIO_ENCODER_TABLE_COUNT (PUMPIO_ENCODER_MAX_OUTPUTS / 8)
+
+/**
+ * Bit of a logical output in the logical output mask
+ */
+#define PUMPIO_ENCODER_OUTPUT(output) (UINT64_C(1) << (output))
+
+/**
+ * Encoder of a device. Treat as opaque, use the functions below.
+ */
+struct pumpio_encoder {
+  /* Raw output word of every value of a byte of the logical mask */
+  uint64_t tables[PUMPIO_ENCODER_TABLE_COUNT][256];
+  uint8_t table_count;
+};
+
+/**
+ * Initialize an encoder from the output table of a device.
+ *
+ * @param encoder Pointer to the encoder to initialize
+ * @param outputs Raw output word bits of each logical output, index is the
+ *                number of the logical output
+ * @param count Number of logical outputs, max. PUMPIO_ENCODER_MAX_OUTPUTS
+ */
+void pumpio_encoder_init(
+    struct pumpio_encoder *encoder, const uint64_t *outputs, uint8_t count);
+
+/**
+ * Encode a logical output mask.
+ *
+ * @param encoder Pointer to an initialized encoder
+ * @param mask Logical outputs to turn on, bits of unknown outputs are ignored
+ * @return Raw output word with the outputs of the mask turned on
+ */
+static inline uint64_t
+pumpio_encoder_encode(const struct pumpio_encoder *encoder, uint64_t mask)
+{
+  uint64_t word;
+
+  assert(encoder != NULL);
+
+  word = 0;
+
+  for (uint8_t i = 0; i < encoder->table_count; i++) {
+    word |= encoder->tables[i][(uint8_t) (mask >> (i * 8))];
+  }
+
+  return word;
+}
+
+/**
+ * Replace a group of logical outputs of a raw output word, e.g. all lights of
+ * a player. Both masks are encoded in a single pass over the tables.
+ *
+ * @param encoder Pointer to an initialized encoder
+ * @param word Raw output word to update
+ * @param mask Logical outputs to replace, outputs not in the mask are kept
+ * @param value New values of the logical outputs in the mask
+ * @return Updated raw output word
+ */
+static inline uint64_t pumpio_encoder_replace(
+    const struct pumpio_encoder *encoder,
+    uint64_t word,
+    uint64_t mask,
+    uint64_t value)
+{
+  uint64_t group;
+  uint64_t next;
+
+  assert(encoder != NULL);
+
+  group = 0;
+  next = 0;
+  value &= mask;
+
+  for (uint8_t i = 0; i < encoder->table_count; i++) {
+    group |= encoder->tables[i][(uint8_t) (mask >> (i * 8))];
+    next |= encoder->tables[i][(uint8_t) (value >> (i * 8))];
+  }
+
+  return (word & ~group) | next;
+}
+
+/**
+ * Get the bytes which differ between two raw output words.
+ *
+ * @param prev Raw output word, e.g. as last written to the device
+ * @param next Raw output word to compare with
+ * @return Mask with bit n set if byte n of the paket changed, 0 if the words
+ *         are equal
+ */
+static inline uint8_t pumpio_encoder_diff(uint64_t prev, uint64_t next)
+{
+  uint64_t diff;
+
+  diff = prev ^ next;
+
+  // Fold every byte into its lowest bit and gather these in the top byte
+  diff |= diff >> 4;
+  diff |= diff >> 2;
+  diff |= diff >> 1;
+  diff &= UINT64_C(0x0101010101010101);
+
+  return (uint8_t) ((diff * UINT64_C(0x0102040810204080)) >> 56);
+}
+
+/**
+ * Convert a raw output paket to a raw output word.
+ *
+ * @param raw Raw output paket of PUMPIO_ENCODER_RAW_SIZE bytes
+ * @return Raw output word
+ */
+static inline uint64_t pumpio_encoder_from_raw(const uint8_t *raw)
+{
+  uint64_t word;
+
+  assert(raw != NULL);
+
+  // Byte n of the paket is byte n of the word on any host
+  memcpy(&word, raw, sizeof(word));
+
+  return le64toh(word);
+}
+
+/**
+ * Write a raw output word to a raw output paket.
+ *
+ * @param word Raw output word
+ * @param raw Raw output paket of PUMPIO_ENCODER_RAW_SIZE bytes to write to
+ */
+static inline void pumpio_encoder_to_raw(uint64_t word, uint8_t *raw)
+{
+  assert(raw != NULL);
+
+  word = htole64(word);
+  memcpy(raw, &word, sizeof(word));
+}
+
+#endif
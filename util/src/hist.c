@@ -0,0 +1,196 @@
+#include <assert.h>
+#include <stddef.h>
+
+#include "hist.h"
+
+static uint32_t pumpio_hist_bucket_index(uint64_t value)
+{
+  uint32_t msb;
+  uint32_t shift;
+
+  if (value < PUMPIO_HIST_SUB_BUCKETS) {
+    return (uint32_t) value;
+  }
+
+  if (value >= (UINT64_C(1) << PUMPIO_HIST_VALUE_BITS)) {
+    value = (UINT64_C(1) << PUMPIO_HIST_VALUE_BITS) - 1;
+  }
+
+  msb = 63 - __builtin_clzll(value);
+  shift = msb - PUMPIO_HIST_SUB_BITS;
+
+  return (shift + 1) * PUMPIO_HIST_SUB_BUCKETS +
+      (uint32_t) ((value >> shift) & (PUMPIO_HIST_SUB_BUCKETS - 1));
+}
+
+/**
+ * Get the value in the middle of the range covered by a bucket
+ */
+static uint64_t pumpio_hist_bucket_value(uint32_t index)
+{
+  uint32_t shift;
+  uint64_t lower;
+
+  if (index < PUMPIO_HIST_SUB_BUCKETS) {
+    return index;
+  }
+
+  shift = index / PUMPIO_HIST_SUB_BUCKETS - 1;
+  lower = (uint64_t) (PUMPIO_HIST_SUB_BUCKETS + index % PUMPIO_HIST_SUB_BUCKETS)
+      << shift;
+
+  return lower + ((UINT64_C(1) << shift) >> 1);
+}
+
+void pumpio_hist_reset(struct pumpio_hist *hist)
+{
+  assert(hist != NULL);
+
+  atomic_store_explicit(&hist->sum, 0, memory_order_relaxed);
+  atomic_store_explicit(&hist->min, 0, memory_order_relaxed);
+  atomic_store_explicit(&hist->max, 0, memory_order_relaxed);
+
+  for (uint32_t i = 0; i < PUMPIO_HIST_BUCKETS; i++) {
+    atomic_store_explicit(&hist->buckets[i], 0, memory_order_relaxed);
+  }
+}
+
+void pumpio_hist_record(struct pumpio_hist *hist, uint64_t value)
+{
+  uint64_t cur;
+
+  assert(hist != NULL);
+
+  atomic_fetch_add_explicit(
+      &hist->buckets[pumpio_hist_bucket_index(value)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+
+  // Min is stored + 1 to keep 0 as empty for zero initialized histograms
+  cur = atomic_load_explicit(&hist->min, memory_order_relaxed);
+
+  while ((cur == 0 || value < cur - 1) &&
+         !atomic_compare_exchange_weak_explicit(
+             &hist->min,
+             &cur,
+             value + 1,
+             memory_order_relaxed,
+             memory_order_relaxed)) {
+    // Retry with the updated min
+  }
+
+  cur = atomic_load_explicit(&hist->max, memory_order_relaxed);
+
+  while (value > cur &&
+         !atomic_compare_exchange_weak_explicit(
+             &hist->max,
+             &cur,
+             value,
+             memory_order_relaxed,
+             memory_order_relaxed)) {
+    // Retry with the updated max
+  }
+}
+
+void pumpio_hist_snapshot(
+    const struct pumpio_hist *hist, struct pumpio_hist_snapshot *snapshot)
+{
+  uint64_t min;
+
+  assert(hist != NULL);
+  assert(snapshot != NULL);
+
+  snapshot->count = 0;
+
+  // Count from the buckets to keep the percentiles consistent
+  for (uint32_t i = 0; i < PUMPIO_HIST_BUCKETS; i++) {
+    snapshot->buckets[i] =
+        atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+    snapshot->count += snapshot->buckets[i];
+  }
+
+  snapshot->sum = atomic_load_explicit(&hist->sum, memory_order_relaxed);
+  min = atomic_load_explicit(&hist->min, memory_order_relaxed);
+  snapshot->min = min > 0 ? min - 1 : 0;
+  snapshot->max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
+
+uint64_t pumpio_hist_rank(uint64_t count, double percentile)
+{
+  uint64_t ppm;
+  uint64_t rank;
+
+  assert(count > 0);
+
+  if (percentile <= 0.0) {
+    return 1;
+  }
+
+  if (percentile >= 100.0) {
+    return count;
+  }
+
+  // Percentile in parts per million as e.g. 99.9 / 100 * 1000 is slightly
+  // larger than 999 in floating point
+  ppm = (uint64_t) (percentile * 10000.0 + 0.5);
+  rank = count / 1000000 * ppm + (count % 1000000 * ppm + 999999) / 1000000;
+
+  return rank > 0 ? rank : 1;
+}
+
+uint64_t pumpio_hist_percentile(
+    const struct pumpio_hist_snapshot *snapshot, double percentile)
+{
+  uint64_t rank;
+  uint64_t accu;
+  uint64_t value;
+
+  assert(snapshot != NULL);
+
+  if (snapshot->count == 0) {
+    return 0;
+  }
+
+  if (percentile <= 0.0) {
+    return snapshot->min;
+  }
+
+  if (percentile >= 100.0) {
+    return snapshot->max;
+  }
+
+  rank = pumpio_hist_rank(snapshot->count, percentile);
+
+  accu = 0;
+
+  for (uint32_t i = 0; i < PUMPIO_HIST_BUCKETS; i++) {
+    accu += snapshot->buckets[i];
+
+    if (accu >= rank) {
+      value = pumpio_hist_bucket_value(i);
+
+      // Bucket middle might be outside of what was actually recorded
+      if (value < snapshot->min) {
+        return snapshot->min;
+      }
+
+      if (value > snapshot->max) {
+        return snapshot->max;
+      }
+
+      return value;
+    }
+  }
+
+  return snapshot->max;
+}
+
+uint64_t pumpio_hist_mean(const struct pumpio_hist_snapshot *snapshot)
+{
+  assert(snapshot != NULL);
+
+  if (snapshot->count == 0) {
+    return 0;
+  }
+
+  return snapshot->sum / snapshot->count;
+}
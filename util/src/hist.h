@@ -0,0 +1,112 @@
+/**
+ * Lock-free log-linear histogram for recording latencies.
+ *
+ * Values are sorted into buckets with a fixed relative precision: every power
+ * of two range is split into PUMPIO_HIST_SUB_BUCKETS linear sub-buckets, i.e.
+ * the relative error of a value read back is < 1 / PUMPIO_HIST_SUB_BUCKETS.
+ * Recording is a handful of relaxed atomic increments which makes it cheap
+ * enough to stay enabled permanently. Any number of threads can record and
+ * read concurrently.
+ */
+#ifndef PUMPIO_HIST_H
+#define PUMPIO_HIST_H
+
+#include <stdint.h>
+
+#include "atomic_.h"
+
+/**
+ * Number of bits of a value resolved linearly within its power of two range
+ */
+#define PUMPIO_HIST_SUB_BITS 4
+#define PUMPIO_HIST_SUB_BUCKETS (1 << PUMPIO_HIST_SUB_BITS)
+
+/**
+ * Max. number of significant bits of a value, larger values are clamped. With
+ * values in ns, this covers ~18 minutes.
+ */
+#define PUMPIO_HIST_VALUE_BITS 40
+
+#define PUMPIO_HIST_BUCKETS \
+  ((PUMPIO_HIST_VALUE_BITS - PUMPIO_HIST_SUB_BITS + 1) * \
+   PUMPIO_HIST_SUB_BUCKETS)
+
+/**
+ * Histogram. Treat as opaque, use the functions below. A zero initialized
+ * histogram, e.g. a static one, is empty and ready to use.
+ */
+struct pumpio_hist {
+  PUMPIO_ATOMIC(uint64_t) sum;
+  PUMPIO_ATOMIC(uint64_t) min;
+  PUMPIO_ATOMIC(uint64_t) max;
+  PUMPIO_ATOMIC(uint64_t) buckets[PUMPIO_HIST_BUCKETS];
+};
+
+/**
+ * Copy of a histogram for evaluation
+ */
+struct pumpio_hist_snapshot {
+  uint64_t count;
+  uint64_t sum;
+  /* Min. and max. value recorded, 0 if empty */
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[PUMPIO_HIST_BUCKETS];
+};
+
+/**
+ * Reset a histogram to empty. Values recorded concurrently might get lost.
+ *
+ * @param hist Pointer to the histogram to reset
+ */
+void pumpio_hist_reset(struct pumpio_hist *hist);
+
+/**
+ * Record a value.
+ *
+ * @param hist Pointer to the histogram
+ * @param value Value to record, e.g. a latency in ns
+ */
+void pumpio_hist_record(struct pumpio_hist *hist, uint64_t value);
+
+/**
+ * Take a snapshot of a histogram. The snapshot is not atomic as a whole, i.e.
+ * values recorded concurrently might be included in parts of it only.
+ *
+ * @param hist Pointer to the histogram
+ * @param snapshot Pointer to the snapshot to fill
+ */
+void pumpio_hist_snapshot(
+    const struct pumpio_hist *hist, struct pumpio_hist_snapshot *snapshot);
+
+/**
+ * Get the nearest rank of a percentile, i.e. ceil(percentile / 100 * count)
+ * computed in integers to not be off by one due to floating point, e.g. 999
+ * for the 99.9th percentile of 1000 values.
+ *
+ * @param count Number of values, > 0
+ * @param percentile Percentile in the range 0.0 to 100.0, precise to 0.0001
+ * @return 1-based rank of the value at the percentile, 1 to count
+ */
+uint64_t pumpio_hist_rank(uint64_t count, double percentile);
+
+/**
+ * Get the value at the given percentile of a snapshot.
+ *
+ * @param snapshot Pointer to a snapshot
+ * @param percentile Percentile in the range 0.0 to 100.0, e.g. 99.9
+ * @return Value at the percentile, precise to the bucket it is located in,
+ *         0 if the snapshot is empty
+ */
+uint64_t pumpio_hist_percentile(
+    const struct pumpio_hist_snapshot *snapshot, double percentile);
+
+/**
+ * Get the mean of all values of a snapshot.
+ *
+ * @param snapshot Pointer to a snapshot
+ * @return Mean value, 0 if the snapshot is empty
+ */
+uint64_t pumpio_hist_mean(const struct pumpio_hist_snapshot *snapshot);
+
+#endif
@@ -0,0 +1,147 @@
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+
+#include "stats.h"
+#include "time_.h"
+
+static void pumpio_stats_start(struct pumpio_stats *stats, uint64_t time_ns)
+{
+  uint64_t expected;
+
+  expected = 0;
+
+  // Only the first event after start or reset sets the start time
+  if (atomic_load_explicit(&stats->start_time_ns, memory_order_relaxed) == 0) {
+    atomic_compare_exchange_strong_explicit(
+        &stats->start_time_ns,
+        &expected,
+        time_ns,
+        memory_order_relaxed,
+        memory_order_relaxed);
+  }
+}
+
+void pumpio_stats_reset(struct pumpio_stats *stats)
+{
+  assert(stats != NULL);
+
+  atomic_store_explicit(&stats->start_time_ns, 0, memory_order_relaxed);
+  atomic_store_explicit(&stats->transfers, 0, memory_order_relaxed);
+  atomic_store_explicit(&stats->cycles, 0, memory_order_relaxed);
+  atomic_store_explicit(&stats->failovers, 0, memory_order_relaxed);
+
+  for (uint32_t i = 0; i < PUMPIO_STATS_ERROR_CODES; i++) {
+    atomic_store_explicit(&stats->errors[i], 0, memory_order_relaxed);
+  }
+
+  for (uint32_t i = 0; i < PUMPIO_STATS_HIST_COUNT; i++) {
+    pumpio_hist_reset(&stats->hists[i]);
+  }
+}
+
+void pumpio_stats_record_transfer(
+    struct pumpio_stats *stats, uint64_t latency_ns, result_t result)
+{
+  assert(stats != NULL);
+
+  pumpio_stats_start(stats, pumpio_time_now_ns());
+
+  pumpio_hist_record(&stats->hists[PUMPIO_STATS_HIST_TRANSFER], latency_ns);
+  atomic_fetch_add_explicit(&stats->transfers, 1, memory_order_relaxed);
+
+  if (RESULT_IS_ERROR(result)) {
+    pumpio_stats_record_error(stats, result);
+  }
+}
+
+void pumpio_stats_record_cycle(
+    struct pumpio_stats *stats,
+    uint64_t *last_start_ns,
+    uint64_t start_ns,
+    uint64_t end_ns)
+{
+  assert(stats != NULL);
+
+  pumpio_stats_start(stats, start_ns);
+
+  pumpio_hist_record(&stats->hists[PUMPIO_STATS_HIST_CYCLE], end_ns - start_ns);
+  atomic_fetch_add_explicit(&stats->cycles, 1, memory_order_relaxed);
+
+  if (last_start_ns == NULL) {
+    return;
+  }
+
+  // Intervals are per device, devices might share the statistics
+  if (*last_start_ns != 0 && start_ns > *last_start_ns) {
+    pumpio_hist_record(
+        &stats->hists[PUMPIO_STATS_HIST_CYCLE_INTERVAL],
+        start_ns - *last_start_ns);
+  }
+
+  *last_start_ns = start_ns;
+}
+
+void pumpio_stats_record_error(struct pumpio_stats *stats, result_t result)
+{
+  assert(stats != NULL);
+
+  if (result >= PUMPIO_STATS_ERROR_CODES) {
+    result = PUMPIO_STATS_ERROR_CODES - 1;
+  }
+
+  atomic_fetch_add_explicit(&stats->errors[result], 1, memory_order_relaxed);
+}
+
+void pumpio_stats_record_output(struct pumpio_stats *stats, uint64_t latency_ns)
+{
+  assert(stats != NULL);
+
+  pumpio_hist_record(&stats->hists[PUMPIO_STATS_HIST_OUTPUT], latency_ns);
+}
+
+void pumpio_stats_record_failover(struct pumpio_stats *stats)
+{
+  assert(stats != NULL);
+
+  atomic_fetch_add_explicit(&stats->failovers, 1, memory_order_relaxed);
+}
+
+void pumpio_stats_snapshot(
+    const struct pumpio_stats *stats, struct pumpio_stats_snapshot *snapshot)
+{
+  double elapsed_sec;
+
+  assert(stats != NULL);
+  assert(snapshot != NULL);
+
+  snapshot->time_ns = pumpio_time_now_ns();
+  snapshot->start_time_ns =
+      atomic_load_explicit(&stats->start_time_ns, memory_order_relaxed);
+  snapshot->transfers =
+      atomic_load_explicit(&stats->transfers, memory_order_relaxed);
+  snapshot->cycles = atomic_load_explicit(&stats->cycles, memory_order_relaxed);
+  snapshot->error_count = 0;
+
+  for (uint32_t i = 0; i < PUMPIO_STATS_ERROR_CODES; i++) {
+    snapshot->errors[i] =
+        atomic_load_explicit(&stats->errors[i], memory_order_relaxed);
+    snapshot->error_count += snapshot->errors[i];
+  }
+
+  snapshot->timeouts = snapshot->errors[EAGAIN] + snapshot->errors[ETIMEDOUT];
+  snapshot->failovers =
+      atomic_load_explicit(&stats->failovers, memory_order_relaxed);
+
+  for (uint32_t i = 0; i < PUMPIO_STATS_HIST_COUNT; i++) {
+    pumpio_hist_snapshot(&stats->hists[i], &snapshot->hists[i]);
+  }
+
+  if (snapshot->start_time_ns != 0 &&
+      snapshot->time_ns > snapshot->start_time_ns) {
+    elapsed_sec = (snapshot->time_ns - snapshot->start_time_ns) / 1.0e9;
+    snapshot->poll_rate_hz = snapshot->cycles / elapsed_sec;
+  } else {
+    snapshot->poll_rate_hz = 0.0;
+  }
+}
@@ -0,0 +1,156 @@
+/**
+ * Always-on instrumentation of device I/O: transfer and cycle latencies,
+ * output latency, poll rate and error counts.
+ *
+ * All counters and histograms (see hist.h) are updated lock-free and can be
+ * read at any time using pumpio_stats_snapshot, e.g. to log percentiles from
+ * a running game. A zero initialized instance, e.g. a static one, is empty and
+ * ready to use.
+ *
+ * Any number of devices can record in the same instance, e.g. all devices of
+ * a library. Anything tracked per device, like the start of the previous
+ * cycle for the cycle interval, is owned by the device handle. Record the
+ * devices in separate instances to evaluate them individually.
+ */
+#ifndef PUMPIO_STATS_H
+#define PUMPIO_STATS_H
+
+#include <stdint.h>
+
+#include "atomic_.h"
+#include "hist.h"
+#include "result.h"
+
+/**
+ * Number of error codes counted individually. Errors with larger codes are
+ * counted in the last slot.
+ */
+#define PUMPIO_STATS_ERROR_CODES 256
+
+/**
+ * Latency histograms recorded, all values in ns
+ */
+enum pumpio_stats_hist {
+  /* Duration of a single usb transfer, including failed ones */
+  PUMPIO_STATS_HIST_TRANSFER = 0,
+  /* Duration of a full polling cycle */
+  PUMPIO_STATS_HIST_CYCLE = 1,
+  /* Time between the start of two consecutive polling cycles of the same
+     device */
+  PUMPIO_STATS_HIST_CYCLE_INTERVAL = 2,
+  /* Time from handing changed outputs, e.g. lights, to the backend until the
+     transfer carrying them completed */
+  PUMPIO_STATS_HIST_OUTPUT = 3,
+  PUMPIO_STATS_HIST_COUNT = 4,
+};
+
+/**
+ * Statistics instance. Treat as opaque, use the functions below.
+ */
+struct pumpio_stats {
+  PUMPIO_ATOMIC(uint64_t) start_time_ns;
+  PUMPIO_ATOMIC(uint64_t) transfers;
+  PUMPIO_ATOMIC(uint64_t) cycles;
+  PUMPIO_ATOMIC(uint64_t) failovers;
+  PUMPIO_ATOMIC(uint64_t) errors[PUMPIO_STATS_ERROR_CODES];
+  struct pumpio_hist hists[PUMPIO_STATS_HIST_COUNT];
+};
+
+/**
+ * Copy of the statistics for evaluation
+ */
+struct pumpio_stats_snapshot {
+  /* Time the snapshot was taken and the first event was recorded after
+     start or reset, see pumpio_time_now_ns */
+  uint64_t time_ns;
+  uint64_t start_time_ns;
+  /* Total number of transfers and polling cycles executed */
+  uint64_t transfers;
+  uint64_t cycles;
+  /* Average number of polling cycles per second since the start, summed
+     over all devices recording in the instance */
+  double poll_rate_hz;
+  /* Number of errors by result_t, e.g. errors[EIO] */
+  uint64_t errors[PUMPIO_STATS_ERROR_CODES];
+  /* Total number of errors */
+  uint64_t error_count;
+  /* Number of errors caused by timeouts, i.e. EAGAIN and ETIMEDOUT */
+  uint64_t timeouts;
+  /* Number of switches to another backend or device node made by a
+     supervisor, e.g. on degraded latency */
+  uint64_t failovers;
+  /* Latency histograms, see enum pumpio_stats_hist */
+  struct pumpio_hist_snapshot hists[PUMPIO_STATS_HIST_COUNT];
+};
+
+/**
+ * Reset all statistics. Events recorded concurrently might get lost.
+ *
+ * @param stats Pointer to the statistics
+ */
+void pumpio_stats_reset(struct pumpio_stats *stats);
+
+/**
+ * Record a single transfer. Errors are counted as well.
+ *
+ * @param stats Pointer to the statistics
+ * @param latency_ns Duration of the transfer
+ * @param result Result of the transfer
+ */
+void pumpio_stats_record_transfer(
+    struct pumpio_stats *stats, uint64_t latency_ns, result_t result);
+
+/**
+ * Record a full polling cycle. Errors are not counted, record them with
+ * pumpio_stats_record_error if not recorded on the transfer level already.
+ *
+ * @param stats Pointer to the statistics
+ * @param last_start_ns Pointer to the start of the previous cycle of the
+ *                      device, owned by the device handle and updated by the
+ *                      call, 0 before the first cycle. NULL to not record the
+ *                      cycle interval
+ * @param start_ns Time the cycle started
+ * @param end_ns Time the cycle completed
+ */
+void pumpio_stats_record_cycle(
+    struct pumpio_stats *stats,
+    uint64_t *last_start_ns,
+    uint64_t start_ns,
+    uint64_t end_ns);
+
+/**
+ * Record an error.
+ *
+ * @param stats Pointer to the statistics
+ * @param result Error code
+ */
+void pumpio_stats_record_error(struct pumpio_stats *stats, result_t result);
+
+/**
+ * Record the latency of an output change.
+ *
+ * @param stats Pointer to the statistics
+ * @param latency_ns Time from handing the changed output to the backend until
+ *                   it was transferred
+ */
+void pumpio_stats_record_output(
+    struct pumpio_stats *stats, uint64_t latency_ns);
+
+/**
+ * Record a switch to another backend or device node.
+ *
+ * @param stats Pointer to the statistics
+ */
+void pumpio_stats_record_failover(struct pumpio_stats *stats);
+
+/**
+ * Take a snapshot of the statistics. The snapshot is not atomic as a whole.
+ *
+ * @param stats Pointer to the statistics
+ * @param snapshot Pointer to the snapshot to fill. This is a rather large
+ *                 struct, consider not putting it on the stack.
+ */
+void pumpio_stats_snapshot(
+    const struct pumpio_stats *stats, struct pumpio_stats_snapshot *snapshot);
+
+#endif
@@ -0,0 +1,12 @@
+#include <time.h>
+
+#include "time_.h"
+
+uint64_t pumpio_time_now_ns()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,18 @@
+/**
+ * Time utilities shared by all device libraries
+ */
+#ifndef PUMPIO_TIME_H
+#define PUMPIO_TIME_H
+
+#include <stdint.h>
+
+/**
+ * Get the current time of the monotonic system clock (CLOCK_MONOTONIC).
+ *
+ * All timestamps provided by the device libraries are based on this clock.
+ *
+ * @return Current time in ns
+ */
+uint64_t pumpio_time_now_ns();
+
+#endif
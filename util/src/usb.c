@@ -1,13 +1,91 @@
 #include <assert.h>
 #include <errno.h>
 #include <libusb-1.0/libusb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "stats.h"
+#include "time_.h"
 #include "usb_.h"
 
-struct pumpio_usb_ctx {
+/* USB 3 allows max. 7 tiers of hubs */
+#define PUMPIO_USB_PORT_DEPTH_MAX 7
+
+/* Max. number of devices tracked by the hotplug device cache */
+#define PUMPIO_USB_CACHE_SIZE 128
+
+/* Min. time between two attempts to reopen a disconnected device */
+#define PUMPIO_USB_REOPEN_INTERVAL_NS 100000000
+
+/* Timeout for a single iteration of the event thread */
+#define PUMPIO_USB_EVENT_TIMEOUT_US 100000
+
+/* Min. time to wait between two retries of a transfer with a deadline. Some
+   transient errors, e.g. a stall, are returned immediately and retrying them
+   without waiting spins on the CPU until the deadline */
+#define PUMPIO_USB_BACKOFF_MIN_US 10
+
+#define PUMPIO_USB_ID_MAX \
+  (PUMPIO_USB_PATH_MAX > PUMPIO_USB_SERIAL_MAX ? PUMPIO_USB_PATH_MAX : \
+                                                 PUMPIO_USB_SERIAL_MAX)
+
+struct pumpio_usb_cache_entry {
+  struct libusb_device *device;
+  uint16_t vid;
+  uint16_t pid;
+};
+
+/**
+ * Process-wide libusb context shared by all opened devices and by lookups
+ * while it exists, see pumpio_usb_query_ref.
+ *
+ * If supported by the platform, a hotplug callback keeps a cache of all
+ * connected devices up-to-date which avoids enumerating the entire bus on
+ * lookups and triggers reconnecting of disconnected devices.
+ */
+struct pumpio_usb_shared {
+  pthread_mutex_t lock;
   struct libusb_context *ctx;
+  uint32_t refs;
+  bool hotplug;
+  libusb_hotplug_callback_handle hotplug_handle;
+  pthread_t event_thread;
+  atomic_bool event_thread_stop;
+  /* Incremented on every device arrival */
+  _Atomic uint32_t arrivals;
+  pthread_mutex_t cache_lock;
+  bool cache_valid;
+  size_t cache_count;
+  struct pumpio_usb_cache_entry cache[PUMPIO_USB_CACHE_SIZE];
+};
+
+struct pumpio_usb_ctx {
   struct libusb_device_handle *dev;
+  uint16_t vid;
+  uint16_t pid;
+  uint16_t config;
+  uint16_t iface;
+  /* A kernel driver, e.g. piuio.ko, was bound to the device currently open */
+  bool kernel_driver_detached;
+  /* Hand the device back to that kernel driver on close */
+  bool reattach_kernel_driver;
+  bool has_id;
+  char id[PUMPIO_USB_ID_MAX];
+  uint32_t arrivals;
+  uint64_t reopen_time_ns;
+  struct pumpio_stats *stats;
+  /* Custom transport replacing libusb, NULL for real devices */
+  pumpio_usb_transport_func_t transport;
+  void *transport_ctx;
+};
+
+static struct pumpio_usb_shared pumpio_usb_shared = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cache_lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
 static result_t pumpio_usb_map_libusb_error(int32_t libusb_error)
@@ -46,171 +124,718 @@ static result_t pumpio_usb_map_libusb_error(int32_t libusb_error)
   }
 }
 
+static void pumpio_usb_get_path(
+    struct libusb_device *device, char *path, size_t len)
+{
+  uint8_t ports[PUMPIO_USB_PORT_DEPTH_MAX];
+  int32_t num_ports;
+  int32_t pos;
+
+  num_ports = libusb_get_port_numbers(device, ports, sizeof(ports));
+  pos = snprintf(path, len, "%u", libusb_get_bus_number(device));
+
+  // Root hubs don't have a port number
+  if (num_ports <= 0) {
+    snprintf(path + pos, len - pos, "-0");
+    return;
+  }
+
+  for (int32_t i = 0; i < num_ports && pos < (int32_t) len; i++) {
+    pos += snprintf(
+        path + pos, len - pos, "%c%u", i == 0 ? '-' : '.', ports[i]);
+  }
+}
+
+static void pumpio_usb_get_serial(
+    struct libusb_device_handle *handle,
+    const struct libusb_device_descriptor *desc,
+    char *serial,
+    size_t len)
+{
+  int32_t ret;
+
+  serial[0] = '\0';
+
+  if (desc->iSerialNumber == 0) {
+    return;
+  }
+
+  ret = libusb_get_string_descriptor_ascii(
+      handle, desc->iSerialNumber, (unsigned char *) serial, len);
+
+  if (ret < 0) {
+    serial[0] = '\0';
+  }
+}
+
+static void pumpio_usb_cache_clear()
+{
+  for (size_t i = 0; i < pumpio_usb_shared.cache_count; i++) {
+    libusb_unref_device(pumpio_usb_shared.cache[i].device);
+  }
+
+  pumpio_usb_shared.cache_count = 0;
+}
+
+static int LIBUSB_CALL pumpio_usb_hotplug_callback(
+    struct libusb_context *ctx,
+    struct libusb_device *device,
+    libusb_hotplug_event event,
+    void *user_data)
+{
+  struct libusb_device_descriptor desc;
+
+  pthread_mutex_lock(&pumpio_usb_shared.cache_lock);
+
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+    if (pumpio_usb_shared.cache_count < PUMPIO_USB_CACHE_SIZE) {
+      struct pumpio_usb_cache_entry *entry =
+          &pumpio_usb_shared.cache[pumpio_usb_shared.cache_count++];
+
+      libusb_get_device_descriptor(device, &desc);
+
+      entry->device = libusb_ref_device(device);
+      entry->vid = desc.idVendor;
+      entry->pid = desc.idProduct;
+    } else {
+      /* fall back to enumerating the bus on every lookup */
+      pumpio_usb_shared.cache_valid = false;
+    }
+  } else if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+    for (size_t i = 0; i < pumpio_usb_shared.cache_count; i++) {
+      if (pumpio_usb_shared.cache[i].device == device) {
+        libusb_unref_device(device);
+        pumpio_usb_shared.cache[i] =
+            pumpio_usb_shared.cache[--pumpio_usb_shared.cache_count];
+        break;
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&pumpio_usb_shared.cache_lock);
+
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+    atomic_fetch_add_explicit(
+        &pumpio_usb_shared.arrivals, 1, memory_order_release);
+  }
+
+  return 0;
+}
+
+static void *pumpio_usb_event_thread(void *arg)
+{
+  struct timeval tv;
+
+  while (!atomic_load_explicit(
+      &pumpio_usb_shared.event_thread_stop, memory_order_acquire)) {
+    tv.tv_sec = 0;
+    tv.tv_usec = PUMPIO_USB_EVENT_TIMEOUT_US;
+
+    libusb_handle_events_timeout_completed(pumpio_usb_shared.ctx, &tv, NULL);
+  }
+
+  return NULL;
+}
+
+/**
+ * Acquire a reference to the shared context, create it if this is the first
+ * reference.
+ */
+static int32_t pumpio_usb_ref(struct libusb_context **ctx)
+{
+  int32_t ret;
+
+  pthread_mutex_lock(&pumpio_usb_shared.lock);
+
+  if (pumpio_usb_shared.refs == 0) {
+    ret = libusb_init(&pumpio_usb_shared.ctx);
+
+    if (ret != LIBUSB_SUCCESS) {
+      pthread_mutex_unlock(&pumpio_usb_shared.lock);
+      return ret;
+    }
+
+    /* dont print any error messages to stderr, change this for debugging */
+    // libusb_set_option(ctx, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_NONE);
+
+    pumpio_usb_shared.hotplug = false;
+    pumpio_usb_shared.cache_valid = false;
+    pumpio_usb_shared.cache_count = 0;
+
+    if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+      pumpio_usb_shared.cache_valid = true;
+
+      /* enumerate flag populates the cache with all connected devices */
+      ret = libusb_hotplug_register_callback(
+          pumpio_usb_shared.ctx,
+          LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+              LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+          LIBUSB_HOTPLUG_ENUMERATE,
+          LIBUSB_HOTPLUG_MATCH_ANY,
+          LIBUSB_HOTPLUG_MATCH_ANY,
+          LIBUSB_HOTPLUG_MATCH_ANY,
+          pumpio_usb_hotplug_callback,
+          NULL,
+          &pumpio_usb_shared.hotplug_handle);
+
+      if (ret == LIBUSB_SUCCESS) {
+        atomic_store_explicit(
+            &pumpio_usb_shared.event_thread_stop, false, memory_order_relaxed);
+
+        ret = pthread_create(
+            &pumpio_usb_shared.event_thread,
+            NULL,
+            pumpio_usb_event_thread,
+            NULL);
+
+        if (ret == 0) {
+          pumpio_usb_shared.hotplug = true;
+        } else {
+          libusb_hotplug_deregister_callback(
+              pumpio_usb_shared.ctx, pumpio_usb_shared.hotplug_handle);
+        }
+      }
+
+      /* not fatal, lookups and reconnects fall back to enumerating */
+      if (!pumpio_usb_shared.hotplug) {
+        pthread_mutex_lock(&pumpio_usb_shared.cache_lock);
+        pumpio_usb_cache_clear();
+        pumpio_usb_shared.cache_valid = false;
+        pthread_mutex_unlock(&pumpio_usb_shared.cache_lock);
+      }
+    }
+  }
+
+  pumpio_usb_shared.refs++;
+  *ctx = pumpio_usb_shared.ctx;
+
+  pthread_mutex_unlock(&pumpio_usb_shared.lock);
+
+  return LIBUSB_SUCCESS;
+}
+
+/**
+ * Release a reference to the shared context, destroy it if this was the last
+ * reference.
+ */
+static void pumpio_usb_unref()
+{
+  pthread_mutex_lock(&pumpio_usb_shared.lock);
+
+  assert(pumpio_usb_shared.refs > 0);
+
+  if (--pumpio_usb_shared.refs == 0) {
+    if (pumpio_usb_shared.hotplug) {
+      atomic_store_explicit(
+          &pumpio_usb_shared.event_thread_stop, true, memory_order_release);
+      /* deregistering wakes up the event thread */
+      libusb_hotplug_deregister_callback(
+          pumpio_usb_shared.ctx, pumpio_usb_shared.hotplug_handle);
+      pthread_join(pumpio_usb_shared.event_thread, NULL);
+      pumpio_usb_shared.hotplug = false;
+    }
+
+    pthread_mutex_lock(&pumpio_usb_shared.cache_lock);
+    pumpio_usb_cache_clear();
+    pumpio_usb_shared.cache_valid = false;
+    pthread_mutex_unlock(&pumpio_usb_shared.cache_lock);
+
+    libusb_exit(pumpio_usb_shared.ctx);
+    pumpio_usb_shared.ctx = NULL;
+  }
+
+  pthread_mutex_unlock(&pumpio_usb_shared.lock);
+}
+
+/**
+ * Acquire a context for a one-shot lookup. Takes a reference to the shared
+ * context if any device or caller holds it already to use its hotplug cache.
+ * Otherwise, a plain temporary context is created to not set up hotplug and
+ * the event thread just for a single lookup. Release with
+ * pumpio_usb_query_unref.
+ */
+static int32_t
+pumpio_usb_query_ref(struct libusb_context **ctx, bool *shared)
+{
+  pthread_mutex_lock(&pumpio_usb_shared.lock);
+
+  if (pumpio_usb_shared.refs > 0) {
+    pumpio_usb_shared.refs++;
+    *ctx = pumpio_usb_shared.ctx;
+    *shared = true;
+
+    pthread_mutex_unlock(&pumpio_usb_shared.lock);
+
+    return LIBUSB_SUCCESS;
+  }
+
+  pthread_mutex_unlock(&pumpio_usb_shared.lock);
+
+  *shared = false;
+
+  return libusb_init(ctx);
+}
+
+static void pumpio_usb_query_unref(struct libusb_context *ctx, bool shared)
+{
+  if (shared) {
+    pumpio_usb_unref();
+  } else {
+    libusb_exit(ctx);
+  }
+}
+
+/**
+ * Get a list of referenced devices with the given VID and PID, either from the
+ * hotplug cache or by enumerating the bus. The cache belongs to the shared
+ * context, only use it if ctx is the shared one. Free with
+ * pumpio_usb_free_devices.
+ */
+static ssize_t pumpio_usb_get_devices(
+    struct libusb_context *ctx,
+    bool cached,
+    uint16_t vid,
+    uint16_t pid,
+    struct libusb_device ***devices)
+{
+  struct libusb_device **dev_list;
+  struct libusb_device **list;
+  ssize_t num_dev;
+  ssize_t count;
+
+  count = 0;
+
+  pthread_mutex_lock(&pumpio_usb_shared.cache_lock);
+
+  if (cached && pumpio_usb_shared.cache_valid) {
+    list = (struct libusb_device **) malloc(
+        sizeof(struct libusb_device *) * (pumpio_usb_shared.cache_count + 1));
+
+    if (list == NULL) {
+      pthread_mutex_unlock(&pumpio_usb_shared.cache_lock);
+      return LIBUSB_ERROR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < pumpio_usb_shared.cache_count; i++) {
+      struct pumpio_usb_cache_entry *entry = &pumpio_usb_shared.cache[i];
+
+      if (entry->vid == vid && entry->pid == pid) {
+        list[count++] = libusb_ref_device(entry->device);
+      }
+    }
+
+    pthread_mutex_unlock(&pumpio_usb_shared.cache_lock);
+
+    *devices = list;
+
+    return count;
+  }
+
+  pthread_mutex_unlock(&pumpio_usb_shared.cache_lock);
+
+  num_dev = libusb_get_device_list(ctx, &dev_list);
+
+  if (num_dev < 0) {
+    return num_dev;
+  }
+
+  list = (struct libusb_device **) malloc(
+      sizeof(struct libusb_device *) * (num_dev + 1));
+
+  if (list == NULL) {
+    libusb_free_device_list(dev_list, 1);
+    return LIBUSB_ERROR_NO_MEM;
+  }
+
+  for (ssize_t i = 0; i < num_dev; i++) {
+    struct libusb_device_descriptor dev_desc_tmp;
+
+    libusb_get_device_descriptor(dev_list[i], &dev_desc_tmp);
+
+    if (dev_desc_tmp.idVendor == vid && dev_desc_tmp.idProduct == pid) {
+      list[count++] = libusb_ref_device(dev_list[i]);
+    }
+  }
+
+  libusb_free_device_list(dev_list, 1);
+
+  *devices = list;
+
+  return count;
+}
+
+static void
+pumpio_usb_free_devices(struct libusb_device **devices, ssize_t count)
+{
+  for (ssize_t i = 0; i < count; i++) {
+    libusb_unref_device(devices[i]);
+  }
+
+  free(devices);
+}
+
 static int32_t pumpio_usb_get_device_handle(
     struct libusb_device_handle **handle,
     struct libusb_context *ctx,
     uint16_t vid,
-    uint16_t pid)
+    uint16_t pid,
+    const char *id)
 {
   int32_t ret;
+  int32_t ret_open;
   struct libusb_device **dev_list;
-  struct libusb_device *device;
+  struct libusb_device_handle *dev_handle;
+  ssize_t num_dev;
 
   dev_list = NULL;
-  device = NULL;
+  dev_handle = NULL;
+  ret = LIBUSB_ERROR_NOT_FOUND;
 
   assert(handle != NULL);
   assert(ctx != NULL);
 
-  ssize_t num_dev = libusb_get_device_list(ctx, &dev_list);
+  num_dev = pumpio_usb_get_devices(ctx, true, vid, pid, &dev_list);
+
+  if (num_dev < 0) {
+    return num_dev;
+  }
 
   /* find device */
   for (ssize_t i = 0; i < num_dev; i++) {
     struct libusb_device_descriptor dev_desc_tmp;
     struct libusb_device *dev_tmp;
+    char path[PUMPIO_USB_PATH_MAX];
+    char serial[PUMPIO_USB_SERIAL_MAX];
 
     dev_tmp = dev_list[i];
 
     libusb_get_device_descriptor(dev_tmp, &dev_desc_tmp);
 
-    if (dev_desc_tmp.idVendor == vid && dev_desc_tmp.idProduct == pid) {
-      device = dev_tmp;
+    if (id != NULL) {
+      pumpio_usb_get_path(dev_tmp, path, sizeof(path));
+
+      if (strcmp(path, id) && dev_desc_tmp.iSerialNumber == 0) {
+        continue;
+      }
+    }
+
+    ret_open = libusb_open(dev_tmp, &dev_handle);
+
+    if (ret_open != LIBUSB_SUCCESS) {
+      /* report the error only for the device requested, one opened to read
+         its serial might not be it, keep looking */
+      if (id == NULL || !strcmp(path, id)) {
+        ret = ret_open;
+      }
+
+      continue;
+    }
+
+    if (id == NULL || !strcmp(path, id)) {
       break;
     }
+
+    pumpio_usb_get_serial(dev_handle, &dev_desc_tmp, serial, sizeof(serial));
+
+    if (!strcmp(serial, id)) {
+      break;
+    }
+
+    libusb_close(dev_handle);
+    dev_handle = NULL;
   }
 
+  pumpio_usb_free_devices(dev_list, num_dev);
+
   /* not found */
-  if (device == NULL) {
-    libusb_free_device_list(dev_list, 1);
-    return LIBUSB_ERROR_NOT_FOUND;
+  if (dev_handle == NULL) {
+    return ret;
   }
 
-  ret = libusb_open(device, handle);
+  *handle = dev_handle;
+
+  return LIBUSB_SUCCESS;
+}
+
+/**
+ * Look up, open and set up the device described by the context
+ */
+static int32_t
+pumpio_usb_setup_device(struct pumpio_usb_ctx *dev, struct libusb_context *ctx)
+{
+  int32_t ret;
+  struct libusb_device_handle *dev_handle;
+
+  dev_handle = NULL;
+
+  ret = pumpio_usb_get_device_handle(
+      &dev_handle, ctx, dev->vid, dev->pid, dev->has_id ? dev->id : NULL);
 
   if (ret != LIBUSB_SUCCESS) {
-    libusb_free_device_list(dev_list, 1);
+    return ret;
+  }
+
+  /* a reconnected device is a new one, it might not have a driver bound */
+  dev->kernel_driver_detached = false;
+
+  /* check if the device is attached to the kernel, detach it first then */
+  if (libusb_kernel_driver_active(dev_handle, dev->iface) == 1) {
+    ret = libusb_detach_kernel_driver(dev_handle, dev->iface);
+
+    if (ret != LIBUSB_SUCCESS) {
+      libusb_close(dev_handle);
+      return ret;
+    }
+
+    dev->kernel_driver_detached = true;
+  }
+
+  ret = libusb_set_configuration(dev_handle, dev->config);
 
+  if (ret != LIBUSB_SUCCESS) {
+    libusb_close(dev_handle);
     return ret;
   }
 
-  libusb_free_device_list(dev_list, 1);
+  ret = libusb_claim_interface(dev_handle, dev->iface);
+
+  if (ret != LIBUSB_SUCCESS) {
+    libusb_close(dev_handle);
+    return ret;
+  }
+
+  ret = libusb_set_interface_alt_setting(dev_handle, dev->iface, 0);
+
+  if (ret != LIBUSB_SUCCESS) {
+    libusb_close(dev_handle);
+    return ret;
+  }
+
+  dev->dev = dev_handle;
 
   return LIBUSB_SUCCESS;
 }
 
+/**
+ * Try to reopen a disconnected device. Attempts are made immediately once a
+ * device arrival was signaled by hotplug or periodically otherwise.
+ */
+static result_t pumpio_usb_reconnect(struct pumpio_usb_ctx *dev)
+{
+  uint32_t arrivals;
+  uint64_t now_ns;
+  int32_t ret;
+
+  arrivals =
+      atomic_load_explicit(&pumpio_usb_shared.arrivals, memory_order_acquire);
+  now_ns = pumpio_time_now_ns();
+
+  if (arrivals == dev->arrivals &&
+      now_ns - dev->reopen_time_ns < PUMPIO_USB_REOPEN_INTERVAL_NS) {
+    return ENODEV;
+  }
+
+  dev->arrivals = arrivals;
+  dev->reopen_time_ns = now_ns;
+
+  ret = pumpio_usb_setup_device(dev, pumpio_usb_shared.ctx);
+
+  if (ret == LIBUSB_ERROR_NOT_FOUND) {
+    return ENODEV;
+  }
+
+  return pumpio_usb_map_libusb_error(ret);
+}
+
+result_t pumpio_usb_init()
+{
+  struct libusb_context *ctx;
+
+  return pumpio_usb_map_libusb_error(pumpio_usb_ref(&ctx));
+}
+
+void pumpio_usb_exit()
+{
+  pumpio_usb_unref();
+}
+
 bool pumpio_usb_available(uint16_t vid, uint16_t pid)
 {
-  bool found;
   int32_t ret;
   struct libusb_context *ctx;
   struct libusb_device **dev_list;
-  struct libusb_device *device;
-
-  dev_list = NULL;
-  device = NULL;
+  ssize_t num_dev;
+  bool shared;
 
-  ret = libusb_init(&ctx);
+  ret = pumpio_usb_query_ref(&ctx, &shared);
 
   if (ret != LIBUSB_SUCCESS) {
     return false;
   }
 
-  ssize_t num_dev = libusb_get_device_list(ctx, &dev_list);
+  num_dev = pumpio_usb_get_devices(ctx, shared, vid, pid, &dev_list);
 
-  /* find device */
-  for (ssize_t i = 0; i < num_dev; i++) {
+  /* the list is allocated even if no device matches */
+  if (num_dev >= 0) {
+    pumpio_usb_free_devices(dev_list, num_dev);
+  }
+
+  pumpio_usb_query_unref(ctx, shared);
+
+  return num_dev > 0;
+}
+
+result_t pumpio_usb_enumerate(
+    uint16_t vid,
+    uint16_t pid,
+    struct pumpio_usb_device_info *infos,
+    size_t max_count,
+    size_t *count)
+{
+  int32_t ret;
+  struct libusb_context *ctx;
+  struct libusb_device **dev_list;
+  ssize_t num_dev;
+  bool shared;
+
+  assert(infos != NULL || max_count == 0);
+  assert(count != NULL);
+
+  *count = 0;
+
+  ret = pumpio_usb_query_ref(&ctx, &shared);
+
+  if (ret != LIBUSB_SUCCESS) {
+    return pumpio_usb_map_libusb_error(ret);
+  }
+
+  num_dev = pumpio_usb_get_devices(ctx, shared, vid, pid, &dev_list);
+
+  if (num_dev < 0) {
+    pumpio_usb_query_unref(ctx, shared);
+    return pumpio_usb_map_libusb_error(num_dev);
+  }
+
+  for (ssize_t i = 0; i < num_dev && i < (ssize_t) max_count; i++) {
     struct libusb_device_descriptor dev_desc_tmp;
-    struct libusb_device *dev_tmp;
+    struct libusb_device_handle *dev_handle;
+    struct pumpio_usb_device_info *info;
 
-    dev_tmp = dev_list[i];
+    libusb_get_device_descriptor(dev_list[i], &dev_desc_tmp);
 
-    libusb_get_device_descriptor(dev_tmp, &dev_desc_tmp);
+    info = &infos[i];
 
-    if (dev_desc_tmp.idVendor == vid && dev_desc_tmp.idProduct == pid) {
-      device = dev_tmp;
-      break;
+    info->bus = libusb_get_bus_number(dev_list[i]);
+    info->address = libusb_get_device_address(dev_list[i]);
+    pumpio_usb_get_path(dev_list[i], info->path, sizeof(info->path));
+    info->serial[0] = '\0';
+
+    /* serial is optional, e.g. not readable without permissions */
+    if (libusb_open(dev_list[i], &dev_handle) == LIBUSB_SUCCESS) {
+      pumpio_usb_get_serial(
+          dev_handle, &dev_desc_tmp, info->serial, sizeof(info->serial));
+      libusb_close(dev_handle);
     }
   }
 
-  found = device != NULL;
+  *count = num_dev;
 
-  libusb_free_device_list(dev_list, 1);
-  libusb_exit(ctx);
+  pumpio_usb_free_devices(dev_list, num_dev);
+  pumpio_usb_query_unref(ctx, shared);
 
-  return found;
+  return RESULT_SUCCESS;
 }
 
 result_t pumpio_usb_open(
     void **handle, uint16_t vid, uint16_t pid, uint16_t config, uint16_t iface)
+{
+  return pumpio_usb_open_id(handle, vid, pid, NULL, config, iface);
+}
+
+result_t pumpio_usb_open_id(
+    void **handle,
+    uint16_t vid,
+    uint16_t pid,
+    const char *id,
+    uint16_t config,
+    uint16_t iface)
 {
   int32_t ret;
   struct libusb_context *ctx;
-  struct libusb_device_handle *dev;
   struct pumpio_usb_ctx *handle_tmp;
 
   assert(handle);
 
-  ret = libusb_init(&ctx);
+  if (id != NULL && strlen(id) >= PUMPIO_USB_ID_MAX) {
+    return EINVAL;
+  }
 
-  if (ret != LIBUSB_SUCCESS) {
-    return pumpio_usb_map_libusb_error(ret);
+  handle_tmp = (struct pumpio_usb_ctx *) malloc(sizeof(struct pumpio_usb_ctx));
+
+  if (handle_tmp == NULL) {
+    return ENOMEM;
   }
 
-  /* dont print any error messages to stderr, change this for debugging */
-  // libusb_set_option(ctx, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_NONE);
+  handle_tmp->dev = NULL;
+  handle_tmp->stats = NULL;
+  handle_tmp->transport = NULL;
+  handle_tmp->transport_ctx = NULL;
+  handle_tmp->vid = vid;
+  handle_tmp->pid = pid;
+  handle_tmp->config = config;
+  handle_tmp->iface = iface;
+  handle_tmp->kernel_driver_detached = false;
+  handle_tmp->reattach_kernel_driver = false;
+  handle_tmp->has_id = id != NULL;
+
+  if (id != NULL) {
+    strcpy(handle_tmp->id, id);
+  }
 
-  ret = pumpio_usb_get_device_handle(&dev, ctx, vid, pid);
+  ret = pumpio_usb_ref(&ctx);
 
   if (ret != LIBUSB_SUCCESS) {
-    libusb_exit(ctx);
+    free(handle_tmp);
     return pumpio_usb_map_libusb_error(ret);
   }
 
-  /* check if the device is attached to the kernel, detach it first then */
-  if (libusb_kernel_driver_active(dev, iface) == 1) {
-    ret = libusb_detach_kernel_driver(dev, iface);
-
-    if (ret != LIBUSB_SUCCESS) {
-      libusb_close(dev);
-      libusb_exit(ctx);
-
-      return pumpio_usb_map_libusb_error(ret);
-    }
-  }
+  handle_tmp->arrivals =
+      atomic_load_explicit(&pumpio_usb_shared.arrivals, memory_order_acquire);
+  handle_tmp->reopen_time_ns = pumpio_time_now_ns();
 
-  ret = libusb_set_configuration(dev, config);
+  ret = pumpio_usb_setup_device(handle_tmp, ctx);
 
   if (ret != LIBUSB_SUCCESS) {
-    libusb_close(dev);
-    libusb_exit(ctx);
+    pumpio_usb_unref();
+    free(handle_tmp);
 
     return pumpio_usb_map_libusb_error(ret);
   }
 
-  ret = libusb_claim_interface(dev, iface);
+  (*handle) = (void *) handle_tmp;
 
-  if (ret != LIBUSB_SUCCESS) {
-    libusb_close(dev);
-    libusb_exit(ctx);
+  return RESULT_SUCCESS;
+}
 
-    return pumpio_usb_map_libusb_error(ret);
-  }
+result_t pumpio_usb_open_transport(
+    void **handle, pumpio_usb_transport_func_t transport, void *ctx)
+{
+  struct pumpio_usb_ctx *handle_tmp;
 
-  ret = libusb_set_interface_alt_setting(dev, iface, 0);
+  assert(handle != NULL);
+  assert(transport != NULL);
 
-  if (ret != LIBUSB_SUCCESS) {
-    libusb_close(dev);
-    libusb_exit(ctx);
+  handle_tmp =
+      (struct pumpio_usb_ctx *) calloc(1, sizeof(struct pumpio_usb_ctx));
 
-    return pumpio_usb_map_libusb_error(ret);
+  if (handle_tmp == NULL) {
+    return ENOMEM;
   }
 
-  handle_tmp = (struct pumpio_usb_ctx *) malloc(sizeof(struct pumpio_usb_ctx));
-
-  handle_tmp->ctx = ctx;
-  handle_tmp->dev = dev;
+  handle_tmp->transport = transport;
+  handle_tmp->transport_ctx = ctx;
 
-  (*handle) = (void *) handle_tmp;
+  *handle = handle_tmp;
 
   return RESULT_SUCCESS;
 }
@@ -227,6 +852,8 @@ result_t pumpio_usb_control_transfer(
     uint16_t *len_res)
 {
   struct pumpio_usb_ctx *dev;
+  result_t result;
+  uint64_t start_ns;
   int32_t ret;
 
   assert(handle != NULL);
@@ -235,9 +862,58 @@ result_t pumpio_usb_control_transfer(
 
   dev = (struct pumpio_usb_ctx *) handle;
 
+  if (dev->transport != NULL) {
+    start_ns = dev->stats != NULL ? pumpio_time_now_ns() : 0;
+
+    result = dev->transport(
+        dev->transport_ctx,
+        request_type,
+        request,
+        value,
+        index,
+        data,
+        len,
+        timeout_ms,
+        len_res);
+
+    if (dev->stats != NULL) {
+      pumpio_stats_record_transfer(
+          dev->stats, pumpio_time_now_ns() - start_ns, result);
+    }
+
+    return result;
+  }
+
+  /* device got disconnected, transparently reopen once it is back */
+  if (dev->dev == NULL) {
+    result = pumpio_usb_reconnect(dev);
+
+    if (RESULT_IS_ERROR(result)) {
+      if (dev->stats != NULL) {
+        pumpio_stats_record_error(dev->stats, result);
+      }
+
+      return result;
+    }
+  }
+
+  start_ns = dev->stats != NULL ? pumpio_time_now_ns() : 0;
+
   ret = libusb_control_transfer(
       dev->dev, request_type, request, value, index, data, len, timeout_ms);
 
+  if (dev->stats != NULL) {
+    pumpio_stats_record_transfer(
+        dev->stats,
+        pumpio_time_now_ns() - start_ns,
+        pumpio_usb_map_libusb_error(ret < 0 ? ret : LIBUSB_SUCCESS));
+  }
+
+  if (ret == LIBUSB_ERROR_NO_DEVICE) {
+    libusb_close(dev->dev);
+    dev->dev = NULL;
+  }
+
   if (ret < 0) {
     return pumpio_usb_map_libusb_error(ret);
   }
@@ -247,17 +923,152 @@ result_t pumpio_usb_control_transfer(
   return RESULT_SUCCESS;
 }
 
+static bool pumpio_usb_is_transient_error(result_t result)
+{
+  switch (result) {
+    case EIO:
+    case EAGAIN:
+    case EOVERFLOW:
+    case EPIPE:
+    case EINTR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+result_t pumpio_usb_control_transfer_deadline(
+    void *handle,
+    uint8_t request_type,
+    uint8_t request,
+    uint16_t value,
+    uint16_t index,
+    uint8_t *data,
+    uint16_t len,
+    const struct pumpio_usb_deadline *deadline,
+    uint16_t *len_res)
+{
+  struct pumpio_stats *stats;
+  struct timespec backoff;
+  result_t result;
+  uint64_t now_ns;
+  uint64_t left_ms;
+  uint64_t backoff_us;
+  uint32_t timeout_ms;
+
+  assert(handle != NULL);
+  assert(deadline != NULL);
+
+  stats = ((struct pumpio_usb_ctx *) handle)->stats;
+  backoff_us = deadline->backoff_us;
+
+  if (backoff_us < PUMPIO_USB_BACKOFF_MIN_US) {
+    backoff_us = PUMPIO_USB_BACKOFF_MIN_US;
+  }
+
+  while (true) {
+    now_ns = pumpio_time_now_ns();
+
+    if (now_ns >= deadline->deadline_ns) {
+      break;
+    }
+
+    /* round up, a timeout of 0 means unlimited for libusb */
+    left_ms = (deadline->deadline_ns - now_ns + 999999) / 1000000;
+    timeout_ms = deadline->timeout_ms;
+
+    if (timeout_ms == 0 || left_ms < timeout_ms) {
+      timeout_ms = (uint32_t) left_ms;
+    }
+
+    result = pumpio_usb_control_transfer(
+        handle,
+        request_type,
+        request,
+        value,
+        index,
+        data,
+        len,
+        timeout_ms,
+        len_res);
+
+    if (!pumpio_usb_is_transient_error(result)) {
+      return result;
+    }
+
+    now_ns = pumpio_time_now_ns();
+
+    if (now_ns + backoff_us * 1000 >= deadline->deadline_ns) {
+      break;
+    }
+
+    backoff.tv_sec = backoff_us / 1000000;
+    backoff.tv_nsec = (backoff_us % 1000000) * 1000;
+    nanosleep(&backoff, NULL);
+
+    backoff_us *= 2;
+
+    if (backoff_us > deadline->backoff_max_us) {
+      backoff_us = deadline->backoff_max_us > PUMPIO_USB_BACKOFF_MIN_US ?
+          deadline->backoff_max_us :
+          PUMPIO_USB_BACKOFF_MIN_US;
+    }
+  }
+
+  if (stats != NULL) {
+    pumpio_stats_record_error(stats, ETIMEDOUT);
+  }
+
+  return ETIMEDOUT;
+}
+
+void pumpio_usb_set_reattach_kernel_driver(void *handle, bool reattach)
+{
+  assert(handle != NULL);
+
+  ((struct pumpio_usb_ctx *) handle)->reattach_kernel_driver = reattach;
+}
+
+void pumpio_usb_set_stats(void *handle, struct pumpio_stats *stats)
+{
+  assert(handle != NULL);
+
+  ((struct pumpio_usb_ctx *) handle)->stats = stats;
+}
+
+bool pumpio_usb_connected(void *handle)
+{
+  struct pumpio_usb_ctx *dev;
+
+  assert(handle != NULL);
+
+  dev = (struct pumpio_usb_ctx *) handle;
+
+  return dev->dev != NULL || dev->transport != NULL;
+}
+
 void pumpio_usb_close(void *handle)
 {
   assert(handle);
 
   struct pumpio_usb_ctx *dev = (struct pumpio_usb_ctx *) handle;
 
-  assert(dev->dev);
-  assert(dev->ctx);
+  if (dev->transport != NULL) {
+    free(dev);
+    return;
+  }
+
+  if (dev->dev != NULL) {
+    /* hand the device back to the kernel driver it was taken from */
+    if (dev->reattach_kernel_driver && dev->kernel_driver_detached) {
+      libusb_release_interface(dev->dev, dev->iface);
+      libusb_attach_kernel_driver(dev->dev, dev->iface);
+    }
+
+    libusb_close(dev->dev);
+  }
 
-  libusb_close(dev->dev);
-  libusb_exit(dev->ctx);
+  pumpio_usb_unref();
 
   free(dev);
 }
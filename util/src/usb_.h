@@ -1,17 +1,92 @@
 /**
  * Wrapper module for libusb-1.0 to make it more convenient to use usb devices
+ *
+ * All calls share a single, reference counted libusb context for the whole
+ * process. If the platform supports hotplug, connected devices are tracked in
+ * a cache which avoids enumerating the bus on every lookup. Opened devices
+ * survive being unplugged: transfers fail with ENODEV while the device is
+ * gone and the device is reopened transparently on the first transfer after
+ * it was plugged in again.
  */
 #ifndef PUMPIO_USB_H
 #define PUMPIO_USB_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "result.h"
+#include "stats.h"
+
+/**
+ * Max length of a device path including null terminator
+ */
+#define PUMPIO_USB_PATH_MAX 32
+
+/**
+ * Max length of a device serial number including null terminator
+ */
+#define PUMPIO_USB_SERIAL_MAX 64
+
+/**
+ * Bounds for executing a transfer with retries, see
+ * pumpio_usb_control_transfer_deadline
+ */
+struct pumpio_usb_deadline {
+  /* Absolute point in time the transfer must be completed by, based on the
+     monotonic clock (see pumpio_time_now_ns) */
+  uint64_t deadline_ns;
+  /* Max. timeout of a single transfer attempt in ms, the timeout is reduced
+     to the time left until the deadline */
+  uint32_t timeout_ms;
+  /* Time to wait before the first retry in us, doubled with each retry. Min.
+     10 us to not spin on errors returned immediately, e.g. stalls */
+  uint32_t backoff_us;
+  /* Max. time to wait between two retries in us */
+  uint32_t backoff_max_us;
+};
+
+/**
+ * Information identifying a single connected usb device
+ */
+struct pumpio_usb_device_info {
+  /* Number of the bus the device is connected to */
+  uint8_t bus;
+  /* Address of the device on the bus, changes on every reconnect */
+  uint8_t address;
+  /* Physical location of the device in the form "bus-port.port...", e.g.
+     "1-2.4", same format as used by sysfs. Stable as long as the device is
+     connected to the same port */
+  char path[PUMPIO_USB_PATH_MAX];
+  /* Serial number of the device, empty if the device doesn't have one or it
+     can't be read, e.g. due to missing permissions */
+  char serial[PUMPIO_USB_SERIAL_MAX];
+};
 
 /**
- * Check if a USB device with the given VID and PID is connected and can be
- * opened.
+ * Acquire a reference to the shared usb context.
+ *
+ * This is optional, the context is created with the first device opened and
+ * destroyed with the last one closed. Holding an additional reference keeps
+ * the device cache alive which speeds up repeated calls to
+ * pumpio_usb_available or pumpio_usb_enumerate without any device opened.
+ *
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENOMEM, ENOTSUP
+ */
+result_t pumpio_usb_init();
+
+/**
+ * Release a reference acquired with pumpio_usb_init.
+ */
+void pumpio_usb_exit();
+
+/**
+ * Check if a USB device with the given VID and PID is connected.
+ *
+ * Answered from the hotplug device cache while it is valid, otherwise by
+ * enumerating the bus. The device is not opened, i.e. opening it can still
+ * fail, e.g. with EACCES or EBUSY.
  *
  * @param vid Vendor ID of the USB device to check
  * @param pid Product ID of the USB device to check
@@ -19,9 +94,33 @@
  */
 bool pumpio_usb_available(uint16_t vid, uint16_t pid);
 
+/**
+ * Enumerate all connected usb devices with the given VID and PID.
+ *
+ * @param vid Vendor ID of the devices to enumerate
+ * @param pid Product ID of the devices to enumerate
+ * @param infos Pointer to an allocated array to return information about the
+ *              devices found in
+ * @param max_count Number of elements of the infos array
+ * @param count Pointer to a variable to return the total number of devices
+ *              found in. This can be larger than max_count in which case only
+ *              the first max_count devices are returned.
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENOMEM, ENOTSUP
+ */
+result_t pumpio_usb_enumerate(
+    uint16_t vid,
+    uint16_t pid,
+    struct pumpio_usb_device_info *infos,
+    size_t max_count,
+    size_t *count);
+
 /**
  * Open a usb device with given parameters.
  *
+ * If multiple matching devices are connected, the first one found is opened.
+ * Use pumpio_usb_open_id to open a specific device.
+ *
  * @param handle Pointer to variable (void*) to store the resulting handle
  *               reference in if successful. The caller is responsible for
  *               managing the handle and free it using pumpio_usb_close.
@@ -36,6 +135,66 @@ bool pumpio_usb_available(uint16_t vid, uint16_t pid);
 result_t pumpio_usb_open(
     void **handle, uint16_t vid, uint16_t pid, uint16_t config, uint16_t iface);
 
+/**
+ * Open a specific usb device with given parameters.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if successful. The caller is responsible for
+ *               managing the handle and free it using pumpio_usb_close.
+ * @param vid Vendor ID of the device
+ * @param pid Product ID of the device
+ * @param id Identifier of the device to open, either its path or its serial
+ *           number as returned by pumpio_usb_enumerate. NULL to open the
+ *           first device found.
+ * @param config Configuration to set when opening the device
+ * @param iface Interface to claim
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
+ *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
+ */
+result_t pumpio_usb_open_id(
+    void **handle,
+    uint16_t vid,
+    uint16_t pid,
+    const char *id,
+    uint16_t config,
+    uint16_t iface);
+
+/**
+ * Control transfer function of a custom transport replacing libusb, e.g. to
+ * simulate a device. Parameters match pumpio_usb_control_transfer.
+ *
+ * @param ctx Context provided when opening the device
+ * @return Success or an error code as defined by result_t
+ */
+typedef result_t (*pumpio_usb_transport_func_t)(
+    void *ctx,
+    uint8_t request_type,
+    uint8_t request,
+    uint16_t value,
+    uint16_t index,
+    uint8_t *data,
+    uint16_t len,
+    uint32_t timeout_ms,
+    uint16_t *len_res);
+
+/**
+ * Open a device that is driven by a custom transport instead of libusb, e.g.
+ * a simulated device for testing and benchmarking without hardware. All
+ * transfers are dispatched to the transport and recorded like the ones of a
+ * real device. The transport cannot get disconnected.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if successful. The caller is responsible for
+ *               managing the handle and free it using pumpio_usb_close.
+ * @param transport Transfer function of the transport
+ * @param ctx Context passed to the transport on every transfer
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM
+ */
+result_t pumpio_usb_open_transport(
+    void **handle, pumpio_usb_transport_func_t transport, void *ctx);
+
 /**
  * Execute a synchronous control transfer from the host to the device.
  *
@@ -56,7 +215,8 @@ result_t pumpio_usb_open(
  *                successfully transfered bytes to.
  * @return Success or an error code as defined by result_t. Possible return
  *         values: RESULT_SUCCESS, EIO, EINVAL, EACCES, ENODEV, ENOENT, EBUSY,
- *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP
+ *         EAGAIN, EOVERFLOW, EPIPE, EINTR, ENOMEM, ENOTSUP. ENODEV if the
+ *         device is disconnected, keep calling to reconnect once it is back.
  */
 result_t pumpio_usb_control_transfer(
     void *handle,
@@ -69,10 +229,77 @@ result_t pumpio_usb_control_transfer(
     uint32_t timeout_ms,
     uint16_t *len_res);
 
+/**
+ * Execute a synchronous control transfer from the host to the device bounded
+ * by a deadline.
+ *
+ * Transient errors, e.g. a transfer timing out or stalling on a flaky hub, are
+ * retried with exponential backoff until the deadline is reached. Errors that
+ * won't go away by retrying, e.g. the device being disconnected, are returned
+ * immediately.
+ *
+ * @param handle Valid handle of an opened usb device
+ * @param request_type Request type field for the setup packet
+ * @param request Request field for the setup packet
+ * @param value Value field for the setup packet
+ * @param index Index field for the setup packet
+ * @param data Pointer to an allocated buffer, see pumpio_usb_control_transfer
+ * @param len Length of the allocated data buffer provided in data
+ * @param deadline Deadline and retry parameters for the transfer
+ * @param len_res Pointer to a field to return the resulting number of
+ *                successfully transfered bytes to.
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ETIMEDOUT if the transfer did not complete
+ *         before the deadline, EINVAL, EACCES, ENODEV, ENOENT, EBUSY, ENOMEM,
+ *         ENOTSUP
+ */
+result_t pumpio_usb_control_transfer_deadline(
+    void *handle,
+    uint8_t request_type,
+    uint8_t request,
+    uint16_t value,
+    uint16_t index,
+    uint8_t *data,
+    uint16_t len,
+    const struct pumpio_usb_deadline *deadline,
+    uint16_t *len_res);
+
+/**
+ * Re-attach the kernel driver, e.g. piuio.ko, detached from the device on
+ * open when closing it. Disabled by default, i.e. the device stays without a
+ * driver after closing it. Enable it to hand the device back to the kernel,
+ * e.g. when switching to a backend using the kernel driver.
+ *
+ * @param handle Valid handle of an opened usb device
+ * @param reattach True to re-attach the kernel driver on close
+ */
+void pumpio_usb_set_reattach_kernel_driver(void *handle, bool reattach);
+
+/**
+ * Record all transfers and errors of an opened usb device in the given
+ * statistics (see stats.h).
+ *
+ * @param handle Valid handle of an opened usb device
+ * @param stats Pointer to the statistics to record in, must stay valid until
+ *              the device is closed. NULL to disable recording
+ */
+void pumpio_usb_set_stats(void *handle, struct pumpio_stats *stats);
+
+/**
+ * Check if an opened usb device is currently connected.
+ *
+ * @param handle Valid handle of an opened usb device
+ * @return True if connected, false if it got disconnected and was not
+ *         reopened, yet
+ */
+bool pumpio_usb_connected(void *handle);
+
 /**
  * Close an opened usb device.
  *
- * Ensure you call this for every device opened to free resources.
+ * Ensure you call this for every device opened to free resources. A kernel
+ * driver detached on open is only attached again if enabled, see
+ * pumpio_usb_set_reattach_kernel_driver.
  *
  * @param handle Valid handle of the opened device to close
  */
@@ -0,0 +1,582 @@
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/usbdevice_fs.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "time_.h"
+#include "usbfs.h"
+
+#define PUMPIO_USBFS_SYSFS_DIR "/sys/bus/usb/devices"
+#define PUMPIO_USBFS_DEV_PATH_FMT "/dev/bus/usb/%03u/%03u"
+
+/* Size of the setup paket preceding the data of a control URB */
+#define PUMPIO_USBFS_SETUP_SIZE 8
+
+/* Direction bit of the request type, set for device to host */
+#define PUMPIO_USBFS_DIR_IN 0x80
+
+#define PUMPIO_USBFS_ATTR_MAX 64
+
+struct pumpio_usbfs_ctx {
+  int fd;
+  uint16_t iface;
+  bool kernel_driver_detached;
+  struct usbdevfs_urb urbs[PUMPIO_USBFS_BATCH_MAX];
+  uint8_t buffers[PUMPIO_USBFS_BATCH_MAX]
+                 [PUMPIO_USBFS_SETUP_SIZE + PUMPIO_USBFS_DATA_MAX];
+  bool reaped[PUMPIO_USBFS_BATCH_MAX];
+  /* Batch in flight, NULL if none */
+  struct pumpio_usbfs_control *transfers;
+  size_t count;
+  size_t pending;
+  /* Error of the first failed transfer of the batch in flight */
+  result_t result;
+};
+
+/**
+ * Read a single line attribute of a sysfs usb device, trailing newline
+ * removed
+ */
+static bool pumpio_usbfs_read_attr(
+    const char *name, const char *attr, char *value, size_t len)
+{
+  char path[PATH_MAX];
+  FILE *file;
+  bool ok;
+
+  snprintf(path, sizeof(path), PUMPIO_USBFS_SYSFS_DIR "/%s/%s", name, attr);
+
+  file = fopen(path, "r");
+
+  if (file == NULL) {
+    return false;
+  }
+
+  ok = fgets(value, len, file) != NULL;
+  fclose(file);
+
+  if (ok) {
+    value[strcspn(value, "\n")] = '\0';
+  }
+
+  return ok;
+}
+
+static bool pumpio_usbfs_read_attr_uint(
+    const char *name, const char *attr, int base, uint32_t *value)
+{
+  char buf[PUMPIO_USBFS_ATTR_MAX];
+
+  if (!pumpio_usbfs_read_attr(name, attr, buf, sizeof(buf))) {
+    return false;
+  }
+
+  *value = (uint32_t) strtoul(buf, NULL, base);
+
+  return true;
+}
+
+/**
+ * Find the sysfs name, e.g. "1-2.4", of the first device matching the given
+ * ids. The name equals the path used by usb_.h.
+ */
+static result_t pumpio_usbfs_find(
+    uint16_t vid, uint16_t pid, const char *id, char *name, size_t len)
+{
+  DIR *dir;
+  struct dirent *entry;
+  char serial[PUMPIO_USBFS_ATTR_MAX];
+  uint32_t value;
+  bool found;
+
+  dir = opendir(PUMPIO_USBFS_SYSFS_DIR);
+
+  if (dir == NULL) {
+    return errno;
+  }
+
+  found = false;
+
+  while (!found && (entry = readdir(dir)) != NULL) {
+    // Skip interfaces, e.g. "1-2.4:1.0", and the directory links
+    if (entry->d_name[0] == '.' || strchr(entry->d_name, ':') != NULL) {
+      continue;
+    }
+
+    if (!pumpio_usbfs_read_attr_uint(entry->d_name, "idVendor", 16, &value) ||
+        value != vid) {
+      continue;
+    }
+
+    if (!pumpio_usbfs_read_attr_uint(entry->d_name, "idProduct", 16, &value) ||
+        value != pid) {
+      continue;
+    }
+
+    if (id != NULL && strcmp(entry->d_name, id) &&
+        (!pumpio_usbfs_read_attr(
+             entry->d_name, "serial", serial, sizeof(serial)) ||
+         strcmp(serial, id))) {
+      continue;
+    }
+
+    if (strlen(entry->d_name) < len) {
+      strcpy(name, entry->d_name);
+      found = true;
+    }
+  }
+
+  closedir(dir);
+
+  return found ? RESULT_SUCCESS : ENOENT;
+}
+
+static result_t pumpio_usbfs_open_node(const char *name, int *fd)
+{
+  char path[PATH_MAX];
+  uint32_t busnum;
+  uint32_t devnum;
+
+  if (!pumpio_usbfs_read_attr_uint(name, "busnum", 10, &busnum) ||
+      !pumpio_usbfs_read_attr_uint(name, "devnum", 10, &devnum)) {
+    return ENODEV;
+  }
+
+  snprintf(path, sizeof(path), PUMPIO_USBFS_DEV_PATH_FMT, busnum, devnum);
+
+  *fd = open(path, O_RDWR | O_CLOEXEC);
+
+  if (*fd < 0) {
+    return errno;
+  }
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Detach the kernel driver bound to the interface, if any
+ */
+static result_t pumpio_usbfs_detach(struct pumpio_usbfs_ctx *ctx)
+{
+  struct usbdevfs_getdriver driver;
+  struct usbdevfs_ioctl command;
+
+  memset(&driver, 0, sizeof(driver));
+  driver.interface = ctx->iface;
+
+  if (ioctl(ctx->fd, USBDEVFS_GETDRIVER, &driver) != 0) {
+    // No driver bound
+    return errno == ENODATA ? RESULT_SUCCESS : errno;
+  }
+
+  // Bound to usbfs already, e.g. by another process
+  if (!strcmp(driver.driver, "usbfs")) {
+    return EBUSY;
+  }
+
+  memset(&command, 0, sizeof(command));
+  command.ifno = ctx->iface;
+  command.ioctl_code = USBDEVFS_DISCONNECT;
+
+  if (ioctl(ctx->fd, USBDEVFS_IOCTL, &command) < 0) {
+    return errno;
+  }
+
+  ctx->kernel_driver_detached = true;
+
+  return RESULT_SUCCESS;
+}
+
+static void pumpio_usbfs_attach(struct pumpio_usbfs_ctx *ctx)
+{
+  struct usbdevfs_ioctl command;
+
+  if (!ctx->kernel_driver_detached) {
+    return;
+  }
+
+  memset(&command, 0, sizeof(command));
+  command.ifno = ctx->iface;
+  command.ioctl_code = USBDEVFS_CONNECT;
+
+  ioctl(ctx->fd, USBDEVFS_IOCTL, &command);
+}
+
+result_t pumpio_usbfs_open(
+    void **handle,
+    uint16_t vid,
+    uint16_t pid,
+    const char *id,
+    uint16_t config,
+    uint16_t iface)
+{
+  struct pumpio_usbfs_ctx *ctx;
+  char name[PUMPIO_USBFS_ATTR_MAX];
+  uint32_t active_config;
+  uint32_t tmp;
+  result_t result;
+
+  assert(handle != NULL);
+
+  result = pumpio_usbfs_find(vid, pid, id, name, sizeof(name));
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  ctx = (struct pumpio_usbfs_ctx *) malloc(sizeof(struct pumpio_usbfs_ctx));
+
+  if (ctx == NULL) {
+    return ENOMEM;
+  }
+
+  memset(ctx, 0, sizeof(struct pumpio_usbfs_ctx));
+  ctx->iface = iface;
+
+  result = pumpio_usbfs_open_node(name, &ctx->fd);
+
+  if (RESULT_IS_ERROR(result)) {
+    free(ctx);
+    return result;
+  }
+
+  result = pumpio_usbfs_detach(ctx);
+
+  if (RESULT_IS_ERROR(result)) {
+    close(ctx->fd);
+    free(ctx);
+    return result;
+  }
+
+  // Setting the configuration re-initializes the device even if already
+  // active, only do it if required
+  if (!pumpio_usbfs_read_attr_uint(
+          name, "bConfigurationValue", 10, &active_config) ||
+      active_config != config) {
+    tmp = config;
+
+    if (ioctl(ctx->fd, USBDEVFS_SETCONFIGURATION, &tmp) != 0) {
+      result = errno;
+      pumpio_usbfs_attach(ctx);
+      close(ctx->fd);
+      free(ctx);
+      return result;
+    }
+  }
+
+  tmp = iface;
+
+  if (ioctl(ctx->fd, USBDEVFS_CLAIMINTERFACE, &tmp) != 0) {
+    result = errno;
+    pumpio_usbfs_attach(ctx);
+    close(ctx->fd);
+    free(ctx);
+    return result;
+  }
+
+  *handle = (void *) ctx;
+
+  return RESULT_SUCCESS;
+}
+
+static result_t pumpio_usbfs_map_status(int status)
+{
+  if (status == 0) {
+    return RESULT_SUCCESS;
+  }
+
+  // The device is gone if the host controller shut down the endpoint
+  if (status == -ESHUTDOWN) {
+    return ENODEV;
+  }
+
+  return (result_t) -status;
+}
+
+/**
+ * Reap a single completed URB and finish its transfer of the batch in flight
+ */
+static result_t pumpio_usbfs_reap(struct pumpio_usbfs_ctx *ctx, bool block)
+{
+  struct pumpio_usbfs_control *transfer;
+  struct usbdevfs_urb *urb;
+  unsigned long request;
+  size_t i;
+
+  request = block ? USBDEVFS_REAPURB : USBDEVFS_REAPURBNDELAY;
+
+  if (ioctl(ctx->fd, request, &urb) != 0) {
+    return errno == ESHUTDOWN || errno == ENODEV ? ENODEV : errno;
+  }
+
+  i = (size_t) (uintptr_t) urb->usercontext;
+  ctx->reaped[i] = true;
+  ctx->pending--;
+
+  transfer = &ctx->transfers[i];
+  transfer->len_res = (uint16_t) urb->actual_length;
+
+  if (transfer->request_type & PUMPIO_USBFS_DIR_IN) {
+    memcpy(
+        transfer->data,
+        ctx->buffers[i] + PUMPIO_USBFS_SETUP_SIZE,
+        transfer->len_res);
+  }
+
+  // Keep the error of the first failed transfer
+  if (!RESULT_IS_ERROR(ctx->result)) {
+    ctx->result = pumpio_usbfs_map_status(urb->status);
+  }
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Cancel all transfers of the batch in flight not reaped, yet, and wait for
+ * them to complete
+ */
+static void pumpio_usbfs_discard(struct pumpio_usbfs_ctx *ctx)
+{
+  for (size_t i = 0; i < ctx->count; i++) {
+    if (!ctx->reaped[i]) {
+      ioctl(ctx->fd, USBDEVFS_DISCARDURB, &ctx->urbs[i]);
+    }
+  }
+
+  while (ctx->pending > 0) {
+    if (RESULT_IS_ERROR(pumpio_usbfs_reap(ctx, true))) {
+      // Device is gone, the kernel freed all URBs
+      break;
+    }
+  }
+
+  ctx->pending = 0;
+  ctx->transfers = NULL;
+}
+
+static void pumpio_usbfs_fill_urb(
+    struct pumpio_usbfs_ctx *ctx,
+    const struct pumpio_usbfs_control *transfer,
+    size_t i)
+{
+  struct usbdevfs_urb *urb;
+  uint8_t *setup;
+
+  setup = ctx->buffers[i];
+  setup[0] = transfer->request_type;
+  setup[1] = transfer->request;
+  setup[2] = transfer->value & 0xFF;
+  setup[3] = transfer->value >> 8;
+  setup[4] = transfer->index & 0xFF;
+  setup[5] = transfer->index >> 8;
+  setup[6] = transfer->len & 0xFF;
+  setup[7] = transfer->len >> 8;
+
+  if (!(transfer->request_type & PUMPIO_USBFS_DIR_IN)) {
+    memcpy(setup + PUMPIO_USBFS_SETUP_SIZE, transfer->data, transfer->len);
+  }
+
+  urb = &ctx->urbs[i];
+  memset(urb, 0, sizeof(struct usbdevfs_urb));
+  urb->type = USBDEVFS_URB_TYPE_CONTROL;
+  urb->endpoint = 0;
+  urb->buffer = setup;
+  urb->buffer_length = PUMPIO_USBFS_SETUP_SIZE + transfer->len;
+  urb->usercontext = (void *) (uintptr_t) i;
+}
+
+int pumpio_usbfs_fd(void *handle)
+{
+  assert(handle != NULL);
+
+  return ((struct pumpio_usbfs_ctx *) handle)->fd;
+}
+
+result_t pumpio_usbfs_submit_batch(
+    void *handle, struct pumpio_usbfs_control *transfers, size_t count)
+{
+  struct pumpio_usbfs_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(transfers != NULL);
+
+  ctx = (struct pumpio_usbfs_ctx *) handle;
+
+  if (ctx->transfers != NULL) {
+    return EBUSY;
+  }
+
+  if (count > PUMPIO_USBFS_BATCH_MAX) {
+    return EINVAL;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (transfers[i].len > PUMPIO_USBFS_DATA_MAX) {
+      return EINVAL;
+    }
+  }
+
+  ctx->transfers = transfers;
+  ctx->count = count;
+  ctx->pending = 0;
+  ctx->result = RESULT_SUCCESS;
+
+  // Submit all at once, the kernel queues them on the control endpoint
+  for (size_t i = 0; i < count; i++) {
+    pumpio_usbfs_fill_urb(ctx, &transfers[i], i);
+    ctx->reaped[i] = false;
+
+    if (ioctl(ctx->fd, USBDEVFS_SUBMITURB, &ctx->urbs[i]) != 0) {
+      result = errno == ESHUTDOWN ? ENODEV : errno;
+
+      // Only the ones submitted so far are in flight
+      ctx->count = i;
+      pumpio_usbfs_discard(ctx);
+
+      return result;
+    }
+
+    ctx->pending++;
+  }
+
+  return RESULT_SUCCESS;
+}
+
+result_t pumpio_usbfs_reap_batch(void *handle)
+{
+  struct pumpio_usbfs_ctx *ctx;
+  result_t result;
+
+  assert(handle != NULL);
+
+  ctx = (struct pumpio_usbfs_ctx *) handle;
+
+  if (ctx->transfers == NULL) {
+    return EINVAL;
+  }
+
+  while (ctx->pending > 0) {
+    result = pumpio_usbfs_reap(ctx, false);
+
+    if (result == EAGAIN) {
+      return EAGAIN;
+    }
+
+    if (RESULT_IS_ERROR(result)) {
+      pumpio_usbfs_discard(ctx);
+      return result;
+    }
+  }
+
+  ctx->transfers = NULL;
+
+  return ctx->result;
+}
+
+void pumpio_usbfs_cancel_batch(void *handle)
+{
+  struct pumpio_usbfs_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct pumpio_usbfs_ctx *) handle;
+
+  if (ctx->transfers != NULL) {
+    pumpio_usbfs_discard(ctx);
+  }
+}
+
+result_t pumpio_usbfs_control_batch(
+    void *handle,
+    struct pumpio_usbfs_control *transfers,
+    size_t count,
+    uint32_t timeout_ms)
+{
+  struct pumpio_usbfs_ctx *ctx;
+  struct pollfd pfd;
+  result_t result;
+  uint64_t deadline_ns;
+  uint64_t now_ns;
+  int ret;
+
+  assert(handle != NULL);
+  assert(transfers != NULL);
+
+  ctx = (struct pumpio_usbfs_ctx *) handle;
+  deadline_ns = pumpio_time_now_ns() + (uint64_t) timeout_ms * 1000000;
+
+  result = pumpio_usbfs_submit_batch(handle, transfers, count);
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  while (true) {
+    result = pumpio_usbfs_reap_batch(handle);
+
+    if (result != EAGAIN) {
+      return result;
+    }
+
+    // Wait for the next completion, signaled as writable
+    pfd.fd = ctx->fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    if (timeout_ms > 0) {
+      now_ns = pumpio_time_now_ns();
+
+      if (now_ns >= deadline_ns) {
+        pumpio_usbfs_discard(ctx);
+        return ETIMEDOUT;
+      }
+
+      // Round up to not busy loop on the last millisecond
+      ret = poll(&pfd, 1, (int) ((deadline_ns - now_ns + 999999) / 1000000));
+    } else {
+      ret = poll(&pfd, 1, -1);
+    }
+
+    if (ret < 0 && errno != EINTR) {
+      result = errno;
+      pumpio_usbfs_discard(ctx);
+      return result;
+    }
+
+    if (ret > 0 && (pfd.revents & (POLLERR | POLLHUP))) {
+      pumpio_usbfs_discard(ctx);
+      return ENODEV;
+    }
+  }
+}
+
+void pumpio_usbfs_close(void *handle)
+{
+  struct pumpio_usbfs_ctx *ctx;
+  uint32_t iface;
+
+  assert(handle != NULL);
+
+  ctx = (struct pumpio_usbfs_ctx *) handle;
+  iface = ctx->iface;
+
+  pumpio_usbfs_cancel_batch(handle);
+
+  ioctl(ctx->fd, USBDEVFS_RELEASEINTERFACE, &iface);
+
+  // Hand the device back to the kernel driver it was taken from
+  pumpio_usbfs_attach(ctx);
+
+  close(ctx->fd);
+  free(ctx);
+}
@@ -0,0 +1,159 @@
+/**
+ * Direct access to usb devices through the kernel's usbfs interface, i.e. the
+ * device nodes /dev/bus/usb/BBB/DDD, bypassing libusb.
+ *
+ * Control transfers are submitted as URBs in batches and reaped in bulk. The
+ * kernel queues the URBs of an endpoint and executes them in order, i.e. the
+ * transfers of a batch still run one after another on the bus but without a
+ * round trip to user space in between. Compared to synchronous libusb
+ * transfers, this removes the per-transfer allocation, event handling and
+ * locking as well as the wake ups of the calling thread.
+ *
+ * Batches are either executed synchronously, see pumpio_usbfs_control_batch,
+ * or submitted and reaped asynchronously. The latter allows to keep batches of
+ * several devices in flight at once on a single thread, waiting on the file
+ * descriptors of all devices with poll or epoll.
+ *
+ * Devices are looked up via sysfs. Unlike the libusb based usb_.h, a
+ * disconnected device is not reconnected transparently, it has to be reopened.
+ */
+#ifndef PUMPIO_USBFS_H
+#define PUMPIO_USBFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "result.h"
+
+/**
+ * Max. number of transfers of a batch
+ */
+#define PUMPIO_USBFS_BATCH_MAX 16
+
+/**
+ * Max. number of data bytes of a single transfer
+ */
+#define PUMPIO_USBFS_DATA_MAX 64
+
+/**
+ * A single control transfer of a batch
+ */
+struct pumpio_usbfs_control {
+  uint8_t request_type;
+  uint8_t request;
+  uint16_t value;
+  uint16_t index;
+  /* Data to send or buffer to receive into, depending on the direction of
+     the request type */
+  uint8_t *data;
+  uint16_t len;
+  /* Number of bytes actually transferred, set by the call */
+  uint16_t len_res;
+};
+
+/**
+ * Open a specific usb device through usbfs, detach any kernel driver bound to
+ * the interface and claim it.
+ *
+ * @param handle Pointer to variable (void*) to store the resulting handle
+ *               reference in if successful. The caller is responsible for
+ *               managing the handle and free it using pumpio_usbfs_close.
+ * @param vid Vendor ID of the device
+ * @param pid Product ID of the device
+ * @param id Identifier of the device to open, either its path (e.g. "1-2.4")
+ *           or its serial number. NULL to open the first device found.
+ * @param config Configuration to set if not active already
+ * @param iface Interface to claim
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOENT if no matching device is connected,
+ *         EACCES if the device node is not accessible, EBUSY if the interface
+ *         is claimed already, ENOMEM, any error of open or ioctl
+ */
+result_t pumpio_usbfs_open(
+    void **handle,
+    uint16_t vid,
+    uint16_t pid,
+    const char *id,
+    uint16_t config,
+    uint16_t iface);
+
+/**
+ * Submit a batch of control transfers and wait until all of them completed.
+ *
+ * The transfers are executed in the given order. If any transfer fails, the
+ * following ones are still executed by the device and the error of the first
+ * failed transfer is returned.
+ *
+ * @param handle Valid handle of an opened device
+ * @param transfers Transfers to execute
+ * @param count Number of transfers, max. PUMPIO_USBFS_BATCH_MAX
+ * @param timeout_ms Max. time to wait for the whole batch, 0 to wait forever.
+ *                   Transfers not completed in time are cancelled
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL, EBUSY if a batch is in flight
+ *         already, ETIMEDOUT, ENODEV if the device was
+ *         disconnected, EPIPE if the device stalled a request, any error of
+ *         ioctl or the transfers
+ */
+result_t pumpio_usbfs_control_batch(
+    void *handle,
+    struct pumpio_usbfs_control *transfers,
+    size_t count,
+    uint32_t timeout_ms);
+
+/**
+ * Get the file descriptor of the device node, e.g. to wait for completions
+ * of a submitted batch with poll or epoll. The descriptor is signaled as
+ * writable (POLLOUT) if completed transfers can be reaped and with POLLERR and
+ * POLLHUP if the device was disconnected.
+ *
+ * @param handle Valid handle of an opened device
+ * @return File descriptor owned by the handle, do not close it
+ */
+int pumpio_usbfs_fd(void *handle);
+
+/**
+ * Submit a batch of control transfers without waiting for their completion.
+ * Only a single batch can be in flight per device. The transfers, including
+ * their data buffers, must stay valid until the batch is reaped or cancelled.
+ *
+ * @param handle Valid handle of an opened device
+ * @param transfers Transfers to execute in the given order
+ * @param count Number of transfers, max. PUMPIO_USBFS_BATCH_MAX
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, EINVAL, EBUSY if a batch is in flight
+ *         already, ENODEV if the device was disconnected, any error of ioctl
+ */
+result_t pumpio_usbfs_submit_batch(
+    void *handle, struct pumpio_usbfs_control *transfers, size_t count);
+
+/**
+ * Reap the completed transfers of the batch in flight without blocking.
+ *
+ * @param handle Valid handle of an opened device
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS if all transfers completed, EAGAIN if
+ *         transfers are still pending, EINVAL if no batch is in flight,
+ *         ENODEV if the device was disconnected, EPIPE if the device stalled
+ *         a request, any error of ioctl or the transfers. The batch is
+ *         finished on any value but EAGAIN
+ */
+result_t pumpio_usbfs_reap_batch(void *handle);
+
+/**
+ * Cancel the batch in flight, if any, and wait for the kernel to return all of
+ * its transfers. Transfers completed already keep their results.
+ *
+ * @param handle Valid handle of an opened device
+ */
+void pumpio_usbfs_cancel_batch(void *handle);
+
+/**
+ * Release the interface, re-attach the kernel driver detached on open and
+ * close the device.
+ *
+ * @param handle Valid handle of an opened device
+ */
+void pumpio_usbfs_close(void *handle);
+
+#endif
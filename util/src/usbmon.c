@@ -0,0 +1,413 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "usbmon.h"
+
+/* Header formats of the binary interface, 48 bytes as returned by the kernel,
+   64 bytes as used by the mmap interface */
+#define PUMPIO_USBMON_HDR_SIZE 48
+#define PUMPIO_USBMON_HDR_MMAPPED_SIZE 64
+
+/* Size of an isochronous descriptor following the mmapped header */
+#define PUMPIO_USBMON_ISO_DESC_SIZE 16
+
+/* Offset of the number of isochronous descriptors in the mmapped header */
+#define PUMPIO_USBMON_HDR_NDESC_OFFSET 60
+
+/* Max. number of data bytes fetched per event from the kernel */
+#define PUMPIO_USBMON_CAPTURE_MAX 4096
+
+#define PUMPIO_USBMON_PCAP_MAGIC_US 0xA1B2C3D4
+#define PUMPIO_USBMON_PCAP_MAGIC_NS 0xA1B23C4D
+#define PUMPIO_USBMON_PCAP_VERSION_MAJOR 2
+#define PUMPIO_USBMON_PCAP_VERSION_MINOR 4
+#define PUMPIO_USBMON_PCAP_LINKTYPE 189
+#define PUMPIO_USBMON_PCAP_LINKTYPE_MMAPPED 220
+#define PUMPIO_USBMON_PCAP_SNAPLEN \
+  (PUMPIO_USBMON_HDR_SIZE + PUMPIO_USBMON_CAPTURE_MAX)
+
+/* Fetch a single event, see Documentation/usb/usbmon.rst */
+#define PUMPIO_USBMON_IOC_MAGIC 0x92
+#define PUMPIO_USBMON_IOCX_GET \
+  _IOW(PUMPIO_USBMON_IOC_MAGIC, 6, struct pumpio_usbmon_get_arg)
+
+struct pumpio_usbmon_get_arg {
+  void *hdr;
+  void *data;
+  size_t alloc;
+};
+
+struct __attribute__((__packed__)) pumpio_usbmon_pcap_header {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct __attribute__((__packed__)) pumpio_usbmon_pcap_record {
+  uint32_t ts_sec;
+  uint32_t ts_frac;
+  uint32_t incl_len;
+  uint32_t orig_len;
+};
+
+/**
+ * Common part of both header formats, host byte order
+ */
+struct __attribute__((__packed__)) pumpio_usbmon_hdr {
+  uint64_t id;
+  uint8_t type;
+  uint8_t xfer_type;
+  uint8_t epnum;
+  uint8_t devnum;
+  uint16_t busnum;
+  /* 0 if the setup paket is present */
+  char flag_setup;
+  /* 0 if data is present */
+  char flag_data;
+  int64_t ts_sec;
+  int32_t ts_usec;
+  int32_t status;
+  uint32_t length;
+  uint32_t len_cap;
+  uint8_t setup[8];
+};
+
+struct pumpio_usbmon_ctx {
+  /* Live capture from a usbmon device, -1 for capture files */
+  int fd;
+  FILE *file;
+  FILE *record;
+  uint32_t hdr_size;
+  uint8_t buffer[PUMPIO_USBMON_PCAP_SNAPLEN];
+};
+
+_Static_assert(
+    sizeof(struct pumpio_usbmon_pcap_header) == 24,
+    "Unexpected pcap header size");
+_Static_assert(
+    sizeof(struct pumpio_usbmon_pcap_record) == 16,
+    "Unexpected pcap record size");
+_Static_assert(
+    sizeof(struct pumpio_usbmon_hdr) == PUMPIO_USBMON_HDR_SIZE,
+    "Unexpected usbmon header size");
+
+static result_t pumpio_usbmon_pcap_read_header(struct pumpio_usbmon_ctx *ctx)
+{
+  struct pumpio_usbmon_pcap_header header;
+
+  if (fread(&header, sizeof(header), 1, ctx->file) != 1) {
+    return ferror(ctx->file) ? errno : EIO;
+  }
+
+  // The usbmon headers are in host byte order, i.e. only captures taken on a
+  // machine with the same byte order are readable
+  if (header.magic != PUMPIO_USBMON_PCAP_MAGIC_US &&
+      header.magic != PUMPIO_USBMON_PCAP_MAGIC_NS) {
+    return ENOTSUP;
+  }
+
+  if (header.linktype == PUMPIO_USBMON_PCAP_LINKTYPE) {
+    ctx->hdr_size = PUMPIO_USBMON_HDR_SIZE;
+  } else if (header.linktype == PUMPIO_USBMON_PCAP_LINKTYPE_MMAPPED) {
+    ctx->hdr_size = PUMPIO_USBMON_HDR_MMAPPED_SIZE;
+  } else {
+    return ENOTSUP;
+  }
+
+  return RESULT_SUCCESS;
+}
+
+static result_t pumpio_usbmon_pcap_write_header(FILE *file)
+{
+  struct pumpio_usbmon_pcap_header header;
+
+  header.magic = PUMPIO_USBMON_PCAP_MAGIC_US;
+  header.version_major = PUMPIO_USBMON_PCAP_VERSION_MAJOR;
+  header.version_minor = PUMPIO_USBMON_PCAP_VERSION_MINOR;
+  header.thiszone = 0;
+  header.sigfigs = 0;
+  header.snaplen = PUMPIO_USBMON_PCAP_SNAPLEN;
+  header.linktype = PUMPIO_USBMON_PCAP_LINKTYPE;
+
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    return errno;
+  }
+
+  return RESULT_SUCCESS;
+}
+
+/**
+ * Read the next record of a capture file into the buffer.
+ */
+static result_t
+pumpio_usbmon_pcap_read_record(struct pumpio_usbmon_ctx *ctx, uint32_t *len)
+{
+  struct pumpio_usbmon_pcap_record record;
+  size_t read;
+  uint32_t skip;
+
+  read = fread(&record, 1, sizeof(record), ctx->file);
+
+  if (read != sizeof(record)) {
+    if (ferror(ctx->file)) {
+      return errno;
+    }
+
+    // Clean end of file only if not within a record
+    return read == 0 ? ENODATA : EIO;
+  }
+
+  if (record.incl_len < ctx->hdr_size) {
+    return EIO;
+  }
+
+  // Data exceeding the buffer is not of interest, skip it
+  *len = record.incl_len;
+  skip = 0;
+
+  if (*len > sizeof(ctx->buffer)) {
+    skip = *len - sizeof(ctx->buffer);
+    *len = sizeof(ctx->buffer);
+  }
+
+  if (fread(ctx->buffer, *len, 1, ctx->file) != 1) {
+    return ferror(ctx->file) ? errno : EIO;
+  }
+
+  if (skip > 0 && fseek(ctx->file, skip, SEEK_CUR) != 0) {
+    return errno;
+  }
+
+  return RESULT_SUCCESS;
+}
+
+static result_t
+pumpio_usbmon_live_read_record(struct pumpio_usbmon_ctx *ctx, uint32_t *len)
+{
+  struct pumpio_usbmon_get_arg arg;
+  struct pumpio_usbmon_hdr *hdr;
+
+  arg.hdr = ctx->buffer;
+  arg.data = ctx->buffer + PUMPIO_USBMON_HDR_SIZE;
+  arg.alloc = PUMPIO_USBMON_CAPTURE_MAX;
+
+  if (ioctl(ctx->fd, PUMPIO_USBMON_IOCX_GET, &arg) < 0) {
+    return errno;
+  }
+
+  hdr = (struct pumpio_usbmon_hdr *) ctx->buffer;
+  *len = PUMPIO_USBMON_HDR_SIZE +
+      (hdr->len_cap < PUMPIO_USBMON_CAPTURE_MAX ? hdr->len_cap :
+                                                  PUMPIO_USBMON_CAPTURE_MAX);
+
+  return RESULT_SUCCESS;
+}
+
+static result_t
+pumpio_usbmon_record(struct pumpio_usbmon_ctx *ctx, uint32_t len)
+{
+  struct pumpio_usbmon_pcap_record record;
+  struct pumpio_usbmon_hdr *hdr;
+
+  hdr = (struct pumpio_usbmon_hdr *) ctx->buffer;
+
+  record.ts_sec = (uint32_t) hdr->ts_sec;
+  record.ts_frac = (uint32_t) hdr->ts_usec;
+  record.incl_len = len;
+  record.orig_len = PUMPIO_USBMON_HDR_SIZE + hdr->len_cap;
+
+  if (fwrite(&record, sizeof(record), 1, ctx->record) != 1 ||
+      fwrite(ctx->buffer, len, 1, ctx->record) != 1) {
+    return errno;
+  }
+
+  return RESULT_SUCCESS;
+}
+
+static void pumpio_usbmon_decode(
+    const struct pumpio_usbmon_ctx *ctx,
+    uint32_t len,
+    struct pumpio_usbmon_event *event)
+{
+  struct pumpio_usbmon_hdr hdr;
+  uint32_t offset;
+  uint32_t ndesc;
+  uint32_t available;
+
+  memcpy(&hdr, ctx->buffer, sizeof(hdr));
+
+  event->id = hdr.id;
+  event->time_ns =
+      (uint64_t) hdr.ts_sec * 1000000000 + (uint64_t) hdr.ts_usec * 1000;
+  event->type = (char) hdr.type;
+  event->xfer_type = hdr.xfer_type;
+  event->epnum = hdr.epnum;
+  event->devnum = hdr.devnum;
+  event->busnum = hdr.busnum;
+  event->setup_valid = hdr.flag_setup == 0;
+  memcpy(event->setup, hdr.setup, sizeof(event->setup));
+  event->status = hdr.status;
+  event->length = hdr.length;
+
+  offset = ctx->hdr_size;
+
+  // Isochronous descriptors precede the data in the mmapped format
+  if (ctx->hdr_size == PUMPIO_USBMON_HDR_MMAPPED_SIZE) {
+    memcpy(
+        &ndesc, ctx->buffer + PUMPIO_USBMON_HDR_NDESC_OFFSET, sizeof(ndesc));
+
+    // Malformed captures might claim more descriptors than captured, don't
+    // let the offset wrap around or run past the record
+    if (ndesc > (len - offset) / PUMPIO_USBMON_ISO_DESC_SIZE) {
+      offset = len;
+    } else {
+      offset += ndesc * PUMPIO_USBMON_ISO_DESC_SIZE;
+    }
+  }
+
+  available = 0;
+
+  if (hdr.flag_data == 0 && len > offset) {
+    available = len - offset;
+
+    // Capture files might be padded
+    if (available > hdr.len_cap) {
+      available = hdr.len_cap;
+    }
+  }
+
+  event->data_len =
+      available < PUMPIO_USBMON_DATA_MAX ? available : PUMPIO_USBMON_DATA_MAX;
+  memcpy(event->data, ctx->buffer + offset, event->data_len);
+}
+
+result_t
+pumpio_usbmon_open(void **handle, const char *path, const char *record_path)
+{
+  struct pumpio_usbmon_ctx *ctx;
+  struct stat st;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(path != NULL);
+
+  if (stat(path, &st) != 0) {
+    return errno;
+  }
+
+  ctx = (struct pumpio_usbmon_ctx *) calloc(
+      1, sizeof(struct pumpio_usbmon_ctx));
+
+  if (ctx == NULL) {
+    return ENOMEM;
+  }
+
+  ctx->fd = -1;
+  result = RESULT_SUCCESS;
+
+  if (S_ISCHR(st.st_mode)) {
+    ctx->fd = open(path, O_RDONLY);
+    ctx->hdr_size = PUMPIO_USBMON_HDR_SIZE;
+
+    if (ctx->fd < 0) {
+      result = errno;
+    } else if (record_path != NULL) {
+      ctx->record = fopen(record_path, "wb");
+
+      if (ctx->record == NULL) {
+        result = errno;
+      } else {
+        result = pumpio_usbmon_pcap_write_header(ctx->record);
+      }
+    }
+  } else {
+    ctx->file = fopen(path, "rb");
+
+    if (ctx->file == NULL) {
+      result = errno;
+    } else {
+      result = pumpio_usbmon_pcap_read_header(ctx);
+    }
+  }
+
+  if (RESULT_IS_ERROR(result)) {
+    pumpio_usbmon_close(ctx);
+    return result;
+  }
+
+  *handle = ctx;
+
+  return RESULT_SUCCESS;
+}
+
+result_t pumpio_usbmon_read(void *handle, struct pumpio_usbmon_event *event)
+{
+  struct pumpio_usbmon_ctx *ctx;
+  uint32_t len;
+  result_t result;
+
+  assert(handle != NULL);
+  assert(event != NULL);
+
+  ctx = (struct pumpio_usbmon_ctx *) handle;
+  len = 0;
+
+  if (ctx->fd >= 0) {
+    result = pumpio_usbmon_live_read_record(ctx, &len);
+
+    if (RESULT_IS_SUCCESS(result) && ctx->record != NULL) {
+      result = pumpio_usbmon_record(ctx, len);
+    }
+  } else {
+    result = pumpio_usbmon_pcap_read_record(ctx, &len);
+  }
+
+  if (RESULT_IS_ERROR(result)) {
+    return result;
+  }
+
+  pumpio_usbmon_decode(ctx, len, event);
+
+  return RESULT_SUCCESS;
+}
+
+bool pumpio_usbmon_is_live(void *handle)
+{
+  assert(handle != NULL);
+
+  return ((struct pumpio_usbmon_ctx *) handle)->fd >= 0;
+}
+
+void pumpio_usbmon_close(void *handle)
+{
+  struct pumpio_usbmon_ctx *ctx;
+
+  assert(handle != NULL);
+
+  ctx = (struct pumpio_usbmon_ctx *) handle;
+
+  if (ctx->fd >= 0) {
+    close(ctx->fd);
+  }
+
+  if (ctx->file != NULL) {
+    fclose(ctx->file);
+  }
+
+  if (ctx->record != NULL) {
+    fclose(ctx->record);
+  }
+
+  free(ctx);
+}
@@ -0,0 +1,118 @@
+/**
+ * Reader for USB traffic captured by the Linux usbmon facility.
+ *
+ * Events are read either live from the binary usbmon interface, e.g.
+ * /dev/usbmon1 for bus 1 or /dev/usbmon0 for all buses (requires the usbmon
+ * kernel module and root privileges), or from a capture file in pcap format as
+ * written by tcpdump or Wireshark (link types LINUX_USB and
+ * LINUX_USB_MMAPPED). A live capture can be recorded to a pcap file at the same
+ * time, which can be read back offline, e.g. to evaluate it with different
+ * options or to inspect it with Wireshark.
+ *
+ * The timestamps of usbmon are taken by the host controller driver on
+ * submission and completion of an URB and have microsecond resolution only.
+ */
+#ifndef PUMPIO_USBMON_H
+#define PUMPIO_USBMON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "result.h"
+
+/**
+ * Max. number of data bytes of an event kept, the remainder is truncated
+ */
+#define PUMPIO_USBMON_DATA_MAX 64
+
+/**
+ * Event types
+ */
+#define PUMPIO_USBMON_TYPE_SUBMIT 'S'
+#define PUMPIO_USBMON_TYPE_COMPLETE 'C'
+#define PUMPIO_USBMON_TYPE_ERROR 'E'
+
+/**
+ * Transfer types
+ */
+#define PUMPIO_USBMON_XFER_ISO 0
+#define PUMPIO_USBMON_XFER_INTERRUPT 1
+#define PUMPIO_USBMON_XFER_CONTROL 2
+#define PUMPIO_USBMON_XFER_BULK 3
+
+/**
+ * Direction bit of the endpoint number, set for IN endpoints
+ */
+#define PUMPIO_USBMON_EP_DIR_IN 0x80
+
+/**
+ * A single submission, completion or submission error event of an URB
+ */
+struct pumpio_usbmon_event {
+  /* URB tag, identical for the submission and completion of an URB */
+  uint64_t id;
+  /* Submission or completion timestamp in ns */
+  uint64_t time_ns;
+  char type;
+  uint8_t xfer_type;
+  uint8_t epnum;
+  uint8_t devnum;
+  uint16_t busnum;
+  /* Setup paket of a control transfer submission, if setup_valid is set */
+  bool setup_valid;
+  uint8_t setup[8];
+  /* URB status, -EINPROGRESS for submissions */
+  int32_t status;
+  /* Requested length on submission, actual length on completion */
+  uint32_t length;
+  /* Number of data bytes captured and available in data */
+  uint32_t data_len;
+  uint8_t data[PUMPIO_USBMON_DATA_MAX];
+};
+
+/**
+ * Open a usbmon capture.
+ *
+ * @param handle Pointer to a variable to return the handle of the opened
+ *               capture to
+ * @param path Path to a binary usbmon device, e.g. /dev/usbmon0, or a pcap
+ *             capture file
+ * @param record_path Optional path of a pcap file to record all events read
+ *                    from a live capture to, NULL if not used. Ignored for
+ *                    capture files
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENOMEM, ENOTSUP if the capture file format
+ *         or its link type is not supported, EIO if the capture file is
+ *         truncated, any error of opening or reading the files
+ */
+result_t pumpio_usbmon_open(
+    void **handle, const char *path, const char *record_path);
+
+/**
+ * Read the next event. Blocks on a live capture until an event is available.
+ *
+ * @param handle Handle of an opened capture
+ * @param event Pointer to an event to fill
+ * @return Success or an error code as defined by result_t. Possible return
+ *         values: RESULT_SUCCESS, ENODATA if the end of a capture file is
+ *         reached, EINTR if interrupted by a signal, EIO if the capture is
+ *         truncated or malformed, any error of reading or recording
+ */
+result_t pumpio_usbmon_read(void *handle, struct pumpio_usbmon_event *event);
+
+/**
+ * Check if a capture is read live from a usbmon device.
+ *
+ * @param handle Handle of an opened capture
+ * @return True if live, false if read from a capture file
+ */
+bool pumpio_usbmon_is_live(void *handle);
+
+/**
+ * Close a capture. Flushes and closes the recording, if any.
+ *
+ * @param handle Handle of an opened capture
+ */
+void pumpio_usbmon_close(void *handle);
+
+#endif